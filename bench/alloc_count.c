@@ -0,0 +1,54 @@
+/**
+ * 坤舆编程语言 - 内存分配计数器
+ * 通过LD_PRELOAD注入被测进程，统计malloc/calloc/realloc的调用次数，
+ * 进程退出时把计数写入环境变量KUNYU_ALLOC_COUNT_FILE指定的文件。
+ * 仅支持Linux + glibc。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// glibc导出的原始分配函数
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+// 分配次数
+static unsigned long long alloc_count = 0;
+
+void *malloc(size_t size) {
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    alloc_count++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+
+/**
+ * 进程退出时输出分配次数
+ */
+__attribute__((destructor))
+static void report_alloc_count(void) {
+    // 先取出计数，避免把下面fopen的分配也算进去
+    unsigned long long count = alloc_count;
+
+    const char *path = getenv("KUNYU_ALLOC_COUNT_FILE");
+    if (path == NULL) {
+        return;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    fprintf(file, "%llu\n", count);
+    fclose(file);
+}
@@ -0,0 +1,194 @@
+/**
+ * 坤舆编程语言 - 嵌入接口调用开销基准测试
+ * 像宿主程序一样只通过libkunyu.h使用解释器：脚本编译一次后反复调用其中的函数，
+ * 报告每次调用的耗时，并与每次都重新分析脚本（命令行解释器的方式）比较
+ */
+
+#include "libkunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define DEFAULT_REPEAT 5
+#define MAX_REPEAT 100
+#define DEFAULT_CALLS 200000L
+#define RECOMPILE_CALLS 2000L        // 每次重新分析的用例慢得多，调用次数少一些
+
+/**
+ * 基准测试使用的脚本
+ */
+static const char *SCRIPT =
+    "函数 加(a, b) {\n"
+    "    返回 a + b;\n"
+    "}\n"
+    "\n"
+    "函数 规则(请求) {\n"
+    "    变量 金额 = 字典获取(请求, \"金额\");\n"
+    "    如果 (金额 > 1000) {\n"
+    "        如果 (字典获取(请求, \"次数\") < 3) {\n"
+    "            返回 \"人工审核\";\n"
+    "        }\n"
+    "    }\n"
+    "    返回 \"通过\";\n"
+    "}\n";
+
+/**
+ * 获取单调时钟的纳秒数
+ */
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * 比较函数：升序
+ */
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * 调用一次并检查结果
+ */
+static bool call_once(KunyuState *state, KunyuScript *script, const char *function,
+                      KunyuValue **args, int arg_count) {
+    KunyuValue *result = kunyu_call(script, function, args, arg_count);
+    if (result == NULL) {
+        fprintf(stderr, "错误: 调用'%s'失败: %s\n", function, kunyu_last_error(state));
+        return false;
+    }
+    kunyu_release(result);
+    return true;
+}
+
+/**
+ * 编译一次，调用calls次
+ * @return 每次调用的纳秒数，失败返回负数
+ */
+static double bench_compiled(const char *function, KunyuValue **args, int arg_count, long calls) {
+    KunyuState *state = kunyu_state_new();
+    KunyuScript *script = state != NULL ? kunyu_compile(state, SCRIPT) : NULL;
+    if (script == NULL) {
+        fprintf(stderr, "错误: 编译脚本失败: %s\n", state != NULL ? kunyu_last_error(state) : "无法创建状态");
+        kunyu_state_free(state);
+        return -1;
+    }
+
+    double start = now_ns();
+    for (long i = 0; i < calls; i++) {
+        if (!call_once(state, script, function, args, arg_count)) {
+            kunyu_state_free(state);
+            return -1;
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    kunyu_state_free(state);
+    return elapsed / calls;
+}
+
+/**
+ * 每次调用前都创建状态并重新编译脚本
+ * @return 每次调用的纳秒数，失败返回负数
+ */
+static double bench_recompile(const char *function, KunyuValue **args, int arg_count, long calls) {
+    double start = now_ns();
+    for (long i = 0; i < calls; i++) {
+        KunyuState *state = kunyu_state_new();
+        KunyuScript *script = state != NULL ? kunyu_compile(state, SCRIPT) : NULL;
+        bool ok = script != NULL && call_once(state, script, function, args, arg_count);
+        kunyu_state_free(state);
+        if (!ok) {
+            return -1;
+        }
+    }
+    return (now_ns() - start) / calls;
+}
+
+/**
+ * 显示帮助信息
+ */
+static void show_help(const char *program_name) {
+    printf("用法: %s [选项]\n\n", program_name);
+    printf("选项:\n");
+    printf("  -n 次数    每个用例的重复次数 (默认 %d)\n", DEFAULT_REPEAT);
+    printf("  -c 次数    每次重复中调用函数的次数 (默认 %ld)\n", DEFAULT_CALLS);
+    printf("  -h         显示帮助信息\n");
+}
+
+int main(int argc, char *argv[]) {
+    int repeat = DEFAULT_REPEAT;
+    long calls = DEFAULT_CALLS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            calls = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0) {
+            show_help(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "错误: 未知选项 '%s'\n", argv[i]);
+            show_help(argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1 || repeat > MAX_REPEAT || calls < 1) {
+        fprintf(stderr, "错误: 重复次数必须在1到%d之间，调用次数必须大于0\n", MAX_REPEAT);
+        return 1;
+    }
+
+    // 参数在状态之外创建，所有用例共用
+    KunyuValue *numbers[2] = { kunyu_integer_new(20), kunyu_integer_new(22) };
+    KunyuValue *request = kunyu_dict_new();
+    KunyuValue *amount = kunyu_integer_new(1500);
+    KunyuValue *count = kunyu_integer_new(1);
+    kunyu_dict_put(request, "金额", amount);
+    kunyu_dict_put(request, "次数", count);
+    kunyu_release(amount);
+    kunyu_release(count);
+
+    struct {
+        const char *name;
+        const char *function;
+        KunyuValue **args;
+        int arg_count;
+        bool recompile;
+    } cases[] = {
+        {"加法",             "加",   numbers,  2, false},
+        {"规则",             "规则", &request, 1, false},
+        {"规则（每次编译）", "规则", &request, 1, true},
+    };
+
+    int status = 0;
+    printf("%-24s %14s %14s\n", "用例", "中位数(纳秒)", "最快(纳秒)");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        double samples[MAX_REPEAT];
+        bool ok = true;
+        for (int r = 0; r < repeat && ok; r++) {
+            samples[r] = cases[c].recompile
+                ? bench_recompile(cases[c].function, cases[c].args, cases[c].arg_count,
+                                  calls < RECOMPILE_CALLS ? calls : RECOMPILE_CALLS)
+                : bench_compiled(cases[c].function, cases[c].args, cases[c].arg_count, calls);
+            ok = samples[r] >= 0;
+        }
+        if (!ok) {
+            printf("%-24s %14s\n", cases[c].name, "失败");
+            status = 1;
+            continue;
+        }
+        qsort(samples, repeat, sizeof(double), compare_double);
+        printf("%-24s %14.0f %14.0f\n", cases[c].name, samples[repeat / 2], samples[0]);
+    }
+
+    kunyu_release(numbers[0]);
+    kunyu_release(numbers[1]);
+    kunyu_release(request);
+    return status;
+}
@@ -0,0 +1,277 @@
+/**
+ * 坤舆编程语言 - 前端吞吐量基准测试
+ * 单独测量词法分析(lexer_tokenize)和语法分析(parser_parse，再用parser_parse_function_bodies
+ * 分析所有函数体)的速度，报告词法分析的MB/s、语法分析的节点/s以及峰值内存
+ */
+
+#include "kunyu.h"
+#include "ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define DEFAULT_REPEAT 5
+#define MAX_REPEAT 100
+
+/**
+ * 一个输入文件的测量结果
+ */
+typedef struct {
+    const char *path;            // 文件路径
+    size_t bytes;                // 源码字节数
+    int tokens;                  // 标记数
+    size_t nodes;                // AST节点数
+    double lex_ms;               // 词法分析耗时中位数
+    double parse_ms;             // 语法分析耗时中位数
+    long lex_rss_kb;             // 词法分析后的峰值常驻内存
+    long parse_rss_kb;           // 语法分析后的峰值常驻内存
+    bool ok;                     // 是否成功
+} FrontendResult;
+
+/**
+ * 获取单调时钟的毫秒数
+ */
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * 获取进程的峰值常驻内存（KB）
+ */
+static long peak_rss_kb() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * 读取整个文件
+ */
+static char* read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "错误: 无法打开文件 '%s'\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buffer = (char *)malloc(length + 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    *size = fread(buffer, 1, length, file);
+    buffer[*size] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+/**
+ * 比较函数：升序
+ */
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 求中位数（会对数组排序）
+ */
+static double median(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_double);
+    if (count % 2 == 1) {
+        return values[count / 2];
+    }
+    return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * 测量一个文件
+ */
+static bool run_file(const char *path, int repeat, int threads, FrontendResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->path = path;
+
+    char *source = read_file(path, &result->bytes);
+    if (source == NULL) {
+        return false;
+    }
+
+    double lex_times[MAX_REPEAT];
+    double parse_times[MAX_REPEAT];
+
+    for (int r = 0; r < repeat; r++) {
+        double start = now_ms();
+        if (lexer_init(source) == NULL) {
+            free(source);
+            return false;
+        }
+        int count = lexer_tokenize();
+        lex_times[r] = now_ms() - start;
+        if (count < 0) {
+            KunyuError *error = lexer_get_error();
+            fprintf(stderr, "%s: 词法分析错误: %s (行 %d, 列 %d)\n",
+                    path, error->message, error->line, error->column);
+            lexer_free();
+            free(source);
+            return false;
+        }
+        result->tokens = count;
+        result->lex_rss_kb = peak_rss_kb();
+
+        start = now_ms();
+        AstNode *ast = parser_parse(lexer_get_tokens(), count);
+        if (ast != NULL && !parser_parse_function_bodies(ast, threads)) {
+            ast_free(ast);
+            ast = NULL;
+        }
+        parse_times[r] = now_ms() - start;
+        if (ast == NULL) {
+            KunyuError *error = parser_get_error();
+            fprintf(stderr, "%s: 语法分析错误: %s (行 %d, 列 %d)\n",
+                    path, error->message, error->line, error->column);
+            lexer_free();
+            free(source);
+            return false;
+        }
+        result->parse_rss_kb = peak_rss_kb();
+        result->nodes = ast_count_nodes(ast);
+
+        ast_free(ast);
+        lexer_free();
+    }
+
+    result->lex_ms = median(lex_times, repeat);
+    result->parse_ms = median(parse_times, repeat);
+    result->ok = true;
+
+    free(source);
+    return true;
+}
+
+/**
+ * 输出JSON格式的结果
+ */
+static void write_json(FILE *out, const FrontendResult *results, int count) {
+    fprintf(out, "{\n  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const FrontendResult *r = &results[i];
+        fprintf(out, "    {\"file\": \"%s\", \"status\": \"%s\", \"bytes\": %zu, \"tokens\": %d, "
+                "\"nodes\": %zu, \"lex_ms\": %.3f, \"parse_ms\": %.3f, "
+                "\"lex_mb_per_s\": %.2f, \"parse_nodes_per_s\": %.0f, "
+                "\"lex_peak_rss_kb\": %ld, \"parse_peak_rss_kb\": %ld}%s\n",
+                r->path, r->ok ? "ok" : "failed", r->bytes, r->tokens, r->nodes,
+                r->lex_ms, r->parse_ms,
+                r->lex_ms > 0 ? r->bytes / (1024.0 * 1024.0) / (r->lex_ms / 1000.0) : 0,
+                r->parse_ms > 0 ? r->nodes / (r->parse_ms / 1000.0) : 0,
+                r->lex_rss_kb, r->parse_rss_kb,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+/**
+ * 显示帮助信息
+ */
+static void show_help(const char *program_name) {
+    printf("用法: %s [选项] 源文件...\n\n", program_name);
+    printf("选项:\n");
+    printf("  -n 次数    每个文件的重复次数 (默认 %d)\n", DEFAULT_REPEAT);
+    printf("  -o 文件名  把JSON格式的结果写入文件\n");
+    printf("  -j 线程数  分析函数体的线程数 (默认 0，使用所有处理器)\n");
+    printf("  -h         显示帮助信息\n");
+    printf("\n峰值内存是进程级的，文件按参数顺序测量，建议从小到大排列\n");
+}
+
+/**
+ * 主程序入口
+ */
+int main(int argc, char *argv[]) {
+    int repeat = DEFAULT_REPEAT;
+    const char *output_file = NULL;
+    int threads = 0;
+    const char *files[argc];
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0) {
+            show_help(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "错误: 未知选项 '%s'\n", argv[i]);
+            show_help(argv[0]);
+            return 1;
+        } else {
+            files[file_count++] = argv[i];
+        }
+    }
+
+    if (file_count == 0 || repeat < 1 || repeat > MAX_REPEAT || threads < 0) {
+        show_help(argv[0]);
+        return 1;
+    }
+
+    FrontendResult *results = (FrontendResult *)calloc(file_count, sizeof(FrontendResult));
+    if (results == NULL) {
+        return 1;
+    }
+
+    bool all_ok = true;
+    printf("%-40s %10s %10s %10s %10s %12s %10s\n",
+           "file", "MB", "lex ms", "lex MB/s", "parse ms", "nodes/s", "rss KB");
+    for (int i = 0; i < file_count; i++) {
+        FrontendResult *r = &results[i];
+        if (!run_file(files[i], repeat, threads, r)) {
+            r->path = files[i];
+            all_ok = false;
+            printf("%-40s %10s\n", files[i], "失败");
+            continue;
+        }
+
+        double mb = r->bytes / (1024.0 * 1024.0);
+        printf("%-40s %10.2f %10.2f %10.2f %10.2f %12.0f %10ld\n",
+               r->path, mb, r->lex_ms,
+               r->lex_ms > 0 ? mb / (r->lex_ms / 1000.0) : 0,
+               r->parse_ms,
+               r->parse_ms > 0 ? r->nodes / (r->parse_ms / 1000.0) : 0,
+               r->parse_rss_kb);
+        fflush(stdout);
+    }
+
+    if (output_file != NULL) {
+        FILE *out = fopen(output_file, "w");
+        if (out == NULL) {
+            fprintf(stderr, "错误: 无法写入文件 '%s'\n", output_file);
+            free(results);
+            return 1;
+        }
+        write_json(out, results, file_count);
+        fclose(out);
+    }
+
+    free(results);
+    return all_ok ? 0 : 1;
+}
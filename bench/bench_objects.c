@@ -0,0 +1,495 @@
+/**
+ * 坤舆编程语言 - 对象系统微基准测试
+ * 直接调用对象系统的接口，测量列表、字典、字符串和引用计数操作
+ * 在不同规模下的每次操作耗时，并在可用时通过perf_event_open统计缓存未命中次数
+ */
+
+#include "kunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define MIN_OPS_PER_RUN 2000000L     // 小规模用例重复到至少这么多次操作
+#define DEFAULT_MAX_SIZE 10000000L
+#define DEFAULT_DICT_MAX_SIZE 20000L // 字典查找是线性扫描，规模过大时耗时呈平方增长
+
+/**
+ * 基准测试选项
+ */
+typedef struct {
+    long max_size;               // 最大规模
+    long dict_max_size;          // 字典用例的最大规模
+    const char *only;            // 只运行名称包含该字符串的用例，NULL表示全部
+} BenchOptions;
+
+/**
+ * 一次测量的结果
+ */
+typedef struct {
+    long ops;                    // 操作次数
+    double ns;                   // 总耗时（纳秒）
+    long long cache_misses;      // 缓存未命中次数，-1表示不可用
+} Measurement;
+
+/**
+ * 用例函数：对规模为size的数据执行操作，返回操作次数
+ * 准备工作在用例内部完成，只有start_measure和stop_measure之间的部分计入结果
+ */
+typedef long (*BenchFunc)(long size);
+
+/**
+ * 用例
+ */
+typedef struct {
+    const char *name;            // 用例名
+    BenchFunc func;              // 用例函数
+    bool quadratic;              // 耗时是否随规模平方增长
+} BenchCase;
+
+// 缓存未命中计数器的文件描述符，-1表示不可用
+static int cache_fd = -1;
+
+// 当前测量
+static Measurement current;
+static struct timespec measure_start;
+
+// 防止编译器优化掉读取结果
+static volatile double sink;
+
+/**
+ * 打开缓存未命中计数器
+ */
+static void open_cache_counter() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cache_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+/**
+ * 开始测量
+ */
+static void start_measure() {
+#ifdef __linux__
+    if (cache_fd >= 0) {
+        ioctl(cache_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(cache_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &measure_start);
+}
+
+/**
+ * 结束测量，累加到当前结果
+ */
+static void stop_measure() {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    current.ns += (end.tv_sec - measure_start.tv_sec) * 1e9 + (end.tv_nsec - measure_start.tv_nsec);
+
+#ifdef __linux__
+    if (cache_fd >= 0) {
+        long long count = 0;
+        ioctl(cache_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(cache_fd, &count, sizeof(count)) == sizeof(count)) {
+            current.cache_misses += count;
+        }
+    }
+#endif
+}
+
+/**
+ * 预先创建一组字符串键
+ */
+static PyObject** make_keys(long size) {
+    PyObject **keys = (PyObject **)malloc(sizeof(PyObject *) * size);
+    if (keys == NULL) {
+        return NULL;
+    }
+    char buffer[32];
+    for (long i = 0; i < size; i++) {
+        snprintf(buffer, sizeof(buffer), "键%ld", i);
+        keys[i] = py_string_new(buffer);
+    }
+    return keys;
+}
+
+/**
+ * 释放预先创建的键
+ */
+static void free_keys(PyObject **keys, long size) {
+    for (long i = 0; i < size; i++) {
+        py_decref(keys[i]);
+    }
+    free(keys);
+}
+
+/**
+ * 用例：向空列表追加size项
+ */
+static long bench_list_append(long size) {
+    PyObject *item = py_number_new(1);
+    PyObject *list = py_list_new();
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        py_list_append(list, item);
+    }
+    stop_measure();
+
+    py_decref(list);
+    py_decref(item);
+    return size;
+}
+
+/**
+ * 准备一个有size项的列表
+ */
+static PyObject* make_list(long size) {
+    PyObject *list = py_list_new();
+    for (long i = 0; i < size; i++) {
+        PyObject *item = py_number_new((double)i);
+        py_list_append(list, item);
+        py_decref(item);
+    }
+    return list;
+}
+
+/**
+ * 用例：顺序读取列表
+ */
+static long bench_list_get_sequential(long size) {
+    PyObject *list = make_list(size);
+    double sum = 0;
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        PyObject *item = py_list_get(list, (size_t)i);
+        sum += ((PyNumberObject *)item)->value;
+        py_decref(item);
+    }
+    stop_measure();
+
+    sink = sum;
+    py_decref(list);
+    return size;
+}
+
+/**
+ * 用例：随机读取列表，访问顺序预先打乱，测量缓存不友好时的表现
+ */
+static long bench_list_get_random(long size) {
+    PyObject *list = make_list(size);
+    size_t *order = (size_t *)malloc(sizeof(size_t) * size);
+    if (order == NULL) {
+        py_decref(list);
+        return 0;
+    }
+    unsigned long long state = 88172645463325252ULL;
+    for (long i = 0; i < size; i++) {
+        order[i] = (size_t)i;
+    }
+    for (long i = size - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        long j = (long)(state % (unsigned long long)(i + 1));
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    double sum = 0;
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        PyObject *item = py_list_get(list, order[i]);
+        sum += ((PyNumberObject *)item)->value;
+        py_decref(item);
+    }
+    stop_measure();
+
+    sink = sum;
+    free(order);
+    py_decref(list);
+    return size;
+}
+
+/**
+ * 用例：向空字典插入size个不同的字符串键
+ */
+static long bench_dict_set(long size) {
+    PyObject **keys = make_keys(size);
+    if (keys == NULL) {
+        return 0;
+    }
+    PyObject *value = py_number_new(1);
+    PyObject *dict = py_dict_new();
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        py_dict_set(dict, keys[i], value);
+    }
+    stop_measure();
+
+    py_decref(dict);
+    py_decref(value);
+    free_keys(keys, size);
+    return size;
+}
+
+/**
+ * 用例：从有size个键的字典中读取每个键
+ */
+static long bench_dict_get(long size) {
+    PyObject **keys = make_keys(size);
+    if (keys == NULL) {
+        return 0;
+    }
+    PyObject *dict = py_dict_new();
+    for (long i = 0; i < size; i++) {
+        PyObject *value = py_number_new((double)i);
+        py_dict_set(dict, keys[i], value);
+        py_decref(value);
+    }
+    double sum = 0;
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        PyObject *value = py_dict_get(dict, keys[i]);
+        sum += ((PyNumberObject *)value)->value;
+        py_decref(value);
+    }
+    stop_measure();
+
+    sink = sum;
+    py_decref(dict);
+    free_keys(keys, size);
+    return size;
+}
+
+/**
+ * 用例：创建size条字段相同的记录（8个字符串键的字典），逐个字段写入再读取
+ */
+static long bench_dict_record(long size) {
+    static const char *fields[] = { "编号", "姓名", "年龄", "城市", "分数", "等级", "邮箱", "备注" };
+    const int field_count = 8;
+    PyObject *keys[8];
+    for (int f = 0; f < field_count; f++) {
+        keys[f] = py_string_new(fields[f]);
+    }
+    PyObject *value = py_number_new(1);
+    PyObject **records = (PyObject **)malloc(sizeof(PyObject *) * size);
+    if (records == NULL) {
+        return 0;
+    }
+    double sum = 0;
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        records[i] = py_dict_new();
+        for (int f = 0; f < field_count; f++) {
+            py_dict_set(records[i], keys[f], value);
+        }
+    }
+    for (long i = 0; i < size; i++) {
+        for (int f = 0; f < field_count; f++) {
+            PyObject *field = py_dict_get(records[i], keys[f]);
+            sum += ((PyNumberObject *)field)->value;
+            py_decref(field);
+        }
+    }
+    for (long i = 0; i < size; i++) {
+        py_decref(records[i]);
+    }
+    stop_measure();
+
+    sink = sum;
+    free(records);
+    py_decref(value);
+    for (int f = 0; f < field_count; f++) {
+        py_decref(keys[f]);
+    }
+    return size;
+}
+
+/**
+ * 用例：创建并释放size个短字符串
+ */
+static long bench_string_new(long size) {
+    static const char *samples[] = { "坤舆", "hello", "字符串对象基准测试", "x" };
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        PyObject *str = py_string_new(samples[i & 3]);
+        py_decref(str);
+    }
+    stop_measure();
+
+    return size;
+}
+
+/**
+ * 用例：创建并释放size个数字对象
+ */
+static long bench_number_new(long size) {
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        PyObject *num = py_number_new((double)i);
+        py_decref(num);
+    }
+    stop_measure();
+
+    return size;
+}
+
+/**
+ * 用例：对size个对象各做一次增加和减少引用计数
+ */
+static long bench_refcount(long size) {
+    PyObject *list = make_list(size);
+    PyObject **items = ((PyListObject *)list)->items;
+
+    start_measure();
+    for (long i = 0; i < size; i++) {
+        py_incref(items[i]);
+        py_decref(items[i]);
+    }
+    stop_measure();
+
+    py_decref(list);
+    return size * 2;
+}
+
+// 用例表
+static const BenchCase cases[] = {
+    { "list_append",         bench_list_append,         false },
+    { "list_get_sequential", bench_list_get_sequential, false },
+    { "list_get_random",     bench_list_get_random,     false },
+    { "dict_set",            bench_dict_set,            true  },
+    { "dict_get",            bench_dict_get,            true  },
+    { "dict_record",         bench_dict_record,         false },
+    { "string_new",          bench_string_new,          false },
+    { "number_new",          bench_number_new,          false },
+    { "refcount",            bench_refcount,            false },
+};
+
+/**
+ * 显示帮助信息
+ */
+static void show_help(const char *program_name) {
+    printf("用法: %s [选项]\n\n", program_name);
+    printf("选项:\n");
+    printf("  -m 规模      最大规模(默认 %ld)\n", DEFAULT_MAX_SIZE);
+    printf("  -d 规模      字典用例的最大规模(默认 %ld)\n", DEFAULT_DICT_MAX_SIZE);
+    printf("  -k 名称      只运行名称包含该字符串的用例\n");
+    printf("  -h           显示帮助信息\n");
+}
+
+/**
+ * 解析命令行参数
+ */
+static bool parse_args(int argc, char *argv[], BenchOptions *options) {
+    options->max_size = DEFAULT_MAX_SIZE;
+    options->dict_max_size = DEFAULT_DICT_MAX_SIZE;
+    options->only = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            options->max_size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            options->dict_max_size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            options->only = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    return options->max_size > 0 && options->dict_max_size > 0;
+}
+
+/**
+ * 运行一个用例的一个规模，小规模时重复运行以获得稳定的结果
+ */
+static Measurement run_case(const BenchCase *bench, long size) {
+    memset(&current, 0, sizeof(current));
+    // 平方增长的用例按比较次数估算工作量
+    long work = bench->quadratic ? size * size : size;
+    long runs = work >= MIN_OPS_PER_RUN ? 1 : (MIN_OPS_PER_RUN + work - 1) / work;
+    for (long r = 0; r < runs; r++) {
+        current.ops += bench->func(size);
+    }
+    if (cache_fd < 0) {
+        current.cache_misses = -1;
+    }
+    return current;
+}
+
+/**
+ * 主程序入口
+ */
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    if (!parse_args(argc, argv, &options)) {
+        show_help(argv[0]);
+        return 1;
+    }
+
+    open_cache_counter();
+    if (cache_fd < 0) {
+        printf("提示: perf_event_open不可用，不统计缓存未命中\n");
+    }
+
+    printf("%-20s %10s %12s %14s %14s\n", "case", "size", "ns/op", "cache-miss/op", "cache-misses");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const BenchCase *bench = &cases[c];
+        if (options.only != NULL && strstr(bench->name, options.only) == NULL) {
+            continue;
+        }
+
+        long limit = bench->quadratic ? options.dict_max_size : options.max_size;
+        for (long size = 10; size <= options.max_size; size *= 10) {
+            if (size > limit) {
+                printf("%-20s %10ld %12s\n", bench->name, size, "跳过");
+                continue;
+            }
+
+            Measurement m = run_case(bench, size);
+            if (m.ops <= 0) {
+                printf("%-20s %10ld %12s\n", bench->name, size, "失败");
+                continue;
+            }
+
+            if (m.cache_misses >= 0) {
+                printf("%-20s %10ld %12.2f %14.4f %14lld\n", bench->name, size,
+                       m.ns / m.ops, (double)m.cache_misses / m.ops, m.cache_misses);
+            } else {
+                printf("%-20s %10ld %12.2f %14s %14s\n", bench->name, size, m.ns / m.ops, "-", "-");
+            }
+            fflush(stdout);
+        }
+    }
+
+#ifdef __linux__
+    if (cache_fd >= 0) {
+        close(cache_fd);
+    }
+#endif
+    return 0;
+}
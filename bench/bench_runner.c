@@ -0,0 +1,487 @@
+/**
+ * 坤舆编程语言 - 基准测试运行器
+ * 重复运行基准测试脚本，统计耗时中位数、峰值内存和分配次数，
+ * 以JSON格式输出结果，并可以与保存的基线结果进行比较
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_CASES 64
+#define MAX_CASE_ARGS 8
+#define MAX_REPEAT 100
+
+/**
+ * 运行器选项
+ */
+typedef struct {
+    const char *kunyu;           // 解释器路径
+    const char *alloc_lib;       // 分配计数库路径（可选）
+    const char *baseline_file;   // 基线结果文件（可选）
+    const char *output_file;     // 结果输出文件，NULL表示标准输出
+    int repeat;                  // 每个用例的重复次数
+    double threshold;            // 判定为性能回归的阈值（百分比）
+    bool fail_on_regression;     // 出现回归时返回非零状态
+} RunnerOptions;
+
+/**
+ * 基准测试用例
+ */
+typedef struct {
+    char name[512];              // 用例名称（文件名去掉扩展名）
+    char path[512];              // 脚本路径
+    char *args[MAX_CASE_ARGS];   // 传给解释器的额外参数
+    int arg_count;               // 额外参数数量
+    bool ok;                     // 是否全部运行成功
+    int exit_code;               // 失败时的退出码
+    double median_ms;            // 耗时中位数
+    double min_ms;               // 最短耗时
+    double max_ms;               // 最长耗时
+    long peak_rss_kb;            // 峰值常驻内存
+    long long allocations;       // 分配次数，-1表示未统计
+    double baseline_ms;          // 基线耗时中位数，负数表示无基线
+} BenchCase;
+
+/**
+ * 显示帮助信息
+ */
+static void show_help(const char *program_name) {
+    printf("用法: %s [选项] 用例...\n\n", program_name);
+    printf("用例格式: 脚本路径[:解释器参数]，例如 bench/cases/fib.kunyu 或 large.kunyu:-c\n\n");
+    printf("选项:\n");
+    printf("  -k, --kunyu 路径        解释器可执行文件路径 (必需)\n");
+    printf("  -n, --repeat 次数       每个用例的重复次数 (默认 5)\n");
+    printf("  -a, --alloc-lib 路径    分配计数库，通过LD_PRELOAD注入\n");
+    printf("  -b, --baseline 文件名   与基线结果进行比较\n");
+    printf("  -o, --output 文件名     结果输出文件 (默认标准输出)\n");
+    printf("  -t, --threshold 百分比  判定为回归的耗时增幅 (默认 10)\n");
+    printf("      --fail-on-regression 出现回归时返回非零状态\n");
+    printf("  -h, --help              显示帮助信息\n");
+}
+
+/**
+ * 获取单调时钟的毫秒数
+ */
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * 解析用例描述
+ */
+static bool parse_case(const char *spec, BenchCase *bench_case) {
+    memset(bench_case, 0, sizeof(BenchCase));
+    bench_case->allocations = -1;
+    bench_case->baseline_ms = -1;
+
+    // 分离脚本路径和解释器参数
+    const char *colon = strchr(spec, ':');
+    size_t path_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (path_len == 0 || path_len >= sizeof(bench_case->path)) {
+        fprintf(stderr, "错误: 无效的用例 '%s'\n", spec);
+        return false;
+    }
+    memcpy(bench_case->path, spec, path_len);
+    bench_case->path[path_len] = '\0';
+
+    if (colon != NULL) {
+        char *args = strdup(colon + 1);
+        for (char *arg = strtok(args, " "); arg != NULL; arg = strtok(NULL, " ")) {
+            if (bench_case->arg_count >= MAX_CASE_ARGS) {
+                break;
+            }
+            bench_case->args[bench_case->arg_count++] = strdup(arg);
+        }
+        free(args);
+    }
+
+    // 用例名称取文件名并去掉扩展名
+    const char *base = strrchr(bench_case->path, '/');
+    base = base ? base + 1 : bench_case->path;
+    snprintf(bench_case->name, sizeof(bench_case->name), "%s", base);
+    char *dot = strrchr(bench_case->name, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+    }
+
+    return true;
+}
+
+/**
+ * 运行一次用例
+ * @return 成功返回true，并填写耗时、峰值内存和分配次数
+ */
+static bool run_once(const RunnerOptions *options, BenchCase *bench_case,
+                     double *elapsed_ms, long *rss_kb, long long *allocations) {
+    char alloc_path[] = "/tmp/kunyu_alloc_XXXXXX";
+    int alloc_fd = -1;
+    if (options->alloc_lib != NULL) {
+        alloc_fd = mkstemp(alloc_path);
+        if (alloc_fd < 0) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            return false;
+        }
+        close(alloc_fd);
+    }
+
+    char *argv[MAX_CASE_ARGS + 3];
+    int argc = 0;
+    argv[argc++] = (char *)options->kunyu;
+    for (int i = 0; i < bench_case->arg_count; i++) {
+        argv[argc++] = bench_case->args[i];
+    }
+    argv[argc++] = bench_case->path;
+    argv[argc] = NULL;
+
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "错误: 无法创建子进程\n");
+        return false;
+    }
+
+    if (pid == 0) {
+        // 子进程：丢弃脚本输出，注入分配计数库
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+        if (options->alloc_lib != NULL) {
+            setenv("LD_PRELOAD", options->alloc_lib, 1);
+            setenv("KUNYU_ALLOC_COUNT_FILE", alloc_path, 1);
+        }
+        execv(options->kunyu, argv);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        fprintf(stderr, "错误: 等待子进程失败\n");
+        return false;
+    }
+    *elapsed_ms = now_ms() - start;
+    *rss_kb = usage.ru_maxrss;
+
+    // 读取分配次数
+    *allocations = -1;
+    if (options->alloc_lib != NULL) {
+        FILE *file = fopen(alloc_path, "r");
+        if (file != NULL) {
+            if (fscanf(file, "%lld", allocations) != 1) {
+                *allocations = -1;
+            }
+            fclose(file);
+        }
+        unlink(alloc_path);
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        bench_case->exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * 比较函数，用于排序耗时
+ */
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 重复运行用例并汇总结果
+ */
+static void run_case(const RunnerOptions *options, BenchCase *bench_case) {
+    double times[MAX_REPEAT];
+    bench_case->ok = true;
+
+    for (int i = 0; i < options->repeat; i++) {
+        long rss_kb = 0;
+        long long allocations = -1;
+        if (!run_once(options, bench_case, &times[i], &rss_kb, &allocations)) {
+            bench_case->ok = false;
+            return;
+        }
+        if (rss_kb > bench_case->peak_rss_kb) {
+            bench_case->peak_rss_kb = rss_kb;
+        }
+        bench_case->allocations = allocations;
+    }
+
+    qsort(times, options->repeat, sizeof(double), compare_double);
+    int mid = options->repeat / 2;
+    if (options->repeat % 2 == 0) {
+        bench_case->median_ms = (times[mid - 1] + times[mid]) / 2;
+    } else {
+        bench_case->median_ms = times[mid];
+    }
+    bench_case->min_ms = times[0];
+    bench_case->max_ms = times[options->repeat - 1];
+}
+
+/**
+ * 读取整个文件
+ */
+static char* read_file(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buffer = (char *)malloc(size + 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t read_size = fread(buffer, 1, size, file);
+    buffer[read_size] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+/**
+ * 从基线结果中查找用例的耗时中位数
+ * 基线文件即本程序之前输出的JSON，按用例名称查找其后的"median_ms"字段
+ */
+static double find_baseline_ms(const char *baseline, const char *name) {
+    char pattern[600];
+    snprintf(pattern, sizeof(pattern), "\"name\": \"%s\"", name);
+
+    const char *entry = strstr(baseline, pattern);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    // 只在当前用例的对象内查找
+    const char *end = strchr(entry, '}');
+    const char *field = strstr(entry, "\"median_ms\":");
+    if (field == NULL || (end != NULL && field > end)) {
+        return -1;
+    }
+
+    return strtod(field + strlen("\"median_ms\":"), NULL);
+}
+
+/**
+ * 计算相对基线的变化百分比
+ */
+static double change_percent(const BenchCase *bench_case) {
+    if (bench_case->baseline_ms <= 0) {
+        return 0;
+    }
+    return (bench_case->median_ms - bench_case->baseline_ms) / bench_case->baseline_ms * 100.0;
+}
+
+/**
+ * 输出JSON结果
+ */
+static void write_json(FILE *out, const RunnerOptions *options,
+                       BenchCase *cases, int case_count) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repeat\": %d,\n", options->repeat);
+    fprintf(out, "  \"cases\": [\n");
+
+    for (int i = 0; i < case_count; i++) {
+        BenchCase *c = &cases[i];
+        fprintf(out, "    {\"name\": \"%s\", \"file\": \"%s\", \"status\": \"%s\"",
+                c->name, c->path, c->ok ? "ok" : "failed");
+        if (c->ok) {
+            fprintf(out, ", \"median_ms\": %.3f, \"min_ms\": %.3f, \"max_ms\": %.3f",
+                    c->median_ms, c->min_ms, c->max_ms);
+            fprintf(out, ", \"peak_rss_kb\": %ld", c->peak_rss_kb);
+            if (c->allocations >= 0) {
+                fprintf(out, ", \"allocations\": %lld", c->allocations);
+            } else {
+                fprintf(out, ", \"allocations\": null");
+            }
+            if (c->baseline_ms > 0) {
+                fprintf(out, ", \"baseline_median_ms\": %.3f, \"change_pct\": %.2f",
+                        c->baseline_ms, change_percent(c));
+            }
+        } else {
+            fprintf(out, ", \"exit_code\": %d", c->exit_code);
+        }
+        fprintf(out, "}%s\n", i + 1 < case_count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+/**
+ * 在标准错误上打印与基线的对比
+ * @return 出现回归的用例数量
+ */
+static int report_baseline(const RunnerOptions *options, BenchCase *cases, int case_count) {
+    int regressions = 0;
+
+    fprintf(stderr, "%-20s %12s %12s %10s\n", "用例", "基线(ms)", "当前(ms)", "变化");
+    for (int i = 0; i < case_count; i++) {
+        BenchCase *c = &cases[i];
+        if (!c->ok) {
+            fprintf(stderr, "%-20s %12s %12s %10s\n", c->name, "-", "失败", "-");
+            regressions++;
+            continue;
+        }
+        if (c->baseline_ms <= 0) {
+            fprintf(stderr, "%-20s %12s %12.3f %10s\n", c->name, "-", c->median_ms, "新增");
+            continue;
+        }
+
+        double change = change_percent(c);
+        bool regressed = change > options->threshold;
+        if (regressed) {
+            regressions++;
+        }
+        fprintf(stderr, "%-20s %12.3f %12.3f %+9.2f%%%s\n",
+                c->name, c->baseline_ms, c->median_ms, change, regressed ? " 回归" : "");
+    }
+
+    return regressions;
+}
+
+/**
+ * 主程序入口
+ */
+int main(int argc, char *argv[]) {
+    RunnerOptions options;
+    options.kunyu = NULL;
+    options.alloc_lib = NULL;
+    options.baseline_file = NULL;
+    options.output_file = NULL;
+    options.repeat = 5;
+    options.threshold = 10.0;
+    options.fail_on_regression = false;
+
+    BenchCase cases[MAX_CASES];
+    int case_count = 0;
+
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if ((strcmp(arg, "-k") == 0 || strcmp(arg, "--kunyu") == 0) && has_value) {
+            options.kunyu = argv[++i];
+        } else if ((strcmp(arg, "-n") == 0 || strcmp(arg, "--repeat") == 0) && has_value) {
+            options.repeat = atoi(argv[++i]);
+        } else if ((strcmp(arg, "-a") == 0 || strcmp(arg, "--alloc-lib") == 0) && has_value) {
+            options.alloc_lib = argv[++i];
+        } else if ((strcmp(arg, "-b") == 0 || strcmp(arg, "--baseline") == 0) && has_value) {
+            options.baseline_file = argv[++i];
+        } else if ((strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) && has_value) {
+            options.output_file = argv[++i];
+        } else if ((strcmp(arg, "-t") == 0 || strcmp(arg, "--threshold") == 0) && has_value) {
+            options.threshold = atof(argv[++i]);
+        } else if (strcmp(arg, "--fail-on-regression") == 0) {
+            options.fail_on_regression = true;
+        } else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            show_help(argv[0]);
+            return 0;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "错误: 未知选项 '%s'\n", arg);
+            show_help(argv[0]);
+            return 1;
+        } else {
+            if (case_count >= MAX_CASES) {
+                fprintf(stderr, "错误: 用例数量超过上限 %d\n", MAX_CASES);
+                return 1;
+            }
+            if (!parse_case(arg, &cases[case_count])) {
+                return 1;
+            }
+            case_count++;
+        }
+    }
+
+    if (options.kunyu == NULL || case_count == 0) {
+        show_help(argv[0]);
+        return 1;
+    }
+    if (options.repeat < 1 || options.repeat > MAX_REPEAT) {
+        fprintf(stderr, "错误: 重复次数必须在1到%d之间\n", MAX_REPEAT);
+        return 1;
+    }
+
+    // 分配计数库需要绝对路径，否则子进程的动态链接器可能找不到
+    char alloc_lib_path[4096];
+    if (options.alloc_lib != NULL) {
+        if (realpath(options.alloc_lib, alloc_lib_path) == NULL) {
+            fprintf(stderr, "警告: 找不到分配计数库 '%s'，跳过分配统计\n", options.alloc_lib);
+            options.alloc_lib = NULL;
+        } else {
+            options.alloc_lib = alloc_lib_path;
+        }
+    }
+
+    // 运行所有用例
+    for (int i = 0; i < case_count; i++) {
+        fprintf(stderr, "运行 %s ...\n", cases[i].name);
+        run_case(&options, &cases[i]);
+    }
+
+    // 与基线比较
+    int regressions = 0;
+    if (options.baseline_file != NULL) {
+        char *baseline = read_file(options.baseline_file);
+        if (baseline == NULL) {
+            fprintf(stderr, "警告: 无法读取基线文件 '%s'\n", options.baseline_file);
+        } else {
+            for (int i = 0; i < case_count; i++) {
+                cases[i].baseline_ms = find_baseline_ms(baseline, cases[i].name);
+            }
+            free(baseline);
+            regressions = report_baseline(&options, cases, case_count);
+        }
+    }
+
+    // 输出结果
+    FILE *out = stdout;
+    if (options.output_file != NULL) {
+        out = fopen(options.output_file, "w");
+        if (out == NULL) {
+            fprintf(stderr, "错误: 无法写入文件 '%s'\n", options.output_file);
+            return 1;
+        }
+    }
+    write_json(out, &options, cases, case_count);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    // 释放用例参数
+    for (int i = 0; i < case_count; i++) {
+        for (int j = 0; j < cases[i].arg_count; j++) {
+            free(cases[i].args[j]);
+        }
+    }
+
+    if (options.fail_on_regression && regressions > 0) {
+        return 2;
+    }
+
+    return 0;
+}
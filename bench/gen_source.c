@@ -0,0 +1,330 @@
+/**
+ * 坤舆编程语言 - 基准测试源码生成器
+ * 生成指定规模和形状的坤舆程序，用于测试大文件的词法分析和解析性能
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/**
+ * 程序形状
+ */
+typedef enum {
+    SHAPE_FUNCTIONS = 0,     // 大量函数，每个函数包含混合语句
+    SHAPE_NESTING,           // 深层嵌套的条件、循环和括号
+    SHAPE_EXPRESSIONS,       // 很长的表达式链
+    SHAPE_IDENTIFIERS,       // 很长的中文标识符
+    SHAPE_LITERALS,          // 大型字面量表（列表和字典初始化）
+    SHAPE_MIXED,             // 轮流使用以上各种形状
+    SHAPE_COUNT
+} Shape;
+
+// 形状名称，与Shape枚举一一对应
+static const char *shape_names[SHAPE_COUNT] = {
+    "functions", "nesting", "expressions", "identifiers", "literals", "mixed"
+};
+
+/**
+ * 生成选项
+ */
+typedef struct {
+    Shape shape;             // 程序形状
+    int function_count;      // 生成单元（函数）数量
+    int statement_count;     // 每个单元的规模：语句数、嵌套深度、表达式项数或表项数
+    long target_bytes;       // 目标文件大小，大于0时忽略function_count，生成到达到该大小为止
+    const char *output_file; // 输出文件名，NULL表示标准输出
+} GenOptions;
+
+// 已输出的字节数
+static long bytes_written = 0;
+
+/**
+ * 格式化输出并统计字节数
+ */
+static void emit(FILE *out, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vfprintf(out, format, args);
+    va_end(args);
+    if (written > 0) {
+        bytes_written += written;
+    }
+}
+
+/**
+ * 显示帮助信息
+ */
+static void show_help(const char *program_name) {
+    printf("用法: %s [选项]\n\n", program_name);
+    printf("选项:\n");
+    printf("  -k 形状    程序形状 (默认 functions)：\n");
+    printf("             functions   大量函数，每个函数包含混合语句\n");
+    printf("             nesting     深层嵌套的条件、循环和括号\n");
+    printf("             expressions 很长的表达式链\n");
+    printf("             identifiers 很长的中文标识符\n");
+    printf("             literals    大型字面量表\n");
+    printf("             mixed       轮流使用以上各种形状\n");
+    printf("  -f 数量    生成的函数数量 (默认 2000)\n");
+    printf("  -s 数量    每个函数的规模：语句数、嵌套深度、表达式项数或表项数 (默认 20)\n");
+    printf("  -b 大小    目标文件大小，可带K/M后缀，指定后忽略 -f\n");
+    printf("  -o 文件名  输出文件 (默认标准输出)\n");
+    printf("  -h         显示帮助信息\n");
+}
+
+/**
+ * 解析带K/M后缀的大小
+ */
+static long parse_size(const char *text) {
+    char *end = NULL;
+    long value = strtol(text, &end, 10);
+    if (end != NULL && (*end == 'K' || *end == 'k')) {
+        value *= 1024;
+    } else if (end != NULL && (*end == 'M' || *end == 'm')) {
+        value *= 1024 * 1024;
+    }
+    return value;
+}
+
+/**
+ * 生成一个包含混合语句的函数
+ */
+static void emit_function(FILE *out, int index, int statement_count) {
+    emit(out, "函数 辅助函数_%d(参数甲, 参数乙) {\n", index);
+    emit(out, "    变量 累计 = 0;\n");
+    emit(out, "    变量 计数 = 0;\n");
+
+    for (int i = 0; i < statement_count; i++) {
+        switch (i % 4) {
+            case 0:
+                emit(out, "    累计 = 累计 + (参数甲 * %d) - 参数乙;\n", i + 1);
+                break;
+            case 1:
+                emit(out, "    如果 (累计 > %d) {\n", i * 10);
+                emit(out, "        累计 = 累计 %% %d;\n", i + 7);
+                emit(out, "    } 否则 {\n");
+                emit(out, "        累计 = 累计 + 1;\n");
+                emit(out, "    }\n");
+                break;
+            case 2:
+                emit(out, "    循环 (计数 < %d) {\n", i);
+                emit(out, "        计数 = 计数 + 1;\n");
+                emit(out, "    }\n");
+                break;
+            default:
+                emit(out, "    变量 临时_%d = \"第%d段\" + 累计;\n", i, i);
+                break;
+        }
+    }
+
+    emit(out, "    返回 累计;\n");
+    emit(out, "}\n\n");
+}
+
+/**
+ * 输出缩进
+ */
+static void emit_indent(FILE *out, int level) {
+    for (int i = 0; i < level; i++) {
+        emit(out, "    ");
+    }
+}
+
+/**
+ * 生成一个深层嵌套的函数：条件和循环交替嵌套，最内层是多重括号表达式
+ */
+static void emit_nesting(FILE *out, int index, int depth) {
+    emit(out, "函数 嵌套函数_%d(参数甲) {\n", index);
+    emit(out, "    变量 结果 = 0;\n");
+
+    for (int level = 0; level < depth; level++) {
+        emit_indent(out, level + 1);
+        if (level % 2 == 0) {
+            emit(out, "如果 (参数甲 > %d) {\n", level);
+        } else {
+            emit(out, "循环 (结果 < %d) {\n", level);
+        }
+    }
+
+    emit_indent(out, depth + 1);
+    emit(out, "结果 = ");
+    for (int level = 0; level < depth; level++) {
+        emit(out, "(");
+    }
+    emit(out, "参数甲");
+    for (int level = 0; level < depth; level++) {
+        emit(out, " + %d)", level);
+    }
+    emit(out, ";\n");
+
+    for (int level = depth - 1; level >= 0; level--) {
+        emit_indent(out, level + 1);
+        emit(out, "}\n");
+    }
+
+    emit(out, "    返回 结果;\n");
+    emit(out, "}\n\n");
+}
+
+/**
+ * 生成一个包含长表达式链的函数
+ */
+static void emit_expressions(FILE *out, int index, int terms) {
+    static const char *operators[] = { "+", "-", "*", "+" };
+
+    emit(out, "函数 表达式函数_%d(参数甲, 参数乙) {\n", index);
+    emit(out, "    变量 值 = 参数甲");
+    for (int i = 0; i < terms; i++) {
+        if (i % 3 == 2) {
+            emit(out, " %s 参数乙", operators[i % 4]);
+        } else {
+            emit(out, " %s %d", operators[i % 4], i + 1);
+        }
+    }
+    emit(out, ";\n");
+    emit(out, "    返回 值;\n");
+    emit(out, "}\n\n");
+}
+
+/**
+ * 生成一个使用很长的中文标识符的函数
+ */
+static void emit_identifiers(FILE *out, int index, int statement_count) {
+    emit(out, "函数 计算第%d号客户账户的月度结算余额与优惠明细(本期应收款项总金额, 本期已经核销的优惠券面值) {\n", index);
+    emit(out, "    变量 当前正在累计的结算金额 = 本期应收款项总金额 - 本期已经核销的优惠券面值;\n");
+
+    for (int i = 0; i < statement_count; i++) {
+        emit(out, "    变量 第%d笔交易扣除手续费之后的实际入账金额 = 当前正在累计的结算金额 * %d;\n", i, i + 2);
+        emit(out, "    当前正在累计的结算金额 = 第%d笔交易扣除手续费之后的实际入账金额 - 本期已经核销的优惠券面值;\n", i);
+    }
+
+    emit(out, "    返回 当前正在累计的结算金额;\n");
+    emit(out, "}\n\n");
+}
+
+/**
+ * 生成一段大型字面量表：往全局列表和字典中填入大量字面量
+ */
+static void emit_literals(FILE *out, int index, int entries) {
+    emit(out, "# 字面量表 %d\n", index);
+    for (int i = 0; i < entries; i++) {
+        emit(out, "字典设置(数据表, \"编号_%d_%d\", \"城市名称：北京市海淀区中关村大街%d号\");\n", index, i, i);
+        emit(out, "列表添加(数据列表, %d.%03d);\n", index * 1000 + i, i % 1000);
+    }
+    emit(out, "\n");
+}
+
+/**
+ * 生成第index个单元
+ */
+static void emit_unit(FILE *out, Shape shape, int index, int size) {
+    if (shape == SHAPE_MIXED) {
+        shape = (Shape)(index % SHAPE_MIXED);
+    }
+
+    switch (shape) {
+        case SHAPE_NESTING:
+            emit_nesting(out, index, size);
+            break;
+        case SHAPE_EXPRESSIONS:
+            emit_expressions(out, index, size);
+            break;
+        case SHAPE_IDENTIFIERS:
+            emit_identifiers(out, index, size);
+            break;
+        case SHAPE_LITERALS:
+            emit_literals(out, index, size);
+            break;
+        default:
+            emit_function(out, index, size);
+            break;
+    }
+}
+
+/**
+ * 主程序入口
+ */
+int main(int argc, char *argv[]) {
+    GenOptions options;
+    options.shape = SHAPE_FUNCTIONS;
+    options.function_count = 2000;
+    options.statement_count = 20;
+    options.target_bytes = 0;
+    options.output_file = NULL;
+
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            options.function_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            options.statement_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            options.target_bytes = parse_size(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            int found = -1;
+            for (int k = 0; k < SHAPE_COUNT; k++) {
+                if (strcmp(shape_names[k], name) == 0) {
+                    found = k;
+                }
+            }
+            if (found < 0) {
+                fprintf(stderr, "错误: 未知形状 '%s'\n", name);
+                show_help(argv[0]);
+                return 1;
+            }
+            options.shape = (Shape)found;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options.output_file = argv[++i];
+        } else if (strcmp(argv[i], "-h") == 0) {
+            show_help(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "错误: 未知选项 '%s'\n", argv[i]);
+            show_help(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if (options.output_file != NULL) {
+        out = fopen(options.output_file, "w");
+        if (out == NULL) {
+            fprintf(stderr, "错误: 无法写入文件 '%s'\n", options.output_file);
+            return 1;
+        }
+    }
+
+    emit(out, "# 由 gen_source 自动生成，请勿手动修改\n");
+    emit(out, "# 形状: %s，每个单元规模: %d\n\n", shape_names[options.shape], options.statement_count);
+
+    // 字面量表需要的全局容器
+    if (options.shape == SHAPE_LITERALS || options.shape == SHAPE_MIXED) {
+        emit(out, "变量 数据表 = 创建字典();\n");
+        emit(out, "变量 数据列表 = 创建列表();\n\n");
+    }
+
+    int count = 0;
+    if (options.target_bytes > 0) {
+        while (bytes_written < options.target_bytes) {
+            emit_unit(out, options.shape, count++, options.statement_count);
+        }
+    } else {
+        for (; count < options.function_count; count++) {
+            emit_unit(out, options.shape, count, options.statement_count);
+        }
+    }
+
+    // 只调用第一个函数，其余函数仅参与解析
+    if (count > 0 && (options.shape == SHAPE_FUNCTIONS || options.shape == SHAPE_MIXED)) {
+        emit(out, "变量 结果 = 辅助函数_0(3, 4);\n");
+        emit(out, "输出 结果;\n");
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -17,7 +17,8 @@ typedef enum {
     EXPR_UNARY,          // 一元表达式
     EXPR_CALL,           // 函数调用
     EXPR_GROUPING,       // 分组表达式
-    EXPR_ASSIGN          // 赋值表达式
+    EXPR_ASSIGN,         // 赋值表达式
+    EXPR_LAMBDA          // 匿名函数
 } ExprType;
 
 /**
@@ -31,7 +32,8 @@ typedef enum {
     STMT_LOOP,           // 循环语句
     STMT_FUNCTION,       // 函数声明
     STMT_RETURN,         // 返回语句
-    STMT_PRINT           // 输出语句
+    STMT_PRINT,          // 输出语句
+    STMT_IMPORT          // 导入语句
 } StmtType;
 
 /**
@@ -131,6 +133,14 @@ typedef struct {
     char *name;                          // 函数名
     struct AstNode **args;               // 参数列表
     int arg_count;                       // 参数数量
+    
+    // 内联缓存，由解释器维护
+    int cache_kind;                      // 缓存的调用目标类型，0表示未缓存
+    unsigned int cache_epoch;            // 建立缓存时的名字解析版本
+    const void *cached_target;           // 内置函数或用户函数
+    const DictShape *cached_shape;       // 字典访问时字典的布局
+    const DictShape *cached_next_shape;  // 字典设置新增键时转移到的布局，NULL表示替换已有键
+    int cached_slot;                     // 键在布局中的槽位
 } CallExpr;
 
 /**
@@ -150,6 +160,18 @@ typedef struct {
     struct AstNode *value;               // 值
 } AssignExpr;
 
+/**
+ * 匿名函数表达式
+ */
+typedef struct {
+    ExprNode base;                       // 基类
+    char **params;                       // 参数名列表
+    int param_count;                     // 参数数量
+    struct AstNode *body;                // 函数体
+    char **upvalues;                     // 函数体中用到的外层变量名，创建节点时确定
+    int upvalue_count;                   // 外层变量数量
+} LambdaExpr;
+
 /**
  * 表达式语句
  */
@@ -204,7 +226,12 @@ typedef struct {
     char *name;                          // 函数名
     char **params;                       // 参数名列表
     int param_count;                     // 参数数量
-    struct AstNode *body;                // 函数体
+    struct AstNode *body;                // 函数体，延迟分析时在第一次调用前为NULL
+    Token *body_tokens;                  // 尚未分析的函数体的标记（含两端的大括号）
+    size_t body_token_count;             // 尚未分析的函数体的标记数量
+    size_t memo_capacity;                // @缓存 的结果数上限，0表示不缓存
+    bool assume_pure;                    // 是否标注了 @纯函数
+    bool optimized;                      // 函数体是否已经优化，同一棵语法树再次执行时不重复优化
 } FunctionStmt;
 
 /**
@@ -223,6 +250,49 @@ typedef struct {
     struct AstNode *value;               // 输出值
 } PrintStmt;
 
+/**
+ * 导入语句
+ */
+typedef struct {
+    StmtNode base;                       // 基类
+    char *path;                          // 模块路径
+} ImportStmt;
+
+/**
+ * 超级指令类型
+ */
+typedef enum {
+    SUPER_UPDATE_LOCAL,      // x = x 运算符 操作数;
+    SUPER_COMPARE,           // 条件和循环中的 操作数 比较 操作数
+    SUPER_LIST_GET_DECL,     // 变量 x = 列表获取(列表, 操作数);
+    SUPER_RETURN_BINARY      // 返回 操作数 运算符 操作数;
+} SuperOpType;
+
+/**
+ * 超级指令的操作数：变量或数字常量
+ */
+typedef struct {
+    const char *name;                    // 变量名，NULL表示常量
+    bool is_int;                         // 常量是否是整数
+    int64_t int_constant;                // 整数常量
+    double constant;                     // 数字常量，整数时为其近似值
+} SuperOperand;
+
+/**
+ * 超级指令 - 把常见的语句模式融合成一个节点，
+ * 快速路径的前提（操作数都是数字等）不满足时执行原始节点
+ */
+typedef struct {
+    AstNode base;                        // 基类
+    SuperOpType op;                      // 超级指令类型
+    BinaryOpType binary_op;              // 融合的二元运算符
+    const char *target;                  // 目标变量名，指向原始节点中的字符串
+    bool is_constant;                    // 声明的是否是常量
+    SuperOperand left;                   // 左操作数
+    SuperOperand right;                  // 右操作数
+    struct AstNode *original;            // 原始节点
+} SuperInstr;
+
 /**
  * 程序节点 - 根节点
  */
@@ -272,6 +342,12 @@ AstNode* create_loop(AstNode *condition, AstNode *body);
  */
 AstNode* create_function(const char *name, char **params, int param_count, AstNode *body);
 
+/**
+ * 创建函数体尚未分析的函数声明，函数体由parser_parse_function_body在第一次调用前分析
+ */
+AstNode* create_lazy_function(const char *name, char **params, int param_count,
+                              Token *body_tokens, size_t body_token_count);
+
 /**
  * 创建返回语句
  */
@@ -282,6 +358,11 @@ AstNode* create_return(AstNode *value);
  */
 AstNode* create_print(AstNode *value);
 
+/**
+ * 创建导入语句
+ */
+AstNode* create_import(const char *path);
+
 /**
  * 创建字面量表达式
  */
@@ -317,9 +398,34 @@ AstNode* create_grouping(AstNode *expr);
  */
 AstNode* create_assign(const char *name, AstNode *value);
 
+/**
+ * 创建匿名函数表达式，同时找出函数体中用到的外层变量
+ */
+AstNode* create_lambda(char **params, int param_count, AstNode *body);
+
+/**
+ * 创建超级指令，接管原始节点
+ */
+AstNode* create_super(SuperOpType op, AstNode *original);
+
+/**
+ * 判断节点是否是表达式语句（与程序节点共用NODE_PROGRAM）
+ */
+bool ast_is_expression_stmt(const AstNode *node);
+
 /**
  * 释放AST节点
  */
 void ast_free(AstNode *node);
 
+/**
+ * 统计AST节点数量
+ */
+size_t ast_count_nodes(const AstNode *node);
+
+/**
+ * 把节点及其所有子节点的行号移动delta行，增量分析时用于编辑位置之后的语句
+ */
+void ast_shift_lines(AstNode *node, int delta);
+
 #endif /* KUNYU_AST_H */ 
\ No newline at end of file
@@ -0,0 +1,37 @@
+/**
+ * 坤舆编程语言 - 堆分析钩子
+ * 对象系统在创建、扩容和释放对象时通过这些宏通知堆分析器。
+ * 未开启 --heap-profile 时每个钩子只有一次布尔判断。
+ */
+
+#ifndef KUNYU_HEAPPROF_H
+#define KUNYU_HEAPPROF_H
+
+#include "kunyu.h"
+
+extern bool heap_profiler_active;
+
+void heap_profiler_track_alloc(PyObject *obj, size_t bytes);
+void heap_profiler_track_resize(PyObject *obj, size_t bytes);
+void heap_profiler_track_free(PyObject *obj);
+
+#define HEAP_TRACK_ALLOC(obj, bytes) \
+    do { \
+        if (heap_profiler_active) { \
+            heap_profiler_track_alloc((PyObject *)(obj), (bytes)); \
+        } \
+    } while (0)
+#define HEAP_TRACK_RESIZE(obj, bytes) \
+    do { \
+        if (heap_profiler_active) { \
+            heap_profiler_track_resize((PyObject *)(obj), (bytes)); \
+        } \
+    } while (0)
+#define HEAP_TRACK_FREE(obj) \
+    do { \
+        if (heap_profiler_active) { \
+            heap_profiler_track_free((PyObject *)(obj)); \
+        } \
+    } while (0)
+
+#endif /* KUNYU_HEAPPROF_H */
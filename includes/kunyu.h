@@ -18,6 +18,23 @@
 #define KUNYU_VERSION "0.1.0"
 #define KUNYU_NAME "坤舆编程语言"
 
+/**
+ * 最大调用深度
+ */
+#define KUNYU_MAX_CALL_DEPTH 16384
+
+/**
+ * 调用时在C栈上保留的余量，用于内置函数和错误处理。
+ * 递归在用完栈之前报错，取不到栈大小时按默认栈大小计算
+ */
+#define KUNYU_STACK_RESERVE (256 * 1024)
+#define KUNYU_DEFAULT_STACK_SIZE (8 * 1024 * 1024)
+
+/**
+ * @缓存 不指定大小时每个函数最多缓存的结果数
+ */
+#define KUNYU_MEMO_DEFAULT_CAPACITY 4096
+
 /**
  * 错误码定义
  */
@@ -43,6 +60,7 @@ typedef enum {
     KUNYU_TOKEN_OPERATOR,    // 运算符
     KUNYU_TOKEN_DELIMITER,   // 分隔符
     KUNYU_TOKEN_NEWLINE,     // 换行
+    KUNYU_TOKEN_INTEGER,     // 整数（能用64位整数表示的无小数点数字）
 } KunyuTokenType;
 
 /**
@@ -52,7 +70,9 @@ typedef struct {
     KunyuTokenType type;     // 标记类型
     char *value;             // 标记值
     int line;                // 行号
-    int column;              // 列号
+    int column;              // 列号（字节）
+    size_t offset;           // 在源码中的字节偏移
+    size_t length;           // 在源码中占的字节数
 } Token;
 
 /**
@@ -67,6 +87,7 @@ typedef enum {
     KEYWORD_FUNCTION,        // 函数
     KEYWORD_RETURN,          // 返回
     KEYWORD_PRINT,           // 输出
+    KEYWORD_IMPORT,          // 导入
     KEYWORD_COUNT            // 关键字总数
 } KeywordType;
 
@@ -88,7 +109,10 @@ typedef enum {
     NODE_LITERAL,            // 字面量
     NODE_IDENTIFIER,         // 标识符
     NODE_GROUPING,           // 分组表达式
-    NODE_ASSIGN              // 赋值表达式
+    NODE_ASSIGN,             // 赋值表达式
+    NODE_SUPER,              // 超级指令（由优化器生成）
+    NODE_LAMBDA,             // 匿名函数
+    NODE_IMPORT              // 导入模块
 } NodeType;
 
 /**
@@ -100,7 +124,8 @@ typedef enum {
     TYPE_STRING,
     TYPE_LIST,
     TYPE_DICT,
-    TYPE_FUNCTION
+    TYPE_FUNCTION,
+    TYPE_BIGINT
 } ObjectType;
 
 /**
@@ -117,18 +142,38 @@ typedef struct PyObject {
  */
 typedef struct {
     PyObject base;
-    double value;
+    double value;            // 数值，整数时是int_value的近似值
+    int64_t int_value;       // 整数值，仅is_int为真时有效
+    bool is_int;             // 是否是64位整数
 } PyNumberObject;
 
+/**
+ * 大整数对象 - 超出64位整数范围的整数，以10^9为基数存储
+ */
+typedef struct {
+    PyObject base;
+    int sign;                // 符号：1或-1
+    size_t length;           // 位数
+    uint32_t *digits;        // 各位，低位在前
+} PyBigIntObject;
+
 /**
  * 字符串对象
  */
 typedef struct {
     PyObject base;
     char *value;
-    size_t length;
+    size_t length;           // 字节数
+    bool is_ascii;           // 是否只含ASCII字符，此时字符下标就是字节偏移
+    size_t char_length;      // 字符（码点）数，非ASCII字符串在首次使用前为0
+    size_t *char_index;      // 非ASCII字符串每隔KUNYU_STRING_INDEX_STRIDE个字符的字节偏移，按需建立
 } PyStringObject;
 
+/**
+ * 字符串字符索引的间隔
+ */
+#define KUNYU_STRING_INDEX_STRIDE 64
+
 /**
  * 列表对象
  */
@@ -147,16 +192,50 @@ typedef struct {
     PyObject *value;
 } DictItem;
 
+/**
+ * 字典布局（键的插入顺序），由键序列相同的字典共享
+ */
+typedef struct DictShape DictShape;
+
 /**
  * 字典对象
+ * 键都是字符串且数量不多时共享布局，只保存值数组；否则为字典模式，保存键值对数组
  */
 typedef struct {
     PyObject base;
-    DictItem *items;
-    size_t size;
-    size_t capacity;
+    DictShape *shape;        // 共享布局，NULL表示字典模式
+    PyObject **values;       // 共享布局模式下按槽位排列的值
+    DictItem *items;         // 字典模式下的键值对
+    size_t size;             // 键的数量
+    size_t capacity;         // values或items的容量
 } PyDictObject;
 
+/**
+ * 变量单元 - 被匿名函数捕获的局部变量的值保存在这里，
+ * 作用域中的变量和捕获它的函数对象共享同一个单元，任何一方的赋值对其他方都可见
+ */
+typedef struct {
+    int ref_count;
+    PyObject *value;
+    bool is_constant;            // 捕获的是常量，函数体中也不能赋值
+} PyCell;
+
+/**
+ * 函数对象 - 用户函数或匿名函数作为值使用。
+ * 参数名和函数体属于语法树；匿名函数创建时把用到的外层局部变量的单元放进upvalues中，
+ * 全局变量不捕获，调用时按名字查找
+ */
+typedef struct {
+    PyObject base;
+    const char *name;            // 函数名，匿名函数为NULL
+    char **params;               // 参数名列表
+    int param_count;             // 参数数量
+    struct AstNode *body;        // 函数体
+    char **upvalue_names;        // 捕获的变量名
+    PyCell **upvalues;           // 捕获的变量单元，NULL表示调用时按名字查找（全局变量或创建时还不存在的名字）
+    int upvalue_count;           // 捕获的变量数量
+} PyFunctionObject;
+
 /**
  * 错误处理结构
  */
@@ -167,6 +246,29 @@ typedef struct {
     int column;
 } KunyuError;
 
+/**
+ * 调用栈帧
+ */
+typedef struct {
+    const char *name;                  // 函数名
+    const struct AstNode *call_site;   // 调用位置
+} CallFrame;
+
+/**
+ * 内置函数（定义在builtins.c中）
+ */
+typedef struct BuiltinFunc BuiltinFunc;
+
+/**
+ * 函数结果缓存（定义在memo.c中）
+ */
+typedef struct MemoTable MemoTable;
+
+/**
+ * 支持增量分析的源码文档（定义在document.c中）
+ */
+typedef struct KunyuDocument KunyuDocument;
+
 /**
  * 前置声明
  */
@@ -183,13 +285,27 @@ void lexer_free();
 int lexer_tokenize();
 KunyuError* lexer_get_error();
 Token* lexer_get_tokens();
+Token* lexer_detach_tokens(size_t *count);
+void lexer_free_tokens(Token *tokens, size_t count);
 size_t lexer_get_token_count();
 
 /**
  * 语法分析器接口
  */
 struct AstNode* parser_parse(Token *tokens, size_t token_count);
+struct AstNode* parser_parse_spans(Token *tokens, size_t token_count, size_t **spans);
+struct AstNode* parser_parse_function_body(struct AstNode *function);
+bool parser_parse_function_bodies(struct AstNode *program, int threads);
 void parser_free(struct AstNode *node);
+KunyuError* parser_get_error();
+
+/**
+ * 优化器接口
+ */
+void optimizer_set_enabled(bool enabled);
+int optimizer_optimize(struct AstNode *root);
+int optimizer_optimize_function(struct AstNode **body);
+int optimizer_optimize_function_bodies(struct AstNode *root);
 
 /**
  * 编译器接口
@@ -216,7 +332,16 @@ void kunyu_collect_garbage();
 void py_incref(PyObject *obj);
 void py_decref(PyObject *obj);
 PyObject* py_number_new(double value);
+PyObject* py_int_new(int64_t value);
+bool py_number_is_int(PyObject *obj);
 PyObject* py_string_new(const char *value);
+PyObject* py_function_new(const char *name, char **params, int param_count, struct AstNode *body,
+                          char **upvalue_names, int upvalue_count);
+PyCell* py_cell_new(PyObject *value);
+void py_cell_incref(PyCell *cell);
+void py_cell_decref(PyCell *cell);
+size_t py_string_char_length(PyObject *str);
+PyObject* py_string_char_at(PyObject *str, size_t index);
 
 // 列表对象接口
 PyObject* py_list_new();
@@ -228,8 +353,27 @@ bool py_list_set(PyObject *list, size_t index, PyObject *item);
 // 字典对象接口
 PyObject* py_dict_new();
 bool py_dict_set(PyObject *dict, PyObject *key, PyObject *value);
+bool py_dict_append(PyObject *dict, PyObject *key, PyObject *value);
 PyObject* py_dict_get(PyObject *dict, PyObject *key);
 size_t py_dict_size(PyObject *dict);
+PyObject* py_dict_key_at(PyObject *dict, size_t index);
+PyObject* py_dict_value_at(PyObject *dict, size_t index);
+const DictShape* py_dict_shape(PyObject *dict);
+int py_dict_lookup_slot(PyObject *dict, PyObject *key);
+PyObject* py_dict_get_slot(PyObject *dict, int slot);
+void py_dict_set_slot(PyObject *dict, int slot, PyObject *value);
+bool py_dict_append_slot(PyObject *dict, const DictShape *next, PyObject *value);
+
+// 大整数接口，结果能用64位整数表示时返回整数对象
+bool py_is_integer(PyObject *obj);
+PyObject* py_bigint_from_string(const char *text);
+PyObject* py_bigint_add(PyObject *a, PyObject *b);
+PyObject* py_bigint_sub(PyObject *a, PyObject *b);
+PyObject* py_bigint_mul(PyObject *a, PyObject *b);
+bool py_bigint_divmod(PyObject *a, PyObject *b, PyObject **quotient, PyObject **remainder);
+int py_bigint_compare(PyObject *a, PyObject *b);
+double py_bigint_to_double(PyObject *obj);
+char* py_bigint_to_string(PyObject *obj);
 
 /**
  * 解释器接口
@@ -237,6 +381,80 @@ size_t py_dict_size(PyObject *dict);
 bool interpreter_execute(struct AstNode *root);
 KunyuError* interpreter_get_error();
 void interpreter_cleanup();
+const struct AstNode* interpreter_current_node();
+const CallFrame* interpreter_get_call_stack(int *depth);
+PyObject* interpreter_call_function(PyObject *func, PyObject **args, int arg_count);
+bool interpreter_execute_module(struct AstNode *root, const char *path);
+bool interpreter_execute_statements(struct AstNode *root, int first, int count);
+PyObject* interpreter_call_named(const char *name, PyObject **args, int arg_count);
+bool interpreter_execute_with_constant(struct AstNode *root, const char *name, PyObject *value);
+bool interpreter_define_functions(struct AstNode *root, int count);
+bool interpreter_define_global(const char *name, PyObject *value, bool is_constant);
+bool interpreter_visit_globals(bool (*visit)(const char *name, PyObject *value, bool is_constant, void *context),
+                               void *context);
+PyObject* interpreter_function_value(const char *name);
+
+/**
+ * 模块接口
+ */
+void module_set_entry(const char *filename);
+bool module_import(const char *name, KunyuError *error);
+void module_cleanup();
+void module_set_cache(bool keep);
+
+/**
+ * 增量语法分析接口
+ */
+KunyuDocument* document_new(const char *source);
+bool document_edit(KunyuDocument *doc, size_t start, size_t end, const char *text);
+struct AstNode* document_ast(const KunyuDocument *doc);
+const char* document_source(const KunyuDocument *doc);
+int document_changed(const KunyuDocument *doc, int *first);
+bool document_statement_span(const KunyuDocument *doc, int index, size_t *start, size_t *end, int *line);
+KunyuError* document_error(KunyuDocument *doc);
+void document_free(KunyuDocument *doc);
+
+/**
+ * JSON接口
+ */
+PyObject* json_parse(const char *text, size_t length, char *error, size_t error_size);
+void json_write(FILE *out, PyObject *value);
+void json_write_string(FILE *out, const char *text, size_t length);
+
+/**
+ * 服务模式接口
+ */
+int server_run(const char *path);
+
+/**
+ * 批处理接口
+ */
+int workers_run(struct AstNode *ast, const char *inputs_path, int worker_count);
+
+/**
+ * 快照接口
+ */
+bool snapshot_prepare(struct AstNode *ast, const char *label, const char *path, const char *source);
+bool snapshot_reached(const char *label);
+bool snapshot_written();
+bool snapshot_restore(struct AstNode *ast, const char *path, const char *source, int *next_statement);
+
+/**
+ * 事件循环接口
+ */
+int eventloop_add_timer(double milliseconds, PyObject *callback);
+bool eventloop_cancel_timer(int id);
+int eventloop_open_file(const char *path, const char *mode);
+bool eventloop_create_pipe(int *read_handle, int *write_handle);
+int eventloop_spawn(const char *command);
+int eventloop_connect(const char *path);
+int eventloop_listen(const char *path);
+bool eventloop_read(int id, PyObject *callback);
+bool eventloop_accept(int id, PyObject *callback);
+bool eventloop_write(int id, const char *data, size_t length, PyObject *callback);
+int eventloop_close(int id);
+int64_t eventloop_run();
+void eventloop_cleanup();
 
 /**
  * 内置函数接口
@@ -245,6 +463,50 @@ void builtins_init();
 void builtins_cleanup();
 PyObject* builtins_call(const char *name, PyObject **args, int arg_count);
 bool builtins_is_builtin(const char *name);
+bool builtins_is_pure(const char *name);
+const BuiltinFunc* builtins_find(const char *name);
+PyObject* builtins_invoke(const BuiltinFunc *func, PyObject **args, int arg_count);
+
+/**
+ * 函数结果缓存接口
+ */
+MemoTable* memo_new(size_t capacity);
+void memo_free(MemoTable *table);
+PyObject* memo_lookup(MemoTable *table, PyObject **args, int arg_count);
+void memo_store(MemoTable *table, PyObject **args, int arg_count, PyObject *value);
+bool memo_check_pure(char **params, int param_count, const struct AstNode *body,
+                     bool (*is_pure_call)(const char *name), char *reason, size_t reason_size);
+
+/**
+ * UTF-8编码接口
+ */
+bool utf8_validate(const char *data, size_t length, size_t *error_offset);
+size_t utf8_count_chars(const char *data, size_t length);
+
+/**
+ * 性能分析接口
+ */
+bool profiler_start(int interval_us);
+void profiler_stop();
+void profiler_report(FILE *out);
+bool profiler_write_collapsed(const char *filename);
+
+/**
+ * 堆分析接口
+ */
+bool heap_profiler_start();
+void heap_profiler_stop();
+void heap_profiler_report(FILE *out);
+size_t heap_profiler_report_leaks(FILE *out);
+size_t heap_profiler_live_bytes();
+
+/**
+ * 执行跟踪接口
+ */
+bool trace_start(const char *filename, int threshold_us);
+void trace_stop();
+void trace_phase_begin(const char *name);
+void trace_phase_end();
 
 /**
  * REPL接口
@@ -0,0 +1,102 @@
+/**
+ * 坤舆编程语言 - 嵌入接口
+ * 宿主程序（C或C++）通过这些函数编译脚本一次，之后反复调用脚本中的函数。
+ *
+ * 解释器的状态是进程级的：同一时间只能有一个KunyuState，所有调用必须在同一个线程中进行
+ * （或由宿主加锁串行化）。同一状态中编译的脚本共享全局作用域，和导入的模块一样，
+ * 后编译的脚本可以调用先编译的脚本中的函数，函数名重复时编译失败。
+ *
+ * 值的引用计数：名字中带new的构造函数、kunyu_call和取值函数返回新引用，
+ * 用完后调用kunyu_release；作为参数传入的值仍归调用者所有。
+ */
+
+#ifndef LIBKUNYU_H
+#define LIBKUNYU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * 接口函数的可见性。嵌入库以 -fvisibility=hidden 编译，只导出带KUNYU_API的函数，
+ * 解释器内部的函数不会与宿主程序中的同名符号冲突
+ */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define KUNYU_API __attribute__((visibility("default")))
+#else
+#define KUNYU_API
+#endif
+
+/**
+ * 解释器状态
+ */
+typedef struct KunyuState KunyuState;
+
+/**
+ * 编译好的脚本
+ */
+typedef struct KunyuScript KunyuScript;
+
+/**
+ * 脚本中的值
+ */
+typedef struct PyObject KunyuValue;
+
+/**
+ * 值的类型
+ */
+typedef enum {
+    KUNYU_VALUE_NUMBER = 0,      // 数字（包括大整数）
+    KUNYU_VALUE_STRING,          // 字符串
+    KUNYU_VALUE_LIST,            // 列表
+    KUNYU_VALUE_DICT,            // 字典
+    KUNYU_VALUE_FUNCTION,        // 函数
+    KUNYU_VALUE_OTHER            // 其他
+} KunyuValueType;
+
+/**
+ * 状态和脚本
+ */
+KUNYU_API KunyuState* kunyu_state_new(void);
+KUNYU_API void kunyu_state_free(KunyuState *state);
+KUNYU_API KunyuScript* kunyu_compile(KunyuState *state, const char *source);
+KUNYU_API KunyuValue* kunyu_call(KunyuScript *script, const char *function, KunyuValue **args, int arg_count);
+KUNYU_API const char* kunyu_last_error(const KunyuState *state);
+
+/**
+ * 值的创建
+ */
+KUNYU_API KunyuValue* kunyu_number_new(double value);
+KUNYU_API KunyuValue* kunyu_integer_new(int64_t value);
+KUNYU_API KunyuValue* kunyu_string_new(const char *utf8);
+KUNYU_API KunyuValue* kunyu_list_new(void);
+KUNYU_API bool kunyu_list_push(KunyuValue *list, KunyuValue *item);
+KUNYU_API KunyuValue* kunyu_dict_new(void);
+KUNYU_API bool kunyu_dict_put(KunyuValue *dict, const char *key, KunyuValue *value);
+
+/**
+ * 值的读取
+ */
+KUNYU_API KunyuValueType kunyu_type(const KunyuValue *value);
+KUNYU_API double kunyu_to_number(const KunyuValue *value);
+KUNYU_API bool kunyu_to_integer(const KunyuValue *value, int64_t *out);
+KUNYU_API const char* kunyu_to_string(const KunyuValue *value, size_t *length);
+KUNYU_API size_t kunyu_list_size(const KunyuValue *list);
+KUNYU_API KunyuValue* kunyu_list_at(const KunyuValue *list, size_t index);
+KUNYU_API KunyuValue* kunyu_dict_lookup(const KunyuValue *dict, const char *key);
+
+/**
+ * 引用计数
+ */
+KUNYU_API void kunyu_retain(KunyuValue *value);
+KUNYU_API void kunyu_release(KunyuValue *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBKUNYU_H */
@@ -0,0 +1,105 @@
+/**
+ * 坤舆编程语言 - 解释器内部统计
+ * 统计对象分配、引用计数、作用域、变量查找和函数调用的次数与耗时。
+ * 发布构建（定义KUNYU_RELEASE）时所有统计代码都会被编译掉，没有任何开销。
+ */
+
+#ifndef KUNYU_STATS_H
+#define KUNYU_STATS_H
+
+#include "kunyu.h"
+
+#ifndef KUNYU_RELEASE
+#define KUNYU_STATS_ENABLED 1
+#endif
+
+/**
+ * 计数器
+ */
+typedef enum {
+    STAT_NUMBER_NEW = 0,     // 创建数字对象
+    STAT_STRING_NEW,         // 创建字符串对象
+    STAT_LIST_NEW,           // 创建列表对象
+    STAT_DICT_NEW,           // 创建字典对象
+    STAT_BIGINT_NEW,         // 创建大整数对象
+    STAT_FUNCTION_NEW,       // 创建函数对象
+    STAT_OBJECT_FREE,        // 释放对象
+    STAT_LIVE_OBJECTS,       // 当前存活对象数
+    STAT_PEAK_LIVE_OBJECTS,  // 峰值存活对象数
+    STAT_INCREF,             // 增加引用计数
+    STAT_DECREF,             // 减少引用计数
+    STAT_PEAK_REFCOUNT,      // 单个对象达到的最大引用计数
+    STAT_PUSH_SCOPE,         // 创建作用域
+    STAT_VARIABLE_LOOKUP,    // 变量查找
+    STAT_LOOKUP_SCOPES,      // 变量查找经过的作用域总数
+    STAT_LOOKUP_MAX_CHAIN,   // 变量查找经过的最长作用域链
+    STAT_FUNCTION_LOOKUP,    // 用户函数查找
+    STAT_BUILTIN_LOOKUP,     // 内置函数查找
+    STAT_STRCMP,             // 查找过程中的字符串比较
+    STAT_SUPER_FAST,         // 超级指令走快速路径
+    STAT_SUPER_FALLBACK,     // 超级指令退回原始节点
+    STAT_MEMO_HIT,           // 函数结果缓存命中
+    STAT_MEMO_MISS,          // 函数结果缓存未命中
+    STAT_MEMO_EVICT,         // 函数结果缓存淘汰
+    STAT_COUNTER_COUNT       // 计数器总数
+} StatCounter;
+
+#ifdef KUNYU_STATS_ENABLED
+
+extern uint64_t stats_counters[STAT_COUNTER_COUNT];
+extern bool stats_enabled;
+
+void stats_call_begin(const char *name, bool is_builtin);
+void stats_call_end();
+
+#define STATS_INC(counter) (stats_counters[counter]++)
+#define STATS_ADD(counter, n) (stats_counters[counter] += (uint64_t)(n))
+#define STATS_MAX(counter, n) \
+    do { \
+        if ((uint64_t)(n) > stats_counters[counter]) { \
+            stats_counters[counter] = (uint64_t)(n); \
+        } \
+    } while (0)
+#define STATS_OBJECT_ALLOC() \
+    do { \
+        stats_counters[STAT_LIVE_OBJECTS]++; \
+        STATS_MAX(STAT_PEAK_LIVE_OBJECTS, stats_counters[STAT_LIVE_OBJECTS]); \
+    } while (0)
+#define STATS_OBJECT_FREE() \
+    do { \
+        stats_counters[STAT_OBJECT_FREE]++; \
+        stats_counters[STAT_LIVE_OBJECTS]--; \
+    } while (0)
+#define STATS_CALL_BEGIN(name, is_builtin) \
+    do { \
+        if (stats_enabled) { \
+            stats_call_begin(name, is_builtin); \
+        } \
+    } while (0)
+#define STATS_CALL_END() \
+    do { \
+        if (stats_enabled) { \
+            stats_call_end(); \
+        } \
+    } while (0)
+
+#else
+
+#define STATS_INC(counter) ((void)0)
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_MAX(counter, n) ((void)0)
+#define STATS_OBJECT_ALLOC() ((void)0)
+#define STATS_OBJECT_FREE() ((void)0)
+#define STATS_CALL_BEGIN(name, is_builtin) ((void)0)
+#define STATS_CALL_END() ((void)0)
+
+#endif /* KUNYU_STATS_ENABLED */
+
+/**
+ * 统计接口
+ */
+bool stats_start();
+void stats_report(FILE *out);
+void stats_cleanup();
+
+#endif /* KUNYU_STATS_H */
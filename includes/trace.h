@@ -0,0 +1,30 @@
+/**
+ * 坤舆编程语言 - 执行跟踪钩子
+ * 解释器在调用用户函数和内置函数前后通过这些宏通知跟踪器。
+ * 未开启 --trace 时每个钩子只有一次布尔判断。
+ */
+
+#ifndef KUNYU_TRACE_H
+#define KUNYU_TRACE_H
+
+#include "kunyu.h"
+
+extern bool trace_active;
+
+void trace_call_begin(const char *name, bool is_builtin, int line);
+void trace_call_end();
+
+#define TRACE_CALL_BEGIN(name, is_builtin, line) \
+    do { \
+        if (trace_active) { \
+            trace_call_begin((name), (is_builtin), (line)); \
+        } \
+    } while (0)
+#define TRACE_CALL_END() \
+    do { \
+        if (trace_active) { \
+            trace_call_end(); \
+        } \
+    } while (0)
+
+#endif /* KUNYU_TRACE_H */
@@ -18,6 +18,7 @@ static void destroy_loop(AstNode *node);
 static void destroy_function(AstNode *node);
 static void destroy_return(AstNode *node);
 static void destroy_print(AstNode *node);
+static void destroy_import(AstNode *node);
 static void destroy_literal(AstNode *node);
 static void destroy_variable(AstNode *node);
 static void destroy_binary(AstNode *node);
@@ -25,6 +26,8 @@ static void destroy_unary(AstNode *node);
 static void destroy_call(AstNode *node);
 static void destroy_grouping(AstNode *node);
 static void destroy_assign(AstNode *node);
+static void destroy_super(AstNode *node);
+static void destroy_lambda(AstNode *node);
 
 /**
  * 创建程序节点
@@ -214,21 +217,17 @@ AstNode* create_loop(AstNode *condition, AstNode *body) {
 }
 
 /**
- * 创建函数声明
+ * 创建函数声明节点，不设置函数体
  */
-AstNode* create_function(const char *name, char **params, int param_count, AstNode *body) {
-    if (body == NULL) {
-        return NULL;
-    }
-    
+static FunctionStmt* new_function(const char *name, char **params, int param_count, int line, int column) {
     FunctionStmt *stmt = (FunctionStmt *)malloc(sizeof(FunctionStmt));
     if (stmt == NULL) {
         return NULL;
     }
     
     stmt->base.base.type = NODE_FUNCDECL;
-    stmt->base.base.line = body->line;
-    stmt->base.base.column = body->column;
+    stmt->base.base.line = line;
+    stmt->base.base.column = column;
     stmt->base.base.destructor = destroy_function;
     
     stmt->base.stmt_type = STMT_FUNCTION;
@@ -267,8 +266,49 @@ AstNode* create_function(const char *name, char **params, int param_count, AstNo
     }
     
     stmt->param_count = param_count;
+    stmt->body = NULL;
+    stmt->body_tokens = NULL;
+    stmt->body_token_count = 0;
+    stmt->memo_capacity = 0;
+    stmt->assume_pure = false;
+    stmt->optimized = false;
+    
+    return stmt;
+}
+
+/**
+ * 创建函数声明
+ */
+AstNode* create_function(const char *name, char **params, int param_count, AstNode *body) {
+    if (body == NULL) {
+        return NULL;
+    }
+    
+    FunctionStmt *stmt = new_function(name, params, param_count, body->line, body->column);
+    if (stmt == NULL) {
+        return NULL;
+    }
+    
     stmt->body = body;
+    return (AstNode *)stmt;
+}
+
+/**
+ * 创建函数体尚未分析的函数声明
+ */
+AstNode* create_lazy_function(const char *name, char **params, int param_count,
+                              Token *body_tokens, size_t body_token_count) {
+    if (body_tokens == NULL || body_token_count == 0) {
+        return NULL;
+    }
+    
+    FunctionStmt *stmt = new_function(name, params, param_count, body_tokens[0].line, body_tokens[0].column);
+    if (stmt == NULL) {
+        return NULL;
+    }
     
+    stmt->body_tokens = body_tokens;
+    stmt->body_token_count = body_token_count;
     return (AstNode *)stmt;
 }
 
@@ -318,6 +358,31 @@ AstNode* create_print(AstNode *value) {
     return (AstNode *)stmt;
 }
 
+/**
+ * 创建导入语句
+ */
+AstNode* create_import(const char *path) {
+    ImportStmt *stmt = (ImportStmt *)malloc(sizeof(ImportStmt));
+    if (stmt == NULL) {
+        return NULL;
+    }
+    
+    stmt->base.base.type = NODE_IMPORT;
+    stmt->base.base.line = 0;
+    stmt->base.base.column = 0;
+    stmt->base.base.destructor = destroy_import;
+    
+    stmt->base.stmt_type = STMT_IMPORT;
+    
+    stmt->path = strdup(path);
+    if (stmt->path == NULL) {
+        free(stmt);
+        return NULL;
+    }
+    
+    return (AstNode *)stmt;
+}
+
 /**
  * 创建字面量表达式
  */
@@ -466,6 +531,14 @@ AstNode* create_call(const char *name, AstNode **args, int arg_count) {
     
     expr->arg_count = arg_count;
     
+    // 内联缓存在第一次调用时建立
+    expr->cache_kind = 0;
+    expr->cache_epoch = 0;
+    expr->cached_target = NULL;
+    expr->cached_shape = NULL;
+    expr->cached_next_shape = NULL;
+    expr->cached_slot = -1;
+    
     return (AstNode *)expr;
 }
 
@@ -526,6 +599,260 @@ AstNode* create_assign(const char *name, AstNode *value) {
     return (AstNode *)expr;
 }
 
+/**
+ * 名字列表，查找外层变量时使用
+ */
+typedef struct {
+    const char **names;                  // 名字，指向语法树中的字符串
+    int count;                           // 数量
+    int capacity;                        // 容量
+} NameList;
+
+/**
+ * 判断名字是否在列表中
+ */
+static bool name_list_contains(const NameList *list, const char *name) {
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->names[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 添加名字到列表
+ */
+static bool name_list_add(NameList *list, const char *name) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity == 0 ? 8 : list->capacity * 2;
+        const char **names = (const char **)realloc(list->names, sizeof(const char *) * capacity);
+        if (names == NULL) {
+            return false;
+        }
+        list->names = names;
+        list->capacity = capacity;
+    }
+    list->names[list->count++] = name;
+    return true;
+}
+
+/**
+ * 引用了一个名字：不是函数内声明的变量时记为外层变量
+ */
+static bool reference_name(const char *name, const NameList *declared, NameList *free_names) {
+    if (name_list_contains(declared, name) || name_list_contains(free_names, name)) {
+        return true;
+    }
+    return name_list_add(free_names, name);
+}
+
+/**
+ * 遍历匿名函数体，找出用到但没有在函数内声明的名字。
+ * 代码块结束时撤销其中的声明；嵌套的匿名函数用到的外层变量也是本函数用到的；
+ * 嵌套的函数声明按动态作用域执行，不捕获变量
+ */
+static bool collect_free_names(const AstNode *node, NameList *declared, NameList *free_names) {
+    if (node == NULL) {
+        return true;
+    }
+    
+    bool ok = true;
+    switch (node->type) {
+        case NODE_PROGRAM:
+            if (ast_is_expression_stmt(node)) {
+                ok = collect_free_names(((const ExpressionStmt *)node)->expr, declared, free_names);
+            } else {
+                const Program *program = (const Program *)node;
+                for (int i = 0; ok && i < program->stmt_count; i++) {
+                    ok = collect_free_names(program->statements[i], declared, free_names);
+                }
+            }
+            break;
+        case NODE_BLOCK: {
+            const BlockStmt *block = (const BlockStmt *)node;
+            int mark = declared->count;
+            for (int i = 0; ok && i < block->stmt_count; i++) {
+                ok = collect_free_names(block->statements[i], declared, free_names);
+            }
+            declared->count = mark;
+            break;
+        }
+        case NODE_VARDECL: {
+            const VarDeclStmt *stmt = (const VarDeclStmt *)node;
+            ok = collect_free_names(stmt->initializer, declared, free_names) &&
+                 name_list_add(declared, stmt->name);
+            break;
+        }
+        case NODE_IF: {
+            const IfStmt *stmt = (const IfStmt *)node;
+            ok = collect_free_names(stmt->condition, declared, free_names) &&
+                 collect_free_names(stmt->then_branch, declared, free_names) &&
+                 collect_free_names(stmt->else_branch, declared, free_names);
+            break;
+        }
+        case NODE_LOOP: {
+            const LoopStmt *stmt = (const LoopStmt *)node;
+            ok = collect_free_names(stmt->condition, declared, free_names) &&
+                 collect_free_names(stmt->body, declared, free_names);
+            break;
+        }
+        case NODE_RETURN:
+            ok = collect_free_names(((const ReturnStmt *)node)->value, declared, free_names);
+            break;
+        case NODE_PRINT:
+            ok = collect_free_names(((const PrintStmt *)node)->value, declared, free_names);
+            break;
+        case NODE_BINARY: {
+            const BinaryExpr *expr = (const BinaryExpr *)node;
+            ok = collect_free_names(expr->left, declared, free_names) &&
+                 collect_free_names(expr->right, declared, free_names);
+            break;
+        }
+        case NODE_UNARY:
+            ok = collect_free_names(((const UnaryExpr *)node)->operand, declared, free_names);
+            break;
+        case NODE_GROUPING:
+            ok = collect_free_names(((const GroupingExpr *)node)->expr, declared, free_names);
+            break;
+        case NODE_CALL: {
+            // 被调用的名字也可能是保存函数值的变量
+            const CallExpr *expr = (const CallExpr *)node;
+            ok = reference_name(expr->name, declared, free_names);
+            for (int i = 0; ok && i < expr->arg_count; i++) {
+                ok = collect_free_names(expr->args[i], declared, free_names);
+            }
+            break;
+        }
+        case NODE_IDENTIFIER:
+            ok = reference_name(((const VariableExpr *)node)->name, declared, free_names);
+            break;
+        case NODE_ASSIGN: {
+            const AssignExpr *expr = (const AssignExpr *)node;
+            ok = reference_name(expr->name, declared, free_names) &&
+                 collect_free_names(expr->value, declared, free_names);
+            break;
+        }
+        case NODE_LAMBDA: {
+            const LambdaExpr *expr = (const LambdaExpr *)node;
+            for (int i = 0; ok && i < expr->upvalue_count; i++) {
+                ok = reference_name(expr->upvalues[i], declared, free_names);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    
+    return ok;
+}
+
+/**
+ * 创建匿名函数表达式，同时找出函数体中用到的外层变量
+ */
+AstNode* create_lambda(char **params, int param_count, AstNode *body) {
+    if (body == NULL) {
+        return NULL;
+    }
+    
+    LambdaExpr *expr = (LambdaExpr *)calloc(1, sizeof(LambdaExpr));
+    if (expr == NULL) {
+        return NULL;
+    }
+    
+    expr->base.base.type = NODE_LAMBDA;
+    expr->base.base.line = body->line;
+    expr->base.base.column = body->column;
+    expr->base.base.destructor = destroy_lambda;
+    
+    expr->base.expr_type = EXPR_LAMBDA;
+    
+    // 复制参数名数组
+    if (param_count > 0) {
+        expr->params = (char **)calloc(param_count, sizeof(char *));
+        if (expr->params == NULL) {
+            free(expr);
+            return NULL;
+        }
+        expr->param_count = param_count;
+        for (int i = 0; i < param_count; i++) {
+            expr->params[i] = strdup(params[i]);
+            if (expr->params[i] == NULL) {
+                destroy_lambda((AstNode *)expr);
+                free(expr);
+                return NULL;
+            }
+        }
+    }
+    
+    // 参数视为已声明的变量
+    NameList declared = {NULL, 0, 0};
+    NameList free_names = {NULL, 0, 0};
+    bool ok = true;
+    for (int i = 0; ok && i < param_count; i++) {
+        ok = name_list_add(&declared, expr->params[i]);
+    }
+    ok = ok && collect_free_names(body, &declared, &free_names);
+    free(declared.names);
+    
+    if (ok && free_names.count > 0) {
+        expr->upvalues = (char **)calloc(free_names.count, sizeof(char *));
+        ok = expr->upvalues != NULL;
+        for (int i = 0; ok && i < free_names.count; i++) {
+            expr->upvalues[i] = strdup(free_names.names[i]);
+            expr->upvalue_count = i + 1;
+            ok = expr->upvalues[i] != NULL;
+        }
+    }
+    free(free_names.names);
+    
+    if (!ok) {
+        destroy_lambda((AstNode *)expr);
+        free(expr);
+        return NULL;
+    }
+    
+    expr->body = body;
+    
+    return (AstNode *)expr;
+}
+
+/**
+ * 创建超级指令，接管原始节点
+ */
+AstNode* create_super(SuperOpType op, AstNode *original) {
+    if (original == NULL) {
+        return NULL;
+    }
+    
+    SuperInstr *instr = (SuperInstr *)malloc(sizeof(SuperInstr));
+    if (instr == NULL) {
+        return NULL;
+    }
+    
+    instr->base.type = NODE_SUPER;
+    instr->base.line = original->line;
+    instr->base.column = original->column;
+    instr->base.destructor = destroy_super;
+    
+    instr->op = op;
+    instr->binary_op = OP_ADD;
+    instr->target = NULL;
+    instr->is_constant = false;
+    memset(&instr->left, 0, sizeof(instr->left));
+    memset(&instr->right, 0, sizeof(instr->right));
+    instr->original = original;
+    
+    return (AstNode *)instr;
+}
+
+/**
+ * 判断节点是否是表达式语句（与程序节点共用NODE_PROGRAM）
+ */
+bool ast_is_expression_stmt(const AstNode *node) {
+    return node != NULL && node->type == NODE_PROGRAM && node->destructor == destroy_expression_stmt;
+}
+
 /**
  * 释放AST节点及其子节点
  */
@@ -542,6 +869,187 @@ void ast_free(AstNode *node) {
     free(node);
 }
 
+/**
+ * 统计AST中的节点数量（包括node本身）
+ */
+size_t ast_count_nodes(const AstNode *node) {
+    if (node == NULL) {
+        return 0;
+    }
+    
+    size_t count = 1;
+    switch (node->type) {
+        case NODE_PROGRAM: {
+            // 程序节点和表达式语句共用NODE_PROGRAM，通过析构函数区分
+            if (node->destructor == destroy_program) {
+                const Program *program = (const Program *)node;
+                for (int i = 0; i < program->stmt_count; i++) {
+                    count += ast_count_nodes(program->statements[i]);
+                }
+            } else {
+                count += ast_count_nodes(((const ExpressionStmt *)node)->expr);
+            }
+            break;
+        }
+        case NODE_BLOCK: {
+            const BlockStmt *block = (const BlockStmt *)node;
+            for (int i = 0; i < block->stmt_count; i++) {
+                count += ast_count_nodes(block->statements[i]);
+            }
+            break;
+        }
+        case NODE_VARDECL:
+            count += ast_count_nodes(((const VarDeclStmt *)node)->initializer);
+            break;
+        case NODE_FUNCDECL:
+            count += ast_count_nodes(((const FunctionStmt *)node)->body);
+            break;
+        case NODE_IF: {
+            const IfStmt *stmt = (const IfStmt *)node;
+            count += ast_count_nodes(stmt->condition);
+            count += ast_count_nodes(stmt->then_branch);
+            count += ast_count_nodes(stmt->else_branch);
+            break;
+        }
+        case NODE_LOOP: {
+            const LoopStmt *stmt = (const LoopStmt *)node;
+            count += ast_count_nodes(stmt->condition);
+            count += ast_count_nodes(stmt->body);
+            break;
+        }
+        case NODE_RETURN:
+            count += ast_count_nodes(((const ReturnStmt *)node)->value);
+            break;
+        case NODE_PRINT:
+            count += ast_count_nodes(((const PrintStmt *)node)->value);
+            break;
+        case NODE_BINARY: {
+            const BinaryExpr *expr = (const BinaryExpr *)node;
+            count += ast_count_nodes(expr->left);
+            count += ast_count_nodes(expr->right);
+            break;
+        }
+        case NODE_UNARY:
+            count += ast_count_nodes(((const UnaryExpr *)node)->operand);
+            break;
+        case NODE_CALL: {
+            const CallExpr *expr = (const CallExpr *)node;
+            for (int i = 0; i < expr->arg_count; i++) {
+                count += ast_count_nodes(expr->args[i]);
+            }
+            break;
+        }
+        case NODE_GROUPING:
+            count += ast_count_nodes(((const GroupingExpr *)node)->expr);
+            break;
+        case NODE_ASSIGN:
+            count += ast_count_nodes(((const AssignExpr *)node)->value);
+            break;
+        case NODE_SUPER:
+            count += ast_count_nodes(((const SuperInstr *)node)->original);
+            break;
+        case NODE_LAMBDA:
+            count += ast_count_nodes(((const LambdaExpr *)node)->body);
+            break;
+        default:
+            break;
+    }
+    
+    return count;
+}
+
+/**
+ * 移动节点及其所有子节点的行号
+ */
+void ast_shift_lines(AstNode *node, int delta) {
+    if (node == NULL) {
+        return;
+    }
+    
+    node->line += delta;
+    switch (node->type) {
+        case NODE_PROGRAM: {
+            if (node->destructor == destroy_program) {
+                Program *program = (Program *)node;
+                for (int i = 0; i < program->stmt_count; i++) {
+                    ast_shift_lines(program->statements[i], delta);
+                }
+            } else {
+                ast_shift_lines(((ExpressionStmt *)node)->expr, delta);
+            }
+            break;
+        }
+        case NODE_BLOCK: {
+            BlockStmt *block = (BlockStmt *)node;
+            for (int i = 0; i < block->stmt_count; i++) {
+                ast_shift_lines(block->statements[i], delta);
+            }
+            break;
+        }
+        case NODE_VARDECL:
+            ast_shift_lines(((VarDeclStmt *)node)->initializer, delta);
+            break;
+        case NODE_FUNCDECL: {
+            FunctionStmt *stmt = (FunctionStmt *)node;
+            ast_shift_lines(stmt->body, delta);
+            // 尚未分析的函数体的标记也要移动，分析后的节点和错误信息才有正确的行号
+            for (size_t i = 0; i < stmt->body_token_count; i++) {
+                stmt->body_tokens[i].line += delta;
+            }
+            break;
+        }
+        case NODE_IF: {
+            IfStmt *stmt = (IfStmt *)node;
+            ast_shift_lines(stmt->condition, delta);
+            ast_shift_lines(stmt->then_branch, delta);
+            ast_shift_lines(stmt->else_branch, delta);
+            break;
+        }
+        case NODE_LOOP: {
+            LoopStmt *stmt = (LoopStmt *)node;
+            ast_shift_lines(stmt->condition, delta);
+            ast_shift_lines(stmt->body, delta);
+            break;
+        }
+        case NODE_RETURN:
+            ast_shift_lines(((ReturnStmt *)node)->value, delta);
+            break;
+        case NODE_PRINT:
+            ast_shift_lines(((PrintStmt *)node)->value, delta);
+            break;
+        case NODE_BINARY: {
+            BinaryExpr *expr = (BinaryExpr *)node;
+            ast_shift_lines(expr->left, delta);
+            ast_shift_lines(expr->right, delta);
+            break;
+        }
+        case NODE_UNARY:
+            ast_shift_lines(((UnaryExpr *)node)->operand, delta);
+            break;
+        case NODE_CALL: {
+            CallExpr *expr = (CallExpr *)node;
+            for (int i = 0; i < expr->arg_count; i++) {
+                ast_shift_lines(expr->args[i], delta);
+            }
+            break;
+        }
+        case NODE_GROUPING:
+            ast_shift_lines(((GroupingExpr *)node)->expr, delta);
+            break;
+        case NODE_ASSIGN:
+            ast_shift_lines(((AssignExpr *)node)->value, delta);
+            break;
+        case NODE_SUPER:
+            ast_shift_lines(((SuperInstr *)node)->original, delta);
+            break;
+        case NODE_LAMBDA:
+            ast_shift_lines(((LambdaExpr *)node)->body, delta);
+            break;
+        default:
+            break;
+    }
+}
+
 /**
  * 析构函数实现
  */
@@ -648,6 +1156,13 @@ static void destroy_print(AstNode *node) {
     ast_free(stmt->value);
 }
 
+static void destroy_import(AstNode *node) {
+    ImportStmt *stmt = (ImportStmt *)node;
+    
+    // 释放模块路径
+    free(stmt->path);
+}
+
 static void destroy_literal(AstNode *node) {
     LiteralExpr *expr = (LiteralExpr *)node;
     
@@ -709,4 +1224,28 @@ static void destroy_assign(AstNode *node) {
     
     // 释放值表达式
     ast_free(expr->value);
-} 
\ No newline at end of file
+} 
+
+static void destroy_super(AstNode *node) {
+    SuperInstr *instr = (SuperInstr *)node;
+    
+    // 释放原始节点，目标和操作数的名字都指向它
+    ast_free(instr->original);
+}
+
+static void destroy_lambda(AstNode *node) {
+    LambdaExpr *expr = (LambdaExpr *)node;
+    
+    // 释放参数名和外层变量名
+    for (int i = 0; i < expr->param_count; i++) {
+        free(expr->params[i]);
+    }
+    free(expr->params);
+    for (int i = 0; i < expr->upvalue_count; i++) {
+        free(expr->upvalues[i]);
+    }
+    free(expr->upvalues);
+    
+    // 释放函数体
+    ast_free(expr->body);
+}
@@ -0,0 +1,530 @@
+/**
+ * 坤舆编程语言 - 任意精度整数
+ * 以10^9为基数存储各位，转换为十进制字符串只需逐位格式化。
+ * 乘法在操作数较短时使用竖式乘法，较长时使用Karatsuba算法。
+ * 所有运算的结果能用64位整数表示时都返回普通的整数对象。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/stats.h"
+#include "../includes/heapprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define BIGINT_BASE 1000000000u      // 每一位的基数
+#define BIGINT_BASE_DIGITS 9         // 每一位对应的十进制位数
+#define KARATSUBA_THRESHOLD 32       // 短于此位数时使用竖式乘法
+
+/**
+ * 整数的绝对值和符号，运算过程中使用
+ */
+typedef struct {
+    uint32_t *digits;        // 各位，低位在前
+    size_t length;           // 位数，不含高位的0
+    int sign;                // 1、-1，值为0时是0
+    bool owned;              // digits是否需要释放
+    uint32_t inline_digits[3];  // 64位整数转换时使用的存储
+} Magnitude;
+
+/**
+ * 销毁大整数对象
+ */
+static void bigint_destructor(PyObject *obj) {
+    PyBigIntObject *big = (PyBigIntObject *)obj;
+    free(big->digits);
+}
+
+/**
+ * 去掉高位的0
+ */
+static size_t mag_trim(const uint32_t *digits, size_t length) {
+    while (length > 0 && digits[length - 1] == 0) {
+        length--;
+    }
+    return length;
+}
+
+/**
+ * 比较两个绝对值
+ */
+static int mag_compare(const uint32_t *a, size_t na, const uint32_t *b, size_t nb) {
+    na = mag_trim(a, na);
+    nb = mag_trim(b, nb);
+    if (na != nb) {
+        return na < nb ? -1 : 1;
+    }
+    for (size_t i = na; i > 0; i--) {
+        if (a[i - 1] != b[i - 1]) {
+            return a[i - 1] < b[i - 1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * out = a + b，out至少有max(na, nb) + 1位，可以与a相同
+ * @return 结果的位数
+ */
+static size_t mag_add(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out) {
+    if (na < nb) {
+        const uint32_t *t = a; a = b; b = t;
+        size_t n = na; na = nb; nb = n;
+    }
+
+    uint32_t carry = 0;
+    for (size_t i = 0; i < na; i++) {
+        uint32_t sum = a[i] + (i < nb ? b[i] : 0) + carry;
+        carry = sum >= BIGINT_BASE;
+        out[i] = carry ? sum - BIGINT_BASE : sum;
+    }
+    out[na] = carry;
+    return mag_trim(out, na + 1);
+}
+
+/**
+ * out = a - b，要求a >= b，out至少有na位，可以与a相同
+ * @return 结果的位数
+ */
+static size_t mag_sub(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out) {
+    uint32_t borrow = 0;
+    for (size_t i = 0; i < na; i++) {
+        uint32_t sub = (i < nb ? b[i] : 0) + borrow;
+        if (a[i] >= sub) {
+            out[i] = a[i] - sub;
+            borrow = 0;
+        } else {
+            out[i] = a[i] + BIGINT_BASE - sub;
+            borrow = 1;
+        }
+    }
+    return mag_trim(out, na);
+}
+
+/**
+ * 把b加到out上，out有足够的位数容纳进位
+ */
+static void mag_add_into(uint32_t *out, size_t nout, const uint32_t *b, size_t nb) {
+    uint32_t carry = 0;
+    size_t i = 0;
+    for (; i < nb || (carry && i < nout); i++) {
+        uint32_t sum = out[i] + (i < nb ? b[i] : 0) + carry;
+        carry = sum >= BIGINT_BASE;
+        out[i] = carry ? sum - BIGINT_BASE : sum;
+    }
+}
+
+/**
+ * 竖式乘法，out有na + nb位且已清零
+ */
+static void mag_mul_school(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out) {
+    for (size_t i = 0; i < na; i++) {
+        uint64_t carry = 0;
+        uint64_t ai = a[i];
+        if (ai == 0) {
+            continue;
+        }
+        for (size_t j = 0; j < nb; j++) {
+            uint64_t cur = out[i + j] + ai * b[j] + carry;
+            out[i + j] = (uint32_t)(cur % BIGINT_BASE);
+            carry = cur / BIGINT_BASE;
+        }
+        size_t k = i + nb;
+        while (carry != 0) {
+            uint64_t cur = out[k] + carry;
+            out[k] = (uint32_t)(cur % BIGINT_BASE);
+            carry = cur / BIGINT_BASE;
+            k++;
+        }
+    }
+}
+
+/**
+ * 乘法，out有na + nb位且已清零
+ * @return 成功返回true，内存不足返回false
+ */
+static bool mag_mul(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out) {
+    if (na < nb) {
+        const uint32_t *t = a; a = b; b = t;
+        size_t n = na; na = nb; nb = n;
+    }
+
+    if (nb < KARATSUBA_THRESHOLD) {
+        mag_mul_school(a, na, b, nb, out);
+        return true;
+    }
+
+    // 长度悬殊时把a切成与b等长的段分别相乘
+    if (nb <= na / 2) {
+        uint32_t *part = (uint32_t *)malloc(sizeof(uint32_t) * (nb * 2));
+        if (part == NULL) {
+            return false;
+        }
+        for (size_t offset = 0; offset < na; offset += nb) {
+            size_t chunk = na - offset < nb ? na - offset : nb;
+            memset(part, 0, sizeof(uint32_t) * (chunk + nb));
+            if (!mag_mul(a + offset, chunk, b, nb, part)) {
+                free(part);
+                return false;
+            }
+            mag_add_into(out + offset, na + nb - offset, part, chunk + nb);
+        }
+        free(part);
+        return true;
+    }
+
+    // a = a1 * B^m + a0，b = b1 * B^m + b0
+    // a * b = z2 * B^2m + (z1 - z2 - z0) * B^m + z0，其中z1 = (a0 + a1)(b0 + b1)
+    size_t m = na / 2;
+    const uint32_t *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+    size_t na1 = na - m, nb1 = nb - m;
+    size_t ns = na1 + 1;
+
+    uint32_t *buffer = (uint32_t *)calloc(ns * 2 + ns * 2 + m * 2 + na1 + nb1, sizeof(uint32_t));
+    if (buffer == NULL) {
+        return false;
+    }
+    uint32_t *sa = buffer;
+    uint32_t *sb = sa + ns;
+    uint32_t *z1 = sb + ns;
+    uint32_t *z0 = z1 + ns * 2;
+    uint32_t *z2 = z0 + m * 2;
+
+    size_t nsa = mag_add(a0, m, a1, na1, sa);
+    size_t nsb = mag_add(b0, m, b1, nb1, sb);
+
+    bool ok = mag_mul(a0, m, b0, m, z0) &&
+              mag_mul(a1, na1, b1, nb1, z2) &&
+              (nsa == 0 || nsb == 0 || mag_mul(sa, nsa, sb, nsb, z1));
+    if (!ok) {
+        free(buffer);
+        return false;
+    }
+
+    size_t nz0 = mag_trim(z0, m * 2);
+    size_t nz2 = mag_trim(z2, na1 + nb1);
+    size_t nz1 = mag_trim(z1, ns * 2);
+    nz1 = mag_sub(z1, nz1, z0, nz0, z1);
+    nz1 = mag_sub(z1, nz1, z2, nz2, z1);
+
+    memcpy(out, z0, sizeof(uint32_t) * nz0);
+    mag_add_into(out + m, na + nb - m, z1, nz1);
+    mag_add_into(out + m * 2, na + nb - m * 2, z2, nz2);
+
+    free(buffer);
+    return true;
+}
+
+/**
+ * 读取整数或大整数的绝对值和符号
+ */
+static void mag_from_object(PyObject *obj, Magnitude *mag) {
+    mag->owned = false;
+    if (obj->type == TYPE_BIGINT) {
+        PyBigIntObject *big = (PyBigIntObject *)obj;
+        mag->digits = big->digits;
+        mag->length = big->length;
+        mag->sign = big->sign;
+        return;
+    }
+
+    int64_t value = ((PyNumberObject *)obj)->int_value;
+    uint64_t abs_value = value < 0 ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+    mag->sign = value < 0 ? -1 : (value > 0 ? 1 : 0);
+    mag->digits = mag->inline_digits;
+    mag->length = 0;
+    while (abs_value != 0) {
+        mag->inline_digits[mag->length++] = (uint32_t)(abs_value % BIGINT_BASE);
+        abs_value /= BIGINT_BASE;
+    }
+}
+
+/**
+ * 由绝对值和符号创建对象，能用64位整数表示时返回整数对象。
+ * digits的所有权转移给对象（或被释放）
+ */
+static PyObject* bigint_from_digits(uint32_t *digits, size_t length, int sign) {
+    length = mag_trim(digits, length);
+
+    // 不超过3位（小于10^27）时检查是否在64位整数范围内
+    if (length <= 3) {
+        uint64_t value = 0;
+        bool fits = length < 3 || digits[2] <= 9;
+        if (fits) {
+            for (size_t i = length; i > 0; i--) {
+                value = value * BIGINT_BASE + digits[i - 1];
+            }
+            fits = value <= (uint64_t)INT64_MAX + (sign < 0 ? 1 : 0);
+        }
+        if (fits) {
+            free(digits);
+            if (sign < 0) {
+                return py_int_new(value == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)value);
+            }
+            return py_int_new((int64_t)value);
+        }
+    }
+
+    PyBigIntObject *obj = (PyBigIntObject *)malloc(sizeof(PyBigIntObject));
+    if (obj == NULL) {
+        free(digits);
+        return NULL;
+    }
+
+    obj->base.type = TYPE_BIGINT;
+    obj->base.ref_count = 1;
+    obj->base.destructor = bigint_destructor;
+    obj->sign = sign;
+    obj->length = length;
+    obj->digits = digits;
+
+    STATS_INC(STAT_BIGINT_NEW);
+    STATS_OBJECT_ALLOC();
+    HEAP_TRACK_ALLOC(obj, sizeof(PyBigIntObject) + sizeof(uint32_t) * length);
+
+    return (PyObject *)obj;
+}
+
+/**
+ * 判断对象是否是整数（64位整数或大整数）
+ */
+bool py_is_integer(PyObject *obj) {
+    return obj != NULL && (obj->type == TYPE_BIGINT || py_number_is_int(obj));
+}
+
+/**
+ * 由十进制数字串创建整数，可以带负号
+ */
+PyObject* py_bigint_from_string(const char *text) {
+    int sign = 1;
+    if (*text == '-') {
+        sign = -1;
+        text++;
+    }
+
+    size_t count = strlen(text);
+    size_t length = (count + BIGINT_BASE_DIGITS - 1) / BIGINT_BASE_DIGITS;
+    uint32_t *digits = (uint32_t *)calloc(length > 0 ? length : 1, sizeof(uint32_t));
+    if (digits == NULL) {
+        return NULL;
+    }
+
+    // 从最低位开始每9个十进制位组成一位
+    for (size_t i = 0; i < length; i++) {
+        size_t end = count - i * BIGINT_BASE_DIGITS;
+        size_t start = end >= BIGINT_BASE_DIGITS ? end - BIGINT_BASE_DIGITS : 0;
+        uint32_t digit = 0;
+        for (size_t j = start; j < end; j++) {
+            digit = digit * 10 + (uint32_t)(text[j] - '0');
+        }
+        digits[i] = digit;
+    }
+
+    return bigint_from_digits(digits, length, mag_trim(digits, length) == 0 ? 0 : sign);
+}
+
+/**
+ * 带符号的加法，b_sign用于实现减法
+ */
+static PyObject* bigint_add_signed(PyObject *a, PyObject *b, bool negate_b) {
+    Magnitude x, y;
+    mag_from_object(a, &x);
+    mag_from_object(b, &y);
+    if (negate_b) {
+        y.sign = -y.sign;
+    }
+
+    size_t length = (x.length > y.length ? x.length : y.length) + 1;
+    uint32_t *digits = (uint32_t *)calloc(length, sizeof(uint32_t));
+    if (digits == NULL) {
+        return NULL;
+    }
+
+    if (x.sign == 0 || y.sign == 0 || x.sign == y.sign) {
+        mag_add(x.digits, x.length, y.digits, y.length, digits);
+        return bigint_from_digits(digits, length, x.sign != 0 ? x.sign : y.sign);
+    }
+
+    // 异号时用绝对值大的减去小的
+    int cmp = mag_compare(x.digits, x.length, y.digits, y.length);
+    if (cmp == 0) {
+        return bigint_from_digits(digits, 0, 0);
+    }
+    if (cmp > 0) {
+        mag_sub(x.digits, x.length, y.digits, y.length, digits);
+        return bigint_from_digits(digits, length, x.sign);
+    }
+    mag_sub(y.digits, y.length, x.digits, x.length, digits);
+    return bigint_from_digits(digits, length, y.sign);
+}
+
+/**
+ * 加法，操作数是整数或大整数
+ */
+PyObject* py_bigint_add(PyObject *a, PyObject *b) {
+    return bigint_add_signed(a, b, false);
+}
+
+/**
+ * 减法，操作数是整数或大整数
+ */
+PyObject* py_bigint_sub(PyObject *a, PyObject *b) {
+    return bigint_add_signed(a, b, true);
+}
+
+/**
+ * 乘法，操作数是整数或大整数
+ */
+PyObject* py_bigint_mul(PyObject *a, PyObject *b) {
+    Magnitude x, y;
+    mag_from_object(a, &x);
+    mag_from_object(b, &y);
+
+    size_t length = x.length + y.length;
+    uint32_t *digits = (uint32_t *)calloc(length > 0 ? length : 1, sizeof(uint32_t));
+    if (digits == NULL) {
+        return NULL;
+    }
+
+    if (!mag_mul(x.digits, x.length, y.digits, y.length, digits)) {
+        free(digits);
+        return NULL;
+    }
+
+    return bigint_from_digits(digits, length, x.sign * y.sign);
+}
+
+/**
+ * 除法，商向零取整，余数与被除数同号（与64位整数的/和%一致）
+ * @param quotient 输出商，可以为NULL
+ * @param remainder 输出余数，可以为NULL
+ * @return 成功返回true，除数为0或内存不足返回false
+ */
+bool py_bigint_divmod(PyObject *a, PyObject *b, PyObject **quotient, PyObject **remainder) {
+    Magnitude x, y;
+    mag_from_object(a, &x);
+    mag_from_object(b, &y);
+    if (y.sign == 0) {
+        return false;
+    }
+
+    size_t nq = x.length > 0 ? x.length : 1;
+    uint32_t *q = (uint32_t *)calloc(nq, sizeof(uint32_t));
+    uint32_t *r = (uint32_t *)calloc(y.length + 1, sizeof(uint32_t));
+    uint32_t *product = (uint32_t *)calloc(y.length + 1, sizeof(uint32_t));
+    if (q == NULL || r == NULL || product == NULL) {
+        free(q);
+        free(r);
+        free(product);
+        return false;
+    }
+
+    // 逐位长除：余数乘以基数加上下一位，再二分查找这一位的商
+    size_t nr = 0;
+    for (size_t i = x.length; i > 0; i--) {
+        memmove(r + 1, r, sizeof(uint32_t) * nr);
+        r[0] = x.digits[i - 1];
+        nr = mag_trim(r, nr + 1);
+
+        uint32_t lo = 0, hi = BIGINT_BASE - 1;
+        if (mag_compare(r, nr, y.digits, y.length) < 0) {
+            hi = 0;
+        } else if (y.length == 1) {
+            // 除数只有一位时可以直接估算
+            uint64_t top = nr > 1 ? (uint64_t)r[1] * BIGINT_BASE + r[0] : r[0];
+            lo = hi = (uint32_t)(top / y.digits[0]);
+        }
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            memset(product, 0, sizeof(uint32_t) * (y.length + 1));
+            mag_mul_school(y.digits, y.length, &mid, 1, product);
+            if (mag_compare(product, y.length + 1, r, nr) <= 0) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        q[i - 1] = lo;
+        if (lo != 0) {
+            memset(product, 0, sizeof(uint32_t) * (y.length + 1));
+            mag_mul_school(y.digits, y.length, &lo, 1, product);
+            nr = mag_sub(r, nr, product, y.length + 1, r);
+        }
+    }
+    free(product);
+
+    int q_sign = mag_trim(q, nq) == 0 ? 0 : x.sign * y.sign;
+    int r_sign = nr == 0 ? 0 : x.sign;
+
+    if (quotient != NULL) {
+        *quotient = bigint_from_digits(q, nq, q_sign);
+    } else {
+        free(q);
+    }
+    if (remainder != NULL) {
+        *remainder = bigint_from_digits(r, y.length + 1, r_sign);
+    } else {
+        free(r);
+    }
+    return true;
+}
+
+/**
+ * 比较两个整数或大整数
+ * @return a < b返回负数，相等返回0，a > b返回正数
+ */
+int py_bigint_compare(PyObject *a, PyObject *b) {
+    Magnitude x, y;
+    mag_from_object(a, &x);
+    mag_from_object(b, &y);
+
+    if (x.sign != y.sign) {
+        return x.sign < y.sign ? -1 : 1;
+    }
+    int cmp = mag_compare(x.digits, x.length, y.digits, y.length);
+    return x.sign < 0 ? -cmp : cmp;
+}
+
+/**
+ * 转换为浮点数（可能损失精度）
+ */
+double py_bigint_to_double(PyObject *obj) {
+    Magnitude x;
+    mag_from_object(obj, &x);
+
+    double value = 0;
+    for (size_t i = x.length; i > 0; i--) {
+        value = value * BIGINT_BASE + x.digits[i - 1];
+    }
+    return x.sign < 0 ? -value : value;
+}
+
+/**
+ * 转换为十进制字符串，调用者负责释放
+ */
+char* py_bigint_to_string(PyObject *obj) {
+    Magnitude x;
+    mag_from_object(obj, &x);
+    if (x.length == 0) {
+        return strdup("0");
+    }
+
+    // 最高位不补0，其余各位固定9个十进制位
+    char *text = (char *)malloc(x.length * BIGINT_BASE_DIGITS + 2);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    char *p = text;
+    if (x.sign < 0) {
+        *p++ = '-';
+    }
+    p += sprintf(p, "%" PRIu32, x.digits[x.length - 1]);
+    for (size_t i = x.length - 1; i > 0; i--) {
+        p += sprintf(p, "%09" PRIu32, x.digits[i - 1]);
+    }
+    return text;
+}
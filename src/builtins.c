@@ -4,22 +4,29 @@
  */
 
 #include "../includes/kunyu.h"
+#include "../includes/stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
 
 // 内置函数表
-typedef struct BuiltinFunc {
+struct BuiltinFunc {
     const char *name;              // 函数名
     PyObject* (*func)(PyObject **args, int arg_count);  // 函数指针
     int arg_count;                 // 参数数量
     struct BuiltinFunc *next;      // 下一个函数
-} BuiltinFunc;
+};
 
 // 全局内置函数表
 static BuiltinFunc *builtin_funcs = NULL;
 
+// 没有副作用、结果只取决于参数的内置函数，可以在 @缓存 的函数中调用
+static const char *pure_builtins[] = {
+    "列表获取", "列表长度", "字典获取", "字典大小", "字符串长度", "字符获取"
+};
+
 /**
  * 初始化内置函数表
  */
@@ -42,7 +49,9 @@ static void register_builtin(const char *name, PyObject* (*func)(PyObject **args
  */
 static BuiltinFunc* find_builtin(const char *name) {
     BuiltinFunc *func = builtin_funcs;
+    STATS_INC(STAT_BUILTIN_LOOKUP);
     while (func != NULL) {
+        STATS_INC(STAT_STRCMP);
         if (strcmp(func->name, name) == 0) {
             return func;
         }
@@ -88,7 +97,30 @@ static PyObject* builtin_list_append(PyObject **args, int arg_count) {
     }
     
     bool result = py_list_append(list, item);
-    return py_number_new(result ? 1 : 0);
+    return py_int_new(result ? 1 : 0);
+}
+
+/**
+ * 把数字参数转换为列表下标，不是数字或是负数时返回false
+ */
+static bool number_to_index(PyObject *obj, size_t *index) {
+    if (obj->type != TYPE_NUMBER) {
+        return false;
+    }
+    
+    PyNumberObject *num = (PyNumberObject *)obj;
+    if (num->is_int) {
+        if (num->int_value < 0) {
+            return false;
+        }
+        *index = (size_t)num->int_value;
+    } else {
+        if (num->value < 0) {
+            return false;
+        }
+        *index = (size_t)num->value;
+    }
+    return true;
 }
 
 /**
@@ -106,7 +138,7 @@ static PyObject* builtin_list_length(PyObject **args, int arg_count) {
     }
     
     size_t length = py_list_length(list);
-    return py_number_new((double)length);
+    return py_int_new((int64_t)length);
 }
 
 /**
@@ -120,13 +152,11 @@ static PyObject* builtin_list_get(PyObject **args, int arg_count) {
     PyObject *list = args[0];
     PyObject *index_obj = args[1];
     
-    if (list->type != TYPE_LIST || index_obj->type != TYPE_NUMBER) {
+    size_t index;
+    if (list->type != TYPE_LIST || !number_to_index(index_obj, &index)) {
         return NULL;
     }
     
-    PyNumberObject *index_num = (PyNumberObject *)index_obj;
-    size_t index = (size_t)index_num->value;
-    
     return py_list_get(list, index);
 }
 
@@ -142,15 +172,159 @@ static PyObject* builtin_list_set(PyObject **args, int arg_count) {
     PyObject *index_obj = args[1];
     PyObject *value = args[2];
     
-    if (list->type != TYPE_LIST || index_obj->type != TYPE_NUMBER) {
+    size_t index;
+    if (list->type != TYPE_LIST || !number_to_index(index_obj, &index)) {
         return NULL;
     }
     
-    PyNumberObject *index_num = (PyNumberObject *)index_obj;
-    size_t index = (size_t)index_num->value;
-    
     bool result = py_list_set(list, index, value);
-    return py_number_new(result ? 1 : 0);
+    return py_int_new(result ? 1 : 0);
+}
+
+/**
+ * 内置函数：映射，对列表的每个元素调用函数，返回由结果组成的新列表
+ */
+static PyObject* builtin_list_map(PyObject **args, int arg_count) {
+    if (arg_count != 2 || args[0] == NULL || args[1] == NULL ||
+        args[0]->type != TYPE_LIST || args[1]->type != TYPE_FUNCTION) {
+        return NULL;
+    }
+    
+    PyListObject *list = (PyListObject *)args[0];
+    PyObject *result = py_list_new();
+    if (result == NULL) {
+        return NULL;
+    }
+    
+    // 回调可能修改原列表，每次都重新检查长度
+    for (size_t i = 0; i < list->length; i++) {
+        PyObject *item = list->items[i];
+        py_incref(item);
+        PyObject *value = interpreter_call_function(args[1], &item, 1);
+        py_decref(item);
+        if (value == NULL || !py_list_append(result, value)) {
+            if (value != NULL) {
+                py_decref(value);
+            }
+            py_decref(result);
+            return NULL;
+        }
+        py_decref(value);
+    }
+    
+    return result;
+}
+
+/**
+ * 排序时比较两个元素，a应排在b之前时把less设为true
+ * @param compare 比较函数，为NULL时按数值或字符串的自然顺序
+ * @return 比较失败返回false
+ */
+static bool sort_less(PyObject *compare, PyObject *a, PyObject *b, bool *less) {
+    if (compare != NULL) {
+        PyObject *pair[2] = {a, b};
+        PyObject *result = interpreter_call_function(compare, pair, 2);
+        if (result == NULL) {
+            return false;
+        }
+        if (result->type == TYPE_NUMBER) {
+            *less = ((PyNumberObject *)result)->value != 0;
+        } else if (result->type == TYPE_STRING) {
+            *less = ((PyStringObject *)result)->length > 0;
+        } else {
+            *less = true;
+        }
+        py_decref(result);
+        return true;
+    }
+    
+    if (a->type == TYPE_NUMBER && b->type == TYPE_NUMBER) {
+        PyNumberObject *x = (PyNumberObject *)a;
+        PyNumberObject *y = (PyNumberObject *)b;
+        *less = x->is_int && y->is_int ? x->int_value < y->int_value : x->value < y->value;
+        return true;
+    }
+    if (a->type == TYPE_STRING && b->type == TYPE_STRING) {
+        *less = strcmp(((PyStringObject *)a)->value, ((PyStringObject *)b)->value) < 0;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * 归并排序items[0, count)，temp是同样大小的临时数组
+ * 只在b严格排在a之前时才交换顺序，所以排序是稳定的
+ */
+static bool merge_sort(PyObject *compare, PyObject **items, PyObject **temp, size_t count) {
+    if (count < 2) {
+        return true;
+    }
+    
+    size_t middle = count / 2;
+    if (!merge_sort(compare, items, temp, middle) ||
+        !merge_sort(compare, items + middle, temp, count - middle)) {
+        return false;
+    }
+    
+    size_t i = 0, j = middle, k = 0;
+    while (i < middle && j < count) {
+        bool less;
+        if (!sort_less(compare, items[j], items[i], &less)) {
+            return false;
+        }
+        temp[k++] = less ? items[j++] : items[i++];
+    }
+    while (i < middle) {
+        temp[k++] = items[i++];
+    }
+    while (j < count) {
+        temp[k++] = items[j++];
+    }
+    memcpy(items, temp, sizeof(PyObject *) * count);
+    return true;
+}
+
+/**
+ * 内置函数：排序，返回排好序的新列表，原列表不变。
+ * 可选的第二个参数是比较函数，接收两个元素，第一个应排在前面时返回真
+ */
+static PyObject* builtin_list_sort(PyObject **args, int arg_count) {
+    if (arg_count < 1 || arg_count > 2 || args[0] == NULL || args[0]->type != TYPE_LIST) {
+        return NULL;
+    }
+    PyObject *compare = arg_count == 2 ? args[1] : NULL;
+    if (compare != NULL && compare->type != TYPE_FUNCTION) {
+        return NULL;
+    }
+    
+    // 先复制元素再排序，比较函数修改原列表不会影响排序过程
+    PyListObject *list = (PyListObject *)args[0];
+    size_t count = list->length;
+    PyObject **items = (PyObject **)malloc(sizeof(PyObject *) * (count > 0 ? count * 2 : 1));
+    if (items == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        items[i] = list->items[i];
+        py_incref(items[i]);
+    }
+    
+    PyObject *result = NULL;
+    if (merge_sort(compare, items, items + count, count)) {
+        result = py_list_new();
+        for (size_t i = 0; result != NULL && i < count; i++) {
+            if (!py_list_append(result, items[i])) {
+                py_decref(result);
+                result = NULL;
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        py_decref(items[i]);
+    }
+    free(items);
+    return result;
 }
 
 /**
@@ -177,7 +351,7 @@ static PyObject* builtin_dict_set(PyObject **args, int arg_count) {
     }
     
     bool result = py_dict_set(dict, key, value);
-    return py_number_new(result ? 1 : 0);
+    return py_int_new(result ? 1 : 0);
 }
 
 /**
@@ -219,7 +393,276 @@ static PyObject* builtin_dict_size(PyObject **args, int arg_count) {
     }
     
     size_t size = py_dict_size(dict);
-    return py_number_new((double)size);
+    return py_int_new((int64_t)size);
+}
+
+/**
+ * 内置函数：字符串长度，按字符（码点）计算
+ */
+static PyObject* builtin_string_length(PyObject **args, int arg_count) {
+    if (arg_count != 1 || args[0] == NULL) {
+        return NULL;
+    }
+    
+    PyObject *str = args[0];
+    
+    if (str->type != TYPE_STRING) {
+        return NULL;
+    }
+    
+    return py_int_new((int64_t)py_string_char_length(str));
+}
+
+/**
+ * 内置函数：字符获取，返回字符串中指定下标的字符
+ */
+static PyObject* builtin_string_char_at(PyObject **args, int arg_count) {
+    if (arg_count != 2 || args[0] == NULL || args[1] == NULL) {
+        return NULL;
+    }
+    
+    PyObject *str = args[0];
+    PyObject *index_obj = args[1];
+    
+    size_t index;
+    if (str->type != TYPE_STRING || !number_to_index(index_obj, &index)) {
+        return NULL;
+    }
+    
+    return py_string_char_at(str, index);
+}
+
+/**
+ * 内置函数：读取文件，返回文件的全部内容。
+ * 文件不存在或不是有效的UTF-8编码时失败
+ */
+static PyObject* builtin_read_file(PyObject **args, int arg_count) {
+    if (arg_count != 1 || args[0] == NULL || args[0]->type != TYPE_STRING) {
+        return NULL;
+    }
+    
+    FILE *file = fopen(((PyStringObject *)args[0])->value, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *buffer = (char *)malloc(capacity);
+    while (buffer != NULL) {
+        length += fread(buffer + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = (char *)realloc(buffer, capacity);
+        if (grown == NULL) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+    fclose(file);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer[length] = '\0';
+    
+    // 字符串以\0结尾，内容中含\0的文件同样视为无效
+    PyObject *result = NULL;
+    if (memchr(buffer, '\0', length) == NULL && utf8_validate(buffer, length, NULL)) {
+        result = py_string_new(buffer);
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * 把数字参数转换为句柄或定时器编号
+ */
+static bool number_to_id(PyObject *obj, int *id) {
+    size_t index;
+    if (obj == NULL || !number_to_index(obj, &index) || index > INT32_MAX) {
+        return false;
+    }
+    *id = (int)index;
+    return true;
+}
+
+/**
+ * 检查参数是字符串
+ */
+static bool is_string(PyObject *obj) {
+    return obj != NULL && obj->type == TYPE_STRING;
+}
+
+/**
+ * 检查参数是函数
+ */
+static bool is_function(PyObject *obj) {
+    return obj != NULL && obj->type == TYPE_FUNCTION;
+}
+
+/**
+ * 内置函数：定时器(毫秒, 回调)，到期后调用一次回调，返回定时器编号
+ */
+static PyObject* builtin_set_timer(PyObject **args, int arg_count) {
+    if (args[0] == NULL || args[0]->type != TYPE_NUMBER || !is_function(args[1])) {
+        return NULL;
+    }
+    int id = eventloop_add_timer(((PyNumberObject *)args[0])->value, args[1]);
+    return id > 0 ? py_int_new(id) : NULL;
+}
+
+/**
+ * 内置函数：取消定时器(编号)，定时器还没到期时返回1
+ */
+static PyObject* builtin_cancel_timer(PyObject **args, int arg_count) {
+    int id;
+    if (!number_to_id(args[0], &id)) {
+        return NULL;
+    }
+    return py_int_new(eventloop_cancel_timer(id) ? 1 : 0);
+}
+
+/**
+ * 内置函数：打开文件(路径, 模式)，模式为"读"、"写"或"追加"，返回句柄
+ */
+static PyObject* builtin_open_file(PyObject **args, int arg_count) {
+    if (!is_string(args[0]) || !is_string(args[1])) {
+        return NULL;
+    }
+    int id = eventloop_open_file(((PyStringObject *)args[0])->value, ((PyStringObject *)args[1])->value);
+    return id > 0 ? py_int_new(id) : NULL;
+}
+
+/**
+ * 内置函数：创建管道()，返回[读端, 写端]两个句柄
+ */
+static PyObject* builtin_create_pipe(PyObject **args, int arg_count) {
+    int read_handle, write_handle;
+    if (!eventloop_create_pipe(&read_handle, &write_handle)) {
+        return NULL;
+    }
+    PyObject *result = py_list_new();
+    PyObject *ends[2] = { py_int_new(read_handle), py_int_new(write_handle) };
+    for (int i = 0; i < 2; i++) {
+        if (result != NULL && (ends[i] == NULL || !py_list_append(result, ends[i]))) {
+            py_decref(result);
+            result = NULL;
+        }
+        if (ends[i] != NULL) {
+            py_decref(ends[i]);
+        }
+    }
+    return result;
+}
+
+/**
+ * 内置函数：启动命令(命令)，返回读取子进程标准输出的句柄
+ */
+static PyObject* builtin_spawn(PyObject **args, int arg_count) {
+    if (!is_string(args[0])) {
+        return NULL;
+    }
+    int id = eventloop_spawn(((PyStringObject *)args[0])->value);
+    return id > 0 ? py_int_new(id) : NULL;
+}
+
+/**
+ * 内置函数：连接套接字(路径)，返回句柄
+ */
+static PyObject* builtin_connect(PyObject **args, int arg_count) {
+    if (!is_string(args[0])) {
+        return NULL;
+    }
+    int id = eventloop_connect(((PyStringObject *)args[0])->value);
+    return id > 0 ? py_int_new(id) : NULL;
+}
+
+/**
+ * 内置函数：监听套接字(路径)，返回监听句柄
+ */
+static PyObject* builtin_listen(PyObject **args, int arg_count) {
+    if (!is_string(args[0])) {
+        return NULL;
+    }
+    int id = eventloop_listen(((PyStringObject *)args[0])->value);
+    return id > 0 ? py_int_new(id) : NULL;
+}
+
+/**
+ * 内置函数：异步读取(句柄, 回调)，每次读到数据时调用回调，读到末尾时以空字符串调用
+ */
+static PyObject* builtin_async_read(PyObject **args, int arg_count) {
+    int id;
+    if (!number_to_id(args[0], &id) || !is_function(args[1])) {
+        return NULL;
+    }
+    return eventloop_read(id, args[1]) ? py_int_new(1) : NULL;
+}
+
+/**
+ * 内置函数：接受连接(监听句柄, 回调)，以新连接的句柄调用回调
+ */
+static PyObject* builtin_async_accept(PyObject **args, int arg_count) {
+    int id;
+    if (!number_to_id(args[0], &id) || !is_function(args[1])) {
+        return NULL;
+    }
+    return eventloop_accept(id, args[1]) ? py_int_new(1) : NULL;
+}
+
+/**
+ * 内置函数：异步写入(句柄, 文本[, 回调])，写完后以写入的字节数调用回调
+ */
+static PyObject* builtin_async_write(PyObject **args, int arg_count) {
+    int id;
+    if (arg_count < 2 || arg_count > 3 || !number_to_id(args[0], &id) || !is_string(args[1]) ||
+        (arg_count == 3 && !is_function(args[2]))) {
+        return NULL;
+    }
+    PyStringObject *text = (PyStringObject *)args[1];
+    bool result = eventloop_write(id, text->value, text->length, arg_count == 3 ? args[2] : NULL);
+    return result ? py_int_new(1) : NULL;
+}
+
+/**
+ * 内置函数：关闭(句柄)，返回子进程的退出码，其他句柄返回0
+ */
+static PyObject* builtin_close(PyObject **args, int arg_count) {
+    int id;
+    if (!number_to_id(args[0], &id)) {
+        return NULL;
+    }
+    int status = eventloop_close(id);
+    return status >= 0 ? py_int_new(status) : NULL;
+}
+
+/**
+ * 内置函数：运行事件循环()，直到没有等待中的定时器和I/O，返回调用的回调数
+ */
+static PyObject* builtin_run_loop(PyObject **args, int arg_count) {
+    int64_t dispatched = eventloop_run();
+    return dispatched >= 0 ? py_int_new(dispatched) : NULL;
+}
+
+/**
+ * 内置函数：快照点(标签)，以 --snapshot-after=标签 运行时在这里生成启动快照，返回0
+ */
+static PyObject* builtin_snapshot_point(PyObject **args, int arg_count) {
+    if (!is_string(args[0])) {
+        return NULL;
+    }
+    return snapshot_reached(((PyStringObject *)args[0])->value) ? py_int_new(0) : NULL;
+}
+
+/**
+ * 内置函数：内存报告
+ * 把堆分析报告输出到标准错误，返回当前存活字节数
+ */
+static PyObject* builtin_heap_report(PyObject **args, int arg_count) {
+    heap_profiler_report(stderr);
+    return py_int_new((int64_t)heap_profiler_live_bytes());
 }
 
 /**
@@ -231,6 +674,20 @@ PyObject* builtins_call(const char *name, PyObject **args, int arg_count) {
         return NULL;
     }
     
+    return builtins_invoke(func, args, arg_count);
+}
+
+/**
+ * 查找内置函数，返回的指针在builtins_cleanup之前有效，可用于缓存
+ */
+const BuiltinFunc* builtins_find(const char *name) {
+    return find_builtin(name);
+}
+
+/**
+ * 调用已查找到的内置函数
+ */
+PyObject* builtins_invoke(const BuiltinFunc *func, PyObject **args, int arg_count) {
     if (func->arg_count >= 0 && func->arg_count != arg_count) {
         return NULL;
     }
@@ -242,12 +699,19 @@ PyObject* builtins_call(const char *name, PyObject **args, int arg_count) {
  * 初始化内置函数
  */
 void builtins_init() {
+    // 解释器每次执行前都会初始化，内置函数表已经存在时保留
+    if (builtin_funcs != NULL) {
+        return;
+    }
+    
     // 列表操作
     register_builtin("创建列表", builtin_create_list, 0);
     register_builtin("列表添加", builtin_list_append, 2);
     register_builtin("列表长度", builtin_list_length, 1);
     register_builtin("列表获取", builtin_list_get, 2);
     register_builtin("列表设置", builtin_list_set, 3);
+    register_builtin("映射", builtin_list_map, 2);
+    register_builtin("排序", builtin_list_sort, -1);
     
     // 字典操作
     register_builtin("创建字典", builtin_create_dict, 0);
@@ -255,6 +719,33 @@ void builtins_init() {
     register_builtin("字典获取", builtin_dict_get, 2);
     register_builtin("字典大小", builtin_dict_size, 1);
     
+    // 字符串操作
+    register_builtin("字符串长度", builtin_string_length, 1);
+    register_builtin("字符获取", builtin_string_char_at, 2);
+    
+    // 文件操作
+    register_builtin("读取文件", builtin_read_file, 1);
+    
+    // 事件循环
+    register_builtin("定时器", builtin_set_timer, 2);
+    register_builtin("取消定时器", builtin_cancel_timer, 1);
+    register_builtin("打开文件", builtin_open_file, 2);
+    register_builtin("创建管道", builtin_create_pipe, 0);
+    register_builtin("启动命令", builtin_spawn, 1);
+    register_builtin("连接套接字", builtin_connect, 1);
+    register_builtin("监听套接字", builtin_listen, 1);
+    register_builtin("异步读取", builtin_async_read, 2);
+    register_builtin("接受连接", builtin_async_accept, 2);
+    register_builtin("异步写入", builtin_async_write, -1);
+    register_builtin("关闭", builtin_close, 1);
+    register_builtin("运行事件循环", builtin_run_loop, 0);
+    
+    // 启动快照
+    register_builtin("快照点", builtin_snapshot_point, 1);
+    
+    // 调试工具
+    register_builtin("内存报告", builtin_heap_report, 0);
+    
     // 数学函数
     // 可在此添加更多内置函数
 }
@@ -264,4 +755,16 @@ void builtins_init() {
  */
 bool builtins_is_builtin(const char *name) {
     return find_builtin(name) != NULL;
+}
+
+/**
+ * 检查内置函数是否没有副作用
+ */
+bool builtins_is_pure(const char *name) {
+    for (size_t i = 0; i < sizeof(pure_builtins) / sizeof(pure_builtins[0]); i++) {
+        if (strcmp(pure_builtins[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
 } 
\ No newline at end of file
@@ -0,0 +1,479 @@
+/**
+ * 坤舆编程语言 - 增量语法分析
+ * 文档保存源码和语法树，并记录每条顶层语句在源码中的字节范围。
+ * 编辑（把一段字节替换为新文本）后只重新分析受影响的顶层语句：
+ * 从前一条未受影响的语句末尾开始重新进行词法分析，到编辑位置之后、另起一行开始的第一条语句为止，
+ * 其余语句的语法树（包括优化器生成的超级指令）原样保留，编辑位置之后的只移动行号。
+ * 无法确认局部分析的结果与完整分析相同时（例如新插入的注释或字符串延伸到了后面的语句），
+ * 退回到完整分析。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 顶层语句在源码中的范围
+ */
+typedef struct {
+    size_t start;                // 第一个标记的字节偏移
+    size_t end;                  // 最后一个标记之后的字节偏移
+    size_t first_length;         // 第一个标记的字节数
+    int line;                    // 第一个标记所在行
+    int end_line;                // end所在行
+    int end_column;              // end所在列
+} StatementSpan;
+
+/**
+ * 文档
+ */
+struct KunyuDocument {
+    char *source;                // 源码
+    size_t length;               // 源码字节数
+    AstNode *program;            // 语法树，源码有错误时为NULL
+    StatementSpan *spans;        // 每条顶层语句的范围，与语法树中的语句一一对应
+    int changed_first;           // 最近一次分析产生的第一条语句
+    int changed_count;           // 最近一次分析产生的语句数
+    KunyuError error;            // 最近一次分析的错误
+};
+
+/**
+ * 记录错误
+ */
+static bool document_fail(KunyuDocument *doc, KunyuErrorCode code, const char *message, int line, int column) {
+    doc->error.code = code;
+    doc->error.line = line;
+    doc->error.column = column;
+    snprintf(doc->error.message, sizeof(doc->error.message), "%s", message);
+    return false;
+}
+
+/**
+ * 统计换行符的个数
+ */
+static int count_newlines(const char *text, size_t length) {
+    int count = 0;
+    const char *end = text + length;
+    for (const char *p = text; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * 对源码中的一段进行词法分析，标记的位置换算为整个源码中的位置
+ * @param start 起始字节，必须位于标记之间
+ * @param line 起始位置的行号
+ * @param column 起始位置的列号
+ */
+static Token* lex_range(KunyuDocument *doc, size_t start, size_t end, int line, int column, size_t *count) {
+    size_t length = end - start;
+    char *text = (char *)malloc(length + 1);
+    if (text == NULL) {
+        document_fail(doc, KUNYU_ERROR_MEMORY, "内存分配失败，无法复制源码", 0, 0);
+        return NULL;
+    }
+    memcpy(text, doc->source + start, length);
+    text[length] = '\0';
+
+    if (lexer_init(text) == NULL) {
+        free(text);
+        document_fail(doc, KUNYU_ERROR_MEMORY, "内存分配失败，无法初始化词法分析器", 0, 0);
+        return NULL;
+    }
+    if (lexer_tokenize() < 0) {
+        KunyuError *error = lexer_get_error();
+        int error_line = error->line + line - 1;
+        int error_column = error->line == 1 ? error->column + column - 1 : error->column;
+        document_fail(doc, KUNYU_ERROR_LEXER, error->message, error_line, error_column);
+        lexer_free();
+        free(text);
+        return NULL;
+    }
+
+    Token *tokens = lexer_detach_tokens(count);
+    free(text);
+
+    for (size_t i = 0; i < *count; i++) {
+        if (tokens[i].line == 1) {
+            tokens[i].column += column - 1;
+        }
+        tokens[i].line += line - 1;
+        tokens[i].offset += start;
+    }
+    return tokens;
+}
+
+/**
+ * 分析标记并计算每条顶层语句的范围。函数体全部立即分析，编辑器需要看到所有语法错误，
+ * 语法树也就不再引用标记
+ * @return 程序节点，失败返回NULL
+ */
+static AstNode* parse_range(KunyuDocument *doc, Token *tokens, size_t token_count, StatementSpan **spans_out) {
+    size_t *ranges = NULL;
+    AstNode *program = parser_parse_spans(tokens, token_count, &ranges);
+    if (program != NULL && !parser_parse_function_bodies(program, 0)) {
+        ast_free(program);
+        free(ranges);
+        program = NULL;
+    }
+    if (program == NULL) {
+        KunyuError *error = parser_get_error();
+        document_fail(doc, error->code != KUNYU_OK ? error->code : KUNYU_ERROR_PARSER,
+                      error->message, error->line, error->column);
+        return NULL;
+    }
+
+    int count = ((Program *)program)->stmt_count;
+    StatementSpan *spans = (StatementSpan *)malloc(sizeof(StatementSpan) * (count > 0 ? count : 1));
+    if (spans == NULL) {
+        ast_free(program);
+        free(ranges);
+        document_fail(doc, KUNYU_ERROR_MEMORY, "内存分配失败，无法记录语句的位置", 0, 0);
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const Token *first = &tokens[ranges[2 * i]];
+        // 条件语句会越过换行查找否则，范围不包括语句末尾的换行
+        size_t last_index = ranges[2 * i + 1] - 1;
+        while (last_index > ranges[2 * i] && tokens[last_index].type == KUNYU_TOKEN_NEWLINE) {
+            last_index--;
+        }
+        const Token *last = &tokens[last_index];
+
+        StatementSpan *span = &spans[i];
+        span->start = first->offset;
+        span->end = last->offset + last->length;
+        span->first_length = first->length;
+        span->line = first->line;
+
+        // 与词法分析器相同的方式计算最后一个标记之后的行列号（字符串中可以有换行）
+        span->end_line = last->line;
+        span->end_column = last->column;
+        for (size_t k = last->offset; k < span->end; k++) {
+            if (doc->source[k] == '\n') {
+                span->end_line++;
+                span->end_column = 1;
+            } else {
+                span->end_column++;
+            }
+        }
+    }
+
+    free(ranges);
+    optimizer_optimize(program);
+    *spans_out = spans;
+    return program;
+}
+
+/**
+ * 完整分析整个源码
+ */
+static bool parse_all(KunyuDocument *doc) {
+    ast_free(doc->program);
+    free(doc->spans);
+    doc->program = NULL;
+    doc->spans = NULL;
+    doc->changed_first = 0;
+    doc->changed_count = 0;
+
+    size_t token_count;
+    Token *tokens = lex_range(doc, 0, doc->length, 1, 1, &token_count);
+    if (tokens == NULL) {
+        return false;
+    }
+
+    doc->program = parse_range(doc, tokens, token_count, &doc->spans);
+    lexer_free_tokens(tokens, token_count);
+    if (doc->program == NULL) {
+        return false;
+    }
+
+    doc->changed_count = ((Program *)doc->program)->stmt_count;
+    return true;
+}
+
+/**
+ * 创建文档并完整分析
+ * @param source 源码
+ * @return 文档，内存不足时返回NULL。源码有错误时仍返回文档，错误通过document_error获取
+ */
+KunyuDocument* document_new(const char *source) {
+    KunyuDocument *doc = (KunyuDocument *)calloc(1, sizeof(KunyuDocument));
+    if (doc == NULL) {
+        return NULL;
+    }
+
+    doc->length = strlen(source);
+    doc->source = strdup(source);
+    if (doc->source == NULL) {
+        free(doc);
+        return NULL;
+    }
+
+    size_t error_offset;
+    if (!utf8_validate(doc->source, doc->length, &error_offset)) {
+        char message[64];
+        snprintf(message, sizeof(message), "源码不是有效的UTF-8编码（第%zu字节）", error_offset + 1);
+        document_fail(doc, KUNYU_ERROR_LEXER, message, 0, 0);
+        return doc;
+    }
+
+    parse_all(doc);
+    return doc;
+}
+
+/**
+ * 查找第一条结束位置不早于offset的语句
+ */
+static int find_first_ending_at(const KunyuDocument *doc, int count, size_t offset) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (doc->spans[mid].end < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * 查找第一条开始位置晚于offset的语句
+ */
+static int find_first_starting_after(const KunyuDocument *doc, int from, int count, size_t offset) {
+    int low = from, high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (doc->spans[mid].start <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * 用新分析的语句替换[first, last)之间的语句，之后的语句移动字节偏移和行号
+ */
+static bool splice_statements(KunyuDocument *doc, int first, int last, AstNode *region,
+                              StatementSpan *region_spans, size_t byte_delta_added,
+                              size_t byte_delta_removed, int line_delta) {
+    Program *program = (Program *)doc->program;
+    Program *replacement = (Program *)region;
+    int old_count = program->stmt_count;
+    int replaced_count = replacement->stmt_count;
+    int new_count = old_count - (last - first) + replaced_count;
+
+    AstNode **statements = (AstNode **)malloc(sizeof(AstNode *) * (new_count > 0 ? new_count : 1));
+    StatementSpan *spans = (StatementSpan *)malloc(sizeof(StatementSpan) * (new_count > 0 ? new_count : 1));
+    if (statements == NULL || spans == NULL) {
+        free(statements);
+        free(spans);
+        return document_fail(doc, KUNYU_ERROR_MEMORY, "内存分配失败，无法更新语法树", 0, 0);
+    }
+
+    int index = 0;
+    for (int i = 0; i < first; i++, index++) {
+        statements[index] = program->statements[i];
+        spans[index] = doc->spans[i];
+    }
+    for (int i = 0; i < replaced_count; i++, index++) {
+        statements[index] = replacement->statements[i];
+        spans[index] = region_spans[i];
+    }
+    for (int i = last; i < old_count; i++, index++) {
+        AstNode *stmt = program->statements[i];
+        StatementSpan span = doc->spans[i];
+        if (line_delta != 0) {
+            ast_shift_lines(stmt, line_delta);
+            span.line += line_delta;
+            span.end_line += line_delta;
+        }
+        span.start = span.start + byte_delta_added - byte_delta_removed;
+        span.end = span.end + byte_delta_added - byte_delta_removed;
+        statements[index] = stmt;
+        spans[index] = span;
+    }
+
+    for (int i = first; i < last; i++) {
+        ast_free(program->statements[i]);
+    }
+    free(program->statements);
+    free(doc->spans);
+    program->statements = statements;
+    program->stmt_count = new_count;
+    doc->spans = spans;
+
+    // 语句已经移入文档，只释放替换用的程序节点本身
+    replacement->stmt_count = 0;
+    ast_free(region);
+    free(region_spans);
+
+    doc->changed_first = first;
+    doc->changed_count = replaced_count;
+    return true;
+}
+
+/**
+ * 编辑文档：把[start, end)之间的字节替换为text，然后重新分析受影响的顶层语句
+ * @param start 起始字节偏移
+ * @param end 结束字节偏移
+ * @param text 新文本
+ * @return 编辑后的源码没有错误时返回true。有错误时源码仍然更新，语法树为NULL，
+ *         错误通过document_error获取，下一次编辑会完整分析
+ */
+bool document_edit(KunyuDocument *doc, size_t start, size_t end, const char *text) {
+    doc->error.code = KUNYU_OK;
+    doc->error.message[0] = '\0';
+    doc->error.line = 0;
+    doc->error.column = 0;
+
+    if (start > end || end > doc->length) {
+        return document_fail(doc, KUNYU_ERROR_RUNTIME, "编辑范围超出了源码", 0, 0);
+    }
+    // 不能从UTF-8多字节字符的中间切开
+    const unsigned char *old = (const unsigned char *)doc->source;
+    if ((start < doc->length && (old[start] & 0xC0) == 0x80) ||
+        (end < doc->length && (old[end] & 0xC0) == 0x80)) {
+        return document_fail(doc, KUNYU_ERROR_RUNTIME, "编辑范围不在字符边界上", 0, 0);
+    }
+    size_t added = strlen(text);
+    if (!utf8_validate(text, added, NULL)) {
+        return document_fail(doc, KUNYU_ERROR_LEXER, "插入的文本不是有效的UTF-8编码", 0, 0);
+    }
+
+    // 生成新的源码
+    size_t removed = end - start;
+    size_t new_length = doc->length - removed + added;
+    char *source = (char *)malloc(new_length + 1);
+    if (source == NULL) {
+        return document_fail(doc, KUNYU_ERROR_MEMORY, "内存分配失败，无法更新源码", 0, 0);
+    }
+    memcpy(source, doc->source, start);
+    memcpy(source + start, text, added);
+    memcpy(source + start + added, doc->source + end, doc->length - end);
+    source[new_length] = '\0';
+
+    int line_delta = count_newlines(text, added) - count_newlines(doc->source + start, removed);
+
+    // 受影响的语句：从第一条结束位置不早于编辑起点的语句，
+    // 到编辑终点所在行之后开始的第一条语句（不含），之后的语句列号不变
+    int count = doc->program != NULL ? ((Program *)doc->program)->stmt_count : 0;
+    int first = find_first_ending_at(doc, count, start);
+    const char *newline = memchr(doc->source + end, '\n', doc->length - end);
+    int last = newline != NULL
+        ? find_first_starting_after(doc, first, count, (size_t)(newline - doc->source))
+        : count;
+
+    size_t region_start = first > 0 ? doc->spans[first - 1].end : 0;
+    int region_line = first > 0 ? doc->spans[first - 1].end_line : 1;
+    int region_column = first > 0 ? doc->spans[first - 1].end_column : 1;
+    size_t region_end = last < count ? doc->spans[last].start - removed + added : new_length;
+    size_t next_length = last < count ? doc->spans[last].first_length : 0;
+
+    bool had_program = doc->program != NULL;
+    free(doc->source);
+    doc->source = source;
+    doc->length = new_length;
+    if (!had_program) {
+        return parse_all(doc);
+    }
+
+    // 多分析一个标记：后面那条语句的第一个标记必须原样出现在原来的位置上，
+    // 否则说明编辑改变了之后的词法分析（例如未闭合的字符串），需要完整分析
+    size_t token_count;
+    Token *tokens = lex_range(doc, region_start, region_end + next_length, region_line, region_column,
+                              &token_count);
+    if (tokens == NULL) {
+        return parse_all(doc);
+    }
+    if (last < count) {
+        size_t next = token_count >= 2 ? token_count - 2 : 0;
+        if (token_count < 2 || tokens[next].offset != region_end || tokens[next].length != next_length) {
+            lexer_free_tokens(tokens, token_count);
+            return parse_all(doc);
+        }
+        // 把这个标记当作分析的终点
+        tokens[next].type = KUNYU_TOKEN_EOF;
+        token_count = next + 1;
+    }
+
+    // 局部分析失败可能是编辑把几条语句连在了一起，由完整分析给出结果
+    StatementSpan *region_spans = NULL;
+    AstNode *region = parse_range(doc, tokens, token_count, &region_spans);
+    lexer_free_tokens(tokens, token_count + (last < count ? 1 : 0));
+    if (region == NULL) {
+        return parse_all(doc);
+    }
+
+    return splice_statements(doc, first, last, region, region_spans, added, removed, line_delta);
+}
+
+/**
+ * 获取语法树，源码有错误时返回NULL
+ */
+struct AstNode* document_ast(const KunyuDocument *doc) {
+    return doc->program;
+}
+
+/**
+ * 获取源码
+ */
+const char* document_source(const KunyuDocument *doc) {
+    return doc->source;
+}
+
+/**
+ * 最近一次编辑重新分析了哪些顶层语句，其余语句的语法树是编辑前的节点
+ * @param first 输出第一条重新分析的语句的序号
+ * @return 重新分析的语句数
+ */
+int document_changed(const KunyuDocument *doc, int *first) {
+    *first = doc->changed_first;
+    return doc->changed_count;
+}
+
+/**
+ * 获取顶层语句在源码中的范围
+ * @param index 语句序号
+ * @param start 输出第一个标记的字节偏移
+ * @param end 输出最后一个标记之后的字节偏移
+ * @param line 输出第一个标记所在行
+ * @return 源码有错误或序号超出范围时返回false
+ */
+bool document_statement_span(const KunyuDocument *doc, int index, size_t *start, size_t *end, int *line) {
+    if (doc->program == NULL || index < 0 || index >= ((Program *)doc->program)->stmt_count) {
+        return false;
+    }
+    const StatementSpan *span = &doc->spans[index];
+    *start = span->start;
+    *end = span->end;
+    *line = span->line;
+    return true;
+}
+
+/**
+ * 获取最近一次分析的错误
+ */
+KunyuError* document_error(KunyuDocument *doc) {
+    return &doc->error;
+}
+
+/**
+ * 释放文档
+ */
+void document_free(KunyuDocument *doc) {
+    if (doc == NULL) {
+        return;
+    }
+    ast_free(doc->program);
+    free(doc->spans);
+    free(doc->source);
+    free(doc);
+}
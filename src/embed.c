@@ -0,0 +1,364 @@
+/**
+ * 坤舆编程语言 - 嵌入接口
+ * 编译脚本时完整分析所有函数体并执行顶层语句，之后调用脚本中的函数不再经过词法分析和语法分析。
+ * 解释器的状态是进程级的，KunyuState只负责保存编译过的脚本和最近一次的错误。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include "../includes/libkunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * 编译好的脚本
+ */
+struct KunyuScript {
+    KunyuState *state;           // 所属状态
+    AstNode *ast;                // 语法树，脚本中定义的函数指向其中的节点
+    struct KunyuScript *next;
+};
+
+/**
+ * 解释器状态
+ */
+struct KunyuState {
+    KunyuScript *scripts;        // 编译过的脚本，语法树保留到状态释放
+    char error[320];             // 最近一次的错误，没有错误时为空字符串
+};
+
+// 是否已经有状态，解释器是进程级的，同一时间只能有一个
+static bool state_exists = false;
+
+/**
+ * 记录错误
+ */
+static void embed_error(KunyuState *state, const char *kind, const KunyuError *error) {
+    snprintf(state->error, sizeof(state->error), "%s: %s (行 %d, 列 %d)",
+             kind, error->message, error->line, error->column);
+}
+
+/**
+ * 创建解释器状态
+ * @return 状态，已经有状态或内存不足时返回NULL
+ */
+KunyuState* kunyu_state_new(void) {
+    if (state_exists) {
+        return NULL;
+    }
+
+    KunyuState *state = (KunyuState *)calloc(1, sizeof(KunyuState));
+    if (state == NULL) {
+        return NULL;
+    }
+
+    // 脚本中的相对模块路径以当前目录为基准
+    module_set_entry(NULL);
+    state_exists = true;
+    return state;
+}
+
+/**
+ * 释放解释器状态和其中编译过的所有脚本
+ */
+void kunyu_state_free(KunyuState *state) {
+    if (state == NULL) {
+        return;
+    }
+
+    // 函数表指向脚本的语法树，先清理解释器
+    interpreter_cleanup();
+
+    KunyuScript *script = state->scripts;
+    while (script != NULL) {
+        KunyuScript *next = script->next;
+        ast_free(script->ast);
+        free(script);
+        script = next;
+    }
+    module_set_entry(NULL);
+    free(state);
+    state_exists = false;
+}
+
+/**
+ * 分析源码，得到优化过的语法树。函数体全部立即分析，语法错误在编译时而不是第一次调用时报告
+ */
+static AstNode* compile_source(KunyuState *state, const char *source) {
+    size_t error_offset;
+    if (!utf8_validate(source, strlen(source), &error_offset)) {
+        snprintf(state->error, sizeof(state->error), "源码不是有效的UTF-8编码（第%zu字节）", error_offset + 1);
+        return NULL;
+    }
+
+    if (lexer_init(source) == NULL) {
+        snprintf(state->error, sizeof(state->error), "内存分配失败，无法初始化词法分析器");
+        return NULL;
+    }
+    int token_count = lexer_tokenize();
+    if (token_count < 0) {
+        embed_error(state, "词法分析错误", lexer_get_error());
+        lexer_free();
+        return NULL;
+    }
+
+    size_t detached_count;
+    Token *tokens = lexer_detach_tokens(&detached_count);
+    lexer_free();
+
+    AstNode *ast = parser_parse(tokens, token_count);
+    if (ast != NULL && !parser_parse_function_bodies(ast, 0)) {
+        ast_free(ast);
+        ast = NULL;
+    }
+    if (ast == NULL) {
+        embed_error(state, "语法分析错误", parser_get_error());
+    }
+    lexer_free_tokens(tokens, detached_count);
+
+    if (ast != NULL) {
+        optimizer_optimize(ast);
+    }
+    return ast;
+}
+
+/**
+ * 编译脚本：分析源码并在全局作用域中执行顶层语句（定义函数、变量，导入模块）
+ * @param source 源码
+ * @return 脚本，出错时返回NULL，错误通过kunyu_last_error获取
+ */
+KunyuScript* kunyu_compile(KunyuState *state, const char *source) {
+    if (state == NULL || source == NULL) {
+        return NULL;
+    }
+    state->error[0] = '\0';
+
+    KunyuScript *script = (KunyuScript *)calloc(1, sizeof(KunyuScript));
+    if (script == NULL) {
+        snprintf(state->error, sizeof(state->error), "内存分配失败，无法创建脚本");
+        return NULL;
+    }
+
+    script->ast = compile_source(state, source);
+    if (script->ast == NULL) {
+        free(script);
+        return NULL;
+    }
+
+    // 顶层语句执行到一半出错时，之前定义的函数已经指向语法树，脚本仍要保留到状态释放
+    script->state = state;
+    script->next = state->scripts;
+    state->scripts = script;
+
+    Program *program = (Program *)script->ast;
+    if (!interpreter_execute_statements(script->ast, 0, program->stmt_count)) {
+        embed_error(state, "运行时错误", interpreter_get_error());
+        return NULL;
+    }
+    return script;
+}
+
+/**
+ * 调用脚本中定义的函数
+ * @param function 函数名
+ * @param args 参数，引用仍归调用者所有
+ * @return 返回值的新引用。出错或函数没有返回值时返回NULL，出错时kunyu_last_error不为NULL
+ */
+KunyuValue* kunyu_call(KunyuScript *script, const char *function, KunyuValue **args, int arg_count) {
+    if (script == NULL || function == NULL || arg_count < 0 || (arg_count > 0 && args == NULL)) {
+        return NULL;
+    }
+    KunyuState *state = script->state;
+    state->error[0] = '\0';
+
+    PyObject *result = interpreter_call_named(function, args, arg_count);
+    if (result == NULL) {
+        KunyuError *error = interpreter_get_error();
+        if (error->code == KUNYU_ERROR_PARSER) {
+            embed_error(state, "语法分析错误", error);
+        } else if (error->code != KUNYU_OK) {
+            embed_error(state, "运行时错误", error);
+        }
+    }
+    return result;
+}
+
+/**
+ * 获取最近一次编译或调用的错误
+ * @return 错误信息，没有错误时返回NULL
+ */
+const char* kunyu_last_error(const KunyuState *state) {
+    if (state == NULL || state->error[0] == '\0') {
+        return NULL;
+    }
+    return state->error;
+}
+
+/**
+ * 创建数字
+ */
+KunyuValue* kunyu_number_new(double value) {
+    return py_number_new(value);
+}
+
+/**
+ * 创建整数
+ */
+KunyuValue* kunyu_integer_new(int64_t value) {
+    return py_int_new(value);
+}
+
+/**
+ * 创建字符串
+ * @return 字符串，不是有效的UTF-8编码时返回NULL
+ */
+KunyuValue* kunyu_string_new(const char *utf8) {
+    if (utf8 == NULL || !utf8_validate(utf8, strlen(utf8), NULL)) {
+        return NULL;
+    }
+    return py_string_new(utf8);
+}
+
+/**
+ * 创建空列表
+ */
+KunyuValue* kunyu_list_new(void) {
+    return py_list_new();
+}
+
+/**
+ * 在列表末尾添加一项，列表持有它自己的引用
+ */
+bool kunyu_list_push(KunyuValue *list, KunyuValue *item) {
+    return py_list_append(list, item);
+}
+
+/**
+ * 创建空字典
+ */
+KunyuValue* kunyu_dict_new(void) {
+    return py_dict_new();
+}
+
+/**
+ * 设置字典中字符串键对应的值，字典持有它自己的引用
+ */
+bool kunyu_dict_put(KunyuValue *dict, const char *key, KunyuValue *value) {
+    PyObject *key_obj = kunyu_string_new(key);
+    if (key_obj == NULL) {
+        return false;
+    }
+    bool result = py_dict_set(dict, key_obj, value);
+    py_decref(key_obj);
+    return result;
+}
+
+/**
+ * 获取值的类型
+ */
+KunyuValueType kunyu_type(const KunyuValue *value) {
+    if (value == NULL) {
+        return KUNYU_VALUE_OTHER;
+    }
+    switch (value->type) {
+        case TYPE_NUMBER:
+        case TYPE_BIGINT:   return KUNYU_VALUE_NUMBER;
+        case TYPE_STRING:   return KUNYU_VALUE_STRING;
+        case TYPE_LIST:     return KUNYU_VALUE_LIST;
+        case TYPE_DICT:     return KUNYU_VALUE_DICT;
+        case TYPE_FUNCTION: return KUNYU_VALUE_FUNCTION;
+        default:            return KUNYU_VALUE_OTHER;
+    }
+}
+
+/**
+ * 获取数字的值，大整数返回最接近的浮点数
+ * @return 数值，不是数字时返回NAN
+ */
+double kunyu_to_number(const KunyuValue *value) {
+    if (value == NULL) {
+        return NAN;
+    }
+    if (value->type == TYPE_NUMBER) {
+        return ((const PyNumberObject *)value)->value;
+    }
+    if (value->type == TYPE_BIGINT) {
+        return py_bigint_to_double((PyObject *)value);
+    }
+    return NAN;
+}
+
+/**
+ * 获取64位整数的值
+ * @return 值是能用64位整数表示的整数时返回true
+ */
+bool kunyu_to_integer(const KunyuValue *value, int64_t *out) {
+    if (value == NULL || value->type != TYPE_NUMBER || !((const PyNumberObject *)value)->is_int) {
+        return false;
+    }
+    *out = ((const PyNumberObject *)value)->int_value;
+    return true;
+}
+
+/**
+ * 获取字符串的内容，指针在值释放前有效
+ * @param length 输出字节数，可以为NULL
+ * @return UTF-8字符串，不是字符串时返回NULL
+ */
+const char* kunyu_to_string(const KunyuValue *value, size_t *length) {
+    if (value == NULL || value->type != TYPE_STRING) {
+        return NULL;
+    }
+    const PyStringObject *str = (const PyStringObject *)value;
+    if (length != NULL) {
+        *length = str->length;
+    }
+    return str->value;
+}
+
+/**
+ * 获取列表的长度，不是列表时返回0
+ */
+size_t kunyu_list_size(const KunyuValue *list) {
+    return py_list_length((PyObject *)list);
+}
+
+/**
+ * 获取列表中的一项
+ * @return 新引用，越界或不是列表时返回NULL
+ */
+KunyuValue* kunyu_list_at(const KunyuValue *list, size_t index) {
+    return py_list_get((PyObject *)list, index);
+}
+
+/**
+ * 获取字典中字符串键对应的值
+ * @return 新引用，没有这个键或不是字典时返回NULL
+ */
+KunyuValue* kunyu_dict_lookup(const KunyuValue *dict, const char *key) {
+    PyObject *key_obj = kunyu_string_new(key);
+    if (key_obj == NULL) {
+        return NULL;
+    }
+    PyObject *value = py_dict_get((PyObject *)dict, key_obj);
+    py_decref(key_obj);
+    return value;
+}
+
+/**
+ * 增加引用
+ */
+void kunyu_retain(KunyuValue *value) {
+    if (value != NULL) {
+        py_incref(value);
+    }
+}
+
+/**
+ * 释放引用
+ */
+void kunyu_release(KunyuValue *value) {
+    py_decref(value);
+}
@@ -0,0 +1,892 @@
+/**
+ * 坤舆编程语言 - 事件循环
+ * 基于epoll的单线程事件循环：定时器，以及文件、管道、子进程输出和Unix域套接字的非阻塞读写。
+ * 脚本注册回调后调用运行事件循环，I/O就绪或定时器到期时在同一个线程中依次调用回调，
+ * 一个解释器可以同时等待多个管道或套接字，不需要线程。
+ *
+ * 脚本看到的句柄和定时器都是从1开始的编号，关闭后不会被重用，
+ * 回调中关闭句柄或取消定时器不会影响循环中还没处理的其他事件。
+ */
+
+#include "../includes/kunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define LOOP_READ_CHUNK 65536
+#define LOOP_MAX_EVENTS 64
+#define LOOP_LISTEN_BACKLOG 64
+
+/**
+ * 句柄类型
+ */
+typedef enum {
+    HANDLE_FILE,                 // 文件
+    HANDLE_PIPE,                 // 管道的一端
+    HANDLE_PROCESS,              // 子进程的标准输出
+    HANDLE_SOCKET,               // 已连接的套接字
+    HANDLE_LISTENER              // 监听套接字
+} HandleKind;
+
+/**
+ * 等待写入的数据
+ */
+typedef struct WriteRequest {
+    char *data;
+    size_t length;
+    size_t offset;               // 已经写入的字节数
+    PyObject *callback;          // 写完后调用，可以为NULL
+    struct WriteRequest *next;
+} WriteRequest;
+
+/**
+ * 句柄
+ */
+typedef struct LoopHandle {
+    int id;                      // 脚本看到的编号
+    int fd;
+    HandleKind kind;
+    pid_t pid;                   // 子进程，只有HANDLE_PROCESS有
+    char *path;                  // 套接字文件，只有HANDLE_LISTENER有，关闭时删除
+    PyObject *read_callback;     // 读取数据或接受连接的回调，NULL表示不读
+    char partial[4];             // 上次读到的不完整的UTF-8字符
+    size_t partial_length;
+    WriteRequest *writes;        // 写入队列
+    WriteRequest *writes_tail;
+    uint32_t events;             // 已经向epoll注册的事件，0表示没有注册
+    bool pollable;               // 普通文件不能加入epoll，总是视为就绪
+    struct LoopHandle *next;
+} LoopHandle;
+
+/**
+ * 定时器
+ */
+typedef struct Timer {
+    int id;
+    double due;                  // 到期时间（毫秒，单调时钟）
+    PyObject *callback;
+    struct Timer *next;
+} Timer;
+
+// 事件循环状态
+static struct {
+    int epoll_fd;                // 第一次注册事件时创建
+    LoopHandle *handles;
+    Timer *timers;               // 按到期时间排序，同时到期的按创建顺序
+    int next_handle_id;
+    int next_timer_id;
+    int64_t dispatched;          // 本次运行调用的回调数
+    bool running;
+} loop = { -1, NULL, NULL, 1, 1, 0, false };
+
+/**
+ * 记录运行时错误，内置函数返回NULL时解释器保留这条信息
+ */
+static void loop_error(const char *format, const char *detail) {
+    KunyuError *error = interpreter_get_error();
+    error->code = KUNYU_ERROR_RUNTIME;
+    snprintf(error->message, sizeof(error->message), format, detail);
+}
+
+/**
+ * 获取单调时钟的毫秒数
+ */
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * 设置非阻塞和执行时关闭，子进程不会继承循环中的描述符
+ */
+static bool set_fd_flags(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+           fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+/**
+ * 按编号查找句柄
+ */
+static LoopHandle* find_handle(int id) {
+    for (LoopHandle *handle = loop.handles; handle != NULL; handle = handle->next) {
+        if (handle->id == id) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 按编号查找句柄，找不到时记录错误
+ */
+static LoopHandle* require_handle(int id) {
+    LoopHandle *handle = find_handle(id);
+    if (handle == NULL) {
+        char text[32];
+        snprintf(text, sizeof(text), "%d", id);
+        loop_error("句柄%s不存在或已经关闭", text);
+    }
+    return handle;
+}
+
+/**
+ * 为描述符创建句柄，失败时关闭描述符
+ * @return 句柄编号，失败返回0
+ */
+static int add_handle(int fd, HandleKind kind, pid_t pid) {
+    LoopHandle *handle = (LoopHandle *)calloc(1, sizeof(LoopHandle));
+    if (handle == NULL || !set_fd_flags(fd)) {
+        free(handle);
+        close(fd);
+        loop_error("%s", handle == NULL ? "内存分配失败，无法创建句柄" : "无法设置非阻塞模式");
+        return 0;
+    }
+    handle->id = loop.next_handle_id++;
+    handle->fd = fd;
+    handle->kind = kind;
+    handle->pid = pid;
+    handle->pollable = true;
+    handle->next = loop.handles;
+    loop.handles = handle;
+    return handle->id;
+}
+
+/**
+ * 句柄是否在等待读取或写入
+ */
+static bool handle_active(const LoopHandle *handle) {
+    return handle->read_callback != NULL || handle->writes != NULL;
+}
+
+/**
+ * 按句柄当前等待的操作更新epoll中注册的事件。
+ * 没有等待的操作时从epoll中移除，否则对端关闭后会一直报告EPOLLHUP
+ */
+static bool update_interest(LoopHandle *handle) {
+    uint32_t events = (handle->read_callback != NULL ? EPOLLIN : 0) |
+                      (handle->writes != NULL ? EPOLLOUT : 0);
+    if (!handle->pollable || events == handle->events) {
+        return true;
+    }
+
+    if (loop.epoll_fd < 0) {
+        loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop.epoll_fd < 0) {
+            loop_error("无法创建事件循环: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u32 = (uint32_t)handle->id;
+    int op = handle->events == 0 ? EPOLL_CTL_ADD : (events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    if (epoll_ctl(loop.epoll_fd, op, handle->fd, &event) != 0) {
+        if (errno == EPERM) {
+            // 普通文件和/dev/null这类设备不支持epoll，读写总是立即完成
+            handle->pollable = false;
+            handle->events = 0;
+            return true;
+        }
+        loop_error("无法注册事件: %s", strerror(errno));
+        return false;
+    }
+    handle->events = events;
+    return true;
+}
+
+/**
+ * 释放写入请求
+ */
+static void free_write_request(WriteRequest *request) {
+    if (request->callback != NULL) {
+        py_decref(request->callback);
+    }
+    free(request->data);
+    free(request);
+}
+
+/**
+ * 关闭句柄并从列表中移除，未完成的写入直接丢弃
+ * @param terminate 子进程还在运行时是否先结束它
+ * @return 子进程的退出码，其他句柄返回0
+ */
+static int destroy_handle(LoopHandle *handle, bool terminate) {
+    LoopHandle **link = &loop.handles;
+    while (*link != handle) {
+        link = &(*link)->next;
+    }
+    *link = handle->next;
+
+    // 关闭描述符会自动从epoll中移除
+    close(handle->fd);
+    if (handle->path != NULL) {
+        unlink(handle->path);
+        free(handle->path);
+    }
+    if (handle->read_callback != NULL) {
+        py_decref(handle->read_callback);
+    }
+    while (handle->writes != NULL) {
+        WriteRequest *next = handle->writes->next;
+        free_write_request(handle->writes);
+        handle->writes = next;
+    }
+
+    int status = 0;
+    if (handle->pid > 0) {
+        if (terminate) {
+            kill(handle->pid, SIGTERM);
+        }
+        int wait_status = 0;
+        while (waitpid(handle->pid, &wait_status, 0) < 0 && errno == EINTR) {
+        }
+        if (WIFEXITED(wait_status)) {
+            status = WEXITSTATUS(wait_status);
+        } else if (WIFSIGNALED(wait_status)) {
+            status = 128 + WTERMSIG(wait_status);
+        }
+    }
+    free(handle);
+    return status;
+}
+
+/**
+ * 调用回调
+ * @param arg 参数，NULL表示没有参数；引用仍归调用者所有
+ * @return 回调出错返回false
+ */
+static bool call_callback(PyObject *callback, PyObject *arg) {
+    // 回调可能关闭自己所在的句柄，调用期间保持引用
+    py_incref(callback);
+    PyObject *result = interpreter_call_function(callback, arg != NULL ? &arg : NULL, arg != NULL ? 1 : 0);
+    py_decref(callback);
+    loop.dispatched++;
+
+    if (result != NULL) {
+        py_decref(result);
+        return true;
+    }
+    // 没有返回值的函数也返回NULL
+    return interpreter_get_error()->code == KUNYU_OK;
+}
+
+/**
+ * 调用带一个整数参数的回调
+ */
+static bool call_callback_int(PyObject *callback, int64_t value) {
+    PyObject *arg = py_int_new(value);
+    if (arg == NULL) {
+        return false;
+    }
+    bool result = call_callback(callback, arg);
+    py_decref(arg);
+    return result;
+}
+
+/**
+ * 计算缓冲区末尾不完整的UTF-8字符的字节数，留到下次读取时拼接
+ */
+static size_t incomplete_utf8_tail(const char *data, size_t length) {
+    for (size_t back = 1; back <= 3 && back <= length; back++) {
+        unsigned char c = (unsigned char)data[length - back];
+        if ((c & 0xC0) == 0x80) {
+            continue;
+        }
+        size_t need = c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 1));
+        return need > back ? back : 0;
+    }
+    return 0;
+}
+
+/**
+ * 读取一次数据交给回调，读到文件末尾时以空字符串调用回调并停止读取
+ * @return 出错返回false
+ */
+static bool dispatch_read(LoopHandle *handle) {
+    char buffer[LOOP_READ_CHUNK + 8];
+    memcpy(buffer, handle->partial, handle->partial_length);
+    ssize_t count = read(handle->fd, buffer + handle->partial_length, LOOP_READ_CHUNK);
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        loop_error("读取失败: %s", strerror(errno));
+        return false;
+    }
+
+    size_t length = handle->partial_length + (size_t)count;
+    size_t tail = count > 0 ? incomplete_utf8_tail(buffer, length) : 0;
+    length -= tail;
+    if (count == 0 && length > 0) {
+        // 文件以不完整的字符结尾
+        loop_error("%s", "读取的数据不是有效的UTF-8编码");
+        return false;
+    }
+    if (memchr(buffer, '\0', length) != NULL || !utf8_validate(buffer, length, NULL)) {
+        loop_error("%s", "读取的数据不是有效的UTF-8编码");
+        return false;
+    }
+    memcpy(handle->partial, buffer + length, tail);
+    handle->partial_length = tail;
+    if (count > 0 && length == 0) {
+        return true;
+    }
+
+    buffer[length] = '\0';
+    PyObject *data = py_string_new(buffer);
+    if (data == NULL) {
+        return false;
+    }
+    PyObject *callback = handle->read_callback;
+    if (count == 0) {
+        // 到达末尾后不再读取，回调中可以关闭句柄
+        handle->read_callback = NULL;
+        update_interest(handle);
+    } else {
+        py_incref(callback);
+    }
+    bool result = call_callback(callback, data);
+    py_decref(callback);
+    py_decref(data);
+    return result;
+}
+
+/**
+ * 接受所有等待中的连接，每个连接以新句柄的编号调用回调
+ * @return 出错返回false
+ */
+static bool dispatch_accept(int id) {
+    for (;;) {
+        LoopHandle *handle = find_handle(id);
+        if (handle == NULL || handle->read_callback == NULL) {
+            return true;
+        }
+        int fd = accept(handle->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                return true;
+            }
+            loop_error("接受连接失败: %s", strerror(errno));
+            return false;
+        }
+        int client = add_handle(fd, HANDLE_SOCKET, 0);
+        if (client == 0 || !call_callback_int(handle->read_callback, client)) {
+            return false;
+        }
+    }
+}
+
+/**
+ * 尽量写出队列中的数据，写完的请求以写入的字节数调用回调
+ * @return 出错返回false
+ */
+static bool dispatch_write(int id) {
+    for (;;) {
+        LoopHandle *handle = find_handle(id);
+        if (handle == NULL || handle->writes == NULL) {
+            return true;
+        }
+        WriteRequest *request = handle->writes;
+        while (request->offset < request->length) {
+            ssize_t count = write(handle->fd, request->data + request->offset, request->length - request->offset);
+            if (count < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                loop_error("写入失败: %s", strerror(errno));
+                return false;
+            }
+            request->offset += (size_t)count;
+        }
+
+        handle->writes = request->next;
+        if (handle->writes == NULL) {
+            handle->writes_tail = NULL;
+            update_interest(handle);
+        }
+        bool result = request->callback == NULL ||
+                      call_callback_int(request->callback, (int64_t)request->length);
+        free_write_request(request);
+        if (!result) {
+            return false;
+        }
+    }
+}
+
+/**
+ * 处理句柄上的事件。回调可能关闭任何句柄，每一步之前都按编号重新查找
+ * @return 出错返回false
+ */
+static bool dispatch_handle(int id, uint32_t events) {
+    LoopHandle *handle = find_handle(id);
+    if (handle == NULL) {
+        return true;
+    }
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && handle->read_callback != NULL) {
+        bool result = handle->kind == HANDLE_LISTENER ? dispatch_accept(id) : dispatch_read(handle);
+        if (!result) {
+            return false;
+        }
+    }
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        return dispatch_write(id);
+    }
+    return true;
+}
+
+/**
+ * 调用所有已经到期的定时器。回调中新建的定时器留到下一轮，避免零延迟的定时器占住循环
+ * @return 出错返回false
+ */
+static bool dispatch_timers() {
+    double now = now_ms();
+    int last_id = loop.next_timer_id;
+    while (loop.timers != NULL && loop.timers->due <= now && loop.timers->id < last_id) {
+        Timer *timer = loop.timers;
+        loop.timers = timer->next;
+        bool result = call_callback(timer->callback, NULL);
+        py_decref(timer->callback);
+        free(timer);
+        if (!result) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 是否有不支持epoll、可以立即处理的句柄
+ */
+static bool has_ready_handle() {
+    for (LoopHandle *handle = loop.handles; handle != NULL; handle = handle->next) {
+        if (!handle->pollable && handle_active(handle)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 是否还有等待中的定时器或I/O
+ */
+static bool has_pending_work() {
+    if (loop.timers != NULL) {
+        return true;
+    }
+    for (LoopHandle *handle = loop.handles; handle != NULL; handle = handle->next) {
+        if (handle_active(handle)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 处理所有不支持epoll的句柄。先记下编号，回调可能修改句柄列表
+ * @return 出错返回false
+ */
+static bool dispatch_ready_handles() {
+    int ids[LOOP_MAX_EVENTS];
+    int count = 0;
+    for (LoopHandle *handle = loop.handles; handle != NULL && count < LOOP_MAX_EVENTS; handle = handle->next) {
+        if (!handle->pollable && handle_active(handle)) {
+            ids[count++] = handle->id;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (!dispatch_handle(ids[i], EPOLLIN | EPOLLOUT)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 添加定时器
+ * @param milliseconds 延迟的毫秒数，负数按0处理
+ * @param callback 到期时调用的函数，没有参数
+ * @return 定时器编号，失败返回0
+ */
+int eventloop_add_timer(double milliseconds, PyObject *callback) {
+    Timer *timer = (Timer *)malloc(sizeof(Timer));
+    if (timer == NULL) {
+        loop_error("%s", "内存分配失败，无法创建定时器");
+        return 0;
+    }
+    timer->id = loop.next_timer_id++;
+    timer->due = now_ms() + (milliseconds > 0 ? milliseconds : 0);
+    timer->callback = callback;
+    py_incref(callback);
+
+    Timer **link = &loop.timers;
+    while (*link != NULL && (*link)->due <= timer->due) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    return timer->id;
+}
+
+/**
+ * 取消定时器
+ * @return 定时器还没到期时返回true
+ */
+bool eventloop_cancel_timer(int id) {
+    for (Timer **link = &loop.timers; *link != NULL; link = &(*link)->next) {
+        if ((*link)->id == id) {
+            Timer *timer = *link;
+            *link = timer->next;
+            py_decref(timer->callback);
+            free(timer);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 打开文件
+ * @param mode "读"、"写"（清空原有内容）或"追加"
+ * @return 句柄编号，失败返回0
+ */
+int eventloop_open_file(const char *path, const char *mode) {
+    int flags;
+    if (strcmp(mode, "读") == 0) {
+        flags = O_RDONLY;
+    } else if (strcmp(mode, "写") == 0) {
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (strcmp(mode, "追加") == 0) {
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+    } else {
+        loop_error("未知的打开模式'%s'，应为读、写或追加", mode);
+        return 0;
+    }
+
+    int fd = open(path, flags | O_NONBLOCK | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        loop_error("无法打开文件: %s", strerror(errno));
+        return 0;
+    }
+    return add_handle(fd, HANDLE_FILE, 0);
+}
+
+/**
+ * 创建管道
+ * @return 成功时输出读端和写端的句柄编号
+ */
+bool eventloop_create_pipe(int *read_handle, int *write_handle) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        loop_error("无法创建管道: %s", strerror(errno));
+        return false;
+    }
+    *read_handle = add_handle(fds[0], HANDLE_PIPE, 0);
+    if (*read_handle == 0) {
+        close(fds[1]);
+        return false;
+    }
+    *write_handle = add_handle(fds[1], HANDLE_PIPE, 0);
+    if (*write_handle == 0) {
+        destroy_handle(find_handle(*read_handle), false);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 通过/bin/sh启动命令，子进程的标准输入和标准错误与解释器相同
+ * @return 读取子进程标准输出的句柄编号，失败返回0
+ */
+int eventloop_spawn(const char *command) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        loop_error("无法创建管道: %s", strerror(errno));
+        return 0;
+    }
+
+    // 子进程会继承还没写出的缓冲区
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        loop_error("无法创建子进程: %s", strerror(errno));
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        if (dup2(fds[1], STDOUT_FILENO) < 0) {
+            _exit(127);
+        }
+        close(fds[1]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    int id = add_handle(fds[0], HANDLE_PROCESS, pid);
+    if (id == 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    return id;
+}
+
+/**
+ * 填写Unix域套接字地址
+ */
+static bool socket_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        loop_error("套接字路径太长 '%s'", path);
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+/**
+ * 连接Unix域套接字
+ * @return 句柄编号，失败返回0
+ */
+int eventloop_connect(const char *path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        return 0;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        loop_error("无法创建套接字: %s", strerror(errno));
+        return 0;
+    }
+    // 本地连接立即完成，连接后再切换为非阻塞
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        loop_error("无法连接套接字: %s", strerror(errno));
+        close(fd);
+        return 0;
+    }
+    return add_handle(fd, HANDLE_SOCKET, 0);
+}
+
+/**
+ * 在Unix域套接字上监听，路径上遗留的套接字文件会被替换，关闭句柄时删除套接字文件
+ * @return 句柄编号，失败返回0
+ */
+int eventloop_listen(const char *path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        return 0;
+    }
+    struct stat info;
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            loop_error("'%s' 已存在且不是套接字", path);
+            return 0;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        loop_error("无法创建套接字: %s", strerror(errno));
+        return 0;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, LOOP_LISTEN_BACKLOG) != 0) {
+        loop_error("无法监听套接字: %s", strerror(errno));
+        close(fd);
+        return 0;
+    }
+    int id = add_handle(fd, HANDLE_LISTENER, 0);
+    if (id > 0) {
+        find_handle(id)->path = strdup(path);
+    }
+    return id;
+}
+
+/**
+ * 开始读取：每次读到数据时以字符串调用回调，读到末尾时以空字符串调用一次后停止。
+ * 已经在读取时替换原来的回调
+ */
+bool eventloop_read(int id, PyObject *callback) {
+    LoopHandle *handle = require_handle(id);
+    if (handle == NULL) {
+        return false;
+    }
+    if (handle->kind == HANDLE_LISTENER) {
+        loop_error("%s", "监听套接字不能读取，应使用接受连接");
+        return false;
+    }
+    py_incref(callback);
+    if (handle->read_callback != NULL) {
+        py_decref(handle->read_callback);
+    }
+    handle->read_callback = callback;
+    return update_interest(handle);
+}
+
+/**
+ * 开始接受连接：每个新连接以新句柄的编号调用回调，直到关闭监听句柄
+ */
+bool eventloop_accept(int id, PyObject *callback) {
+    LoopHandle *handle = require_handle(id);
+    if (handle == NULL) {
+        return false;
+    }
+    if (handle->kind != HANDLE_LISTENER) {
+        loop_error("%s", "只有监听套接字可以接受连接");
+        return false;
+    }
+    py_incref(callback);
+    if (handle->read_callback != NULL) {
+        py_decref(handle->read_callback);
+    }
+    handle->read_callback = callback;
+    return update_interest(handle);
+}
+
+/**
+ * 把数据加入写入队列，运行事件循环时按顺序写出
+ * @param callback 全部写完后以字节数调用，可以为NULL
+ */
+bool eventloop_write(int id, const char *data, size_t length, PyObject *callback) {
+    LoopHandle *handle = require_handle(id);
+    if (handle == NULL) {
+        return false;
+    }
+    WriteRequest *request = (WriteRequest *)calloc(1, sizeof(WriteRequest));
+    char *copy = (char *)malloc(length > 0 ? length : 1);
+    if (request == NULL || copy == NULL) {
+        free(request);
+        free(copy);
+        loop_error("%s", "内存分配失败，无法写入");
+        return false;
+    }
+    memcpy(copy, data, length);
+    request->data = copy;
+    request->length = length;
+    request->callback = callback;
+    if (callback != NULL) {
+        py_incref(callback);
+    }
+
+    if (handle->writes_tail != NULL) {
+        handle->writes_tail->next = request;
+    } else {
+        handle->writes = request;
+    }
+    handle->writes_tail = request;
+    return update_interest(handle);
+}
+
+/**
+ * 关闭句柄，未完成的写入被丢弃。子进程的句柄等待子进程结束
+ * @return 子进程的退出码（被信号结束时为128加信号编号），其他句柄返回0，句柄不存在返回-1
+ */
+int eventloop_close(int id) {
+    LoopHandle *handle = require_handle(id);
+    if (handle == NULL) {
+        return -1;
+    }
+    return destroy_handle(handle, false);
+}
+
+/**
+ * 运行事件循环，直到没有等待中的定时器和I/O，或者某个回调出错
+ * @return 调用的回调数，出错返回-1
+ */
+int64_t eventloop_run() {
+    if (loop.running) {
+        loop_error("%s", "事件循环已经在运行，不能在回调中再次运行");
+        return -1;
+    }
+    loop.running = true;
+    loop.dispatched = 0;
+
+    // 对端关闭后写管道或套接字得到EPIPE错误，而不是让进程被SIGPIPE结束
+    struct sigaction ignore, saved;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, &saved);
+
+    bool ok = true;
+    while (ok && has_pending_work()) {
+        int timeout = -1;
+        if (has_ready_handle()) {
+            timeout = 0;
+        } else if (loop.timers != NULL) {
+            double wait = loop.timers->due - now_ms();
+            timeout = wait > 0 ? (int)(wait + 0.999) : 0;
+        }
+
+        struct epoll_event events[LOOP_MAX_EVENTS];
+        int count = 0;
+        if (loop.epoll_fd >= 0) {
+            count = epoll_wait(loop.epoll_fd, events, LOOP_MAX_EVENTS, timeout);
+            if (count < 0) {
+                if (errno != EINTR) {
+                    loop_error("等待事件失败: %s", strerror(errno));
+                    ok = false;
+                }
+                continue;
+            }
+        } else if (timeout > 0) {
+            // 只有定时器
+            struct timespec ts = { timeout / 1000, (long)(timeout % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+
+        for (int i = 0; ok && i < count; i++) {
+            ok = dispatch_handle((int)events[i].data.u32, events[i].events);
+        }
+        if (ok) {
+            ok = dispatch_ready_handles();
+        }
+        if (ok) {
+            ok = dispatch_timers();
+        }
+    }
+
+    sigaction(SIGPIPE, &saved, NULL);
+    loop.running = false;
+    return ok ? loop.dispatched : -1;
+}
+
+/**
+ * 关闭所有句柄（结束还在运行的子进程）并清除所有定时器
+ */
+void eventloop_cleanup() {
+    while (loop.handles != NULL) {
+        destroy_handle(loop.handles, true);
+    }
+    while (loop.timers != NULL) {
+        Timer *next = loop.timers->next;
+        py_decref(loop.timers->callback);
+        free(loop.timers);
+        loop.timers = next;
+    }
+    if (loop.epoll_fd >= 0) {
+        close(loop.epoll_fd);
+        loop.epoll_fd = -1;
+    }
+    loop.running = false;
+}
@@ -0,0 +1,493 @@
+/**
+ * 坤舆编程语言 - 堆分析器
+ * 记录每个对象由哪一行代码分配，按源码行统计存活的对象数和字节数，
+ * 并在解释器清理完毕后列出仍未释放的对象，用于发现引用计数泄漏
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include "../includes/heapprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define HEAP_INITIAL_CAPACITY 1024   // 哈希表初始容量，必须是2的幂
+#define HEAP_MAX_LEAKS 50            // 泄漏报告最多列出的对象数
+#define HEAP_TYPE_COUNT (TYPE_BIGINT + 1)
+
+/**
+ * 一个被跟踪的对象
+ */
+typedef struct {
+    PyObject *object;        // 对象指针，NULL表示空槽
+    size_t bytes;            // 对象占用的字节数（含缓冲区）
+    int line;                // 分配位置的行号
+    int column;              // 分配位置的列号
+} HeapObject;
+
+/**
+ * 按分配位置统计（行号 + 对象类型）
+ */
+typedef struct {
+    int line;                // 行号，0表示不在任何语句中
+    ObjectType type;         // 对象类型
+    bool used;               // 是否已使用
+    size_t live_objects;     // 存活对象数
+    size_t live_bytes;       // 存活字节数
+    size_t total_objects;    // 累计分配对象数
+    size_t total_bytes;      // 累计分配字节数
+    size_t peak_bytes;       // 存活字节数峰值
+} HeapSite;
+
+/**
+ * 堆分析器上下文
+ */
+typedef struct {
+    HeapObject *objects;     // 对象哈希表（开放寻址）
+    size_t object_capacity;
+    size_t object_count;
+    HeapSite *sites;         // 分配位置哈希表（开放寻址）
+    size_t site_capacity;
+    size_t site_count;
+    size_t live_bytes;       // 当前存活字节数
+    size_t peak_bytes;       // 存活字节数峰值
+    size_t total_objects;    // 累计分配对象数
+} HeapProfiler;
+
+// 是否正在跟踪分配，对象系统的钩子会读取它
+bool heap_profiler_active = false;
+
+// 全局堆分析器上下文
+static HeapProfiler heap;
+
+/**
+ * 对象类型名
+ */
+static const char* type_name(ObjectType type) {
+    switch (type) {
+        case TYPE_NUMBER:   return "数字";
+        case TYPE_STRING:   return "字符串";
+        case TYPE_LIST:     return "列表";
+        case TYPE_DICT:     return "字典";
+        case TYPE_FUNCTION: return "函数";
+        case TYPE_BIGINT:   return "大整数";
+        default:            return "空";
+    }
+}
+
+/**
+ * 计算指针哈希值
+ */
+static size_t hash_pointer(const void *ptr) {
+    uint64_t x = (uint64_t)(uintptr_t)ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+/**
+ * 计算分配位置哈希值
+ */
+static size_t hash_site(int line, ObjectType type) {
+    return hash_pointer((const void *)(uintptr_t)(((uint64_t)(unsigned)line << 8) | (unsigned)type));
+}
+
+/**
+ * 查找对象所在的槽位
+ * @return 对象的槽位，不存在时返回应插入的空槽
+ */
+static size_t find_object_slot(HeapObject *objects, size_t capacity, const PyObject *obj) {
+    size_t mask = capacity - 1;
+    size_t index = hash_pointer(obj) & mask;
+    while (objects[index].object != NULL && objects[index].object != obj) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+/**
+ * 扩大对象哈希表
+ */
+static bool grow_objects() {
+    size_t new_capacity = heap.object_capacity * 2;
+    HeapObject *new_objects = (HeapObject *)calloc(new_capacity, sizeof(HeapObject));
+    if (new_objects == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < heap.object_capacity; i++) {
+        if (heap.objects[i].object != NULL) {
+            size_t index = find_object_slot(new_objects, new_capacity, heap.objects[i].object);
+            new_objects[index] = heap.objects[i];
+        }
+    }
+
+    free(heap.objects);
+    heap.objects = new_objects;
+    heap.object_capacity = new_capacity;
+    return true;
+}
+
+/**
+ * 从对象哈希表中删除一个槽位，并把后面的探测链前移
+ */
+static void remove_object_slot(size_t index) {
+    size_t mask = heap.object_capacity - 1;
+    size_t hole = index;
+    size_t next = (index + 1) & mask;
+
+    while (heap.objects[next].object != NULL) {
+        size_t home = hash_pointer(heap.objects[next].object) & mask;
+        // 只有原本位置不在(hole, next]区间内的项才能前移到空洞
+        bool movable = hole <= next
+            ? (home <= hole || home > next)
+            : (home <= hole && home > next);
+        if (movable) {
+            heap.objects[hole] = heap.objects[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    heap.objects[hole].object = NULL;
+    heap.object_count--;
+}
+
+/**
+ * 扩大分配位置哈希表
+ */
+static bool grow_sites() {
+    size_t new_capacity = heap.site_capacity * 2;
+    HeapSite *new_sites = (HeapSite *)calloc(new_capacity, sizeof(HeapSite));
+    if (new_sites == NULL) {
+        return false;
+    }
+
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < heap.site_capacity; i++) {
+        if (heap.sites[i].used) {
+            size_t index = hash_site(heap.sites[i].line, heap.sites[i].type) & mask;
+            while (new_sites[index].used) {
+                index = (index + 1) & mask;
+            }
+            new_sites[index] = heap.sites[i];
+        }
+    }
+
+    free(heap.sites);
+    heap.sites = new_sites;
+    heap.site_capacity = new_capacity;
+    return true;
+}
+
+/**
+ * 查找或创建分配位置
+ */
+static HeapSite* find_site(int line, ObjectType type) {
+    if ((heap.site_count + 1) * 4 > heap.site_capacity * 3 && !grow_sites()) {
+        return NULL;
+    }
+
+    size_t mask = heap.site_capacity - 1;
+    size_t index = hash_site(line, type) & mask;
+    while (heap.sites[index].used) {
+        if (heap.sites[index].line == line && heap.sites[index].type == type) {
+            return &heap.sites[index];
+        }
+        index = (index + 1) & mask;
+    }
+
+    HeapSite *site = &heap.sites[index];
+    site->used = true;
+    site->line = line;
+    site->type = type;
+    heap.site_count++;
+    return site;
+}
+
+/**
+ * 更新存活字节数
+ */
+static void adjust_live_bytes(HeapSite *site, size_t old_bytes, size_t new_bytes) {
+    heap.live_bytes = heap.live_bytes - old_bytes + new_bytes;
+    if (heap.live_bytes > heap.peak_bytes) {
+        heap.peak_bytes = heap.live_bytes;
+    }
+
+    if (site != NULL) {
+        site->live_bytes = site->live_bytes - old_bytes + new_bytes;
+        if (site->live_bytes > site->peak_bytes) {
+            site->peak_bytes = site->live_bytes;
+        }
+    }
+}
+
+/**
+ * 开始跟踪对象分配
+ * @return 成功返回true，失败返回false
+ */
+bool heap_profiler_start() {
+    memset(&heap, 0, sizeof(heap));
+    heap.objects = (HeapObject *)calloc(HEAP_INITIAL_CAPACITY, sizeof(HeapObject));
+    heap.sites = (HeapSite *)calloc(HEAP_INITIAL_CAPACITY, sizeof(HeapSite));
+    if (heap.objects == NULL || heap.sites == NULL) {
+        free(heap.objects);
+        free(heap.sites);
+        memset(&heap, 0, sizeof(heap));
+        fprintf(stderr, "警告: 堆分析器内存分配失败，已禁用堆分析\n");
+        return false;
+    }
+
+    heap.object_capacity = HEAP_INITIAL_CAPACITY;
+    heap.site_capacity = HEAP_INITIAL_CAPACITY;
+    heap_profiler_active = true;
+    return true;
+}
+
+/**
+ * 停止跟踪并释放分析数据
+ */
+void heap_profiler_stop() {
+    heap_profiler_active = false;
+    free(heap.objects);
+    free(heap.sites);
+    memset(&heap, 0, sizeof(heap));
+}
+
+/**
+ * 记录新分配的对象，分配位置取解释器当前执行的节点
+ */
+void heap_profiler_track_alloc(PyObject *obj, size_t bytes) {
+    if (obj == NULL) {
+        return;
+    }
+    if ((heap.object_count + 1) * 4 > heap.object_capacity * 3 && !grow_objects()) {
+        return;
+    }
+
+    const AstNode *node = interpreter_current_node();
+    int line = node != NULL ? node->line : 0;
+    int column = node != NULL ? node->column : 0;
+
+    HeapSite *site = find_site(line, obj->type);
+    if (site == NULL) {
+        return;
+    }
+
+    size_t index = find_object_slot(heap.objects, heap.object_capacity, obj);
+    if (heap.objects[index].object == NULL) {
+        heap.object_count++;
+    }
+    heap.objects[index].object = obj;
+    heap.objects[index].bytes = bytes;
+    heap.objects[index].line = line;
+    heap.objects[index].column = column;
+
+    site->live_objects++;
+    site->total_objects++;
+    site->total_bytes += bytes;
+    heap.total_objects++;
+    adjust_live_bytes(site, 0, bytes);
+}
+
+/**
+ * 记录对象缓冲区大小的变化
+ * @param bytes 对象新的总字节数
+ */
+void heap_profiler_track_resize(PyObject *obj, size_t bytes) {
+    size_t index = find_object_slot(heap.objects, heap.object_capacity, obj);
+    HeapObject *entry = &heap.objects[index];
+    if (entry->object == NULL) {
+        // 开始分析之前分配的对象
+        return;
+    }
+
+    HeapSite *site = find_site(entry->line, obj->type);
+    if (site != NULL && bytes > entry->bytes) {
+        site->total_bytes += bytes - entry->bytes;
+    }
+    adjust_live_bytes(site, entry->bytes, bytes);
+    entry->bytes = bytes;
+}
+
+/**
+ * 记录对象被释放
+ */
+void heap_profiler_track_free(PyObject *obj) {
+    size_t index = find_object_slot(heap.objects, heap.object_capacity, obj);
+    HeapObject *entry = &heap.objects[index];
+    if (entry->object == NULL) {
+        return;
+    }
+
+    HeapSite *site = find_site(entry->line, obj->type);
+    if (site != NULL) {
+        site->live_objects--;
+    }
+    adjust_live_bytes(site, entry->bytes, 0);
+    remove_object_slot(index);
+}
+
+/**
+ * 比较函数：按存活字节数降序，其次按累计字节数降序
+ */
+static int compare_sites(const void *a, const void *b) {
+    const HeapSite *x = *(const HeapSite * const *)a;
+    const HeapSite *y = *(const HeapSite * const *)b;
+    if (x->live_bytes != y->live_bytes) {
+        return x->live_bytes < y->live_bytes ? 1 : -1;
+    }
+    if (x->total_bytes != y->total_bytes) {
+        return x->total_bytes < y->total_bytes ? 1 : -1;
+    }
+    return x->line - y->line;
+}
+
+/**
+ * 比较函数：按分配位置排序
+ */
+static int compare_objects(const void *a, const void *b) {
+    const HeapObject *x = *(const HeapObject * const *)a;
+    const HeapObject *y = *(const HeapObject * const *)b;
+    if (x->line != y->line) {
+        return x->line - y->line;
+    }
+    return x->column - y->column;
+}
+
+/**
+ * 按分配位置输出存活对象和字节数
+ * @param out 输出流
+ */
+void heap_profiler_report(FILE *out) {
+    if (!heap_profiler_active) {
+        fprintf(out, "堆分析未开启，请使用 --heap-profile 运行\n");
+        return;
+    }
+
+    fprintf(out, "\n=== 堆分析报告 ===\n");
+    fprintf(out, "存活对象: %zu  存活字节: %zu  峰值字节: %zu  累计分配对象: %zu\n\n",
+            heap.object_count, heap.live_bytes, heap.peak_bytes, heap.total_objects);
+
+    if (heap.site_count == 0) {
+        return;
+    }
+
+    HeapSite **sites = (HeapSite **)malloc(sizeof(HeapSite *) * heap.site_count);
+    if (sites == NULL) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < heap.site_capacity; i++) {
+        if (heap.sites[i].used) {
+            sites[count++] = &heap.sites[i];
+        }
+    }
+    qsort(sites, count, sizeof(HeapSite *), compare_sites);
+
+    fprintf(out, "%6s  %-6s %10s %12s %12s %12s %12s\n",
+            "行", "类型", "存活对象", "存活字节", "峰值字节", "累计对象", "累计字节");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "%6d  %-6s %10zu %12zu %12zu %12zu %12zu\n",
+                sites[i]->line, type_name(sites[i]->type),
+                sites[i]->live_objects, sites[i]->live_bytes, sites[i]->peak_bytes,
+                sites[i]->total_objects, sites[i]->total_bytes);
+    }
+    fprintf(out, "\n");
+
+    free(sites);
+}
+
+/**
+ * 输出对象内容的简短描述
+ */
+static void describe_object(FILE *out, const PyObject *obj) {
+    switch (obj->type) {
+        case TYPE_NUMBER: {
+            const PyNumberObject *num = (const PyNumberObject *)obj;
+            if (num->is_int) {
+                fprintf(out, "%" PRId64, num->int_value);
+            } else {
+                fprintf(out, "%g", num->value);
+            }
+            break;
+        }
+        case TYPE_BIGINT:
+            fprintf(out, "约%zu位的大整数", ((const PyBigIntObject *)obj)->length * 9);
+            break;
+        case TYPE_STRING: {
+            const PyStringObject *str = (const PyStringObject *)obj;
+            if (str->length > 32) {
+                fprintf(out, "\"%.32s...\"", str->value);
+            } else {
+                fprintf(out, "\"%s\"", str->value);
+            }
+            break;
+        }
+        case TYPE_LIST:
+            fprintf(out, "%zu项", ((const PyListObject *)obj)->length);
+            break;
+        case TYPE_DICT:
+            fprintf(out, "%zu个键", ((const PyDictObject *)obj)->size);
+            break;
+        default:
+            fprintf(out, "-");
+            break;
+    }
+}
+
+/**
+ * 列出解释器清理后仍未释放的对象，应在interpreter_cleanup之后调用
+ * @param out 输出流
+ * @return 未释放的对象数
+ */
+size_t heap_profiler_report_leaks(FILE *out) {
+    if (!heap_profiler_active) {
+        return 0;
+    }
+
+    if (heap.object_count == 0) {
+        fprintf(out, "堆分析: 所有对象都已释放\n");
+        return 0;
+    }
+
+    HeapObject **leaks = (HeapObject **)malloc(sizeof(HeapObject *) * heap.object_count);
+    if (leaks == NULL) {
+        return heap.object_count;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < heap.object_capacity; i++) {
+        if (heap.objects[i].object != NULL) {
+            leaks[count++] = &heap.objects[i];
+        }
+    }
+    qsort(leaks, count, sizeof(HeapObject *), compare_objects);
+
+    fprintf(out, "\n=== 未释放的对象 (%zu 个, %zu 字节) ===\n", count, heap.live_bytes);
+    fprintf(out, "%-12s %-6s %6s %10s  %s\n", "位置", "类型", "引用", "字节", "值");
+    for (size_t i = 0; i < count && i < HEAP_MAX_LEAKS; i++) {
+        char location[32];
+        snprintf(location, sizeof(location), "%d:%d", leaks[i]->line, leaks[i]->column);
+        fprintf(out, "%-12s %-6s %6d %10zu  ", location, type_name(leaks[i]->object->type),
+                leaks[i]->object->ref_count, leaks[i]->bytes);
+        describe_object(out, leaks[i]->object);
+        fprintf(out, "\n");
+    }
+    if (count > HEAP_MAX_LEAKS) {
+        fprintf(out, "... 另有 %zu 个对象未列出\n", count - HEAP_MAX_LEAKS);
+    }
+    fprintf(out, "\n");
+
+    free(leaks);
+    return count;
+}
+
+/**
+ * 获取当前存活字节数
+ */
+size_t heap_profiler_live_bytes() {
+    return heap.live_bytes;
+}
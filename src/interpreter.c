@@ -5,11 +5,16 @@
 
 #include "../includes/kunyu.h"
 #include "../includes/ast.h"
+#include "../includes/stats.h"
+#include "../includes/trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <errno.h>
 #include <math.h>
+#include <sys/resource.h>
 
 /**
  * 解释器上下文
@@ -18,14 +23,29 @@ typedef struct {
     KunyuError error;        // 错误信息
     bool has_return;         // 是否有返回值
     PyObject *return_value;  // 返回值
+    bool definitions_only;   // 只执行函数声明和导入语句，从快照恢复时使用
 } InterpreterContext;
 
+// 函数的纯度，在第一次需要时检查
+typedef enum {
+    PURITY_UNKNOWN = 0,      // 尚未检查
+    PURITY_CHECKING,         // 正在检查（递归调用视为纯）
+    PURITY_PURE,             // 纯函数
+    PURITY_IMPURE            // 可能有副作用
+} FunctionPurity;
+
 // 函数表条目
 typedef struct FunctionEntry {
     char *name;              // 函数名
     char **params;           // 参数名列表
     int param_count;         // 参数数量
-    AstNode *body;           // 函数体
+    AstNode *body;           // 函数体，延迟分析时第一次调用前为NULL
+    FunctionStmt *decl;      // 函数声明节点，用于分析延迟的函数体
+    char *module;            // 声明所在的模块文件，入口脚本中的函数为NULL
+    MemoTable *memo;         // @缓存 的结果缓存，NULL表示不缓存
+    FunctionPurity purity;   // 纯度
+    bool compiled;           // 函数体是否已经优化
+    struct FunctionEntry *next_unconfirmed; // 本次纯度检查中暂时判定为纯的下一个函数
     struct FunctionEntry *next;
 } FunctionEntry;
 
@@ -33,7 +53,8 @@ typedef struct FunctionEntry {
 typedef struct VariableEntry {
     char *name;
     bool is_constant;
-    PyObject *value;
+    PyObject *value;          // 变量的值，被匿名函数捕获后改为保存在cell中
+    PyCell *cell;             // 与捕获它的函数对象共享的单元，未被捕获时为NULL
     struct VariableEntry *next;
 } VariableEntry;
 
@@ -50,16 +71,70 @@ static FunctionEntry *function_table = NULL;
 // 全局解释器上下文
 static InterpreterContext interpreter;
 
+// 正在执行顶层语句的模块文件，NULL表示入口脚本
+static const char *current_module = NULL;
+
+// 纯度检查的嵌套层数，以及检查过程中判定为纯的函数。这些结论可能依赖于
+// “正在检查的函数是纯的”这一假设，最外层的检查失败时全部作废
+static int purity_depth = 0;
+static FunctionEntry *unconfirmed_pure = NULL;
+
+// 调用栈和当前执行的节点，会被性能分析器的信号处理函数读取
+static CallFrame call_stack[KUNYU_MAX_CALL_DEPTH];
+static volatile int call_depth = 0;
+static const AstNode * volatile current_node = NULL;
+
+// 最外层调用开始时的栈位置和允许使用的栈大小，递归过深时在C栈溢出之前报错
+static const char *stack_base = NULL;
+static size_t stack_limit = 0;
+
 /**
- * 初始化解释器
+ * 调用点内联缓存的类型
  */
-static void interpreter_init() {
-    interpreter.error.code = KUNYU_OK;
-    interpreter.error.message[0] = '\0';
-    interpreter.error.line = 0;
-    interpreter.error.column = 0;
-    interpreter.has_return = false;
-    interpreter.return_value = NULL;
+typedef enum {
+    CALL_CACHE_NONE = 0,     // 未缓存
+    CALL_CACHE_BUILTIN,      // 内置函数
+    CALL_CACHE_USER,         // 用户定义的函数
+    CALL_CACHE_DICT_GET,     // 以字符串常量为键的字典获取
+    CALL_CACHE_DICT_SET,     // 以字符串常量为键的字典设置
+    CALL_CACHE_VALUE         // 变量中保存的函数值，每次调用时读取变量
+} CallCacheKind;
+
+// 参数不多于此数量时参数数组分配在栈上
+#define CALL_INLINE_ARGS 8
+
+// 名字解析版本，函数表变化时递增，调用点缓存的版本不一致时重新解析
+static unsigned int resolve_epoch = 1;
+
+/**
+ * 使所有调用点的目标缓存失效
+ */
+static void invalidate_call_caches() {
+    resolve_epoch++;
+    if (resolve_epoch == 0) {
+        resolve_epoch = 1;
+    }
+}
+
+/**
+ * 释放变量条目，被捕获的变量只释放对单元的引用
+ */
+static void free_variable_entry(VariableEntry *var) {
+    if (var->cell != NULL) {
+        py_cell_decref(var->cell);
+    } else if (var->value != NULL) {
+        py_decref(var->value);
+    }
+    free(var->name);
+    free(var);
+}
+
+/**
+ * 释放所有作用域、变量和函数表
+ */
+static void free_interpreter_state() {
+    // 事件循环的回调和句柄属于这次运行
+    eventloop_cleanup();
     
     // 清空所有作用域
     while (current_scope != NULL) {
@@ -69,11 +144,7 @@ static void interpreter_init() {
         VariableEntry *var = current_scope->variables;
         while (var != NULL) {
             VariableEntry *next = var->next;
-            if (var->value != NULL) {
-                py_decref(var->value);
-            }
-            free(var->name);
-            free(var);
+            free_variable_entry(var);
             var = next;
         }
         
@@ -81,29 +152,56 @@ static void interpreter_init() {
         current_scope = parent;
     }
     
-    // 创建全局作用域
-    current_scope = (Scope*)malloc(sizeof(Scope));
-    if (current_scope != NULL) {
-        current_scope->variables = NULL;
-        current_scope->parent = NULL;
-    }
-    
     // 清空函数表
     FunctionEntry *func = function_table;
     while (func != NULL) {
         FunctionEntry *next = func->next;
         free(func->name);
+        free(func->module);
         
         // 释放参数名
         for (int i = 0; i < func->param_count; i++) {
             free(func->params[i]);
         }
         free(func->params);
+        memo_free(func->memo);
         
         free(func);
         func = next;
     }
     function_table = NULL;
+    invalidate_call_caches();
+    
+    // 导入的模块中定义的函数已随函数表清空，可以释放模块的语法树
+    module_cleanup();
+    
+    // 释放未被取走的返回值
+    if (interpreter.return_value != NULL) {
+        py_decref(interpreter.return_value);
+        interpreter.return_value = NULL;
+    }
+    interpreter.has_return = false;
+}
+
+/**
+ * 初始化解释器
+ */
+static void interpreter_init() {
+    free_interpreter_state();
+    
+    interpreter.error.code = KUNYU_OK;
+    interpreter.error.message[0] = '\0';
+    interpreter.error.line = 0;
+    interpreter.error.column = 0;
+    call_depth = 0;
+    current_node = NULL;
+    
+    // 创建全局作用域
+    current_scope = (Scope*)malloc(sizeof(Scope));
+    if (current_scope != NULL) {
+        current_scope->variables = NULL;
+        current_scope->parent = NULL;
+    }
     
     // 初始化内置函数
     builtins_init();
@@ -124,6 +222,7 @@ static bool push_scope() {
     new_scope->variables = NULL;
     new_scope->parent = current_scope;
     current_scope = new_scope;
+    STATS_INC(STAT_PUSH_SCOPE);
     
     return true;
 }
@@ -142,11 +241,7 @@ static void pop_scope() {
     VariableEntry *var = current_scope->variables;
     while (var != NULL) {
         VariableEntry *next = var->next;
-        if (var->value != NULL) {
-            py_decref(var->value);
-        }
-        free(var->name);
-        free(var);
+        free_variable_entry(var);
         var = next;
     }
     
@@ -154,6 +249,58 @@ static void pop_scope() {
     current_scope = parent;
 }
 
+/**
+ * 解释器可以使用的C栈大小：栈大小的软限制减去保留的余量
+ */
+static size_t usable_stack_size() {
+    size_t size = KUNYU_DEFAULT_STACK_SIZE;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+        limit.rlim_cur < (rlim_t)size * 64) {
+        size = (size_t)limit.rlim_cur;
+    }
+    return size > KUNYU_STACK_RESERVE * 2 ? size - KUNYU_STACK_RESERVE : size / 2;
+}
+
+/**
+ * 压入调用栈帧。除了层数上限，还检查已经用掉的C栈，
+ * 每层调用占用的栈随函数体的写法变化，只靠层数不能保证不溢出
+ */
+static bool push_call_frame(const char *name, const AstNode *call_site) {
+    char marker;
+    if (call_depth == 0) {
+        stack_base = &marker;
+        if (stack_limit == 0) {
+            stack_limit = usable_stack_size();
+        }
+    }
+    size_t used = stack_base > &marker ? (size_t)(stack_base - &marker) : (size_t)(&marker - stack_base);
+    
+    if (call_depth >= KUNYU_MAX_CALL_DEPTH || used >= stack_limit) {
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "调用层数超过上限%d，可能存在无限递归",
+                 call_depth >= KUNYU_MAX_CALL_DEPTH ? KUNYU_MAX_CALL_DEPTH : (int)call_depth);
+        return false;
+    }
+    
+    call_stack[call_depth].name = name;
+    call_stack[call_depth].call_site = call_site;
+    call_depth++;
+    
+    return true;
+}
+
+/**
+ * 弹出调用栈帧，并把当前节点恢复为调用位置
+ */
+static void pop_call_frame() {
+    if (call_depth > 0) {
+        call_depth--;
+        current_node = call_stack[call_depth].call_site;
+    }
+}
+
 /**
  * 创建数字对象
  */
@@ -168,12 +315,299 @@ static PyObject* create_string_object(const char *value) {
     return py_string_new(value);
 }
 
+/**
+ * 数值，整数和浮点数的统一表示，算术运算在它上面进行
+ */
+typedef struct {
+    bool is_int;             // 是否是64位整数
+    int64_t int_value;       // 整数值
+    double value;            // 浮点数值，整数时为其近似值
+} NumberValue;
+
+/**
+ * 数值运算的结果
+ */
+typedef enum {
+    NUMBER_OP_OK,            // 成功
+    NUMBER_OP_ERROR,         // 出错，已设置错误信息
+    NUMBER_OP_OVERFLOW       // 整数运算超出64位整数范围，需要用大整数计算
+} NumberOpResult;
+
+/**
+ * 读取数字对象的值，大整数只能以浮点数参与运算
+ */
+static void number_value_of(PyObject *obj, NumberValue *out) {
+    if (obj->type == TYPE_BIGINT) {
+        out->is_int = false;
+        out->int_value = 0;
+        out->value = py_bigint_to_double(obj);
+        return;
+    }
+
+    PyNumberObject *num = (PyNumberObject *)obj;
+    out->is_int = num->is_int;
+    out->int_value = num->int_value;
+    out->value = num->value;
+}
+
+/**
+ * 设置整数结果
+ */
+static void number_set_int(NumberValue *out, int64_t value) {
+    out->is_int = true;
+    out->int_value = value;
+    out->value = (double)value;
+}
+
+/**
+ * 设置浮点数结果
+ */
+static void number_set_double(NumberValue *out, double value) {
+    out->is_int = false;
+    out->int_value = 0;
+    out->value = value;
+}
+
+/**
+ * 根据数值创建数字对象
+ */
+static PyObject* create_number_from_value(const NumberValue *value) {
+    return value->is_int ? py_int_new(value->int_value) : py_number_new(value->value);
+}
+
+/**
+ * 带溢出检查的64位整数加减乘，溢出时返回true
+ */
+static bool int_add_overflow(int64_t a, int64_t b, int64_t *result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_add_overflow(a, b, result);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+        return true;
+    }
+    *result = a + b;
+    return false;
+#endif
+}
+
+static bool int_sub_overflow(int64_t a, int64_t b, int64_t *result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_sub_overflow(a, b, result);
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) {
+        return true;
+    }
+    *result = a - b;
+    return false;
+#endif
+}
+
+static bool int_mul_overflow(int64_t a, int64_t b, int64_t *result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_mul_overflow(a, b, result);
+#else
+    if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+              : (b > 0 ? a < INT64_MIN / b : (a != 0 && b < INT64_MAX / a))) {
+        return true;
+    }
+    *result = a * b;
+    return false;
+#endif
+}
+
+/**
+ * 整数之间的运算
+ * @param error 出错时设置为错误信息
+ * @param is_double 不能整除的除法设置为true，由调用者改用浮点数计算
+ * @return 结果超出64位整数范围时返回NUMBER_OP_OVERFLOW
+ */
+static NumberOpResult int_binary_op(BinaryOpType op, int64_t left, int64_t right,
+                                    NumberValue *out, const char **error, bool *is_double) {
+    int64_t value;
+    switch (op) {
+        case OP_ADD:
+            if (int_add_overflow(left, right, &value)) {
+                return NUMBER_OP_OVERFLOW;
+            }
+            break;
+        case OP_SUB:
+            if (int_sub_overflow(left, right, &value)) {
+                return NUMBER_OP_OVERFLOW;
+            }
+            break;
+        case OP_MUL:
+            if (int_mul_overflow(left, right, &value)) {
+                return NUMBER_OP_OVERFLOW;
+            }
+            break;
+        case OP_DIV:
+            if (right == 0) {
+                *error = "除数不能为零";
+                return NUMBER_OP_ERROR;
+            }
+            if (left == INT64_MIN && right == -1) {
+                return NUMBER_OP_OVERFLOW;
+            }
+            // 不能整除时结果是浮点数
+            if (left % right != 0) {
+                *is_double = true;
+                return NUMBER_OP_OK;
+            }
+            value = left / right;
+            break;
+        case OP_MOD:
+            if (right == 0) {
+                *error = "模运算的除数不能为零";
+                return NUMBER_OP_ERROR;
+            }
+            value = right == -1 ? 0 : left % right;
+            break;
+        case OP_EQ: value = left == right; break;
+        case OP_NE: value = left != right; break;
+        case OP_LT: value = left < right; break;
+        case OP_LE: value = left <= right; break;
+        case OP_GT: value = left > right; break;
+        case OP_GE: value = left >= right; break;
+        default:
+            *error = "不支持的运算符";
+            return NUMBER_OP_ERROR;
+    }
+
+    number_set_int(out, value);
+    return NUMBER_OP_OK;
+}
+
+/**
+ * 计算两个数字的二元运算。两边都是整数时按整数计算，不能整除的除法改用浮点数；
+ * 比较的结果总是整数0或1
+ * @return 整数运算溢出时返回NUMBER_OP_OVERFLOW，由调用者改用大整数计算
+ */
+static NumberOpResult number_binary_op(BinaryOpType op, const NumberValue *left,
+                                       const NumberValue *right, NumberValue *out) {
+    const char *error = NULL;
+    if (left->is_int && right->is_int) {
+        bool is_double = false;
+        NumberOpResult result = int_binary_op(op, left->int_value, right->int_value,
+                                              out, &error, &is_double);
+        if (result == NUMBER_OP_ERROR) {
+            interpreter.error.code = KUNYU_ERROR_RUNTIME;
+            snprintf(interpreter.error.message, sizeof(interpreter.error.message), "%s", error);
+        }
+        if (!is_double) {
+            return result;
+        }
+    }
+
+    double l = left->value;
+    double r = right->value;
+    switch (op) {
+        case OP_ADD: number_set_double(out, l + r); return NUMBER_OP_OK;
+        case OP_SUB: number_set_double(out, l - r); return NUMBER_OP_OK;
+        case OP_MUL: number_set_double(out, l * r); return NUMBER_OP_OK;
+        case OP_DIV:
+            if (r == 0) {
+                error = "除数不能为零";
+                break;
+            }
+            number_set_double(out, l / r);
+            return NUMBER_OP_OK;
+        case OP_MOD:
+            if (r == 0) {
+                error = "模运算的除数不能为零";
+                break;
+            }
+            number_set_double(out, fmod(l, r));
+            return NUMBER_OP_OK;
+        case OP_EQ: number_set_int(out, l == r); return NUMBER_OP_OK;
+        case OP_NE: number_set_int(out, l != r); return NUMBER_OP_OK;
+        case OP_LT: number_set_int(out, l < r); return NUMBER_OP_OK;
+        case OP_LE: number_set_int(out, l <= r); return NUMBER_OP_OK;
+        case OP_GT: number_set_int(out, l > r); return NUMBER_OP_OK;
+        case OP_GE: number_set_int(out, l >= r); return NUMBER_OP_OK;
+        default:
+            error = "不支持的运算符";
+            break;
+    }
+
+    interpreter.error.code = KUNYU_ERROR_RUNTIME;
+    snprintf(interpreter.error.message, sizeof(interpreter.error.message), "%s", error);
+    return NUMBER_OP_ERROR;
+}
+
+/**
+ * 判断整数是否为0，大整数总是非0
+ */
+static bool is_zero_integer(PyObject *obj) {
+    return obj->type != TYPE_BIGINT && ((PyNumberObject *)obj)->int_value == 0;
+}
+
+/**
+ * 两个整数（至少一个是大整数，或64位整数运算溢出）之间的运算
+ * @return 结果对象，出错返回NULL
+ */
+static PyObject* bigint_binary_op(BinaryOpType op, PyObject *left, PyObject *right) {
+    PyObject *result = NULL;
+    PyObject *remainder = NULL;
+    const char *error = NULL;
+
+    switch (op) {
+        case OP_ADD: result = py_bigint_add(left, right); break;
+        case OP_SUB: result = py_bigint_sub(left, right); break;
+        case OP_MUL: result = py_bigint_mul(left, right); break;
+        case OP_DIV:
+            if (is_zero_integer(right)) {
+                error = "除数不能为零";
+                break;
+            }
+            if (!py_bigint_divmod(left, right, &result, &remainder)) {
+                break;
+            }
+            // 不能整除时结果是浮点数
+            if (remainder != NULL && !is_zero_integer(remainder)) {
+                py_decref(result);
+                result = py_number_new(py_bigint_to_double(left) / py_bigint_to_double(right));
+            }
+            break;
+        case OP_MOD:
+            if (is_zero_integer(right)) {
+                error = "模运算的除数不能为零";
+                break;
+            }
+            py_bigint_divmod(left, right, NULL, &result);
+            break;
+        case OP_EQ: result = py_int_new(py_bigint_compare(left, right) == 0); break;
+        case OP_NE: result = py_int_new(py_bigint_compare(left, right) != 0); break;
+        case OP_LT: result = py_int_new(py_bigint_compare(left, right) < 0); break;
+        case OP_LE: result = py_int_new(py_bigint_compare(left, right) <= 0); break;
+        case OP_GT: result = py_int_new(py_bigint_compare(left, right) > 0); break;
+        case OP_GE: result = py_int_new(py_bigint_compare(left, right) >= 0); break;
+        default:
+            error = "不支持的运算符";
+            break;
+    }
+
+    if (remainder != NULL) {
+        py_decref(remainder);
+    }
+
+    if (error != NULL) {
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), "%s", error);
+    } else if (result == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message),
+                 "内存分配失败，无法创建大整数对象");
+    }
+    return result;
+}
+
 /**
  * 在当前作用域查找变量
  */
 static VariableEntry* find_variable_in_scope(const char *name, Scope *scope) {
     VariableEntry *entry = scope->variables;
     while (entry != NULL) {
+        STATS_INC(STAT_STRCMP);
         if (strcmp(entry->name, name) == 0) {
             return entry;
         }
@@ -187,7 +621,16 @@ static VariableEntry* find_variable_in_scope(const char *name, Scope *scope) {
  */
 static VariableEntry* find_variable(const char *name) {
     Scope *scope = current_scope;
+#ifdef KUNYU_STATS_ENABLED
+    uint64_t chain = 0;
+    STATS_INC(STAT_VARIABLE_LOOKUP);
+#endif
     while (scope != NULL) {
+#ifdef KUNYU_STATS_ENABLED
+        chain++;
+        STATS_INC(STAT_LOOKUP_SCOPES);
+        STATS_MAX(STAT_LOOKUP_MAX_CHAIN, chain);
+#endif
         VariableEntry *entry = find_variable_in_scope(name, scope);
         if (entry != NULL) {
             return entry;
@@ -202,7 +645,9 @@ static VariableEntry* find_variable(const char *name) {
  */
 static FunctionEntry* find_function(const char *name) {
     FunctionEntry *entry = function_table;
+    STATS_INC(STAT_FUNCTION_LOOKUP);
     while (entry != NULL) {
+        STATS_INC(STAT_STRCMP);
         if (strcmp(entry->name, name) == 0) {
             return entry;
         }
@@ -212,16 +657,38 @@ static FunctionEntry* find_function(const char *name) {
 }
 
 /**
- * 定义变量
+ * 读取变量的值
  */
-static bool define_variable(const char *name, PyObject *value, bool is_constant) {
+static inline PyObject* variable_value(const VariableEntry *entry) {
+    return entry->cell != NULL ? entry->cell->value : entry->value;
+}
+
+/**
+ * 替换变量的值，变量持有新值的引用
+ */
+static inline void variable_store(VariableEntry *entry, PyObject *value) {
+    PyObject **slot = entry->cell != NULL ? &entry->cell->value : &entry->value;
+    if (value != NULL) {
+        py_incref(value);
+    }
+    if (*slot != NULL) {
+        py_decref(*slot);
+    }
+    *slot = value;
+}
+
+/**
+ * 在当前作用域中添加变量条目，值为NULL
+ * @return 新条目，变量已存在或内存不足时返回NULL并设置错误
+ */
+static VariableEntry* add_variable(const char *name, bool is_constant) {
     // 检查当前作用域中变量是否已存在
     VariableEntry *existing = find_variable_in_scope(name, current_scope);
     if (existing != NULL) {
         interpreter.error.code = KUNYU_ERROR_RUNTIME;
         snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
                  "变量'%s'已经在当前作用域中定义", name);
-        return false;
+        return NULL;
     }
     
     // 创建新的变量条目
@@ -230,7 +697,7 @@ static bool define_variable(const char *name, PyObject *value, bool is_constant)
         interpreter.error.code = KUNYU_ERROR_MEMORY;
         snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
                  "内存分配失败，无法创建变量条目");
-        return false;
+        return NULL;
     }
     
     entry->name = strdup(name);
@@ -239,24 +706,78 @@ static bool define_variable(const char *name, PyObject *value, bool is_constant)
         interpreter.error.code = KUNYU_ERROR_MEMORY;
         snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
                  "内存分配失败，无法复制变量名");
-        return false;
+        return NULL;
     }
     
-    entry->value = value;
+    entry->value = NULL;
+    entry->cell = NULL;
     entry->is_constant = is_constant;
     
+    // 添加到当前作用域的变量表
+    entry->next = current_scope->variables;
+    current_scope->variables = entry;
+    
+    return entry;
+}
+
+/**
+ * 定义变量
+ */
+static bool define_variable(const char *name, PyObject *value, bool is_constant) {
+    VariableEntry *entry = add_variable(name, is_constant);
+    if (entry == NULL) {
+        return false;
+    }
+    
     // 增加引用计数
+    entry->value = value;
     if (value != NULL) {
         py_incref(value);
     }
     
-    // 添加到当前作用域的变量表
-    entry->next = current_scope->variables;
-    current_scope->variables = entry;
+    return true;
+}
+
+/**
+ * 在当前作用域中定义与函数对象共享单元的变量，调用匿名函数时绑定捕获的变量
+ */
+static bool define_cell_variable(const char *name, PyCell *cell, bool is_constant) {
+    VariableEntry *entry = add_variable(name, is_constant);
+    if (entry == NULL) {
+        return false;
+    }
     
+    py_cell_incref(cell);
+    entry->cell = cell;
     return true;
 }
 
+/**
+ * 取得变量的单元，变量第一次被捕获时把值移进新建的单元
+ * @return 单元（借用的引用），内存不足时返回NULL并设置错误
+ */
+static PyCell* capture_variable(VariableEntry *entry) {
+    if (entry->cell != NULL) {
+        return entry->cell;
+    }
+    
+    PyCell *cell = py_cell_new(entry->value);
+    if (cell == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "内存分配失败，无法捕获变量'%s'", entry->name);
+        return NULL;
+    }
+    
+    if (entry->value != NULL) {
+        py_decref(entry->value);
+        entry->value = NULL;
+    }
+    cell->is_constant = entry->is_constant;
+    entry->cell = cell;
+    return cell;
+}
+
 /**
  * 定义函数
  */
@@ -323,29 +844,21 @@ static bool define_function(const char *name, char **params, int param_count, As
     
     entry->param_count = param_count;
     entry->body = body;
+    entry->decl = NULL;
+    entry->module = NULL;
+    entry->memo = NULL;
+    entry->purity = PURITY_UNKNOWN;
+    entry->compiled = false;
+    entry->next_unconfirmed = NULL;
     
     // 添加到函数表
     entry->next = function_table;
     function_table = entry;
+    invalidate_call_caches();
     
     return true;
 }
 
-/**
- * 获取变量值
- */
-static PyObject* get_variable(const char *name) {
-    VariableEntry *entry = find_variable(name);
-    if (entry == NULL) {
-        interpreter.error.code = KUNYU_ERROR_RUNTIME;
-        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
-                 "未定义的变量: %s", name);
-        return NULL;
-    }
-    
-    return entry->value;
-}
-
 /**
  * 设置变量值
  */
@@ -366,14 +879,7 @@ static bool set_variable(const char *name, PyObject *value) {
     }
     
     // 替换值
-    if (entry->value != NULL) {
-        py_decref(entry->value);
-    }
-    
-    entry->value = value;
-    if (value != NULL) {
-        py_incref(value);
-    }
+    variable_store(entry, value);
     
     return true;
 }
@@ -413,6 +919,11 @@ static char* object_to_string(PyObject *obj) {
     switch (obj->type) {
         case TYPE_NUMBER: {
             PyNumberObject *num = (PyNumberObject *)obj;
+            if (num->is_int) {
+                snprintf(buffer, sizeof(buffer), "%" PRId64, num->int_value);
+                return strdup(buffer);
+            }
+            
             // 检查数字是否为整数
             double intpart;
             if (modf(num->value, &intpart) == 0.0) {
@@ -424,6 +935,16 @@ static char* object_to_string(PyObject *obj) {
             }
             return strdup(buffer);
         }
+        case TYPE_BIGINT:
+            return py_bigint_to_string(obj);
+        case TYPE_FUNCTION: {
+            PyFunctionObject *func = (PyFunctionObject *)obj;
+            if (func->name == NULL) {
+                return strdup("[匿名函数]");
+            }
+            snprintf(buffer, sizeof(buffer), "[函数 %s]", func->name);
+            return strdup(buffer);
+        }
         case TYPE_STRING: {
             PyStringObject *str = (PyStringObject *)obj;
             return strdup(str->value);
@@ -440,6 +961,167 @@ static bool execute_statement(AstNode *node);
 static bool execute_block(BlockStmt *block);
 static PyObject* eval_expression(AstNode *node);
 
+/**
+ * 读取超级指令的数字操作数，变量不存在或不是数字时返回false
+ */
+static bool read_number_operand(const SuperOperand *operand, NumberValue *value) {
+    if (operand->name == NULL) {
+        value->is_int = operand->is_int;
+        value->int_value = operand->int_constant;
+        value->value = operand->constant;
+        return true;
+    }
+    
+    VariableEntry *entry = find_variable(operand->name);
+    PyObject *number = entry != NULL ? variable_value(entry) : NULL;
+    if (number == NULL || number->type != TYPE_NUMBER) {
+        return false;
+    }
+    
+    number_value_of(number, value);
+    return true;
+}
+
+/**
+ * 尝试在快速路径上计算超级指令的两个操作数。
+ * 操作数不是数字或运算出错时返回false，由原始节点处理（包括给出错误信息）
+ */
+static bool eval_super_operands(SuperInstr *instr, NumberValue *value) {
+    NumberValue left, right;
+    if (!read_number_operand(&instr->left, &left) ||
+        !read_number_operand(&instr->right, &right) ||
+        number_binary_op(instr->binary_op, &left, &right, value) != NUMBER_OP_OK) {
+        STATS_INC(STAT_SUPER_FALLBACK);
+        return false;
+    }
+    
+    STATS_INC(STAT_SUPER_FAST);
+    return true;
+}
+
+/**
+ * 评估条件，比较超级指令不创建中间的数字对象
+ */
+static bool eval_condition(AstNode *node, bool *result) {
+    if (node != NULL && node->type == NODE_SUPER) {
+        SuperInstr *instr = (SuperInstr *)node;
+        NumberValue value;
+        current_node = node;
+        if (eval_super_operands(instr, &value)) {
+            *result = value.is_int ? value.int_value != 0 : value.value != 0;
+            return true;
+        }
+        node = instr->original;
+    }
+    
+    PyObject *condition = eval_expression(node);
+    if (condition == NULL) {
+        return false;
+    }
+    
+    *result = is_truthy(condition);
+    py_decref(condition);
+    return true;
+}
+
+/**
+ * 执行 x = x 运算符 操作数;
+ */
+static bool exec_update_local(SuperInstr *instr) {
+    VariableEntry *entry = find_variable(instr->target);
+    NumberValue value;
+    if (entry == NULL || entry->is_constant || !eval_super_operands(instr, &value)) {
+        return execute_statement(instr->original);
+    }
+    
+    // 变量是数字的唯一持有者时直接修改，避免分配新对象（小整数池中的对象总有池的引用）
+    PyObject *current = variable_value(entry);
+    if (current->ref_count == 1) {
+        PyNumberObject *num = (PyNumberObject *)current;
+        num->is_int = value.is_int;
+        num->int_value = value.int_value;
+        num->value = value.value;
+        return true;
+    }
+    
+    PyObject *result = create_number_from_value(&value);
+    if (result == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "内存分配失败，无法创建数字对象");
+        return false;
+    }
+    
+    variable_store(entry, result);
+    py_decref(result);
+    return true;
+}
+
+/**
+ * 执行 变量 x = 列表获取(列表, 操作数);
+ */
+static bool exec_list_get_decl(SuperInstr *instr) {
+    VariableEntry *entry = find_variable(instr->left.name);
+    PyObject *list = entry != NULL ? variable_value(entry) : NULL;
+    NumberValue index;
+    if (list == NULL || list->type != TYPE_LIST ||
+        !read_number_operand(&instr->right, &index) ||
+        (index.is_int ? index.int_value < 0 : index.value < 0) ||
+        (size_t)(index.is_int ? index.int_value : index.value) >= py_list_length(list)) {
+        STATS_INC(STAT_SUPER_FALLBACK);
+        return execute_statement(instr->original);
+    }
+    
+    STATS_INC(STAT_SUPER_FAST);
+    size_t position = index.is_int ? (size_t)index.int_value : (size_t)index.value;
+    PyObject *item = py_list_get(list, position);
+    bool result = define_variable(instr->target, item, instr->is_constant);
+    py_decref(item);
+    return result;
+}
+
+/**
+ * 执行 返回 操作数 运算符 操作数;
+ */
+static bool exec_return_binary(SuperInstr *instr) {
+    NumberValue value;
+    if (!eval_super_operands(instr, &value)) {
+        return execute_statement(instr->original);
+    }
+    
+    PyObject *result = create_number_from_value(&value);
+    if (result == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "内存分配失败，无法创建数字对象");
+        return false;
+    }
+    
+    if (interpreter.return_value != NULL) {
+        py_decref(interpreter.return_value);
+    }
+    interpreter.return_value = result;
+    interpreter.has_return = true;
+    return true;
+}
+
+/**
+ * 执行超级指令
+ */
+static bool exec_super_instr(SuperInstr *instr) {
+    switch (instr->op) {
+        case SUPER_UPDATE_LOCAL:
+            return exec_update_local(instr);
+        case SUPER_LIST_GET_DECL:
+            return exec_list_get_decl(instr);
+        case SUPER_RETURN_BINARY:
+            return exec_return_binary(instr);
+        default:
+            // 比较指令只出现在条件中
+            return execute_statement(instr->original);
+    }
+}
+
 /**
  * 执行输出语句
  */
@@ -505,14 +1187,11 @@ static bool exec_if_stmt(AstNode *node) {
     IfStmt *stmt = (IfStmt *)node;
     
     // 评估条件
-    PyObject *condition = eval_expression(stmt->condition);
-    if (condition == NULL) {
+    bool condition_result;
+    if (!eval_condition(stmt->condition, &condition_result)) {
         return false;
     }
     
-    bool condition_result = is_truthy(condition);
-    py_decref(condition);
-    
     // 根据条件执行相应的分支
     if (condition_result) {
         return execute_statement(stmt->then_branch);
@@ -538,14 +1217,11 @@ static bool exec_loop_stmt(AstNode *node) {
     
     while (true) {
         // 评估条件
-        PyObject *condition = eval_expression(stmt->condition);
-        if (condition == NULL) {
+        bool condition_result;
+        if (!eval_condition(stmt->condition, &condition_result)) {
             return false;
         }
         
-        bool condition_result = is_truthy(condition);
-        py_decref(condition);
-        
         // 条件为假时退出循环
         if (!condition_result) {
             break;
@@ -566,6 +1242,118 @@ static bool exec_loop_stmt(AstNode *node) {
     return true;
 }
 
+/**
+ * 第一次调用前分析（延迟分析时）并优化函数体
+ * @return 函数体有语法错误时返回false
+ */
+static bool compile_function(FunctionEntry *func) {
+    if (func->compiled) {
+        return true;
+    }
+    
+    if (func->body == NULL) {
+        func->body = parser_parse_function_body((AstNode *)func->decl);
+        if (func->body == NULL) {
+            KunyuError *parser_error = parser_get_error();
+            interpreter.error.code = KUNYU_ERROR_PARSER;
+            interpreter.error.line = parser_error->line;
+            interpreter.error.column = parser_error->column;
+            if (func->module != NULL) {
+                snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                         "模块'%.100s'中函数'%s'的函数体有语法错误: %.100s",
+                         func->module, func->name, parser_error->message);
+            } else {
+                snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                         "函数'%s'的函数体有语法错误: %.160s", func->name, parser_error->message);
+            }
+            return false;
+        }
+    }
+    
+    if (func->decl == NULL || !func->decl->optimized) {
+        optimizer_optimize_function(&func->body);
+    }
+    if (func->decl != NULL) {
+        func->decl->body = func->body;
+        func->decl->optimized = true;
+    }
+    func->compiled = true;
+    return true;
+}
+
+static bool function_is_pure(FunctionEntry *func, char *reason, size_t reason_size);
+
+/**
+ * 纯度检查中被调用的函数是否是纯函数
+ */
+static bool is_pure_call(const char *name) {
+    if (builtins_is_builtin(name)) {
+        return builtins_is_pure(name);
+    }
+    
+    FunctionEntry *func = find_function(name);
+    if (func == NULL) {
+        return false;
+    }
+    char reason[128];
+    return function_is_pure(func, reason, sizeof(reason));
+}
+
+/**
+ * 检查用户函数是否是纯函数，结果记录在函数表中。
+ * 递归调用正在检查的函数时假设它是纯的，所以嵌套检查得到的“纯”只是暂定的：
+ * 最外层的检查成功时这些假设都成立；失败时把它们恢复为未检查，下次重新检查。
+ * 判定为有副作用不依赖于任何假设，总是可以保留
+ */
+static bool function_is_pure(FunctionEntry *func, char *reason, size_t reason_size) {
+    switch (func->purity) {
+        case PURITY_PURE:
+        case PURITY_CHECKING:
+            return true;
+        case PURITY_IMPURE:
+            snprintf(reason, reason_size, "函数'%s'可能有副作用", func->name);
+            return false;
+        default:
+            break;
+    }
+    
+    // 纯度检查需要函数体，延迟分析的函数体在这里分析
+    if (!compile_function(func)) {
+        snprintf(reason, reason_size, "函数'%s'的函数体有语法错误", func->name);
+        return false;
+    }
+    
+    func->purity = PURITY_CHECKING;
+    purity_depth++;
+    bool pure = memo_check_pure(func->params, func->param_count, func->body,
+                                is_pure_call, reason, reason_size);
+    purity_depth--;
+    func->purity = pure ? PURITY_PURE : PURITY_IMPURE;
+    if (pure && purity_depth > 0) {
+        func->next_unconfirmed = unconfirmed_pure;
+        unconfirmed_pure = func;
+    }
+    
+    if (purity_depth == 0) {
+        while (unconfirmed_pure != NULL) {
+            FunctionEntry *next = unconfirmed_pure->next_unconfirmed;
+            if (!pure) {
+                unconfirmed_pure->purity = PURITY_UNKNOWN;
+            }
+            unconfirmed_pure->next_unconfirmed = NULL;
+            unconfirmed_pure = next;
+        }
+    }
+    return pure;
+}
+
+/**
+ * 执行导入语句
+ */
+static bool exec_import_stmt(ImportStmt *stmt) {
+    return module_import(stmt->path, &interpreter.error);
+}
+
 /**
  * 执行函数声明
  */
@@ -580,7 +1368,43 @@ static bool exec_function_decl(AstNode *node) {
     FunctionStmt *stmt = (FunctionStmt *)node;
     
     // 定义函数
-    return define_function(stmt->name, stmt->params, stmt->param_count, stmt->body);
+    if (!define_function(stmt->name, stmt->params, stmt->param_count, stmt->body)) {
+        return false;
+    }
+    
+    FunctionEntry *entry = function_table;
+    entry->decl = stmt;
+    if (current_module != NULL) {
+        // 复制失败只影响错误信息中的文件名
+        entry->module = strdup(current_module);
+    }
+    if (stmt->assume_pure) {
+        entry->purity = PURITY_PURE;
+    }
+    if (stmt->memo_capacity == 0) {
+        return true;
+    }
+    
+    // 缓存有副作用的函数会改变程序的行为，无法证明是纯函数时拒绝
+    char reason[128];
+    if (!function_is_pure(entry, reason, sizeof(reason))) {
+        if (interpreter.error.code == KUNYU_ERROR_PARSER) {
+            return false;
+        }
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "函数'%s'不能使用@缓存: %s（确认没有副作用时可以加上@纯函数）", stmt->name, reason);
+        return false;
+    }
+    
+    entry->memo = memo_new(stmt->memo_capacity);
+    if (entry->memo == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "内存分配失败，无法创建函数结果缓存");
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -714,72 +1538,28 @@ static PyObject* eval_binary_expr(BinaryExpr *expr) {
         free(left_str);
         free(right_str);
     }
+    // 大整数之间的运算
+    else if ((left->type == TYPE_BIGINT || right->type == TYPE_BIGINT) &&
+             py_is_integer(left) && py_is_integer(right)) {
+        result = bigint_binary_op(expr->op, left, right);
+    }
     // 处理数值运算
-    else if (left->type == TYPE_NUMBER && right->type == TYPE_NUMBER) {
-        PyNumberObject *num_left = (PyNumberObject *)left;
-        PyNumberObject *num_right = (PyNumberObject *)right;
-        double value;
-        
-        switch (expr->op) {
-            case OP_ADD:
-                value = num_left->value + num_right->value;
-                break;
-            case OP_SUB:
-                value = num_left->value - num_right->value;
-                break;
-            case OP_MUL:
-                value = num_left->value * num_right->value;
-                break;
-            case OP_DIV:
-                if (num_right->value == 0) {
-                    interpreter.error.code = KUNYU_ERROR_RUNTIME;
-                    snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
-                             "除数不能为零");
-                    py_decref(left);
-                    py_decref(right);
-                    return NULL;
-                }
-                value = num_left->value / num_right->value;
-                break;
-            case OP_MOD:
-                if (num_right->value == 0) {
-                    interpreter.error.code = KUNYU_ERROR_RUNTIME;
-                    snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
-                             "模运算的除数不能为零");
-                    py_decref(left);
-                    py_decref(right);
-                    return NULL;
-                }
-                value = (int)num_left->value % (int)num_right->value;
-                break;
-            case OP_EQ:
-                value = (num_left->value == num_right->value) ? 1 : 0;
-                break;
-            case OP_NE:
-                value = (num_left->value != num_right->value) ? 1 : 0;
+    else if ((left->type == TYPE_NUMBER || left->type == TYPE_BIGINT) &&
+             (right->type == TYPE_NUMBER || right->type == TYPE_BIGINT)) {
+        NumberValue left_value, right_value, value;
+        number_value_of(left, &left_value);
+        number_value_of(right, &right_value);
+        switch (number_binary_op(expr->op, &left_value, &right_value, &value)) {
+            case NUMBER_OP_OK:
+                result = create_number_from_value(&value);
                 break;
-            case OP_LT:
-                value = (num_left->value < num_right->value) ? 1 : 0;
-                break;
-            case OP_LE:
-                value = (num_left->value <= num_right->value) ? 1 : 0;
-                break;
-            case OP_GT:
-                value = (num_left->value > num_right->value) ? 1 : 0;
-                break;
-            case OP_GE:
-                value = (num_left->value >= num_right->value) ? 1 : 0;
+            case NUMBER_OP_OVERFLOW:
+                // 64位整数溢出，提升为大整数
+                result = bigint_binary_op(expr->op, left, right);
                 break;
             default:
-                interpreter.error.code = KUNYU_ERROR_RUNTIME;
-                snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
-                         "不支持的运算符");
-                py_decref(left);
-                py_decref(right);
-                return NULL;
+                break;
         }
-        
-        result = create_number_object(value);
     }
     else {
         interpreter.error.code = KUNYU_ERROR_RUNTIME;
@@ -794,71 +1574,211 @@ static PyObject* eval_binary_expr(BinaryExpr *expr) {
 }
 
 /**
- * 评估函数调用表达式
+ * 判断字面量节点是否是字符串常量
  */
-static PyObject* eval_call_expr(CallExpr *expr) {
-    // 首先检查是否是内置函数
-    if (builtins_is_builtin(expr->name)) {
-        // 评估所有参数
-        PyObject **args = NULL;
-        if (expr->arg_count > 0) {
-            args = (PyObject **)malloc(sizeof(PyObject *) * expr->arg_count);
-            if (args == NULL) {
-                interpreter.error.code = KUNYU_ERROR_MEMORY;
+static bool is_string_literal(const AstNode *node) {
+    return node != NULL && node->type == NODE_LITERAL &&
+           ((const LiteralExpr *)node)->token_type == KUNYU_TOKEN_STRING;
+}
+
+/**
+ * 解析调用点的目标并缓存在节点上，函数表未变化时直接使用缓存
+ */
+static bool resolve_call_target(CallExpr *expr) {
+    if (expr->cache_epoch == resolve_epoch) {
+        return true;
+    }
+    
+    // 内置函数优先于同名的用户函数
+    const BuiltinFunc *builtin = builtins_find(expr->name);
+    if (builtin != NULL) {
+        expr->cache_kind = CALL_CACHE_BUILTIN;
+        expr->cached_target = builtin;
+        
+        // 键是字符串常量的字典访问可以按布局缓存槽位
+        if (expr->arg_count == 2 && strcmp(expr->name, "字典获取") == 0 &&
+            is_string_literal(expr->args[1])) {
+            expr->cache_kind = CALL_CACHE_DICT_GET;
+        } else if (expr->arg_count == 3 && strcmp(expr->name, "字典设置") == 0 &&
+                   is_string_literal(expr->args[1])) {
+            expr->cache_kind = CALL_CACHE_DICT_SET;
+        }
+    } else {
+        FunctionEntry *func = find_function(expr->name);
+        if (func != NULL) {
+            expr->cache_kind = CALL_CACHE_USER;
+            expr->cached_target = func;
+        } else {
+            // 最后是保存函数值的变量，变量随作用域变化，不缓存具体的函数
+            VariableEntry *var = find_variable(expr->name);
+            PyObject *value = var != NULL ? variable_value(var) : NULL;
+            if (value == NULL || value->type != TYPE_FUNCTION) {
+                interpreter.error.code = KUNYU_ERROR_RUNTIME;
                 snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
-                         "内存分配失败，无法创建参数数组");
-                return NULL;
-            }
-            
-            for (int i = 0; i < expr->arg_count; i++) {
-                args[i] = eval_expression(expr->args[i]);
-                if (args[i] == NULL) {
-                    // 清理已评估的参数
-                    for (int j = 0; j < i; j++) {
-                        py_decref(args[j]);
-                    }
-                    free(args);
-                    return NULL;
-                }
+                         "未定义的函数: %s", expr->name);
+                return false;
             }
+            expr->cache_kind = CALL_CACHE_VALUE;
+            expr->cached_target = NULL;
+        }
+    }
+    
+    expr->cached_shape = NULL;
+    expr->cached_next_shape = NULL;
+    expr->cached_slot = -1;
+    expr->cache_epoch = resolve_epoch;
+    return true;
+}
+
+/**
+ * 按缓存的布局和槽位直接完成字典访问，args[1]（键）未被评估
+ */
+static PyObject* eval_cached_dict_access(CallExpr *expr, PyObject **args) {
+    if (expr->cache_kind == CALL_CACHE_DICT_GET) {
+        return py_dict_get_slot(args[0], expr->cached_slot);
+    }
+    
+    if (expr->cached_next_shape == NULL) {
+        py_dict_set_slot(args[0], expr->cached_slot, args[2]);
+        return py_number_new(1);
+    }
+    
+    bool result = py_dict_append_slot(args[0], expr->cached_next_shape, args[2]);
+    return py_number_new(result ? 1 : 0);
+}
+
+/**
+ * 字典访问走完整路径成功后，记录调用前后的布局和键的槽位
+ */
+static void update_dict_cache(CallExpr *expr, PyObject **args, const DictShape *before) {
+    const DictShape *after = py_dict_shape(args[0]);
+    if (before == NULL || after == NULL) {
+        return;
+    }
+    
+    int slot = py_dict_lookup_slot(args[0], args[1]);
+    if (slot < 0) {
+        return;
+    }
+    
+    // 布局不变说明是读取或替换已有键，否则是新增键引起的布局转移
+    expr->cached_shape = before;
+    expr->cached_next_shape = after == before ? NULL : after;
+    expr->cached_slot = slot;
+}
+
+/**
+ * 调用内置函数
+ */
+static PyObject* call_builtin(CallExpr *expr) {
+    bool is_dict_access = expr->cache_kind == CALL_CACHE_DICT_GET ||
+                          expr->cache_kind == CALL_CACHE_DICT_SET;
+    
+    // 评估所有参数
+    PyObject *inline_args[CALL_INLINE_ARGS];
+    PyObject **args = inline_args;
+    if (expr->arg_count > CALL_INLINE_ARGS) {
+        args = (PyObject **)malloc(sizeof(PyObject *) * expr->arg_count);
+        if (args == NULL) {
+            interpreter.error.code = KUNYU_ERROR_MEMORY;
+            snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                     "内存分配失败，无法创建参数数组");
+            return NULL;
+        }
+    }
+    
+    bool cache_hit = false;
+    for (int i = 0; i < expr->arg_count; i++) {
+        // 字典的布局与缓存一致时不需要评估键
+        if (i == 1 && is_dict_access && expr->cached_shape != NULL &&
+            py_dict_shape(args[0]) == expr->cached_shape) {
+            cache_hit = true;
+            args[i] = NULL;
+            continue;
         }
         
-        // 调用内置函数
-        PyObject *result = builtins_call(expr->name, args, expr->arg_count);
-        
-        // 清理参数
-        if (args != NULL) {
-            for (int i = 0; i < expr->arg_count; i++) {
-                py_decref(args[i]);
+        args[i] = eval_expression(expr->args[i]);
+        if (args[i] == NULL) {
+            // 清理已评估的参数
+            for (int j = 0; j < i; j++) {
+                if (args[j] != NULL) {
+                    py_decref(args[j]);
+                }
+            }
+            if (args != inline_args) {
+                free(args);
             }
-            free(args);
+            return NULL;
         }
-        
-        if (result == NULL) {
+    }
+    
+    // 值参数的评估可能修改了字典
+    if (cache_hit && py_dict_shape(args[0]) != expr->cached_shape) {
+        cache_hit = false;
+        args[1] = eval_expression(expr->args[1]);
+    }
+    const DictShape *shape_before = is_dict_access && !cache_hit ? py_dict_shape(args[0]) : NULL;
+    
+    // 调用内置函数
+    PyObject *result = NULL;
+    bool pushed = push_call_frame(expr->name, (AstNode *)expr);
+    if (pushed) {
+        STATS_CALL_BEGIN(expr->name, true);
+        TRACE_CALL_BEGIN(expr->name, true, expr->base.base.line);
+        if (cache_hit) {
+            result = eval_cached_dict_access(expr, args);
+        } else {
+            result = builtins_invoke((const BuiltinFunc *)expr->cached_target, args, expr->arg_count);
+        }
+        TRACE_CALL_END();
+        STATS_CALL_END();
+        pop_call_frame();
+    }
+    
+    if (result != NULL && shape_before != NULL) {
+        update_dict_cache(expr, args, shape_before);
+    }
+    
+    // 清理参数
+    for (int i = 0; i < expr->arg_count; i++) {
+        if (args[i] != NULL) {
+            py_decref(args[i]);
+        }
+    }
+    if (args != inline_args) {
+        free(args);
+    }
+    
+    if (result == NULL) {
+        // 回调函数出错时保留回调报告的错误
+        if (pushed && interpreter.error.code == KUNYU_OK) {
             interpreter.error.code = KUNYU_ERROR_RUNTIME;
             snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
                      "调用内置函数'%s'失败", expr->name);
-            return NULL;
         }
-        
-        return result;
-    }
-    
-    // 如果不是内置函数，则查找用户定义的函数
-    FunctionEntry *func = find_function(expr->name);
-    if (func == NULL) {
-        interpreter.error.code = KUNYU_ERROR_RUNTIME;
-        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
-                 "未定义的函数: %s", expr->name);
         return NULL;
     }
     
+    return result;
+}
+
+/**
+ * 调用用户函数或函数对象：创建作用域，绑定捕获的变量和参数，执行函数体。
+ * 匿名函数调用结束时把捕获变量的新值写回函数对象
+ * @param name 函数名，用于错误信息和调用栈
+ * @param closure 函数对象，调用用户函数时为NULL
+ * @param args 已评估的参数，引用仍归调用者所有
+ * @return 返回值，出错返回NULL
+ */
+static PyObject* invoke_function(const char *name, char **params, int param_count, AstNode *body,
+                                 PyFunctionObject *closure, PyObject **args, int arg_count,
+                                 const AstNode *call_site) {
     // 检查参数数量
-    if (expr->arg_count != func->param_count) {
+    if (arg_count != param_count) {
         interpreter.error.code = KUNYU_ERROR_RUNTIME;
         snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
                  "函数'%s'需要%d个参数，但接收到%d个", 
-                 expr->name, func->param_count, expr->arg_count);
+                 name, param_count, arg_count);
         return NULL;
     }
     
@@ -867,18 +1787,17 @@ static PyObject* eval_call_expr(CallExpr *expr) {
         return NULL;
     }
     
-    // 绑定参数
-    for (int i = 0; i < expr->arg_count; i++) {
-        PyObject *arg_value = eval_expression(expr->args[i]);
-        if (arg_value == NULL) {
+    // 绑定捕获的变量和参数，捕获的变量与外层作用域共享单元
+    int upvalue_count = closure != NULL ? closure->upvalue_count : 0;
+    for (int i = 0; i < upvalue_count; i++) {
+        PyCell *cell = closure->upvalues[i];
+        if (cell != NULL && !define_cell_variable(closure->upvalue_names[i], cell, cell->is_constant)) {
             pop_scope();
             return NULL;
         }
-        
-        bool result = define_variable(func->params[i], arg_value, false);
-        py_decref(arg_value);
-        
-        if (!result) {
+    }
+    for (int i = 0; i < arg_count; i++) {
+        if (!define_variable(params[i], args[i], false)) {
             pop_scope();
             return NULL;
         }
@@ -892,7 +1811,16 @@ static PyObject* eval_call_expr(CallExpr *expr) {
     }
     
     // 执行函数体
-    bool success = execute_statement(func->body);
+    if (!push_call_frame(name, call_site)) {
+        pop_scope();
+        return NULL;
+    }
+    STATS_CALL_BEGIN(name, false);
+    TRACE_CALL_BEGIN(name, false, call_site != NULL ? call_site->line : 0);
+    bool success = execute_statement(body);
+    TRACE_CALL_END();
+    STATS_CALL_END();
+    pop_call_frame();
     
     // 保存返回值（如果有）
     PyObject *return_value = NULL;
@@ -921,6 +1849,126 @@ static PyObject* eval_call_expr(CallExpr *expr) {
     return return_value;
 }
 
+/**
+ * 调用函数对象
+ */
+static PyObject* call_function_object(PyFunctionObject *func, PyObject **args, int arg_count,
+                                      const AstNode *call_site) {
+    const char *name = func->name != NULL ? func->name : "匿名函数";
+    return invoke_function(name, func->params, func->param_count, func->body,
+                           func->upvalue_count > 0 ? func : NULL, args, arg_count, call_site);
+}
+
+/**
+ * 评估函数调用表达式
+ */
+static PyObject* eval_call_expr(CallExpr *expr) {
+    if (!resolve_call_target(expr)) {
+        return NULL;
+    }
+    
+    if (expr->cache_kind != CALL_CACHE_USER && expr->cache_kind != CALL_CACHE_VALUE) {
+        return call_builtin(expr);
+    }
+    
+    // 评估所有参数
+    PyObject *inline_args[CALL_INLINE_ARGS];
+    PyObject **args = inline_args;
+    if (expr->arg_count > CALL_INLINE_ARGS) {
+        args = (PyObject **)malloc(sizeof(PyObject *) * expr->arg_count);
+        if (args == NULL) {
+            interpreter.error.code = KUNYU_ERROR_MEMORY;
+            snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                     "内存分配失败，无法创建参数数组");
+            return NULL;
+        }
+    }
+    
+    int evaluated = 0;
+    PyObject *result = NULL;
+    for (; evaluated < expr->arg_count; evaluated++) {
+        args[evaluated] = eval_expression(expr->args[evaluated]);
+        if (args[evaluated] == NULL) {
+            break;
+        }
+    }
+    
+    if (evaluated == expr->arg_count) {
+        if (expr->cache_kind == CALL_CACHE_USER) {
+            FunctionEntry *func = (FunctionEntry *)expr->cached_target;
+            if (func->memo != NULL) {
+                result = memo_lookup(func->memo, args, expr->arg_count);
+            }
+            if (result == NULL && compile_function(func)) {
+                result = invoke_function(func->name, func->params, func->param_count, func->body,
+                                         NULL, args, expr->arg_count, (AstNode *)expr);
+                if (result != NULL && func->memo != NULL) {
+                    memo_store(func->memo, args, expr->arg_count, result);
+                }
+            }
+        } else {
+            // 函数值在参数评估后读取，调用期间持有引用以防变量被重新赋值
+            VariableEntry *var = find_variable(expr->name);
+            PyObject *func = var != NULL ? variable_value(var) : NULL;
+            if (func == NULL || func->type != TYPE_FUNCTION) {
+                interpreter.error.code = KUNYU_ERROR_RUNTIME;
+                snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                         "'%s'不是函数", expr->name);
+            } else {
+                py_incref(func);
+                result = call_function_object((PyFunctionObject *)func, args, expr->arg_count,
+                                              (AstNode *)expr);
+                py_decref(func);
+            }
+        }
+    }
+    
+    // 清理参数
+    for (int i = 0; i < evaluated; i++) {
+        py_decref(args[i]);
+    }
+    if (args != inline_args) {
+        free(args);
+    }
+    
+    return result;
+}
+
+/**
+ * 评估匿名函数表达式：创建函数对象，函数体用到的外层局部变量改为保存在单元中，
+ * 函数对象和外层作用域共享这些单元
+ */
+static PyObject* eval_lambda_expr(LambdaExpr *expr) {
+    PyFunctionObject *func = (PyFunctionObject *)py_function_new(
+        NULL, expr->params, expr->param_count, expr->body, expr->upvalues, expr->upvalue_count);
+    if (func == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "内存分配失败，无法创建函数对象");
+        return NULL;
+    }
+    
+    // 全局变量和创建时不存在的名字（全局函数名、之后才定义的变量）不捕获，在调用时按名字查找
+    for (int i = 0; i < expr->upvalue_count; i++) {
+        for (Scope *scope = current_scope; scope != NULL && scope->parent != NULL; scope = scope->parent) {
+            VariableEntry *entry = find_variable_in_scope(expr->upvalues[i], scope);
+            if (entry == NULL) {
+                continue;
+            }
+            PyCell *cell = capture_variable(entry);
+            if (cell == NULL) {
+                py_decref((PyObject *)func);
+                return NULL;
+            }
+            py_cell_incref(cell);
+            func->upvalues[i] = cell;
+            break;
+        }
+    }
+    
+    return (PyObject *)func;
+}
+
 /**
  * 评估分组表达式
  */
@@ -932,7 +1980,19 @@ static PyObject* eval_grouping_expr(GroupingExpr *expr) {
  * 评估变量引用表达式
  */
 static PyObject* eval_variable_expr(VariableExpr *expr) {
-    PyObject *value = get_variable(expr->name);
+    VariableEntry *entry = find_variable(expr->name);
+    if (entry == NULL) {
+        // 没有同名变量时，用户函数的名字可以作为函数值使用
+        if (find_function(expr->name) != NULL) {
+            return interpreter_function_value(expr->name);
+        }
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "未定义的变量: %s", expr->name);
+        return NULL;
+    }
+    
+    PyObject *value = variable_value(entry);
     if (value != NULL) {
         py_incref(value);
     }
@@ -944,6 +2004,15 @@ static PyObject* eval_variable_expr(VariableExpr *expr) {
  */
 static PyObject* eval_literal_expr(LiteralExpr *expr) {
     switch (expr->token_type) {
+        case KUNYU_TOKEN_INTEGER: {
+            // 超出64位整数范围的字面量是大整数
+            errno = 0;
+            int64_t value = strtoll(expr->value, NULL, 10);
+            if (errno == ERANGE) {
+                return py_bigint_from_string(expr->value);
+            }
+            return py_int_new(value);
+        }
         case KUNYU_TOKEN_NUMBER: {
             double value = atof(expr->value);
             return create_number_object(value);
@@ -986,6 +2055,8 @@ static PyObject* eval_expression(AstNode *node) {
         return NULL;
     }
     
+    current_node = node;
+    
     switch (node->type) {
         case NODE_LITERAL: {
             LiteralExpr *expr = (LiteralExpr *)node;
@@ -1011,6 +2082,15 @@ static PyObject* eval_expression(AstNode *node) {
             AssignExpr *expr = (AssignExpr *)node;
             return eval_assign_expr(expr);
         }
+        case NODE_LAMBDA: {
+            LambdaExpr *expr = (LambdaExpr *)node;
+            return eval_lambda_expr(expr);
+        }
+        case NODE_SUPER: {
+            // 比较指令出现在条件以外的位置时按原始表达式求值
+            SuperInstr *instr = (SuperInstr *)node;
+            return eval_expression(instr->original);
+        }
         default: {
             interpreter.error.code = KUNYU_ERROR_RUNTIME;
             snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
@@ -1028,6 +2108,8 @@ static bool execute_statement(AstNode *node) {
         return false;
     }
     
+    current_node = node;
+    
     switch (node->type) {
         case NODE_PRINT:
             return exec_print_stmt(node);
@@ -1039,12 +2121,16 @@ static bool execute_statement(AstNode *node) {
             return exec_loop_stmt(node);
         case NODE_FUNCDECL:
             return exec_function_decl(node);
+        case NODE_IMPORT:
+            return exec_import_stmt((ImportStmt *)node);
         case NODE_BLOCK: {
             BlockStmt *block = (BlockStmt *)node;
             return execute_block(block);
         }
         case NODE_RETURN:
             return exec_return_stmt(node);
+        case NODE_SUPER:
+            return exec_super_instr((SuperInstr *)node);
         case NODE_PROGRAM:
             if (((StmtNode*)node)->stmt_type == STMT_EXPRESSION) {
                 return exec_expression_stmt(node);
@@ -1074,7 +2160,11 @@ static bool execute_program(AstNode *program) {
     
     // 执行每条语句
     for (int i = 0; i < prog->stmt_count; i++) {
-        if (!execute_statement(prog->statements[i])) {
+        AstNode *stmt = prog->statements[i];
+        if (interpreter.definitions_only && stmt->type != NODE_FUNCDECL && stmt->type != NODE_IMPORT) {
+            continue;
+        }
+        if (!execute_statement(stmt)) {
             return false;
         }
         
@@ -1107,15 +2197,298 @@ bool interpreter_execute(AstNode *root) {
     return result;
 }
 
+/**
+ * 在全新的全局作用域中执行程序，执行前把值绑定到全局常量。
+ * 批处理模式用它对每个输入执行一次脚本，内置函数表在多次执行之间保留
+ * @param name 常量名
+ * @param value 常量的值，引用仍归调用者所有
+ * @return 成功返回true
+ */
+bool interpreter_execute_with_constant(AstNode *root, const char *name, PyObject *value) {
+    if (root == NULL) {
+        return false;
+    }
+    
+    interpreter_init();
+    if (current_scope == NULL || !define_variable(name, value, true)) {
+        return false;
+    }
+    
+    return execute_program(root);
+}
+
+/**
+ * 在全新的全局作用域中只执行程序前count条顶层语句中的函数声明和导入语句，
+ * 导入的模块同样只定义函数。从快照恢复时用它重新建立函数表，变量由快照提供
+ * @return 成功返回true
+ */
+bool interpreter_define_functions(AstNode *root, int count) {
+    if (root == NULL || root->type != NODE_PROGRAM) {
+        return false;
+    }
+    
+    interpreter_init();
+    if (current_scope == NULL) {
+        return false;
+    }
+    
+    Program *prog = (Program *)root;
+    bool result = true;
+    interpreter.definitions_only = true;
+    for (int i = 0; result && i < count && i < prog->stmt_count; i++) {
+        AstNode *stmt = prog->statements[i];
+        if (stmt->type == NODE_FUNCDECL || stmt->type == NODE_IMPORT) {
+            result = execute_statement(stmt);
+        }
+    }
+    interpreter.definitions_only = false;
+    return result;
+}
+
+/**
+ * 在全局作用域中定义变量
+ * @param value 变量的值，引用仍归调用者所有
+ * @return 成功返回true，已经定义过时返回false
+ */
+bool interpreter_define_global(const char *name, PyObject *value, bool is_constant) {
+    if (current_scope == NULL) {
+        return false;
+    }
+    
+    Scope *saved_scope = current_scope;
+    while (current_scope->parent != NULL) {
+        current_scope = current_scope->parent;
+    }
+    bool result = define_variable(name, value, is_constant);
+    current_scope = saved_scope;
+    return result;
+}
+
+/**
+ * 按定义的顺序访问全局作用域中的所有变量，visit返回false时停止
+ * @return 所有变量都访问过时返回true
+ */
+bool interpreter_visit_globals(bool (*visit)(const char *name, PyObject *value, bool is_constant, void *context),
+                               void *context) {
+    Scope *global = current_scope;
+    while (global != NULL && global->parent != NULL) {
+        global = global->parent;
+    }
+    if (global == NULL) {
+        return true;
+    }
+    
+    // 变量表是头插的，先倒过来
+    size_t count = 0;
+    for (VariableEntry *var = global->variables; var != NULL; var = var->next) {
+        count++;
+    }
+    VariableEntry **entries = (VariableEntry **)malloc(sizeof(VariableEntry *) * (count > 0 ? count : 1));
+    if (entries == NULL) {
+        return false;
+    }
+    size_t i = count;
+    for (VariableEntry *var = global->variables; var != NULL; var = var->next) {
+        entries[--i] = var;
+    }
+    
+    bool result = true;
+    for (i = 0; result && i < count; i++) {
+        result = visit(entries[i]->name, variable_value(entries[i]), entries[i]->is_constant, context);
+    }
+    free(entries);
+    return result;
+}
+
+/**
+ * 用户函数作为值使用时创建的函数对象
+ * @return 新引用，函数不存在或函数体有语法错误时返回NULL并设置解释器错误
+ */
+PyObject* interpreter_function_value(const char *name) {
+    FunctionEntry *func = find_function(name);
+    if (func == NULL) {
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "未定义的函数: %s", name);
+        return NULL;
+    }
+    if (!compile_function(func)) {
+        return NULL;
+    }
+    
+    PyObject *value = py_function_new(func->name, func->params, func->param_count,
+                                      func->body, NULL, 0);
+    if (value == NULL) {
+        interpreter.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "内存分配失败，无法创建函数对象");
+    }
+    return value;
+}
+
+/**
+ * 在全局作用域中执行模块的顶层语句，模块中声明的变量和函数对导入者可见
+ * @param root 模块的程序节点
+ * @param path 模块文件，函数体有语法错误时出现在错误信息中
+ * @return 成功返回true
+ */
+bool interpreter_execute_module(AstNode *root, const char *path) {
+    Scope *saved_scope = current_scope;
+    while (current_scope->parent != NULL) {
+        current_scope = current_scope->parent;
+    }
+    
+    const char *saved_module = current_module;
+    current_module = path;
+    bool result = execute_program(root);
+    current_module = saved_module;
+    
+    // 模块顶层的返回语句只结束模块本身
+    interpreter.has_return = false;
+    if (interpreter.return_value != NULL) {
+        py_decref(interpreter.return_value);
+        interpreter.return_value = NULL;
+    }
+    
+    current_scope = saved_scope;
+    return result;
+}
+
+/**
+ * 从顶层开始一次新的执行：解释器尚未初始化时先初始化，清除上次的错误，
+ * 上次执行出错时可能停在函数内部，回到全局作用域
+ */
+static void begin_top_level() {
+    if (current_scope == NULL) {
+        interpreter_init();
+    }
+    interpreter.error.code = KUNYU_OK;
+    interpreter.error.message[0] = '\0';
+    interpreter.error.line = 0;
+    interpreter.error.column = 0;
+    
+    while (current_scope->parent != NULL) {
+        pop_scope();
+    }
+    call_depth = 0;
+}
+
+/**
+ * 在保留的全局状态中执行程序的部分顶层语句，解释器尚未初始化时先初始化。
+ * 交互式环境用它执行每次输入追加的语句，变量和函数在输入之间保留
+ * @param root 程序节点
+ * @param first 第一条要执行的语句
+ * @param count 要执行的语句数
+ * @return 成功返回true
+ */
+bool interpreter_execute_statements(AstNode *root, int first, int count) {
+    if (root == NULL || root->type != NODE_PROGRAM) {
+        return false;
+    }
+    
+    begin_top_level();
+    
+    Program *prog = (Program *)root;
+    bool result = true;
+    for (int i = first; i < first + count && i < prog->stmt_count; i++) {
+        if (!execute_statement(prog->statements[i])) {
+            result = false;
+            break;
+        }
+    }
+    
+    // 顶层的返回语句只结束这次执行
+    interpreter.has_return = false;
+    if (interpreter.return_value != NULL) {
+        py_decref(interpreter.return_value);
+        interpreter.return_value = NULL;
+    }
+    return result;
+}
+
+/**
+ * 在全局状态中调用用户定义的函数，供嵌入接口使用
+ * @param name 函数名
+ * @param args 参数，引用仍归调用者所有
+ * @return 返回值，出错或函数没有返回值时返回NULL，用interpreter_get_error区分
+ */
+PyObject* interpreter_call_named(const char *name, PyObject **args, int arg_count) {
+    begin_top_level();
+    
+    FunctionEntry *func = find_function(name);
+    if (func == NULL) {
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "未定义的函数: %s", name);
+        return NULL;
+    }
+    
+    PyObject *result = NULL;
+    if (func->memo != NULL) {
+        result = memo_lookup(func->memo, args, arg_count);
+    }
+    if (result == NULL && compile_function(func)) {
+        result = invoke_function(func->name, func->params, func->param_count, func->body,
+                                 NULL, args, arg_count, NULL);
+        if (result != NULL && func->memo != NULL) {
+            memo_store(func->memo, args, arg_count, result);
+        }
+    }
+    current_node = NULL;
+    return result;
+}
+
 /**
  * 清理解释器资源
  */
 void interpreter_cleanup() {
+    // 释放作用域、变量和函数表
+    free_interpreter_state();
+    call_depth = 0;
+    current_node = NULL;
+    
     // 清理内置函数
     builtins_cleanup();
+}
+
+/**
+ * 从内置函数中调用函数对象（映射、排序等的回调）
+ * @param func 函数对象
+ * @param args 参数，引用仍归调用者所有
+ * @return 返回值，出错时返回NULL并设置解释器错误
+ */
+PyObject* interpreter_call_function(PyObject *func, PyObject **args, int arg_count) {
+    if (func == NULL || func->type != TYPE_FUNCTION) {
+        interpreter.error.code = KUNYU_ERROR_RUNTIME;
+        snprintf(interpreter.error.message, sizeof(interpreter.error.message), 
+                 "预期函数参数");
+        return NULL;
+    }
     
-    // 清理其他资源
-    // 这里可以添加其他需要清理的资源
+    // 回调的调用位置是正在执行的内置函数调用
+    const AstNode *call_site = current_node;
+    PyObject *result = call_function_object((PyFunctionObject *)func, args, arg_count, call_site);
+    current_node = call_site;
+    return result;
+}
+
+/**
+ * 获取当前正在执行的节点
+ */
+const AstNode* interpreter_current_node() {
+    return current_node;
+}
+
+/**
+ * 获取调用栈
+ * @param depth 输出调用栈深度
+ * @return 调用栈帧数组，下标0为最外层调用
+ */
+const CallFrame* interpreter_get_call_stack(int *depth) {
+    if (depth != NULL) {
+        *depth = call_depth;
+    }
+    return call_stack;
 }
 
 /**
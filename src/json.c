@@ -0,0 +1,556 @@
+/**
+ * 坤舆编程语言 - JSON
+ * 在JSON文本和对象之间转换，供服务模式读取请求和写出结果。
+ * 对象：JSON对象对应字典，数组对应列表，true和false对应1和0；语言中没有空值，null只能出现在输出中
+ */
+
+#include "../includes/kunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#define JSON_MAX_DEPTH 256
+
+/**
+ * 解析器上下文
+ */
+typedef struct {
+    const char *text;            // JSON文本
+    size_t length;               // 字节数
+    size_t pos;                  // 当前位置
+    int depth;                   // 嵌套层数
+    char *error;                 // 错误信息缓冲区
+    size_t error_size;           // 错误信息缓冲区大小
+} JsonParser;
+
+static PyObject* parse_value(JsonParser *parser);
+
+/**
+ * 记录错误
+ */
+static PyObject* json_error(JsonParser *parser, const char *message) {
+    snprintf(parser->error, parser->error_size, "%s（第%zu字节）", message, parser->pos + 1);
+    return NULL;
+}
+
+/**
+ * 跳过空白
+ */
+static void skip_whitespace(JsonParser *parser) {
+    while (parser->pos < parser->length) {
+        char c = parser->text[parser->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        parser->pos++;
+    }
+}
+
+/**
+ * 匹配关键字
+ */
+static bool match_literal(JsonParser *parser, const char *literal) {
+    size_t length = strlen(literal);
+    if (parser->length - parser->pos < length || memcmp(parser->text + parser->pos, literal, length) != 0) {
+        return false;
+    }
+    parser->pos += length;
+    return true;
+}
+
+/**
+ * 读取\u后面的四位十六进制数
+ */
+static bool read_hex4(JsonParser *parser, unsigned int *out) {
+    if (parser->length - parser->pos < 4) {
+        return false;
+    }
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = parser->text[parser->pos++];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= (unsigned int)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value |= (unsigned int)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            value |= (unsigned int)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+    *out = value;
+    return true;
+}
+
+/**
+ * 把码点编码为UTF-8
+ * @return 字节数
+ */
+static size_t encode_utf8(unsigned int code, char *out) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+/**
+ * 解析字符串，返回以'\0'结尾的UTF-8字节
+ */
+static char* parse_string_bytes(JsonParser *parser) {
+    // 跳过开头的引号，转义后的字符串不会比原文长
+    parser->pos++;
+    char *buffer = (char *)malloc(parser->length - parser->pos + 1);
+    if (buffer == NULL) {
+        json_error(parser, "内存分配失败，无法解析字符串");
+        return NULL;
+    }
+
+    size_t length = 0;
+    while (parser->pos < parser->length) {
+        unsigned char c = (unsigned char)parser->text[parser->pos++];
+        if (c == '"') {
+            buffer[length] = '\0';
+            if (!utf8_validate(buffer, length, NULL)) {
+                free(buffer);
+                json_error(parser, "字符串不是有效的UTF-8编码");
+                return NULL;
+            }
+            return buffer;
+        }
+        if (c < 0x20) {
+            free(buffer);
+            json_error(parser, "字符串中有未转义的控制字符");
+            return NULL;
+        }
+        if (c != '\\') {
+            buffer[length++] = (char)c;
+            continue;
+        }
+
+        if (parser->pos >= parser->length) {
+            break;
+        }
+        char escape = parser->text[parser->pos++];
+        unsigned int code;
+        switch (escape) {
+            case '"':  buffer[length++] = '"'; break;
+            case '\\': buffer[length++] = '\\'; break;
+            case '/':  buffer[length++] = '/'; break;
+            case 'b':  buffer[length++] = '\b'; break;
+            case 'f':  buffer[length++] = '\f'; break;
+            case 'n':  buffer[length++] = '\n'; break;
+            case 'r':  buffer[length++] = '\r'; break;
+            case 't':  buffer[length++] = '\t'; break;
+            case 'u':
+                if (!read_hex4(parser, &code)) {
+                    free(buffer);
+                    json_error(parser, "无效的\\u转义");
+                    return NULL;
+                }
+                // 代理对组合成一个码点
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    unsigned int low;
+                    if (!match_literal(parser, "\\u") || !read_hex4(parser, &low) ||
+                        low < 0xDC00 || low > 0xDFFF) {
+                        free(buffer);
+                        json_error(parser, "不成对的UTF-16代理");
+                        return NULL;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                    free(buffer);
+                    json_error(parser, "不成对的UTF-16代理");
+                    return NULL;
+                }
+                if (code == 0) {
+                    free(buffer);
+                    json_error(parser, "字符串中不能有\\u0000");
+                    return NULL;
+                }
+                length += encode_utf8(code, buffer + length);
+                break;
+            default:
+                free(buffer);
+                json_error(parser, "无效的转义字符");
+                return NULL;
+        }
+    }
+
+    free(buffer);
+    json_error(parser, "字符串缺少结束的引号");
+    return NULL;
+}
+
+/**
+ * 解析数字，能用64位整数表示的整数保持为整数
+ */
+static PyObject* parse_number(JsonParser *parser) {
+    size_t start = parser->pos;
+    bool is_integer = true;
+    if (parser->text[parser->pos] == '-') {
+        parser->pos++;
+    }
+    size_t digits = parser->pos;
+    while (parser->pos < parser->length) {
+        char c = parser->text[parser->pos];
+        if (c >= '0' && c <= '9') {
+            parser->pos++;
+        } else if (c == '.' || c == 'e' || c == 'E' || c == '+' || (c == '-' && parser->pos > digits)) {
+            is_integer = false;
+            parser->pos++;
+        } else {
+            break;
+        }
+    }
+    if (parser->pos == digits) {
+        return json_error(parser, "无效的数字");
+    }
+
+    char text[64];
+    size_t length = parser->pos - start;
+    if (length >= sizeof(text)) {
+        // 位数很多的整数按大整数处理
+        if (!is_integer) {
+            return json_error(parser, "数字太长");
+        }
+        char *copy = (char *)malloc(length + 1);
+        if (copy == NULL) {
+            return json_error(parser, "内存分配失败，无法解析数字");
+        }
+        memcpy(copy, parser->text + start, length);
+        copy[length] = '\0';
+        PyObject *value = py_bigint_from_string(copy);
+        free(copy);
+        return value != NULL ? value : json_error(parser, "无效的数字");
+    }
+    memcpy(text, parser->text + start, length);
+    text[length] = '\0';
+
+    char *end;
+    if (is_integer) {
+        errno = 0;
+        long long value = strtoll(text, &end, 10);
+        if (*end == '\0' && errno == 0) {
+            return py_int_new((int64_t)value);
+        }
+        if (*end == '\0' && errno == ERANGE) {
+            PyObject *big = py_bigint_from_string(text);
+            return big != NULL ? big : json_error(parser, "无效的数字");
+        }
+        return json_error(parser, "无效的数字");
+    }
+
+    double value = strtod(text, &end);
+    if (*end != '\0') {
+        return json_error(parser, "无效的数字");
+    }
+    return py_number_new(value);
+}
+
+/**
+ * 解析数组
+ */
+static PyObject* parse_array(JsonParser *parser) {
+    parser->pos++;
+    PyObject *list = py_list_new();
+    if (list == NULL) {
+        return json_error(parser, "内存分配失败，无法创建列表");
+    }
+
+    skip_whitespace(parser);
+    if (parser->pos < parser->length && parser->text[parser->pos] == ']') {
+        parser->pos++;
+        return list;
+    }
+
+    while (true) {
+        PyObject *item = parse_value(parser);
+        if (item == NULL) {
+            py_decref(list);
+            return NULL;
+        }
+        bool appended = py_list_append(list, item);
+        py_decref(item);
+        if (!appended) {
+            py_decref(list);
+            return json_error(parser, "内存分配失败，无法添加列表项");
+        }
+
+        skip_whitespace(parser);
+        if (parser->pos < parser->length && parser->text[parser->pos] == ',') {
+            parser->pos++;
+            continue;
+        }
+        if (parser->pos < parser->length && parser->text[parser->pos] == ']') {
+            parser->pos++;
+            return list;
+        }
+        py_decref(list);
+        return json_error(parser, "数组中预期','或']'");
+    }
+}
+
+/**
+ * 解析对象
+ */
+static PyObject* parse_object(JsonParser *parser) {
+    parser->pos++;
+    PyObject *dict = py_dict_new();
+    if (dict == NULL) {
+        return json_error(parser, "内存分配失败，无法创建字典");
+    }
+
+    skip_whitespace(parser);
+    if (parser->pos < parser->length && parser->text[parser->pos] == '}') {
+        parser->pos++;
+        return dict;
+    }
+
+    while (true) {
+        skip_whitespace(parser);
+        if (parser->pos >= parser->length || parser->text[parser->pos] != '"') {
+            py_decref(dict);
+            return json_error(parser, "对象的键必须是字符串");
+        }
+        char *key_text = parse_string_bytes(parser);
+        if (key_text == NULL) {
+            py_decref(dict);
+            return NULL;
+        }
+        PyObject *key = py_string_new(key_text);
+        free(key_text);
+
+        skip_whitespace(parser);
+        if (key == NULL || parser->pos >= parser->length || parser->text[parser->pos] != ':') {
+            py_decref(key);
+            py_decref(dict);
+            return json_error(parser, "对象的键后面预期':'");
+        }
+        parser->pos++;
+
+        PyObject *value = parse_value(parser);
+        if (value == NULL) {
+            py_decref(key);
+            py_decref(dict);
+            return NULL;
+        }
+        bool stored = py_dict_set(dict, key, value);
+        py_decref(key);
+        py_decref(value);
+        if (!stored) {
+            py_decref(dict);
+            return json_error(parser, "内存分配失败，无法设置字典项");
+        }
+
+        skip_whitespace(parser);
+        if (parser->pos < parser->length && parser->text[parser->pos] == ',') {
+            parser->pos++;
+            continue;
+        }
+        if (parser->pos < parser->length && parser->text[parser->pos] == '}') {
+            parser->pos++;
+            return dict;
+        }
+        py_decref(dict);
+        return json_error(parser, "对象中预期','或'}'");
+    }
+}
+
+/**
+ * 解析任意值
+ */
+static PyObject* parse_value(JsonParser *parser) {
+    skip_whitespace(parser);
+    if (parser->pos >= parser->length) {
+        return json_error(parser, "意外的结尾");
+    }
+
+    char c = parser->text[parser->pos];
+    if (c == '{' || c == '[') {
+        if (parser->depth >= JSON_MAX_DEPTH) {
+            return json_error(parser, "嵌套层数太多");
+        }
+        parser->depth++;
+        PyObject *value = c == '{' ? parse_object(parser) : parse_array(parser);
+        parser->depth--;
+        return value;
+    }
+    if (c == '"') {
+        char *text = parse_string_bytes(parser);
+        if (text == NULL) {
+            return NULL;
+        }
+        PyObject *value = py_string_new(text);
+        free(text);
+        return value != NULL ? value : json_error(parser, "内存分配失败，无法创建字符串");
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        return parse_number(parser);
+    }
+    if (match_literal(parser, "true")) {
+        return py_int_new(1);
+    }
+    if (match_literal(parser, "false")) {
+        return py_int_new(0);
+    }
+    if (match_literal(parser, "null")) {
+        parser->pos -= 4;
+        return json_error(parser, "不支持null");
+    }
+    return json_error(parser, "无效的JSON值");
+}
+
+/**
+ * 解析JSON文本
+ * @param text JSON文本
+ * @param length 字节数
+ * @param error 出错时写入错误信息
+ * @return 对象的新引用，出错返回NULL
+ */
+PyObject* json_parse(const char *text, size_t length, char *error, size_t error_size) {
+    JsonParser parser = { text, length, 0, 0, error, error_size };
+    PyObject *value = parse_value(&parser);
+    if (value == NULL) {
+        return NULL;
+    }
+
+    skip_whitespace(&parser);
+    if (parser.pos != parser.length) {
+        py_decref(value);
+        return json_error(&parser, "JSON值后面有多余的内容");
+    }
+    return value;
+}
+
+/**
+ * 写出JSON字符串
+ */
+void json_write_string(FILE *out, const char *text, size_t length) {
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        switch (c) {
+            case '"':  fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (c < 0x20) {
+                    fprintf(out, "\\u%04x", c);
+                } else {
+                    fputc(c, out);
+                }
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * 把对象写成JSON。NULL、函数和不是有限值的数字写成null
+ * @param depth 嵌套层数，防止列表包含自身时无限递归
+ */
+static void write_value(FILE *out, PyObject *value, int depth) {
+    if (value == NULL || depth > JSON_MAX_DEPTH) {
+        fputs("null", out);
+        return;
+    }
+
+    switch (value->type) {
+        case TYPE_NUMBER: {
+            PyNumberObject *number = (PyNumberObject *)value;
+            if (number->is_int) {
+                fprintf(out, "%lld", (long long)number->int_value);
+            } else if (isfinite(number->value)) {
+                fprintf(out, "%.17g", number->value);
+            } else {
+                fputs("null", out);
+            }
+            break;
+        }
+        case TYPE_BIGINT: {
+            char *digits = py_bigint_to_string(value);
+            fputs(digits != NULL ? digits : "null", out);
+            free(digits);
+            break;
+        }
+        case TYPE_STRING: {
+            PyStringObject *str = (PyStringObject *)value;
+            json_write_string(out, str->value, str->length);
+            break;
+        }
+        case TYPE_LIST: {
+            size_t length = py_list_length(value);
+            fputc('[', out);
+            for (size_t i = 0; i < length; i++) {
+                if (i > 0) {
+                    fputc(',', out);
+                }
+                write_value(out, ((PyListObject *)value)->items[i], depth + 1);
+            }
+            fputc(']', out);
+            break;
+        }
+        case TYPE_DICT: {
+            size_t size = py_dict_size(value);
+            fputc('{', out);
+            for (size_t i = 0; i < size; i++) {
+                PyObject *key = py_dict_key_at(value, i);
+                PyObject *item = py_dict_value_at(value, i);
+                if (i > 0) {
+                    fputc(',', out);
+                }
+                // JSON对象的键只能是字符串，其他键写成它的JSON文本
+                if (key != NULL && key->type == TYPE_STRING) {
+                    write_value(out, key, depth + 1);
+                } else {
+                    char *text = NULL;
+                    size_t text_length = 0;
+                    FILE *buffer = open_memstream(&text, &text_length);
+                    if (buffer != NULL) {
+                        write_value(buffer, key, depth + 1);
+                        fclose(buffer);
+                    }
+                    json_write_string(out, text != NULL ? text : "", text != NULL ? text_length : 0);
+                    free(text);
+                }
+                fputc(':', out);
+                write_value(out, item, depth + 1);
+                py_decref(key);
+                py_decref(item);
+            }
+            fputc('}', out);
+            break;
+        }
+        default:
+            fputs("null", out);
+            break;
+    }
+}
+
+/**
+ * 把对象写成JSON
+ * @param value 对象，NULL写成null
+ */
+void json_write(FILE *out, PyObject *value) {
+    write_value(out, value, 0);
+}
@@ -13,7 +13,7 @@
  * 关键字表
  */
 static const char *keywords[] = {
-    "变量", "常量", "如果", "否则", "循环", "函数", "返回", "输出"
+    "变量", "常量", "如果", "否则", "循环", "函数", "返回", "输出", "导入"
 };
 
 /**
@@ -25,6 +25,7 @@ typedef struct {
     size_t pos;              // 当前位置
     int line;                // 当前行号
     int column;              // 当前列号
+    size_t token_start;      // 正在读取的标记的起始位置
     Token *tokens;           // 标记数组
     size_t token_count;      // 标记数量
     size_t token_capacity;   // 标记容量
@@ -72,18 +73,8 @@ Token* lexer_init(const char *source) {
  * 释放词法分析器资源
  */
 void lexer_free() {
-    if (lexer.tokens != NULL) {
-        // 释放每个标记的值
-        for (size_t i = 0; i < lexer.token_count; i++) {
-            if (lexer.tokens[i].value != NULL) {
-                free(lexer.tokens[i].value);
-            }
-        }
-        
-        // 释放标记数组
-        free(lexer.tokens);
-        lexer.tokens = NULL;
-    }
+    lexer_free_tokens(lexer.tokens, lexer.token_count);
+    lexer.tokens = NULL;
     
     lexer.source = NULL;
     lexer.token_count = 0;
@@ -172,6 +163,8 @@ static bool add_token(KunyuTokenType type, const char *value, int line, int colu
     lexer.tokens[lexer.token_count].value = token_value;
     lexer.tokens[lexer.token_count].line = line;
     lexer.tokens[lexer.token_count].column = column;
+    lexer.tokens[lexer.token_count].offset = lexer.token_start;
+    lexer.tokens[lexer.token_count].length = lexer.pos - lexer.token_start;
     
     lexer.token_count++;
     return true;
@@ -353,7 +346,7 @@ static char* read_identifier() {
 /**
  * 读取一个数字
  */
-static char* read_number() {
+static char* read_number(bool *is_integer) {
     size_t start_pos = lexer.pos;
     bool has_dot = false;
     
@@ -383,6 +376,9 @@ static char* read_number() {
     strncpy(number, lexer.source + start_pos, length);
     number[length] = '\0';
     
+    // 没有小数点的数字作为整数，超出64位整数范围时在求值时成为大整数
+    *is_integer = !has_dot;
+    
     return number;
 }
 
@@ -433,6 +429,7 @@ static char* read_string() {
  */
 static bool read_next_token() {
     skip_whitespace();
+    lexer.token_start = lexer.pos;
     
     if (is_eof()) {
         return add_token(KUNYU_TOKEN_EOF, "", lexer.line, lexer.column);
@@ -481,7 +478,8 @@ static bool read_next_token() {
     
     // 处理数字
     if (is_digit(c)) {
-        char *number = read_number();
+        bool is_integer;
+        char *number = read_number(&is_integer);
         if (number == NULL) {
             lexer.error.code = KUNYU_ERROR_LEXER;
             snprintf(lexer.error.message, sizeof(lexer.error.message), 
@@ -491,7 +489,8 @@ static bool read_next_token() {
             return false;
         }
         
-        bool result = add_token(KUNYU_TOKEN_NUMBER, number, line, column);
+        bool result = add_token(is_integer ? KUNYU_TOKEN_INTEGER : KUNYU_TOKEN_NUMBER,
+                                number, line, column);
         free(number);
         return result;
     }
@@ -619,6 +618,10 @@ static bool read_next_token() {
             advance();
             return add_token(KUNYU_TOKEN_DELIMITER, ";", line, column);
             
+        case '@':
+            advance();
+            return add_token(KUNYU_TOKEN_DELIMITER, "@", line, column);
+            
         default:
             // 未知字符
             lexer.error.code = KUNYU_ERROR_LEXER;
@@ -677,6 +680,42 @@ KunyuError* lexer_get_error() {
     return &lexer.error;
 }
 
+/**
+ * 取走标记数组，之后词法分析器不再释放它。
+ * 延迟分析的函数体引用其中的标记，所以标记要和语法树保留同样长的时间
+ * @param count 输出标记数量
+ * @return 标记数组，使用后用lexer_free_tokens释放
+ */
+Token* lexer_detach_tokens(size_t *count) {
+    Token *tokens = lexer.tokens;
+    *count = lexer.token_count;
+    
+    lexer.tokens = NULL;
+    lexer.source = NULL;
+    lexer.token_count = 0;
+    lexer.token_capacity = 0;
+    return tokens;
+}
+
+/**
+ * 释放标记数组
+ */
+void lexer_free_tokens(Token *tokens, size_t count) {
+    if (tokens == NULL) {
+        return;
+    }
+    
+    // 释放每个标记的值
+    for (size_t i = 0; i < count; i++) {
+        if (tokens[i].value != NULL) {
+            free(tokens[i].value);
+        }
+    }
+    
+    // 释放标记数组
+    free(tokens);
+}
+
 /**
  * 获取标记数组
  * @return 标记数组指针
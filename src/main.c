@@ -5,10 +5,12 @@
 
 #include "../includes/kunyu.h"
 #include "../includes/ast.h"
+#include "../includes/stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -31,8 +33,26 @@ typedef struct {
     bool interactive;        // 交互式模式
     const char *input_file;  // 输入文件名
     const char *output_file; // 输出文件名
+    const char *profile_file; // 性能分析折叠栈输出文件，NULL表示不分析
+    int profile_interval;    // 性能分析采样间隔（微秒）
+    bool stats;              // 输出解释器内部统计
+    bool heap_profile;       // 堆分析
+    const char *trace_file;  // 跟踪事件输出文件，NULL表示不跟踪
+    int trace_threshold;     // 短于此时长（微秒）的函数调用不记录
+    bool optimize;           // 执行前生成超级指令
+    int parse_threads;       // 只编译时分析函数体的线程数，0表示使用所有处理器
+    const char *serve_path;  // 服务模式监听的套接字路径，NULL表示不以服务模式运行
+    int workers;             // 批处理的工作进程数，0表示使用所有处理器
+    const char *each_file;   // 批处理的输入文件，每行执行一次脚本，NULL表示不批处理
+    const char *snapshot_label; // 执行到这个快照点时生成启动快照，NULL表示不生成
+    bool from_snapshot;      // 从启动快照恢复
+    const char *snapshot_file; // 快照文件，NULL表示使用默认文件
 } CommandOptions;
 
+#define DEFAULT_PROFILE_FILE "kunyu.folded"
+#define DEFAULT_PROFILE_INTERVAL 1000
+#define SNAPSHOT_SUFFIX ".snapshot"
+
 /**
  * 显示版本信息
  */
@@ -52,6 +72,21 @@ static void show_help(const char *program_name) {
     printf("  -o, --output 文件名 指定输出文件名\n");
     printf("  -d, --debug        调试模式\n");
     printf("  -i, --interactive  启动交互式REPL环境\n");
+    printf("  --profile[=文件名] 采样性能分析，报告输出到标准错误，折叠栈写入文件(默认 %s)\n",
+           DEFAULT_PROFILE_FILE);
+    printf("  --profile-interval=微秒 性能分析采样间隔(默认 %d)\n", DEFAULT_PROFILE_INTERVAL);
+    printf("  --stats            执行结束后把解释器内部统计输出到标准错误\n");
+    printf("  --heap-profile     按源码行统计对象分配，结束时列出未释放的对象\n");
+    printf("  --trace=文件名     把各阶段和函数调用的时间线写成Chrome跟踪事件(JSON)\n");
+    printf("  --trace-threshold=微秒 只记录耗时不少于该值的函数调用(默认 0，全部记录)\n");
+    printf("  --no-optimize      不把常见语句模式融合成超级指令\n");
+    printf("  --parse-threads=数量 -c 检查函数体时使用的线程数(默认 0，使用所有处理器)\n");
+    printf("  --serve=套接字路径 常驻进程，通过Unix域套接字接受执行脚本的JSON请求\n");
+    printf("  --each=输入文件    对输入文件的每一行执行一次脚本，这一行的内容是全局常量\"输入\"\n");
+    printf("  --workers=数量     --each 使用的工作进程数(默认 0，每个处理器一个)\n");
+    printf("  --snapshot-after=标签 执行到 快照点(\"标签\") 时把全局状态写入快照(默认 脚本名%s，-o 可指定)\n",
+           SNAPSHOT_SUFFIX);
+    printf("  --from-snapshot[=文件] 从快照恢复全局状态，从快照点之后继续执行\n");
     printf("\n");
 }
 
@@ -71,6 +106,20 @@ static bool parse_args(int argc, char *argv[], CommandOptions *options) {
     options->interactive = false;
     options->input_file = NULL;
     options->output_file = NULL;
+    options->profile_file = NULL;
+    options->profile_interval = DEFAULT_PROFILE_INTERVAL;
+    options->stats = false;
+    options->heap_profile = false;
+    options->trace_file = NULL;
+    options->trace_threshold = 0;
+    options->optimize = true;
+    options->parse_threads = 0;
+    options->serve_path = NULL;
+    options->workers = -1;
+    options->each_file = NULL;
+    options->snapshot_label = NULL;
+    options->from_snapshot = false;
+    options->snapshot_file = NULL;
     
     // 至少需要一个参数（程序名）
     if (argc < 1) {
@@ -97,6 +146,73 @@ static bool parse_args(int argc, char *argv[], CommandOptions *options) {
             options->interactive = true;
         } else if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
             options->output_file = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options->profile_file = DEFAULT_PROFILE_FILE;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            options->profile_file = argv[i] + 10;
+        } else if (strncmp(argv[i], "--profile-interval=", 19) == 0) {
+            options->profile_interval = atoi(argv[i] + 19);
+            if (options->profile_interval <= 0) {
+                fprintf(stderr, "错误: 无效的采样间隔 '%s'\n", argv[i] + 19);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options->stats = true;
+        } else if (strcmp(argv[i], "--heap-profile") == 0) {
+            options->heap_profile = true;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            options->trace_file = argv[i] + 8;
+        } else if (strncmp(argv[i], "--trace-threshold=", 18) == 0) {
+            options->trace_threshold = atoi(argv[i] + 18);
+            if (options->trace_threshold < 0) {
+                fprintf(stderr, "错误: 无效的跟踪阈值 '%s'\n", argv[i] + 18);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--no-optimize") == 0) {
+            options->optimize = false;
+        } else if (strncmp(argv[i], "--parse-threads=", 16) == 0) {
+            options->parse_threads = atoi(argv[i] + 16);
+            if (options->parse_threads < 0) {
+                fprintf(stderr, "错误: 无效的线程数 '%s'\n", argv[i] + 16);
+                return false;
+            }
+        } else if (strncmp(argv[i], "--serve=", 8) == 0) {
+            options->serve_path = argv[i] + 8;
+            if (options->serve_path[0] == '\0') {
+                fprintf(stderr, "错误: 未指定套接字路径\n");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            options->serve_path = argv[++i];
+        } else if (strncmp(argv[i], "--workers=", 10) == 0 ||
+                   (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)) {
+            const char *value = argv[i][9] == '=' ? argv[i] + 10 : argv[++i];
+            char *end;
+            long workers = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || workers < 0 || workers > 256) {
+                fprintf(stderr, "错误: 无效的工作进程数 '%s'\n", value);
+                return false;
+            }
+            options->workers = (int)workers;
+        } else if (strncmp(argv[i], "--each=", 7) == 0) {
+            options->each_file = argv[i] + 7;
+            if (options->each_file[0] == '\0') {
+                fprintf(stderr, "错误: 未指定输入文件\n");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--each") == 0 && i + 1 < argc) {
+            options->each_file = argv[++i];
+        } else if (strncmp(argv[i], "--snapshot-after=", 17) == 0) {
+            options->snapshot_label = argv[i] + 17;
+            if (options->snapshot_label[0] == '\0') {
+                fprintf(stderr, "错误: 未指定快照点标签\n");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--from-snapshot") == 0) {
+            options->from_snapshot = true;
+        } else if (strncmp(argv[i], "--from-snapshot=", 16) == 0) {
+            options->from_snapshot = true;
+            options->snapshot_file = argv[i] + 16;
         } else if (argv[i][0] == '-') {
             fprintf(stderr, "错误: 未知选项 '%s'\n", argv[i]);
             return false;
@@ -111,9 +227,37 @@ static bool parse_args(int argc, char *argv[], CommandOptions *options) {
         }
     }
     
+    if (options->workers >= 0 && options->each_file == NULL) {
+        fprintf(stderr, "错误: --workers 需要和 --each 一起使用\n");
+        return false;
+    }
+    
+    if ((options->snapshot_label != NULL || options->from_snapshot) &&
+        (options->each_file != NULL || options->compile_only)) {
+        fprintf(stderr, "错误: 启动快照不能和 --each 或 -c 一起使用\n");
+        return false;
+    }
+    
     return true;
 }
 
+/**
+ * 启动快照文件的路径：--from-snapshot=文件 指定的文件，其次是 -o 指定的文件，默认是脚本名加.snapshot
+ * @return 新分配的字符串，使用后需要释放
+ */
+static char* snapshot_file_path(const CommandOptions *options) {
+    const char *path = options->snapshot_file != NULL ? options->snapshot_file : options->output_file;
+    if (path != NULL) {
+        return strdup(path);
+    }
+    size_t length = strlen(options->input_file) + strlen(SNAPSHOT_SUFFIX) + 1;
+    char *result = (char *)malloc(length);
+    if (result != NULL) {
+        snprintf(result, length, "%s%s", options->input_file, SNAPSHOT_SUFFIX);
+    }
+    return result;
+}
+
 /**
  * 读取文件内容
  * @param filename 文件名
@@ -189,6 +333,7 @@ static const char* token_type_str(KunyuTokenType type) {
         case KUNYU_TOKEN_KEYWORD:    return "关键字";
         case KUNYU_TOKEN_STRING:     return "字符串";
         case KUNYU_TOKEN_NUMBER:     return "数字";
+        case KUNYU_TOKEN_INTEGER:    return "整数";
         case KUNYU_TOKEN_OPERATOR:   return "运算符";
         case KUNYU_TOKEN_DELIMITER:  return "分隔符";
         case KUNYU_TOKEN_NEWLINE:    return "换行";
@@ -225,6 +370,45 @@ static void print_tokens(const Token *tokens, size_t count) {
     printf("=== 共 %zu 个标记 ===\n\n", count);
 }
 
+/**
+ * 结束性能分析并输出结果
+ */
+static void finish_profiling(const CommandOptions *options) {
+    if (options->profile_file == NULL) {
+        return;
+    }
+    
+    profiler_stop();
+    profiler_report(stderr);
+    if (profiler_write_collapsed(options->profile_file)) {
+        fprintf(stderr, "折叠栈已写入 %s\n", options->profile_file);
+    }
+}
+
+/**
+ * 输出解释器内部统计
+ */
+static void finish_stats(const CommandOptions *options) {
+    if (!options->stats) {
+        return;
+    }
+    
+    stats_report(stderr);
+    stats_cleanup();
+}
+
+/**
+ * 结束堆分析，应在解释器清理之后调用，此时仍被跟踪的对象都是泄漏
+ */
+static void finish_heap_profiling(const CommandOptions *options) {
+    if (!options->heap_profile) {
+        return;
+    }
+    
+    heap_profiler_report_leaks(stderr);
+    heap_profiler_stop();
+}
+
 /**
  * 设置控制台支持UTF-8输出
  */
@@ -261,6 +445,12 @@ int main(int argc, char *argv[]) {
         return 0;
     }
     
+    // 服务模式
+    if (options.serve_path != NULL) {
+        optimizer_set_enabled(options.optimize);
+        return server_run(options.serve_path);
+    }
+    
     // 交互模式
     if (options.interactive) {
         repl_start();
@@ -276,13 +466,33 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    // 开始跟踪，程序退出时自动写完跟踪文件
+    if (options.trace_file != NULL) {
+        trace_start(options.trace_file, options.trace_threshold);
+    }
+    
     // 读取输入文件
+    trace_phase_begin("读取源文件");
     char *source = read_file(options.input_file);
+    trace_phase_end();
     if (source == NULL) {
         return 1;
     }
     
+    // 校验编码，之后的词法分析和字符串操作都可以假定输入是合法的UTF-8
+    trace_phase_begin("校验编码");
+    size_t error_offset;
+    bool valid = utf8_validate(source, strlen(source), &error_offset);
+    trace_phase_end();
+    if (!valid) {
+        fprintf(stderr, "错误: 文件 '%s' 不是有效的UTF-8编码（第%zu字节）\n",
+                options.input_file, error_offset + 1);
+        free(source);
+        return 1;
+    }
+    
     // 初始化词法分析器
+    trace_phase_begin("词法分析");
     Token *tokens = lexer_init(source);
     if (tokens == NULL) {
         fprintf(stderr, "错误: 初始化词法分析器失败\n");
@@ -300,14 +510,26 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    // 取走标记数组：延迟分析的函数体引用其中的标记，导入模块时会重新使用词法分析器
+    size_t detached_count;
+    tokens = lexer_detach_tokens(&detached_count);
+    trace_phase_end();
+    
     // 调试模式打印标记
     if (options.debug) {
         print_tokens(tokens, token_count);
         printf("\n=== 开始执行程序 ===\n\n");
     }
     
-    // 语法分析
+    // 语法分析，只检查语法或批处理时在多个线程上完整分析所有函数体
+    trace_phase_begin("语法分析");
+    bool eager = options.compile_only || options.each_file != NULL;
     AstNode *ast = parser_parse(tokens, token_count);
+    if (ast != NULL && eager && !parser_parse_function_bodies(ast, options.parse_threads)) {
+        ast_free(ast);
+        ast = NULL;
+    }
+    trace_phase_end();
     if (ast == NULL) {
         KunyuError *error = parser_get_error();
         if (error->code != KUNYU_OK) {
@@ -315,20 +537,101 @@ int main(int argc, char *argv[]) {
         } else {
             fprintf(stderr, "错误: 语法分析失败，无法生成AST\n");
         }
-        lexer_free();
+        lexer_free_tokens(tokens, detached_count);
         free(source);
         return 1;
     }
     
+    module_set_entry(options.input_file);
+    
+    // 优化
+    optimizer_set_enabled(options.optimize);
+    if (options.optimize) {
+        trace_phase_begin("优化");
+        int fused = optimizer_optimize(ast);
+        trace_phase_end();
+        if (options.debug) {
+            printf("优化器生成了%d条超级指令\n", fused);
+        }
+    }
+    
+    // 批处理：函数体也在创建工作进程之前优化，所有工作进程共享优化结果
+    if (options.each_file != NULL && !options.compile_only) {
+        optimizer_optimize_function_bodies(ast);
+        int workers = options.workers > 0 ? options.workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int status = workers_run(ast, options.each_file, workers > 0 ? workers : 1);
+        ast_free(ast);
+        lexer_free_tokens(tokens, detached_count);
+        free(source);
+        return status;
+    }
+    
+    // 启动快照：先从快照恢复，快照不存在或已经作废时完整执行，有快照点时重新生成
+    char *snapshot_path = NULL;
+    int next_statement = 0;
+    if (options.snapshot_label != NULL || options.from_snapshot) {
+        snapshot_path = snapshot_file_path(&options);
+        bool ready = snapshot_path != NULL;
+        if (ready && options.from_snapshot) {
+            trace_phase_begin("恢复快照");
+            ready = snapshot_restore(ast, snapshot_path, source, &next_statement);
+            trace_phase_end();
+        }
+        if (ready && next_statement == 0 && options.snapshot_label != NULL &&
+            !snapshot_prepare(ast, options.snapshot_label, snapshot_path, source)) {
+            fprintf(stderr, "错误: 脚本顶层没有快照点 快照点(\"%s\")\n", options.snapshot_label);
+            ready = false;
+        }
+        if (!ready) {
+            free(snapshot_path);
+            ast_free(ast);
+            lexer_free_tokens(tokens, detached_count);
+            free(source);
+            interpreter_cleanup();
+            return 1;
+        }
+    }
+    
     // 执行程序（除非是仅编译模式）
     if (!options.compile_only) {
-        if (!interpreter_execute(ast)) {
+        if (options.profile_file != NULL && !profiler_start(options.profile_interval)) {
+            options.profile_file = NULL;
+        }
+        if (options.stats && !stats_start()) {
+            options.stats = false;
+        }
+        if (options.heap_profile && !heap_profiler_start()) {
+            options.heap_profile = false;
+        }
+        
+        trace_phase_begin("执行");
+        bool success;
+        if (next_statement > 0) {
+            int stmt_count = ((Program *)ast)->stmt_count;
+            success = interpreter_execute_statements(ast, next_statement, stmt_count - next_statement);
+        } else {
+            success = interpreter_execute(ast);
+        }
+        trace_phase_end();
+        finish_profiling(&options);
+        finish_stats(&options);
+        if (options.heap_profile) {
+            heap_profiler_report(stderr);
+        }
+        
+        if (success && next_statement == 0 && options.snapshot_label != NULL && !snapshot_written()) {
+            fprintf(stderr, "警告: 没有执行到快照点'%s'，没有生成快照\n", options.snapshot_label);
+        }
+        
+        if (!success) {
             KunyuError *error = interpreter_get_error();
             handle_interpreter_error(error);
+            free(snapshot_path);
             ast_free(ast);
-            lexer_free();
+            lexer_free_tokens(tokens, detached_count);
             free(source);
             interpreter_cleanup(); // 清理解释器资源
+            finish_heap_profiling(&options);
             return 1;
         }
         
@@ -338,10 +641,12 @@ int main(int argc, char *argv[]) {
     }
     
     // 释放资源
+    free(snapshot_path);
     ast_free(ast);
-    lexer_free();
+    lexer_free_tokens(tokens, detached_count);
     free(source);
     interpreter_cleanup(); // 清理解释器资源
+    finish_heap_profiling(&options);
     
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,476 @@
+/**
+ * 坤舆编程语言 - 函数结果缓存
+ * 为标注了 @缓存 的函数保存参数到返回值的映射，参数全部是数字或字符串时才使用缓存。
+ * 缓存的条目数有上限，满了以后淘汰最久没有使用的条目。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include "../includes/stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 缓存条目
+ */
+typedef struct MemoEntry {
+    uint64_t hash;                  // 参数的哈希值
+    PyObject **args;                // 参数（持有引用）
+    int arg_count;                  // 参数数量
+    PyObject *value;                // 返回值（持有引用）
+    struct MemoEntry *chain;        // 同一哈希桶的下一项
+    struct MemoEntry *newer;        // 最近使用顺序中的前一项
+    struct MemoEntry *older;        // 最近使用顺序中的后一项
+} MemoEntry;
+
+/**
+ * 缓存表
+ */
+struct MemoTable {
+    MemoEntry **buckets;            // 哈希桶
+    size_t bucket_mask;             // 哈希桶数量减一（数量是2的幂）
+    size_t capacity;                // 最多保存的条目数
+    size_t count;                   // 当前条目数
+    MemoEntry *newest;              // 最近使用的条目
+    MemoEntry *oldest;              // 最久没有使用的条目
+};
+
+/**
+ * 混合哈希值
+ */
+static uint64_t mix_hash(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+/**
+ * 计算参数的哈希值
+ * @return 有不能作为键的参数时返回false
+ */
+static bool hash_args(PyObject **args, int arg_count, uint64_t *hash) {
+    uint64_t h = (uint64_t)arg_count;
+    for (int i = 0; i < arg_count; i++) {
+        PyObject *arg = args[i];
+        if (arg == NULL) {
+            return false;
+        }
+        if (arg->type == TYPE_NUMBER) {
+            PyNumberObject *num = (PyNumberObject *)arg;
+            if (num->is_int) {
+                h = mix_hash(h, (uint64_t)num->int_value);
+            } else {
+                uint64_t bits;
+                memcpy(&bits, &num->value, sizeof(bits));
+                h = mix_hash(h, bits ^ 0xF00DULL);
+            }
+        } else if (arg->type == TYPE_STRING) {
+            PyStringObject *str = (PyStringObject *)arg;
+            uint64_t string_hash = 14695981039346656037ULL;
+            for (size_t k = 0; k < str->length; k++) {
+                string_hash ^= (unsigned char)str->value[k];
+                string_hash *= 1099511628211ULL;
+            }
+            h = mix_hash(h, string_hash);
+        } else {
+            return false;
+        }
+    }
+    *hash = h;
+    return true;
+}
+
+/**
+ * 比较两个参数是否相同。整数和浮点数不相等，因为两者的运算结果不同
+ */
+static bool same_arg(PyObject *a, PyObject *b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    if (a->type == TYPE_NUMBER) {
+        PyNumberObject *x = (PyNumberObject *)a;
+        PyNumberObject *y = (PyNumberObject *)b;
+        if (x->is_int != y->is_int) {
+            return false;
+        }
+        return x->is_int ? x->int_value == y->int_value : x->value == y->value;
+    }
+    PyStringObject *x = (PyStringObject *)a;
+    PyStringObject *y = (PyStringObject *)b;
+    return x->length == y->length && memcmp(x->value, y->value, x->length) == 0;
+}
+
+/**
+ * 查找条目
+ */
+static MemoEntry* find_entry(MemoTable *table, uint64_t hash, PyObject **args, int arg_count) {
+    for (MemoEntry *entry = table->buckets[hash & table->bucket_mask]; entry != NULL; entry = entry->chain) {
+        if (entry->hash != hash || entry->arg_count != arg_count) {
+            continue;
+        }
+        bool same = true;
+        for (int i = 0; same && i < arg_count; i++) {
+            same = same_arg(entry->args[i], args[i]);
+        }
+        if (same) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 从最近使用顺序中摘下条目
+ */
+static void unlink_entry(MemoTable *table, MemoEntry *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        table->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        table->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+/**
+ * 把条目放到最近使用顺序的最前面
+ */
+static void push_newest(MemoTable *table, MemoEntry *entry) {
+    entry->newer = NULL;
+    entry->older = table->newest;
+    if (table->newest != NULL) {
+        table->newest->newer = entry;
+    }
+    table->newest = entry;
+    if (table->oldest == NULL) {
+        table->oldest = entry;
+    }
+}
+
+/**
+ * 释放条目持有的对象
+ */
+static void free_entry(MemoEntry *entry) {
+    for (int i = 0; i < entry->arg_count; i++) {
+        py_decref(entry->args[i]);
+    }
+    free(entry->args);
+    py_decref(entry->value);
+    free(entry);
+}
+
+/**
+ * 淘汰最久没有使用的条目
+ */
+static void evict_oldest(MemoTable *table) {
+    MemoEntry *entry = table->oldest;
+    if (entry == NULL) {
+        return;
+    }
+
+    MemoEntry **slot = &table->buckets[entry->hash & table->bucket_mask];
+    while (*slot != entry) {
+        slot = &(*slot)->chain;
+    }
+    *slot = entry->chain;
+
+    unlink_entry(table, entry);
+    free_entry(entry);
+    table->count--;
+    STATS_INC(STAT_MEMO_EVICT);
+}
+
+/**
+ * 创建缓存表
+ * @param capacity 最多保存的条目数
+ */
+MemoTable* memo_new(size_t capacity) {
+    if (capacity == 0) {
+        capacity = KUNYU_MEMO_DEFAULT_CAPACITY;
+    }
+
+    MemoTable *table = (MemoTable *)calloc(1, sizeof(MemoTable));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    // 哈希桶数量不少于条目数，平均每个桶最多一项
+    size_t bucket_count = 16;
+    while (bucket_count < capacity) {
+        bucket_count *= 2;
+    }
+    table->buckets = (MemoEntry **)calloc(bucket_count, sizeof(MemoEntry *));
+    if (table->buckets == NULL) {
+        free(table);
+        return NULL;
+    }
+    table->bucket_mask = bucket_count - 1;
+    table->capacity = capacity;
+
+    return table;
+}
+
+/**
+ * 释放缓存表及其中的所有条目
+ */
+void memo_free(MemoTable *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    MemoEntry *entry = table->newest;
+    while (entry != NULL) {
+        MemoEntry *older = entry->older;
+        free_entry(entry);
+        entry = older;
+    }
+    free(table->buckets);
+    free(table);
+}
+
+/**
+ * 查找缓存的返回值
+ * @return 返回值的新引用，未命中或参数不能作为键时返回NULL
+ */
+PyObject* memo_lookup(MemoTable *table, PyObject **args, int arg_count) {
+    uint64_t hash;
+    if (!hash_args(args, arg_count, &hash)) {
+        return NULL;
+    }
+
+    MemoEntry *entry = find_entry(table, hash, args, arg_count);
+    if (entry == NULL) {
+        STATS_INC(STAT_MEMO_MISS);
+        return NULL;
+    }
+
+    STATS_INC(STAT_MEMO_HIT);
+    if (entry != table->newest) {
+        unlink_entry(table, entry);
+        push_newest(table, entry);
+    }
+    py_incref(entry->value);
+    return entry->value;
+}
+
+/**
+ * 保存返回值，参数不能作为键或内存不足时什么也不做
+ */
+void memo_store(MemoTable *table, PyObject **args, int arg_count, PyObject *value) {
+    uint64_t hash;
+    if (value == NULL || !hash_args(args, arg_count, &hash)) {
+        return;
+    }
+
+    // 递归调用可能已经保存了相同参数的结果
+    MemoEntry *entry = find_entry(table, hash, args, arg_count);
+    if (entry != NULL) {
+        py_incref(value);
+        py_decref(entry->value);
+        entry->value = value;
+        return;
+    }
+
+    entry = (MemoEntry *)calloc(1, sizeof(MemoEntry));
+    if (entry == NULL) {
+        return;
+    }
+    entry->args = (PyObject **)malloc(sizeof(PyObject *) * (arg_count > 0 ? arg_count : 1));
+    if (entry->args == NULL) {
+        free(entry);
+        return;
+    }
+
+    if (table->count >= table->capacity) {
+        evict_oldest(table);
+    }
+
+    entry->hash = hash;
+    entry->arg_count = arg_count;
+    for (int i = 0; i < arg_count; i++) {
+        entry->args[i] = args[i];
+        py_incref(args[i]);
+    }
+    entry->value = value;
+    py_incref(value);
+
+    size_t bucket = hash & table->bucket_mask;
+    entry->chain = table->buckets[bucket];
+    table->buckets[bucket] = entry;
+    push_newest(table, entry);
+    table->count++;
+}
+
+/**
+ * 纯度检查的状态：当前可见的局部变量和失败原因
+ */
+typedef struct {
+    const char **locals;            // 参数和已声明的局部变量
+    int local_count;
+    int local_capacity;
+    bool (*is_pure_call)(const char *name);
+    char *reason;
+    size_t reason_size;
+} PurityCheck;
+
+/**
+ * 记录失败原因
+ */
+static bool impure(PurityCheck *check, const char *format, const char *name) {
+    snprintf(check->reason, check->reason_size, format, name);
+    return false;
+}
+
+/**
+ * 名字是否是局部变量
+ */
+static bool is_local(const PurityCheck *check, const char *name) {
+    for (int i = check->local_count - 1; i >= 0; i--) {
+        if (strcmp(check->locals[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 添加局部变量
+ */
+static bool add_local(PurityCheck *check, const char *name) {
+    if (check->local_count >= check->local_capacity) {
+        int capacity = check->local_capacity > 0 ? check->local_capacity * 2 : 16;
+        const char **locals = (const char **)realloc((void *)check->locals, sizeof(const char *) * capacity);
+        if (locals == NULL) {
+            return impure(check, "%s", "内存不足");
+        }
+        check->locals = locals;
+        check->local_capacity = capacity;
+    }
+    check->locals[check->local_count++] = name;
+    return true;
+}
+
+/**
+ * 检查节点是否没有副作用，并且只依赖参数。
+ * 函数体中的名字按动态作用域解析，读取外部变量的结果随调用者变化，所以同样视为不纯
+ */
+static bool check_node(PurityCheck *check, const AstNode *node) {
+    if (node == NULL) {
+        return true;
+    }
+
+    switch (node->type) {
+        case NODE_PROGRAM: {
+            if (ast_is_expression_stmt(node)) {
+                return check_node(check, ((const ExpressionStmt *)node)->expr);
+            }
+            const Program *program = (const Program *)node;
+            for (int i = 0; i < program->stmt_count; i++) {
+                if (!check_node(check, program->statements[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NODE_BLOCK: {
+            // 代码块中声明的变量在块结束后不可见
+            const BlockStmt *block = (const BlockStmt *)node;
+            int saved = check->local_count;
+            bool ok = true;
+            for (int i = 0; ok && i < block->stmt_count; i++) {
+                ok = check_node(check, block->statements[i]);
+            }
+            check->local_count = saved;
+            return ok;
+        }
+        case NODE_VARDECL: {
+            const VarDeclStmt *stmt = (const VarDeclStmt *)node;
+            return check_node(check, stmt->initializer) && add_local(check, stmt->name);
+        }
+        case NODE_IF: {
+            const IfStmt *stmt = (const IfStmt *)node;
+            return check_node(check, stmt->condition) &&
+                   check_node(check, stmt->then_branch) &&
+                   check_node(check, stmt->else_branch);
+        }
+        case NODE_LOOP: {
+            const LoopStmt *stmt = (const LoopStmt *)node;
+            return check_node(check, stmt->condition) && check_node(check, stmt->body);
+        }
+        case NODE_RETURN:
+            return check_node(check, ((const ReturnStmt *)node)->value);
+        case NODE_BINARY: {
+            const BinaryExpr *expr = (const BinaryExpr *)node;
+            return check_node(check, expr->left) && check_node(check, expr->right);
+        }
+        case NODE_UNARY:
+            return check_node(check, ((const UnaryExpr *)node)->operand);
+        case NODE_GROUPING:
+            return check_node(check, ((const GroupingExpr *)node)->expr);
+        case NODE_LITERAL:
+            return true;
+        case NODE_IDENTIFIER: {
+            const VariableExpr *expr = (const VariableExpr *)node;
+            if (!is_local(check, expr->name)) {
+                return impure(check, "读取了外部变量'%s'", expr->name);
+            }
+            return true;
+        }
+        case NODE_ASSIGN: {
+            const AssignExpr *expr = (const AssignExpr *)node;
+            if (!is_local(check, expr->name)) {
+                return impure(check, "修改了外部变量'%s'", expr->name);
+            }
+            return check_node(check, expr->value);
+        }
+        case NODE_CALL: {
+            const CallExpr *expr = (const CallExpr *)node;
+            for (int i = 0; i < expr->arg_count; i++) {
+                if (!check_node(check, expr->args[i])) {
+                    return false;
+                }
+            }
+            if (!check->is_pure_call(expr->name)) {
+                return impure(check, "调用了可能有副作用的函数'%s'", expr->name);
+            }
+            return true;
+        }
+        case NODE_SUPER:
+            return check_node(check, ((const SuperInstr *)node)->original);
+        case NODE_PRINT:
+            return impure(check, "%s", "包含输出语句");
+        case NODE_FUNCDECL:
+            return impure(check, "定义了函数'%s'", ((const FunctionStmt *)node)->name);
+        case NODE_LAMBDA:
+            return impure(check, "%s", "创建了匿名函数");
+        default:
+            return impure(check, "%s", "包含无法分析的语句");
+    }
+}
+
+/**
+ * 保守地检查函数是否是纯函数：不输出、不修改也不读取参数和局部变量以外的变量，
+ * 只调用is_pure_call认可的函数
+ * @param reason 不是纯函数时写入原因
+ * @return 是纯函数返回true
+ */
+bool memo_check_pure(char **params, int param_count, const AstNode *body,
+                     bool (*is_pure_call)(const char *name), char *reason, size_t reason_size) {
+    PurityCheck check = {NULL, 0, 0, is_pure_call, reason, reason_size};
+
+    bool ok = true;
+    for (int i = 0; ok && i < param_count; i++) {
+        ok = add_local(&check, params[i]);
+    }
+    if (ok) {
+        ok = check_node(&check, body);
+    }
+
+    free((void *)check.locals);
+    return ok;
+}
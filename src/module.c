@@ -0,0 +1,327 @@
+/**
+ * 坤舆编程语言 - 模块
+ * 导入 "模块"; 语句在进程内只加载每个模块一次：第一次导入时读取、分析并执行模块的顶层语句，
+ * 语法树一直保留到解释器清理，之后的导入什么也不做。模块中的函数体在第一次调用时才分析和优化。
+ * 服务模式下语法树在解释器清理后仍然保留，下一次执行时导入只重新执行顶层语句，源文件改变时重新分析。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define MODULE_EXTENSION ".kunyu"
+
+/**
+ * 已加载的模块
+ */
+typedef struct Module {
+    char *path;                     // 规范化的绝对路径，用于识别同一个模块
+    char *directory;                // 所在目录，模块中的相对路径以此为基准
+    AstNode *ast;                   // 语法树，模块中定义的函数指向其中的节点
+    Token *tokens;                  // 标记数组，延迟分析的函数体引用其中的标记
+    size_t token_count;             // 标记数量
+    bool executed;                  // 本次执行中是否已经导入（包括正在导入）
+    struct timespec mtime;          // 分析时源文件的修改时间
+    off_t size;                     // 分析时源文件的大小
+    struct Module *next;
+} Module;
+
+// 已加载的模块
+static Module *modules = NULL;
+
+// 入口脚本所在目录
+static char *entry_directory = NULL;
+
+// 正在执行的模块所在目录，NULL表示正在执行入口脚本
+static const char *current_directory = NULL;
+
+// 解释器清理时是否保留已分析的模块
+static bool keep_cache = false;
+
+/**
+ * 记录错误
+ */
+static bool module_error(KunyuError *error, KunyuErrorCode code, const char *message) {
+    error->code = code;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+    return false;
+}
+
+/**
+ * 复制路径中的目录部分
+ */
+static char* directory_of(const char *path) {
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        return strdup(".");
+    }
+    if (slash == path) {
+        return strdup("/");
+    }
+
+    size_t length = (size_t)(slash - path);
+    char *directory = (char *)malloc(length + 1);
+    if (directory != NULL) {
+        memcpy(directory, path, length);
+        directory[length] = '\0';
+    }
+    return directory;
+}
+
+/**
+ * 把模块名解析为文件的规范路径。相对路径从导入它的模块所在目录开始查找，
+ * 没有扩展名时补上.kunyu
+ * @return 找不到文件时返回NULL
+ */
+static char* resolve_path(const char *name) {
+    const char *base = current_directory != NULL ? current_directory : entry_directory;
+    size_t name_length = strlen(name);
+    size_t extension_length = strlen(MODULE_EXTENSION);
+    bool has_extension = name_length >= extension_length &&
+        strcmp(name + name_length - extension_length, MODULE_EXTENSION) == 0;
+
+    char candidate[PATH_MAX];
+    int written;
+    if (name[0] == '/' || base == NULL) {
+        written = snprintf(candidate, sizeof(candidate), "%s%s", name, has_extension ? "" : MODULE_EXTENSION);
+    } else {
+        written = snprintf(candidate, sizeof(candidate), "%s/%s%s", base, name, has_extension ? "" : MODULE_EXTENSION);
+    }
+    if (written < 0 || (size_t)written >= sizeof(candidate)) {
+        return NULL;
+    }
+
+    return realpath(candidate, NULL);
+}
+
+/**
+ * 查找已加载的模块
+ */
+static Module* find_module(const char *path) {
+    for (Module *module = modules; module != NULL; module = module->next) {
+        if (strcmp(module->path, path) == 0) {
+            return module;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 读取模块源文件
+ */
+static char* read_source(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *buffer = (char *)malloc(capacity);
+    while (buffer != NULL) {
+        length += fread(buffer + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = (char *)realloc(buffer, capacity);
+        if (grown == NULL) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+    fclose(file);
+
+    if (buffer != NULL) {
+        buffer[length] = '\0';
+    }
+    return buffer;
+}
+
+/**
+ * 读取并分析模块，得到语法树
+ */
+static AstNode* parse_module(Module *module, const char *name, const char *path, KunyuError *error) {
+    char message[sizeof(error->message)];
+
+    char *source = read_source(path);
+    if (source == NULL) {
+        snprintf(message, sizeof(message), "无法读取模块'%s'", name);
+        module_error(error, KUNYU_ERROR_IO, message);
+        return NULL;
+    }
+
+    size_t error_offset;
+    if (!utf8_validate(source, strlen(source), &error_offset)) {
+        snprintf(message, sizeof(message), "模块'%s'不是有效的UTF-8编码（第%zu字节）", name, error_offset + 1);
+        module_error(error, KUNYU_ERROR_IO, message);
+        free(source);
+        return NULL;
+    }
+
+    // 标记数组随模块保留，分析完立即取走，以便模块中再导入模块时重新使用词法分析器
+    AstNode *ast = NULL;
+    if (lexer_init(source) == NULL) {
+        module_error(error, KUNYU_ERROR_MEMORY, "内存分配失败，无法初始化词法分析器");
+    } else {
+        int token_count = lexer_tokenize();
+        if (token_count < 0) {
+            KunyuError *lexer_error = lexer_get_error();
+            snprintf(message, sizeof(message), "模块'%.100s'词法分析错误: %.100s (行 %d, 列 %d)",
+                     path, lexer_error->message, lexer_error->line, lexer_error->column);
+            module_error(error, KUNYU_ERROR_LEXER, message);
+        } else {
+            module->tokens = lexer_detach_tokens(&module->token_count);
+            ast = parser_parse(module->tokens, token_count);
+            if (ast == NULL) {
+                KunyuError *parser_error = parser_get_error();
+                snprintf(message, sizeof(message), "模块'%.100s'语法分析错误: %.100s (行 %d, 列 %d)",
+                         path, parser_error->message, parser_error->line, parser_error->column);
+                module_error(error, KUNYU_ERROR_PARSER, message);
+            }
+        }
+    }
+    lexer_free();
+    free(source);
+
+    if (ast != NULL) {
+        optimizer_optimize(ast);
+    }
+    return ast;
+}
+
+/**
+ * 在模块所在目录下执行模块的顶层语句
+ */
+static bool execute_module(Module *module) {
+    // 先标记为已导入，模块之间的循环导入不会重复执行
+    module->executed = true;
+    const char *saved_directory = current_directory;
+    current_directory = module->directory;
+    bool success = interpreter_execute_module(module->ast, module->path);
+    current_directory = saved_directory;
+    return success;
+}
+
+/**
+ * 记录入口脚本的路径，入口脚本中的相对模块路径以它所在的目录为基准
+ */
+void module_set_entry(const char *filename) {
+    free(entry_directory);
+    entry_directory = filename != NULL ? directory_of(filename) : NULL;
+}
+
+/**
+ * 导入模块。第一次导入时加载并执行模块，已经导入过（或正在导入，即循环导入）时什么也不做
+ * @param name 导入语句中的模块路径
+ * @param error 出错时写入错误信息
+ * @return 成功返回true
+ */
+bool module_import(const char *name, KunyuError *error) {
+    char message[sizeof(error->message)];
+
+    char *path = resolve_path(name);
+    if (path == NULL) {
+        snprintf(message, sizeof(message), "找不到模块'%s'", name);
+        return module_error(error, KUNYU_ERROR_IO, message);
+    }
+
+    Module *cached = find_module(path);
+    if (cached != NULL) {
+        free(path);
+        if (cached->executed || cached->ast == NULL) {
+            return true;
+        }
+        return execute_module(cached);
+    }
+
+    trace_phase_begin("导入模块");
+    Module *module = (Module *)calloc(1, sizeof(Module));
+    if (module != NULL) {
+        struct stat info;
+        if (stat(path, &info) == 0) {
+            module->mtime = info.st_mtim;
+            module->size = info.st_size;
+        }
+        module->path = path;
+        module->directory = directory_of(path);
+        module->ast = parse_module(module, name, path, error);
+    } else {
+        free(path);
+        module_error(error, KUNYU_ERROR_MEMORY, "内存分配失败，无法创建模块");
+    }
+    trace_phase_end();
+    if (module == NULL) {
+        return false;
+    }
+
+    // 分析失败的模块也留在表中，再次导入时不会重复报错
+    module->next = modules;
+    modules = module;
+    if (module->ast == NULL || module->directory == NULL) {
+        if (module->directory == NULL) {
+            module_error(error, KUNYU_ERROR_MEMORY, "内存分配失败，无法复制模块路径");
+        }
+        return false;
+    }
+
+    return execute_module(module);
+}
+
+/**
+ * 设置解释器清理时是否保留已分析的模块。服务模式在请求之间保留，
+ * 关闭时随即释放所有模块
+ */
+void module_set_cache(bool keep) {
+    keep_cache = keep;
+    if (!keep) {
+        module_cleanup();
+    }
+}
+
+/**
+ * 释放模块
+ */
+static void free_module(Module *module) {
+    ast_free(module->ast);
+    lexer_free_tokens(module->tokens, module->token_count);
+    free(module->directory);
+    free(module->path);
+    free(module);
+}
+
+/**
+ * 判断模块的源文件在分析之后是否改变过
+ */
+static bool module_changed(const Module *module) {
+    struct stat info;
+    if (stat(module->path, &info) != 0) {
+        return true;
+    }
+    return info.st_size != module->size ||
+           info.st_mtim.tv_sec != module->mtime.tv_sec ||
+           info.st_mtim.tv_nsec != module->mtime.tv_nsec;
+}
+
+/**
+ * 解释器清理时调用，模块中定义的函数指向模块的语法树，必须在清空函数表之后调用。
+ * 保留模块时只把它们标记为未导入，释放分析失败和源文件改变了的模块；否则释放所有模块
+ */
+void module_cleanup() {
+    Module **link = &modules;
+    while (*link != NULL) {
+        Module *module = *link;
+        if (keep_cache && module->ast != NULL && !module_changed(module)) {
+            module->executed = false;
+            link = &module->next;
+        } else {
+            *link = module->next;
+            free_module(module);
+        }
+    }
+    current_directory = NULL;
+}
@@ -4,6 +4,8 @@
  */
 
 #include "../includes/kunyu.h"
+#include "../includes/stats.h"
+#include "../includes/heapprof.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +23,20 @@ static void number_destructor(PyObject *obj) {
 static void string_destructor(PyObject *obj) {
     PyStringObject *str = (PyStringObject *)obj;
     free(str->value);
+    free(str->char_index);
+}
+
+/**
+ * 销毁函数对象，参数名和函数体属于语法树，不在这里释放
+ */
+static void function_destructor(PyObject *obj) {
+    PyFunctionObject *func = (PyFunctionObject *)obj;
+    for (int i = 0; i < func->upvalue_count; i++) {
+        if (func->upvalues[i] != NULL) {
+            py_cell_decref(func->upvalues[i]);
+        }
+    }
+    free(func->upvalues);
 }
 
 /**
@@ -40,7 +56,16 @@ static void list_destructor(PyObject *obj) {
  */
 static void dict_destructor(PyObject *obj) {
     PyDictObject *dict = (PyDictObject *)obj;
-    // 减少所有键和值的引用计数
+    if (dict->shape != NULL) {
+        // 共享布局模式：键属于布局，只需减少值的引用计数
+        for (size_t i = 0; i < dict->size; i++) {
+            py_decref(dict->values[i]);
+        }
+        free(dict->values);
+        return;
+    }
+    
+    // 字典模式：减少所有键和值的引用计数
     for (size_t i = 0; i < dict->size; i++) {
         py_decref(dict->items[i].key);
         py_decref(dict->items[i].value);
@@ -54,6 +79,8 @@ static void dict_destructor(PyObject *obj) {
 void py_incref(PyObject *obj) {
     if (obj != NULL) {
         obj->ref_count++;
+        STATS_INC(STAT_INCREF);
+        STATS_MAX(STAT_PEAK_REFCOUNT, obj->ref_count);
     }
 }
 
@@ -63,13 +90,16 @@ void py_incref(PyObject *obj) {
 void py_decref(PyObject *obj) {
     if (obj != NULL) {
         obj->ref_count--;
+        STATS_INC(STAT_DECREF);
         if (obj->ref_count <= 0) {
             // 调用对象的析构函数
             if (obj->destructor != NULL) {
                 obj->destructor(obj);
             }
+            HEAP_TRACK_FREE(obj);
             // 释放对象内存
             free(obj);
+            STATS_OBJECT_FREE();
         }
     }
 }
@@ -87,10 +117,70 @@ PyObject* py_number_new(double value) {
     obj->base.ref_count = 1;
     obj->base.destructor = number_destructor;
     obj->value = value;
+    obj->int_value = 0;
+    obj->is_int = false;
+    
+    STATS_INC(STAT_NUMBER_NEW);
+    STATS_OBJECT_ALLOC();
+    HEAP_TRACK_ALLOC(obj, sizeof(PyNumberObject));
+    
+    return (PyObject *)obj;
+}
+
+// 小整数池的范围，覆盖布尔结果、常见下标和循环计数器
+#define SMALL_INT_MIN (-128)
+#define SMALL_INT_MAX 1023
+
+// 小整数池，池中的对象是静态分配的，池本身持有一个引用，永远不会被释放
+static PyNumberObject small_ints[SMALL_INT_MAX - SMALL_INT_MIN + 1];
+static bool small_ints_ready = false;
+
+/**
+ * 初始化小整数池
+ */
+static void init_small_ints() {
+    for (int i = 0; i <= SMALL_INT_MAX - SMALL_INT_MIN; i++) {
+        PyNumberObject *obj = &small_ints[i];
+        obj->base.type = TYPE_NUMBER;
+        obj->base.ref_count = 1;
+        obj->base.destructor = NULL;
+        obj->int_value = (int64_t)i + SMALL_INT_MIN;
+        obj->value = (double)obj->int_value;
+        obj->is_int = true;
+    }
+    small_ints_ready = true;
+}
+
+/**
+ * 创建一个整数对象，小整数直接从池中取，不分配内存
+ */
+PyObject* py_int_new(int64_t value) {
+    if (value >= SMALL_INT_MIN && value <= SMALL_INT_MAX) {
+        if (!small_ints_ready) {
+            init_small_ints();
+        }
+        PyObject *obj = (PyObject *)&small_ints[value - SMALL_INT_MIN];
+        py_incref(obj);
+        return obj;
+    }
+    
+    PyNumberObject *obj = (PyNumberObject *)py_number_new((double)value);
+    if (obj == NULL) {
+        return NULL;
+    }
     
+    obj->int_value = value;
+    obj->is_int = true;
     return (PyObject *)obj;
 }
 
+/**
+ * 判断对象是否是整数
+ */
+bool py_number_is_int(PyObject *obj) {
+    return obj != NULL && obj->type == TYPE_NUMBER && ((PyNumberObject *)obj)->is_int;
+}
+
 /**
  * 创建一个新的字符串对象
  */
@@ -114,11 +204,196 @@ PyObject* py_string_new(const char *value) {
         return NULL;
     }
     
-    obj->length = strlen(value);
+    // 计算长度的同时检查是否只含ASCII字符
+    const unsigned char *p = (const unsigned char *)value;
+    unsigned char high_bits = 0;
+    while (*p != '\0') {
+        high_bits |= *p++;
+    }
+    obj->length = (size_t)(p - (const unsigned char *)value);
+    obj->is_ascii = (high_bits & 0x80) == 0;
+    obj->char_length = obj->is_ascii ? obj->length : 0;
+    obj->char_index = NULL;
+    
+    STATS_INC(STAT_STRING_NEW);
+    STATS_OBJECT_ALLOC();
+    HEAP_TRACK_ALLOC(obj, sizeof(PyStringObject) + obj->length + 1);
+    
+    return (PyObject *)obj;
+}
+
+/**
+ * 判断字节是否是UTF-8字符的后续字节
+ */
+static bool is_utf8_continuation(unsigned char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+/**
+ * 为非ASCII字符串建立字符索引：记录每隔KUNYU_STRING_INDEX_STRIDE个字符的字节偏移。
+ * 不合法的UTF-8字节各算作一个字符
+ */
+static bool string_build_index(PyStringObject *str) {
+    if (str->is_ascii || str->char_index != NULL) {
+        return true;
+    }
+    
+    size_t slots = py_string_char_length((PyObject *)str) / KUNYU_STRING_INDEX_STRIDE + 1;
+    size_t *index = (size_t *)malloc(sizeof(size_t) * slots);
+    if (index == NULL) {
+        return false;
+    }
+    
+    const unsigned char *bytes = (const unsigned char *)str->value;
+    size_t count = 0;
+    for (size_t i = 0; i < str->length; i++) {
+        if (is_utf8_continuation(bytes[i])) {
+            continue;
+        }
+        if (count % KUNYU_STRING_INDEX_STRIDE == 0) {
+            index[count / KUNYU_STRING_INDEX_STRIDE] = i;
+        }
+        count++;
+    }
+    
+    str->char_index = index;
+    HEAP_TRACK_RESIZE(str, sizeof(PyStringObject) + str->length + 1 + sizeof(size_t) * slots);
+    
+    return true;
+}
+
+/**
+ * 获取字符串的字符（码点）数
+ */
+size_t py_string_char_length(PyObject *str) {
+    if (str == NULL || str->type != TYPE_STRING) {
+        return 0;
+    }
+    
+    // 只需要长度时不建立索引，直接统计字符数（非ASCII字符串至少有一个字符，0表示未统计）
+    PyStringObject *str_obj = (PyStringObject *)str;
+    if (str_obj->char_length == 0 && str_obj->length > 0) {
+        str_obj->char_length = utf8_count_chars(str_obj->value, str_obj->length);
+    }
+    return str_obj->char_length;
+}
+
+/**
+ * 获取字符串中下标为index的字符，返回只含这个字符的新字符串。
+ * 非ASCII字符串从索引中最近的位置向后最多跳过KUNYU_STRING_INDEX_STRIDE - 1个字符
+ * @return 下标越界时返回NULL
+ */
+PyObject* py_string_char_at(PyObject *str, size_t index) {
+    if (str == NULL || str->type != TYPE_STRING) {
+        return NULL;
+    }
+    
+    PyStringObject *str_obj = (PyStringObject *)str;
+    if (!string_build_index(str_obj) || index >= str_obj->char_length) {
+        return NULL;
+    }
+    
+    char buffer[8];
+    if (str_obj->is_ascii) {
+        buffer[0] = str_obj->value[index];
+        buffer[1] = '\0';
+        return py_string_new(buffer);
+    }
+    
+    const unsigned char *bytes = (const unsigned char *)str_obj->value;
+    size_t start = str_obj->char_index[index / KUNYU_STRING_INDEX_STRIDE];
+    for (size_t skip = index % KUNYU_STRING_INDEX_STRIDE; skip > 0; skip--) {
+        do {
+            start++;
+        } while (start < str_obj->length && is_utf8_continuation(bytes[start]));
+    }
+    
+    size_t end = start + 1;
+    while (end < str_obj->length && end - start < 4 && is_utf8_continuation(bytes[end])) {
+        end++;
+    }
+    
+    memcpy(buffer, bytes + start, end - start);
+    buffer[end - start] = '\0';
+    return py_string_new(buffer);
+}
+
+/**
+ * 创建函数对象，捕获的变量单元初始为NULL，由解释器填入
+ */
+PyObject* py_function_new(const char *name, char **params, int param_count, struct AstNode *body,
+                          char **upvalue_names, int upvalue_count) {
+    PyFunctionObject *obj = (PyFunctionObject *)malloc(sizeof(PyFunctionObject));
+    if (obj == NULL) {
+        return NULL;
+    }
+    
+    obj->upvalues = NULL;
+    if (upvalue_count > 0) {
+        obj->upvalues = (PyCell **)calloc(upvalue_count, sizeof(PyCell *));
+        if (obj->upvalues == NULL) {
+            free(obj);
+            return NULL;
+        }
+    }
+    
+    obj->base.type = TYPE_FUNCTION;
+    obj->base.ref_count = 1;
+    obj->base.destructor = function_destructor;
+    obj->name = name;
+    obj->params = params;
+    obj->param_count = param_count;
+    obj->body = body;
+    obj->upvalue_names = upvalue_names;
+    obj->upvalue_count = upvalue_count;
+    
+    STATS_INC(STAT_FUNCTION_NEW);
+    STATS_OBJECT_ALLOC();
+    HEAP_TRACK_ALLOC(obj, sizeof(PyFunctionObject) + sizeof(PyCell *) * upvalue_count);
     
     return (PyObject *)obj;
 }
 
+/**
+ * 创建变量单元，单元持有值的引用
+ */
+PyCell* py_cell_new(PyObject *value) {
+    PyCell *cell = (PyCell *)malloc(sizeof(PyCell));
+    if (cell == NULL) {
+        return NULL;
+    }
+    
+    cell->ref_count = 1;
+    cell->value = value;
+    cell->is_constant = false;
+    if (value != NULL) {
+        py_incref(value);
+    }
+    return cell;
+}
+
+/**
+ * 增加变量单元的引用计数
+ */
+void py_cell_incref(PyCell *cell) {
+    if (cell != NULL) {
+        cell->ref_count++;
+    }
+}
+
+/**
+ * 减少变量单元的引用计数，为0时释放单元和它持有的值
+ */
+void py_cell_decref(PyCell *cell) {
+    if (cell == NULL || --cell->ref_count > 0) {
+        return;
+    }
+    if (cell->value != NULL) {
+        py_decref(cell->value);
+    }
+    free(cell);
+}
+
 /**
  * 创建一个新的列表对象
  */
@@ -142,6 +417,10 @@ PyObject* py_list_new() {
     obj->length = 0;
     obj->capacity = initial_capacity;
     
+    STATS_INC(STAT_LIST_NEW);
+    STATS_OBJECT_ALLOC();
+    HEAP_TRACK_ALLOC(obj, sizeof(PyListObject) + sizeof(PyObject *) * initial_capacity);
+    
     return (PyObject *)obj;
 }
 
@@ -165,6 +444,7 @@ bool py_list_append(PyObject *list, PyObject *item) {
         
         list_obj->items = new_items;
         list_obj->capacity = new_capacity;
+        HEAP_TRACK_RESIZE(list_obj, sizeof(PyListObject) + sizeof(PyObject *) * new_capacity);
     }
     
     // 添加项并增加引用计数
@@ -227,6 +507,117 @@ bool py_list_set(PyObject *list, size_t index, PyObject *item) {
     return true;
 }
 
+/**
+ * 字典布局
+ *
+ * 以相同顺序插入相同字符串键的字典共享同一个布局，每个实例只保存值数组。
+ * 布局组成一棵转移树：根布局没有键，每个子布局在父布局的基础上追加一个键。
+ * 布局创建后不再修改，也不会释放，字典可以通过(布局, 槽位)缓存键的位置。
+ * 键不是字符串、键数超过DICT_MAX_SHAPE_KEYS或布局总数达到上限时，
+ * 字典转换为字典模式，用DictItem数组保存键值对。
+ */
+typedef struct {
+    const char *key;         // 键，由引入它的布局持有
+    uint32_t hash;           // 键的哈希值
+} ShapeKey;
+
+struct DictShape {
+    struct DictShape *parent;       // 父布局
+    struct DictShape *transitions;  // 第一个子布局
+    struct DictShape *sibling;      // 下一个兄弟布局
+    char *key;                      // 本布局追加的键
+    uint32_t hash;                  // 本布局追加的键的哈希值
+    size_t count;                   // 键的数量
+    ShapeKey *keys;                 // 按插入顺序排列的全部键
+};
+
+#define DICT_MAX_SHAPE_KEYS 32      // 超过这个键数的字典转为字典模式
+#define DICT_MAX_SHAPES 16384       // 布局总数上限，防止把字典当映射表用时布局无限增长
+#define DICT_INITIAL_VALUES 4       // 值数组的初始容量
+#define DICT_INITIAL_ITEMS 8        // 字典模式键值对数组的初始容量
+
+// 根布局
+static DictShape root_shape = { NULL, NULL, NULL, NULL, 0, 0, NULL };
+
+// 已创建的布局数量
+static size_t shape_count = 0;
+
+/**
+ * 计算字符串哈希值（FNV-1a）
+ */
+static uint32_t hash_string(const char *str) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * 在布局中查找键的槽位
+ * @return 槽位，不存在时返回-1
+ */
+static int shape_find_slot(const DictShape *shape, const char *key, uint32_t hash) {
+    for (size_t i = 0; i < shape->count; i++) {
+        if (shape->keys[i].hash == hash && strcmp(shape->keys[i].key, key) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 获取在布局后追加一个键得到的子布局，不存在时创建
+ * @return 子布局，达到上限或内存不足时返回NULL
+ */
+static DictShape* shape_add_key(DictShape *shape, const char *key, uint32_t hash) {
+    for (DictShape *child = shape->transitions; child != NULL; child = child->sibling) {
+        if (child->hash == hash && strcmp(child->key, key) == 0) {
+            return child;
+        }
+    }
+    
+    if (shape->count >= DICT_MAX_SHAPE_KEYS || shape_count >= DICT_MAX_SHAPES) {
+        return NULL;
+    }
+    
+    DictShape *child = (DictShape *)calloc(1, sizeof(DictShape));
+    if (child == NULL) {
+        return NULL;
+    }
+    child->key = strdup(key);
+    child->keys = (ShapeKey *)malloc(sizeof(ShapeKey) * (shape->count + 1));
+    if (child->key == NULL || child->keys == NULL) {
+        free(child->key);
+        free(child->keys);
+        free(child);
+        return NULL;
+    }
+    
+    if (shape->count > 0) {
+        memcpy(child->keys, shape->keys, sizeof(ShapeKey) * shape->count);
+    }
+    child->keys[shape->count].key = child->key;
+    child->keys[shape->count].hash = hash;
+    child->hash = hash;
+    child->count = shape->count + 1;
+    child->parent = shape;
+    child->sibling = shape->transitions;
+    shape->transitions = child;
+    shape_count++;
+    
+    return child;
+}
+
+/**
+ * 计算字典占用的字节数
+ */
+static size_t dict_bytes(const PyDictObject *dict) {
+    size_t item_size = dict->shape != NULL ? sizeof(PyObject *) : sizeof(DictItem);
+    return sizeof(PyDictObject) + item_size * dict->capacity;
+}
+
 /**
  * 创建一个新的字典对象
  */
@@ -240,21 +631,55 @@ PyObject* py_dict_new() {
     obj->base.ref_count = 1;
     obj->base.destructor = dict_destructor;
     
-    const size_t initial_capacity = 8;
-    obj->items = (DictItem *)malloc(sizeof(DictItem) * initial_capacity);
-    if (obj->items == NULL) {
-        free(obj);
-        return NULL;
-    }
-    
+    // 值数组在第一次设置时才分配
+    obj->shape = &root_shape;
+    obj->values = NULL;
+    obj->items = NULL;
     obj->size = 0;
-    obj->capacity = initial_capacity;
+    obj->capacity = 0;
+    
+    STATS_INC(STAT_DICT_NEW);
+    STATS_OBJECT_ALLOC();
+    HEAP_TRACK_ALLOC(obj, dict_bytes(obj));
     
     return (PyObject *)obj;
 }
 
 /**
- * 查找字典中的键位置
+ * 把共享布局的字典转换为字典模式
+ */
+static bool dict_convert_to_items(PyDictObject *dict) {
+    size_t capacity = dict->size < DICT_INITIAL_ITEMS ? DICT_INITIAL_ITEMS : dict->size * 2;
+    DictItem *items = (DictItem *)malloc(sizeof(DictItem) * capacity);
+    if (items == NULL) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < dict->size; i++) {
+        items[i].key = py_string_new(dict->shape->keys[i].key);
+        if (items[i].key == NULL) {
+            for (size_t j = 0; j < i; j++) {
+                py_decref(items[j].key);
+            }
+            free(items);
+            return false;
+        }
+        // 值的引用直接转移
+        items[i].value = dict->values[i];
+    }
+    
+    free(dict->values);
+    dict->values = NULL;
+    dict->shape = NULL;
+    dict->items = items;
+    dict->capacity = capacity;
+    HEAP_TRACK_RESIZE(dict, dict_bytes(dict));
+    
+    return true;
+}
+
+/**
+ * 查找字典模式中的键位置
  */
 static int py_dict_find_index(PyDictObject *dict, PyObject *key) {
     for (size_t i = 0; i < dict->size; i++) {
@@ -272,14 +697,36 @@ static int py_dict_find_index(PyDictObject *dict, PyObject *key) {
 }
 
 /**
- * 设置字典中键对应的值
+ * 在字典模式中追加键值对，调用者保证键不存在
  */
-bool py_dict_set(PyObject *dict, PyObject *key, PyObject *value) {
-    if (dict == NULL || dict->type != TYPE_DICT || key == NULL || value == NULL) {
-        return false;
+static bool dict_items_append(PyDictObject *dict_obj, PyObject *key, PyObject *value) {
+    // 检查是否需要扩容
+    if (dict_obj->size >= dict_obj->capacity) {
+        size_t new_capacity = dict_obj->capacity * 2;
+        DictItem *new_items = (DictItem *)realloc(dict_obj->items, sizeof(DictItem) * new_capacity);
+        if (new_items == NULL) {
+            return false;
+        }
+        
+        dict_obj->items = new_items;
+        dict_obj->capacity = new_capacity;
+        HEAP_TRACK_RESIZE(dict_obj, dict_bytes(dict_obj));
     }
     
-    PyDictObject *dict_obj = (PyDictObject *)dict;
+    // 添加新键值对
+    dict_obj->items[dict_obj->size].key = key;
+    dict_obj->items[dict_obj->size].value = value;
+    py_incref(key);
+    py_incref(value);
+    dict_obj->size++;
+    
+    return true;
+}
+
+/**
+ * 在字典模式中设置键值对
+ */
+static bool dict_items_set(PyDictObject *dict_obj, PyObject *key, PyObject *value) {
     int index = py_dict_find_index(dict_obj, key);
     
     if (index >= 0) {
@@ -287,27 +734,92 @@ bool py_dict_set(PyObject *dict, PyObject *key, PyObject *value) {
         py_decref(dict_obj->items[index].value);
         dict_obj->items[index].value = value;
         py_incref(value);
-    } else {
-        // 检查是否需要扩容
-        if (dict_obj->size >= dict_obj->capacity) {
-            size_t new_capacity = dict_obj->capacity * 2;
-            DictItem *new_items = (DictItem *)realloc(dict_obj->items, sizeof(DictItem) * new_capacity);
-            if (new_items == NULL) {
-                return false;
-            }
-            
-            dict_obj->items = new_items;
-            dict_obj->capacity = new_capacity;
+        return true;
+    }
+    
+    return dict_items_append(dict_obj, key, value);
+}
+
+/**
+ * 向字典添加一个已知不存在的键，不检查重复。
+ * 从快照恢复时键来自原来的字典，逐个查找会让重建大字典的时间与键数的平方成正比
+ */
+bool py_dict_append(PyObject *dict, PyObject *key, PyObject *value) {
+    if (dict == NULL || dict->type != TYPE_DICT || key == NULL || value == NULL) {
+        return false;
+    }
+    
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    if (dict_obj->shape != NULL) {
+        // 布局模式的键数很少，按正常方式设置
+        if (key->type == TYPE_STRING && dict_obj->size < DICT_MAX_SHAPE_KEYS) {
+            return py_dict_set(dict, key, value);
         }
-        
-        // 添加新键值对
-        dict_obj->items[dict_obj->size].key = key;
-        dict_obj->items[dict_obj->size].value = value;
-        py_incref(key);
+        if (!dict_convert_to_items(dict_obj)) {
+            return false;
+        }
+    }
+    
+    return dict_items_append(dict_obj, key, value);
+}
+
+/**
+ * 设置字典中键对应的值
+ */
+bool py_dict_set(PyObject *dict, PyObject *key, PyObject *value) {
+    if (dict == NULL || dict->type != TYPE_DICT || key == NULL || value == NULL) {
+        return false;
+    }
+    
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    if (dict_obj->shape == NULL) {
+        return dict_items_set(dict_obj, key, value);
+    }
+    
+    // 非字符串键不能放进布局
+    if (key->type != TYPE_STRING) {
+        if (!dict_convert_to_items(dict_obj)) {
+            return false;
+        }
+        return dict_items_set(dict_obj, key, value);
+    }
+    
+    const char *key_str = ((PyStringObject *)key)->value;
+    uint32_t hash = hash_string(key_str);
+    int slot = shape_find_slot(dict_obj->shape, key_str, hash);
+    if (slot >= 0) {
+        // 替换现有值
+        py_decref(dict_obj->values[slot]);
+        dict_obj->values[slot] = value;
         py_incref(value);
-        dict_obj->size++;
+        return true;
     }
     
+    // 追加新键：转移到子布局，无法转移时转为字典模式
+    DictShape *next = shape_add_key(dict_obj->shape, key_str, hash);
+    if (next == NULL) {
+        if (!dict_convert_to_items(dict_obj)) {
+            return false;
+        }
+        return dict_items_set(dict_obj, key, value);
+    }
+    
+    if (dict_obj->size >= dict_obj->capacity) {
+        size_t new_capacity = dict_obj->capacity == 0 ? DICT_INITIAL_VALUES : dict_obj->capacity * 2;
+        PyObject **new_values = (PyObject **)realloc(dict_obj->values, sizeof(PyObject *) * new_capacity);
+        if (new_values == NULL) {
+            return false;
+        }
+        
+        dict_obj->values = new_values;
+        dict_obj->capacity = new_capacity;
+        HEAP_TRACK_RESIZE(dict_obj, dict_bytes(dict_obj));
+    }
+    
+    dict_obj->values[dict_obj->size++] = value;
+    dict_obj->shape = next;
+    py_incref(value);
+    
     return true;
 }
 
@@ -320,15 +832,27 @@ PyObject* py_dict_get(PyObject *dict, PyObject *key) {
     }
     
     PyDictObject *dict_obj = (PyDictObject *)dict;
-    int index = py_dict_find_index(dict_obj, key);
+    PyObject *value = NULL;
+    
+    if (dict_obj->shape != NULL) {
+        if (key->type == TYPE_STRING) {
+            const char *key_str = ((PyStringObject *)key)->value;
+            int slot = shape_find_slot(dict_obj->shape, key_str, hash_string(key_str));
+            if (slot >= 0) {
+                value = dict_obj->values[slot];
+            }
+        }
+    } else {
+        int index = py_dict_find_index(dict_obj, key);
+        if (index >= 0) {
+            value = dict_obj->items[index].value;
+        }
+    }
     
-    if (index >= 0) {
-        PyObject *value = dict_obj->items[index].value;
+    if (value != NULL) {
         py_incref(value);
-        return value;
     }
-    
-    return NULL;
+    return value;
 }
 
 /**
@@ -341,4 +865,110 @@ size_t py_dict_size(PyObject *dict) {
     
     PyDictObject *dict_obj = (PyDictObject *)dict;
     return dict_obj->size;
-} 
\ No newline at end of file
+}
+
+/**
+ * 按插入顺序获取字典的第index个键
+ * @return 键的新引用，越界时返回NULL
+ */
+PyObject* py_dict_key_at(PyObject *dict, size_t index) {
+    if (dict == NULL || dict->type != TYPE_DICT || index >= ((PyDictObject *)dict)->size) {
+        return NULL;
+    }
+    
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    if (dict_obj->shape != NULL) {
+        return py_string_new(dict_obj->shape->keys[index].key);
+    }
+    py_incref(dict_obj->items[index].key);
+    return dict_obj->items[index].key;
+}
+
+/**
+ * 按插入顺序获取字典的第index个值
+ * @return 值的新引用，越界时返回NULL
+ */
+PyObject* py_dict_value_at(PyObject *dict, size_t index) {
+    if (dict == NULL || dict->type != TYPE_DICT || index >= ((PyDictObject *)dict)->size) {
+        return NULL;
+    }
+    
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    PyObject *value = dict_obj->shape != NULL ? dict_obj->values[index] : dict_obj->items[index].value;
+    py_incref(value);
+    return value;
+}
+
+/**
+ * 获取字典当前的布局
+ * @return 布局，字典模式返回NULL
+ */
+const DictShape* py_dict_shape(PyObject *dict) {
+    if (dict == NULL || dict->type != TYPE_DICT) {
+        return NULL;
+    }
+    return ((PyDictObject *)dict)->shape;
+}
+
+/**
+ * 查找字符串键在字典布局中的槽位，可与布局一起缓存
+ * @return 槽位，字典处于字典模式或键不存在时返回-1
+ */
+int py_dict_lookup_slot(PyObject *dict, PyObject *key) {
+    if (dict == NULL || dict->type != TYPE_DICT || key == NULL || key->type != TYPE_STRING) {
+        return -1;
+    }
+    
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    if (dict_obj->shape == NULL) {
+        return -1;
+    }
+    
+    const char *key_str = ((PyStringObject *)key)->value;
+    return shape_find_slot(dict_obj->shape, key_str, hash_string(key_str));
+}
+
+/**
+ * 按槽位读取值，调用者需保证槽位来自字典当前布局
+ */
+PyObject* py_dict_get_slot(PyObject *dict, int slot) {
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    PyObject *value = dict_obj->values[slot];
+    py_incref(value);
+    return value;
+}
+
+/**
+ * 按槽位替换值，调用者需保证槽位来自字典当前布局
+ */
+void py_dict_set_slot(PyObject *dict, int slot, PyObject *value) {
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    py_incref(value);
+    py_decref(dict_obj->values[slot]);
+    dict_obj->values[slot] = value;
+}
+
+/**
+ * 沿已知的布局转移追加一个值，调用者需保证next是字典当前布局追加一个键得到的子布局
+ */
+bool py_dict_append_slot(PyObject *dict, const DictShape *next, PyObject *value) {
+    PyDictObject *dict_obj = (PyDictObject *)dict;
+    
+    if (dict_obj->size >= dict_obj->capacity) {
+        size_t new_capacity = dict_obj->capacity == 0 ? DICT_INITIAL_VALUES : dict_obj->capacity * 2;
+        PyObject **new_values = (PyObject **)realloc(dict_obj->values, sizeof(PyObject *) * new_capacity);
+        if (new_values == NULL) {
+            return false;
+        }
+        
+        dict_obj->values = new_values;
+        dict_obj->capacity = new_capacity;
+        HEAP_TRACK_RESIZE(dict_obj, dict_bytes(dict_obj));
+    }
+    
+    dict_obj->values[dict_obj->size++] = value;
+    dict_obj->shape = (DictShape *)next;
+    py_incref(value);
+    
+    return true;
+}
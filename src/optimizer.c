@@ -0,0 +1,390 @@
+/**
+ * 坤舆编程语言 - 语法树优化器
+ * 在执行前把脚本中最常见的语句模式融合成超级指令：
+ *   x = x + 1;                  局部变量更新
+ *   循环 (i < n) / 如果 (a == 0)  变量或常量之间的比较
+ *   变量 x = 列表获取(xs, i);    按下标取列表元素到新变量
+ *   返回 a + b;                  返回二元运算的结果
+ * 这些模式取自基准测试用例和示例程序中执行次数最多的语句。
+ * 函数体在函数第一次被调用时才优化。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+// 是否生成超级指令（--no-optimize关闭）
+static bool optimizer_enabled = true;
+
+/**
+ * 去掉分组表达式的括号
+ */
+static AstNode* unwrap_grouping(AstNode *node) {
+    while (node != NULL && node->type == NODE_GROUPING) {
+        node = ((GroupingExpr *)node)->expr;
+    }
+    return node;
+}
+
+/**
+ * 匹配操作数：变量引用或数字字面量
+ */
+static bool match_operand(AstNode *node, SuperOperand *operand) {
+    node = unwrap_grouping(node);
+    if (node == NULL) {
+        return false;
+    }
+
+    memset(operand, 0, sizeof(*operand));
+    if (node->type == NODE_IDENTIFIER) {
+        operand->name = ((VariableExpr *)node)->name;
+        return true;
+    }
+
+    if (node->type != NODE_LITERAL) {
+        return false;
+    }
+
+    LiteralExpr *literal = (LiteralExpr *)node;
+    if (literal->token_type == KUNYU_TOKEN_INTEGER) {
+        // 大整数字面量不走快速路径
+        errno = 0;
+        operand->is_int = true;
+        operand->int_constant = strtoll(literal->value, NULL, 10);
+        if (errno == ERANGE) {
+            return false;
+        }
+        operand->constant = (double)operand->int_constant;
+        return true;
+    }
+    if (literal->token_type == KUNYU_TOKEN_NUMBER) {
+        operand->constant = atof(literal->value);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * 判断运算符是否是比较运算符
+ */
+static bool is_compare_op(BinaryOpType op) {
+    return op == OP_EQ || op == OP_NE || op == OP_LT ||
+           op == OP_LE || op == OP_GT || op == OP_GE;
+}
+
+/**
+ * 判断运算符是否可以在快速路径上计算（逻辑运算符不行）
+ */
+static bool is_number_op(BinaryOpType op) {
+    return op != OP_AND && op != OP_OR;
+}
+
+/**
+ * 匹配 操作数 运算符 操作数
+ */
+static bool match_binary(AstNode *node, BinaryOpType *op, SuperOperand *left, SuperOperand *right) {
+    node = unwrap_grouping(node);
+    if (node == NULL || node->type != NODE_BINARY) {
+        return false;
+    }
+
+    BinaryExpr *expr = (BinaryExpr *)node;
+    if (!is_number_op(expr->op) ||
+        !match_operand(expr->left, left) || !match_operand(expr->right, right)) {
+        return false;
+    }
+
+    *op = expr->op;
+    return true;
+}
+
+/**
+ * 条件：操作数 比较 操作数，且至少有一个变量
+ */
+static AstNode* match_compare(AstNode *node) {
+    BinaryOpType op;
+    SuperOperand left, right;
+    if (!match_binary(node, &op, &left, &right) || !is_compare_op(op) ||
+        (left.name == NULL && right.name == NULL)) {
+        return NULL;
+    }
+
+    SuperInstr *instr = (SuperInstr *)create_super(SUPER_COMPARE, node);
+    if (instr == NULL) {
+        return NULL;
+    }
+    instr->binary_op = op;
+    instr->left = left;
+    instr->right = right;
+    return (AstNode *)instr;
+}
+
+/**
+ * 表达式语句：x = x 运算符 操作数;
+ */
+static AstNode* match_update_local(AstNode *node) {
+    if (!ast_is_expression_stmt(node)) {
+        return NULL;
+    }
+
+    AstNode *expr = ((ExpressionStmt *)node)->expr;
+    if (expr == NULL || expr->type != NODE_ASSIGN) {
+        return NULL;
+    }
+
+    AssignExpr *assign = (AssignExpr *)expr;
+    BinaryOpType op;
+    SuperOperand left, right;
+    if (!match_binary(assign->value, &op, &left, &right) ||
+        left.name == NULL || strcmp(left.name, assign->name) != 0) {
+        return NULL;
+    }
+
+    SuperInstr *instr = (SuperInstr *)create_super(SUPER_UPDATE_LOCAL, node);
+    if (instr == NULL) {
+        return NULL;
+    }
+    instr->binary_op = op;
+    instr->target = assign->name;
+    instr->left = left;
+    instr->right = right;
+    return (AstNode *)instr;
+}
+
+/**
+ * 变量声明：变量 x = 列表获取(列表变量, 操作数);
+ */
+static AstNode* match_list_get_decl(AstNode *node) {
+    VarDeclStmt *stmt = (VarDeclStmt *)node;
+    AstNode *init = unwrap_grouping(stmt->initializer);
+    if (init == NULL || init->type != NODE_CALL) {
+        return NULL;
+    }
+
+    CallExpr *call = (CallExpr *)init;
+    SuperOperand list, index;
+    if (call->arg_count != 2 || strcmp(call->name, "列表获取") != 0 ||
+        !match_operand(call->args[0], &list) || list.name == NULL ||
+        !match_operand(call->args[1], &index)) {
+        return NULL;
+    }
+
+    SuperInstr *instr = (SuperInstr *)create_super(SUPER_LIST_GET_DECL, node);
+    if (instr == NULL) {
+        return NULL;
+    }
+    instr->target = stmt->name;
+    instr->is_constant = stmt->is_constant;
+    instr->left = list;
+    instr->right = index;
+    return (AstNode *)instr;
+}
+
+/**
+ * 返回语句：返回 操作数 运算符 操作数;
+ */
+static AstNode* match_return_binary(AstNode *node) {
+    BinaryOpType op;
+    SuperOperand left, right;
+    if (!match_binary(((ReturnStmt *)node)->value, &op, &left, &right)) {
+        return NULL;
+    }
+
+    SuperInstr *instr = (SuperInstr *)create_super(SUPER_RETURN_BINARY, node);
+    if (instr == NULL) {
+        return NULL;
+    }
+    instr->binary_op = op;
+    instr->left = left;
+    instr->right = right;
+    return (AstNode *)instr;
+}
+
+/**
+ * 用超级指令替换节点，返回替换的数量
+ */
+static int replace_node(AstNode **slot, AstNode *instr) {
+    if (instr == NULL) {
+        return 0;
+    }
+    *slot = instr;
+    return 1;
+}
+
+static int optimize_statement(AstNode **slot);
+
+/**
+ * 在表达式中查找匿名函数并优化其函数体
+ * @return 生成的超级指令数量
+ */
+static int optimize_expression(AstNode *node) {
+    if (node == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    switch (node->type) {
+        case NODE_BINARY:
+            count += optimize_expression(((BinaryExpr *)node)->left);
+            count += optimize_expression(((BinaryExpr *)node)->right);
+            break;
+        case NODE_UNARY:
+            count += optimize_expression(((UnaryExpr *)node)->operand);
+            break;
+        case NODE_GROUPING:
+            count += optimize_expression(((GroupingExpr *)node)->expr);
+            break;
+        case NODE_ASSIGN:
+            count += optimize_expression(((AssignExpr *)node)->value);
+            break;
+        case NODE_CALL: {
+            CallExpr *call = (CallExpr *)node;
+            for (int i = 0; i < call->arg_count; i++) {
+                count += optimize_expression(call->args[i]);
+            }
+            break;
+        }
+        case NODE_LAMBDA:
+            count += optimize_statement(&((LambdaExpr *)node)->body);
+            break;
+        default:
+            break;
+    }
+
+    return count;
+}
+
+/**
+ * 优化语句，可能原地替换*slot
+ * @return 生成的超级指令数量
+ */
+static int optimize_statement(AstNode **slot) {
+    AstNode *node = *slot;
+    if (node == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    switch (node->type) {
+        case NODE_PROGRAM:
+            if (ast_is_expression_stmt(node)) {
+                count += optimize_expression(((ExpressionStmt *)node)->expr);
+                count += replace_node(slot, match_update_local(node));
+            } else {
+                Program *program = (Program *)node;
+                for (int i = 0; i < program->stmt_count; i++) {
+                    count += optimize_statement(&program->statements[i]);
+                }
+            }
+            break;
+        case NODE_BLOCK: {
+            BlockStmt *block = (BlockStmt *)node;
+            for (int i = 0; i < block->stmt_count; i++) {
+                count += optimize_statement(&block->statements[i]);
+            }
+            break;
+        }
+        case NODE_VARDECL:
+            count += optimize_expression(((VarDeclStmt *)node)->initializer);
+            count += replace_node(slot, match_list_get_decl(node));
+            break;
+        case NODE_IF: {
+            IfStmt *stmt = (IfStmt *)node;
+            count += optimize_expression(stmt->condition);
+            count += replace_node(&stmt->condition, match_compare(stmt->condition));
+            count += optimize_statement(&stmt->then_branch);
+            count += optimize_statement(&stmt->else_branch);
+            break;
+        }
+        case NODE_LOOP: {
+            LoopStmt *stmt = (LoopStmt *)node;
+            count += optimize_expression(stmt->condition);
+            count += replace_node(&stmt->condition, match_compare(stmt->condition));
+            count += optimize_statement(&stmt->body);
+            break;
+        }
+        case NODE_FUNCDECL:
+            // 函数体在第一次调用时由optimizer_optimize_function优化
+            break;
+        case NODE_RETURN:
+            count += optimize_expression(((ReturnStmt *)node)->value);
+            count += replace_node(slot, match_return_binary(node));
+            break;
+        case NODE_PRINT:
+            count += optimize_expression(((PrintStmt *)node)->value);
+            break;
+        default:
+            break;
+    }
+
+    return count;
+}
+
+/**
+ * 打开或关闭优化
+ */
+void optimizer_set_enabled(bool enabled) {
+    optimizer_enabled = enabled;
+}
+
+/**
+ * 优化整棵语法树，在语法分析之后、执行之前调用
+ * @param root 程序节点
+ * @return 生成的超级指令数量
+ */
+int optimizer_optimize(AstNode *root) {
+    if (!optimizer_enabled || root == NULL || root->type != NODE_PROGRAM) {
+        return 0;
+    }
+
+    return optimize_statement(&root);
+}
+
+/**
+ * 优化函数体，解释器在函数第一次被调用时调用，
+ * 从未调用的函数不花费优化的时间
+ * @param body 函数体所在的位置
+ * @return 生成的超级指令数量
+ */
+int optimizer_optimize_function(AstNode **body) {
+    if (!optimizer_enabled) {
+        return 0;
+    }
+
+    return optimize_statement(body);
+}
+
+/**
+ * 立即优化程序中所有已经分析的函数体并做上标记，第一次调用时不再优化。
+ * 批处理模式在创建工作进程之前调用，优化过的函数体由所有工作进程共享
+ * @param root 程序节点
+ * @return 生成的超级指令数量
+ */
+int optimizer_optimize_function_bodies(AstNode *root) {
+    if (root == NULL || root->type != NODE_PROGRAM) {
+        return 0;
+    }
+
+    int count = 0;
+    Program *program = (Program *)root;
+    for (int i = 0; i < program->stmt_count; i++) {
+        AstNode *node = program->statements[i];
+        if (node == NULL || node->type != NODE_FUNCDECL) {
+            continue;
+        }
+        FunctionStmt *func = (FunctionStmt *)node;
+        if (func->body == NULL || func->optimized) {
+            continue;
+        }
+        if (optimizer_enabled) {
+            count += optimize_statement(&func->body);
+        }
+        func->optimized = true;
+    }
+    return count;
+}
@@ -8,6 +8,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// 并行分析函数体的最大线程数
+#define PARSE_MAX_THREADS 64
+
+// 函数体的标记总数少于此值时不值得创建线程
+#define PARSE_PARALLEL_MIN_TOKENS 8192
 
 /**
  * 语法分析器上下文
@@ -16,11 +24,14 @@ typedef struct {
     Token *tokens;           // 标记数组
     size_t token_count;      // 标记数量
     size_t current;          // 当前标记位置
+    bool lazy;               // 是否延迟分析函数体：先只匹配大括号记下函数体的标记范围，第一次调用前再完整分析
+    size_t *spans;           // 每条顶层语句的标记范围（起始、结束各一项），NULL表示不记录
+    size_t span_capacity;    // 标记范围数组的容量（语句数）
     KunyuError error;        // 错误信息
 } ParserContext;
 
-// 全局语法分析器上下文
-static ParserContext parser;
+// 语法分析器上下文，每个线程一份，以便并行分析函数体
+static __thread ParserContext parser;
 
 /**
  * 获取当前标记
@@ -131,14 +142,29 @@ static Token* expect_keyword(const char* keyword, const char* message) {
     return NULL;
 }
 
+/**
+ * 记录节点在源码中的位置
+ */
+static AstNode* set_position(AstNode* node, Token* token) {
+    if (node != NULL && token != NULL) {
+        node->line = token->line;
+        node->column = token->column;
+    }
+    return node;
+}
+
 // 前置声明解析函数
+static bool record_span(AstNode* program, size_t first);
 static AstNode* parse_expression();
 static AstNode* parse_statement();
 static AstNode* parse_print_stmt();
+static AstNode* parse_import_stmt();
 static AstNode* parse_var_decl();
 static AstNode* parse_if_stmt();
 static AstNode* parse_loop_stmt();
 static AstNode* parse_function_decl();
+static AstNode* parse_annotated_function();
+static AstNode* parse_lambda();
 static AstNode* parse_return_stmt();
 static AstNode* parse_block();
 static AstNode* parse_primary();
@@ -162,9 +188,14 @@ static AstNode* parse_program() {
     
     // 解析所有顶层语句
     while (parser.current < parser.token_count && !check(KUNYU_TOKEN_EOF)) {
+        size_t first = parser.current;
         AstNode* stmt = parse_statement();
         if (stmt != NULL) {
             program_add_statement(program, stmt);
+            if (parser.spans != NULL && !record_span(program, first)) {
+                ast_free(program);
+                return NULL;
+            }
         } else if (parser.error.code != KUNYU_OK) {
             // 发生错误
             ast_free(program);
@@ -178,6 +209,29 @@ static AstNode* parse_program() {
     return program;
 }
 
+/**
+ * 记录刚解析的顶层语句的标记范围
+ */
+static bool record_span(AstNode* program, size_t first) {
+    size_t count = (size_t)((Program*)program)->stmt_count;
+    if (count > parser.span_capacity) {
+        size_t new_capacity = parser.span_capacity * 2;
+        size_t* grown = (size_t*)realloc(parser.spans, sizeof(size_t) * 2 * new_capacity);
+        if (grown == NULL) {
+            parser.error.code = KUNYU_ERROR_MEMORY;
+            snprintf(parser.error.message, sizeof(parser.error.message), 
+                     "内存分配失败，无法记录语句的位置");
+            return false;
+        }
+        parser.spans = grown;
+        parser.span_capacity = new_capacity;
+    }
+    
+    parser.spans[2 * (count - 1)] = first;
+    parser.spans[2 * (count - 1) + 1] = parser.current;
+    return true;
+}
+
 /**
  * 解析一个语句
  */
@@ -206,12 +260,20 @@ static AstNode* parse_statement() {
     if (check_keyword("函数")) {
         return parse_function_decl();
     }
+    if (check(KUNYU_TOKEN_DELIMITER) && strcmp(current_token()->value, "@") == 0) {
+        return parse_annotated_function();
+    }
     
     // 尝试解析返回语句
     if (check_keyword("返回")) {
         return parse_return_stmt();
     }
     
+    // 尝试解析导入语句
+    if (check_keyword("导入")) {
+        return parse_import_stmt();
+    }
+    
     // 默认尝试解析表达式语句
     AstNode* expr = parse_expression();
     if (expr == NULL) {
@@ -219,7 +281,7 @@ static AstNode* parse_statement() {
     }
     
     // 表达式语句需要以分号结尾
-    if (!match(KUNYU_TOKEN_DELIMITER) || strcmp(current_token()->value, ";") != 0) {
+    if (!check(KUNYU_TOKEN_DELIMITER) || strcmp(current_token()->value, ";") != 0) {
         ast_free(expr);
         parser.error.code = KUNYU_ERROR_PARSER;
         Token* token = current_token();
@@ -258,7 +320,33 @@ static AstNode* parse_print_stmt() {
         return NULL;
     }
     
-    return create_print(expr);
+    return set_position(create_print(expr), keyword);
+}
+
+/**
+ * 解析导入语句 导入 "模块";
+ */
+static AstNode* parse_import_stmt() {
+    Token* keyword = advance(); // 跳过"导入"关键字
+    
+    Token* path = expect(KUNYU_TOKEN_STRING, "预期模块路径字符串");
+    if (path == NULL) {
+        return NULL;
+    }
+    
+    Token* semicolon = expect(KUNYU_TOKEN_DELIMITER, "预期';'作为导入语句的结束");
+    if (semicolon == NULL || strcmp(semicolon->value, ";") != 0) {
+        return NULL;
+    }
+    
+    AstNode* stmt = create_import(path->value);
+    if (stmt == NULL) {
+        parser.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(parser.error.message, sizeof(parser.error.message), 
+                 "内存分配失败，无法创建导入语句");
+        return NULL;
+    }
+    return set_position(stmt, keyword);
 }
 
 /**
@@ -267,7 +355,7 @@ static AstNode* parse_print_stmt() {
 static AstNode* parse_var_decl() {
     // 匹配 "变量" 或 "常量" 关键字
     bool is_constant = check_keyword("常量");
-    advance(); // 跳过变量/常量关键字
+    Token* keyword = advance(); // 跳过变量/常量关键字
     
     // 获取变量名
     Token* name = expect(KUNYU_TOKEN_IDENTIFIER, "预期变量名标识符");
@@ -294,7 +382,7 @@ static AstNode* parse_var_decl() {
         return NULL;
     }
     
-    return create_var_decl(name->value, initializer, is_constant);
+    return set_position(create_var_decl(name->value, initializer, is_constant), keyword);
 }
 
 /**
@@ -373,7 +461,7 @@ static AstNode* parse_if_stmt() {
         }
     }
     
-    return create_if(condition, then_branch, else_branch);
+    return set_position(create_if(condition, then_branch, else_branch), if_keyword);
 }
 
 /**
@@ -419,13 +507,16 @@ static AstNode* parse_loop_stmt() {
         return NULL;
     }
     
-    return create_loop(condition, body);
+    return set_position(create_loop(condition, body), loop_keyword);
 }
 
 /**
  * 解析代码块
  */
 static AstNode* parse_block() {
+    // 代码块从刚刚匹配的左大括号开始
+    Token* lbrace = parser.current > 0 ? &parser.tokens[parser.current - 1] : NULL;
+    
     // 跳过换行
     while (match(KUNYU_TOKEN_NEWLINE)) {}
     
@@ -493,29 +584,33 @@ static AstNode* parse_block() {
         return NULL;
     }
     
-    return create_block(statements, stmt_count);
+    // 代码块节点复制了语句数组
+    AstNode* block = create_block(statements, stmt_count);
+    free(statements);
+    return set_position(block, lbrace);
 }
 
 /**
- * 解析函数声明
+ * 释放参数名数组
  */
-static AstNode* parse_function_decl() {
-    // 匹配 "函数" 关键字
-    Token* func_keyword = expect_keyword("函数", "预期'函数'关键字");
-    if (func_keyword == NULL) {
-        return NULL;
-    }
-    
-    // 获取函数名
-    Token* name = expect(KUNYU_TOKEN_IDENTIFIER, "预期函数名标识符");
-    if (name == NULL) {
-        return NULL;
+static void free_params(char** params, int param_count) {
+    for (int i = 0; i < param_count; i++) {
+        free(params[i]);
     }
-    
+    free(params);
+}
+
+/**
+ * 解析参数列表 "(" [参数 {"," 参数}] ")" 和函数体开头的左大括号
+ * @param params 输出参数名数组
+ * @param param_count 输出参数数量
+ * @return 成功返回true
+ */
+static bool parse_params(char*** params_out, int* param_count_out) {
     // 匹配左括号 "("
     Token* lparen = expect(KUNYU_TOKEN_DELIMITER, "预期'('开始参数列表");
     if (lparen == NULL || strcmp(lparen->value, "(") != 0) {
-        return NULL;
+        return false;
     }
     
     // 解析参数列表
@@ -528,27 +623,20 @@ static AstNode* parse_function_decl() {
             // 获取参数名
             Token* param = expect(KUNYU_TOKEN_IDENTIFIER, "预期参数名标识符");
             if (param == NULL) {
-                // 释放已解析的参数
-                for (int i = 0; i < param_count; i++) {
-                    free(params[i]);
-                }
-                free(params);
-                return NULL;
+                free_params(params, param_count);
+                return false;
             }
             
             // 添加参数到数组
             char** new_params = (char**)realloc(params, sizeof(char*) * (param_count + 1));
             if (new_params == NULL) {
                 // 内存分配失败，释放已解析的参数
-                for (int i = 0; i < param_count; i++) {
-                    free(params[i]);
-                }
-                free(params);
+                free_params(params, param_count);
                 
                 parser.error.code = KUNYU_ERROR_MEMORY;
                 snprintf(parser.error.message, sizeof(parser.error.message), 
                          "内存分配失败，无法扩展参数数组");
-                return NULL;
+                return false;
             }
             
             params = new_params;
@@ -563,12 +651,8 @@ static AstNode* parse_function_decl() {
             // 否则，匹配逗号 ","
             Token* comma = expect(KUNYU_TOKEN_DELIMITER, "预期','分隔参数");
             if (comma == NULL || strcmp(comma->value, ",") != 0) {
-                // 释放已解析的参数
-                for (int i = 0; i < param_count; i++) {
-                    free(params[i]);
-                }
-                free(params);
-                return NULL;
+                free_params(params, param_count);
+                return false;
             }
         }
     }
@@ -576,37 +660,213 @@ static AstNode* parse_function_decl() {
     // 匹配右括号 ")"
     Token* rparen = expect(KUNYU_TOKEN_DELIMITER, "预期')'结束参数列表");
     if (rparen == NULL || strcmp(rparen->value, ")") != 0) {
-        // 释放已解析的参数
-        for (int i = 0; i < param_count; i++) {
-            free(params[i]);
-        }
-        free(params);
-        return NULL;
+        free_params(params, param_count);
+        return false;
     }
     
     // 匹配左大括号 "{"
     Token* lbrace = expect(KUNYU_TOKEN_DELIMITER, "预期'{'开始函数体");
     if (lbrace == NULL || strcmp(lbrace->value, "{") != 0) {
-        // 释放已解析的参数
-        for (int i = 0; i < param_count; i++) {
-            free(params[i]);
-        }
-        free(params);
+        free_params(params, param_count);
+        return false;
+    }
+    
+    *params_out = params;
+    *param_count_out = param_count;
+    return true;
+}
+
+/**
+ * 解析参数列表和函数体
+ * @return 函数体，失败返回NULL
+ */
+static AstNode* parse_params_and_body(char*** params_out, int* param_count_out) {
+    char** params = NULL;
+    int param_count = 0;
+    if (!parse_params(&params, &param_count)) {
         return NULL;
     }
     
-    // 解析函数体
     AstNode* body = parse_block();
     if (body == NULL) {
-        // 释放已解析的参数
-        for (int i = 0; i < param_count; i++) {
-            free(params[i]);
+        free_params(params, param_count);
+        return NULL;
+    }
+    
+    *params_out = params;
+    *param_count_out = param_count;
+    return body;
+}
+
+/**
+ * 跳过函数体，只匹配大括号。刚刚匹配的左大括号是函数体的开头
+ * @param count 输出函数体的标记数量（含两端的大括号）
+ * @return 函数体的第一个标记，大括号不匹配时返回NULL
+ */
+static Token* skip_function_body(size_t* count) {
+    size_t start = parser.current - 1;
+    int depth = 1;
+    
+    while (depth > 0) {
+        Token* token = current_token();
+        if (token == NULL || token->type == KUNYU_TOKEN_EOF) {
+            Token* lbrace = &parser.tokens[start];
+            parser.error.code = KUNYU_ERROR_PARSER;
+            parser.error.line = lbrace->line;
+            parser.error.column = lbrace->column;
+            snprintf(parser.error.message, sizeof(parser.error.message), 
+                     "函数体缺少匹配的'}'");
+            return NULL;
+        }
+        if (token->type == KUNYU_TOKEN_DELIMITER) {
+            if (strcmp(token->value, "{") == 0) {
+                depth++;
+            } else if (strcmp(token->value, "}") == 0) {
+                depth--;
+            }
+        }
+        advance();
+    }
+    
+    *count = parser.current - start;
+    return &parser.tokens[start];
+}
+
+/**
+ * 解析函数声明
+ */
+static AstNode* parse_function_decl() {
+    // 匹配 "函数" 关键字
+    Token* func_keyword = expect_keyword("函数", "预期'函数'关键字");
+    if (func_keyword == NULL) {
+        return NULL;
+    }
+    
+    // 获取函数名
+    Token* name = expect(KUNYU_TOKEN_IDENTIFIER, "预期函数名标识符");
+    if (name == NULL) {
+        return NULL;
+    }
+    
+    char** params = NULL;
+    int param_count = 0;
+    AstNode* func;
+    if (parser.lazy) {
+        if (!parse_params(&params, &param_count)) {
+            return NULL;
+        }
+        size_t body_token_count = 0;
+        Token* body_tokens = skip_function_body(&body_token_count);
+        if (body_tokens == NULL) {
+            free_params(params, param_count);
+            return NULL;
+        }
+        func = create_lazy_function(name->value, params, param_count, body_tokens, body_token_count);
+    } else {
+        AstNode* body = parse_params_and_body(&params, &param_count);
+        if (body == NULL) {
+            return NULL;
+        }
+        func = create_function(name->value, params, param_count, body);
+    }
+    free_params(params, param_count);
+    return set_position(func, func_keyword);
+}
+
+/**
+ * 在当前标记处报告语法错误
+ */
+static AstNode* annotation_error(const char* message, const char* name) {
+    Token* token = current_token();
+    parser.error.code = KUNYU_ERROR_PARSER;
+    parser.error.line = token ? token->line : 0;
+    parser.error.column = token ? token->column : 0;
+    snprintf(parser.error.message, sizeof(parser.error.message), message, name);
+    return NULL;
+}
+
+/**
+ * 解析带注解的函数声明，注解可以叠加：
+ *   @缓存 或 @缓存(结果数上限)  按参数缓存函数的返回值
+ *   @纯函数                    声明函数没有副作用，跳过纯度检查
+ */
+static AstNode* parse_annotated_function() {
+    size_t memo_capacity = 0;
+    bool assume_pure = false;
+    
+    while (check(KUNYU_TOKEN_DELIMITER) && strcmp(current_token()->value, "@") == 0) {
+        advance(); // 跳过"@"
+        Token* name = expect(KUNYU_TOKEN_IDENTIFIER, "预期注解名");
+        if (name == NULL) {
+            return NULL;
+        }
+        
+        if (strcmp(name->value, "缓存") == 0) {
+            memo_capacity = KUNYU_MEMO_DEFAULT_CAPACITY;
+            if (check(KUNYU_TOKEN_DELIMITER) && strcmp(current_token()->value, "(") == 0) {
+                advance();
+                Token* size = expect(KUNYU_TOKEN_INTEGER, "预期缓存的结果数上限");
+                if (size == NULL) {
+                    return NULL;
+                }
+                long long capacity = strtoll(size->value, NULL, 10);
+                if (capacity <= 0) {
+                    parser.current--;
+                    return annotation_error("缓存的结果数上限必须大于0: %s", size->value);
+                }
+                memo_capacity = (size_t)capacity;
+                if (!check(KUNYU_TOKEN_DELIMITER) || strcmp(current_token()->value, ")") != 0) {
+                    return annotation_error("%s", "预期')'");
+                }
+                advance();
+            }
+        } else if (strcmp(name->value, "纯函数") == 0) {
+            assume_pure = true;
+        } else {
+            parser.current--;
+            return annotation_error("未知的注解: @%s", name->value);
         }
-        free(params);
+        
+        // 注解可以单独占一行
+        while (match(KUNYU_TOKEN_NEWLINE)) {}
+    }
+    
+    if (!check_keyword("函数")) {
+        return annotation_error("%s", "注解后预期函数声明");
+    }
+    
+    AstNode* func = parse_function_decl();
+    if (func != NULL) {
+        ((FunctionStmt*)func)->memo_capacity = memo_capacity;
+        ((FunctionStmt*)func)->assume_pure = assume_pure;
+    }
+    return func;
+}
+
+/**
+ * 解析匿名函数 函数 (参数...) { ... }
+ */
+static AstNode* parse_lambda() {
+    Token* func_keyword = advance(); // 跳过"函数"关键字
+    
+    char** params = NULL;
+    int param_count = 0;
+    AstNode* body = parse_params_and_body(&params, &param_count);
+    if (body == NULL) {
+        return NULL;
+    }
+    
+    AstNode* lambda = create_lambda(params, param_count, body);
+    free_params(params, param_count);
+    if (lambda == NULL) {
+        ast_free(body);
+        parser.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(parser.error.message, sizeof(parser.error.message), 
+                 "内存分配失败，无法创建匿名函数节点");
         return NULL;
     }
     
-    return create_function(name->value, params, param_count, body);
+    return set_position(lambda, func_keyword);
 }
 
 /**
@@ -632,7 +892,7 @@ static AstNode* parse_return_stmt() {
         return NULL;
     }
     
-    return create_return(value);
+    return set_position(create_return(value), return_keyword);
 }
 
 /**
@@ -657,7 +917,7 @@ static AstNode* parse_expression() {
             
             // 注意：这里不需要检查分号，因为赋值表达式作为表达式语句的一部分，
             // 在parse_statement中已经处理了分号检查
-            return create_assign(name->value, value);
+            return set_position(create_assign(name->value, value), name);
         }
     }
     
@@ -823,7 +1083,10 @@ static AstNode* parse_function_call(const char* name) {
         return NULL;
     }
     
-    return create_call(name, args, arg_count);
+    // 调用节点复制了参数数组
+    AstNode* call = create_call(name, args, arg_count);
+    free(args);
+    return call;
 }
 
 /**
@@ -839,9 +1102,10 @@ static AstNode* parse_primary() {
     }
     
     // 处理字面量
-    if (token->type == KUNYU_TOKEN_NUMBER || token->type == KUNYU_TOKEN_STRING) {
+    if (token->type == KUNYU_TOKEN_NUMBER || token->type == KUNYU_TOKEN_INTEGER ||
+        token->type == KUNYU_TOKEN_STRING) {
         advance();
-        return create_literal(token->type, token->value);
+        return set_position(create_literal(token->type, token->value), token);
     }
     
     // 处理变量引用或函数调用
@@ -851,16 +1115,21 @@ static AstNode* parse_primary() {
         
         // 检查是否是函数调用
         if (check(KUNYU_TOKEN_DELIMITER) && strcmp(current_token()->value, "(") == 0) {
-            return parse_function_call(name);
+            return set_position(parse_function_call(name), token);
         }
         
         // 否则是变量引用
-        return create_variable(name);
+        return set_position(create_variable(name), token);
+    }
+    
+    // 处理匿名函数
+    if (check_keyword("函数")) {
+        return parse_lambda();
     }
     
     // 处理分组表达式
     if (token->type == KUNYU_TOKEN_DELIMITER && strcmp(token->value, "(") == 0) {
-        advance(); // 跳过左括号
+        Token* lparen = advance(); // 跳过左括号
         
         AstNode* expr = parse_expression();
         if (expr == NULL) {
@@ -874,7 +1143,7 @@ static AstNode* parse_primary() {
             return NULL;
         }
         
-        return create_grouping(expr);
+        return set_position(create_grouping(expr), lparen);
     }
     
     parser.error.code = KUNYU_ERROR_PARSER;
@@ -892,6 +1161,9 @@ static void parser_init(Token *tokens, size_t token_count) {
     parser.tokens = tokens;
     parser.token_count = token_count;
     parser.current = 0;
+    parser.lazy = true;
+    parser.spans = NULL;
+    parser.span_capacity = 0;
     parser.error.code = KUNYU_OK;
     parser.error.message[0] = '\0';
     parser.error.line = 0;
@@ -916,6 +1188,258 @@ struct AstNode* parser_parse(Token *tokens, size_t token_count) {
     return parse_program();
 }
 
+/**
+ * 分析延迟分析的函数体，结果存入函数声明节点。
+ * 错误信息和平常一样通过parser_get_error获取，行列号指向源文件中的位置
+ * @param function 函数声明节点
+ * @return 函数体，函数体已经分析过时直接返回，失败返回NULL
+ */
+struct AstNode* parser_parse_function_body(struct AstNode *function) {
+    FunctionStmt *stmt = (FunctionStmt *)function;
+    if (stmt->body != NULL || stmt->body_tokens == NULL) {
+        return stmt->body;
+    }
+    
+    // 函数体可能在分析其他代码时被调用（例如导入模块），保存当前的分析位置
+    Token *saved_tokens = parser.tokens;
+    size_t saved_count = parser.token_count;
+    size_t saved_current = parser.current;
+    bool saved_lazy = parser.lazy;
+    
+    // 从左大括号之后开始，parse_block以左大括号作为代码块的位置
+    parser_init(stmt->body_tokens, stmt->body_token_count);
+    parser.current = 1;
+    AstNode *body = parse_block();
+    
+    parser.tokens = saved_tokens;
+    parser.token_count = saved_count;
+    parser.current = saved_current;
+    parser.lazy = saved_lazy;
+    
+    if (body != NULL) {
+        stmt->body = body;
+        stmt->body_tokens = NULL;
+        stmt->body_token_count = 0;
+    }
+    return body;
+}
+
+/**
+ * 并行分析函数体的任务
+ */
+typedef struct {
+    FunctionStmt **functions;    // 待分析的函数，按源码顺序排列
+    size_t count;                // 函数数量
+    size_t next;                 // 下一个待分析的函数
+    size_t first_error;          // 最早出错的函数序号，等于count表示没有错误
+    KunyuError error;            // 最早的错误
+    pthread_mutex_t lock;
+} BodyParseJobs;
+
+/**
+ * 收集尚未分析函数体的函数。函数体之外只有代码块、条件和循环语句中能出现函数声明
+ */
+static bool collect_lazy_functions(AstNode *node, FunctionStmt ***functions, size_t *count,
+                                   size_t *capacity, size_t *token_total) {
+    if (node == NULL) {
+        return true;
+    }
+    
+    switch (node->type) {
+        case NODE_PROGRAM: {
+            if (ast_is_expression_stmt(node)) {
+                return true;
+            }
+            Program *program = (Program *)node;
+            for (int i = 0; i < program->stmt_count; i++) {
+                if (!collect_lazy_functions(program->statements[i], functions, count, capacity, token_total)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NODE_BLOCK: {
+            BlockStmt *block = (BlockStmt *)node;
+            for (int i = 0; i < block->stmt_count; i++) {
+                if (!collect_lazy_functions(block->statements[i], functions, count, capacity, token_total)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NODE_IF: {
+            IfStmt *stmt = (IfStmt *)node;
+            return collect_lazy_functions(stmt->then_branch, functions, count, capacity, token_total) &&
+                   collect_lazy_functions(stmt->else_branch, functions, count, capacity, token_total);
+        }
+        case NODE_LOOP:
+            return collect_lazy_functions(((LoopStmt *)node)->body, functions, count, capacity, token_total);
+        case NODE_FUNCDECL: {
+            FunctionStmt *stmt = (FunctionStmt *)node;
+            if (stmt->body_tokens == NULL) {
+                return true;
+            }
+            if (*count == *capacity) {
+                size_t new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+                FunctionStmt **grown = (FunctionStmt **)realloc(*functions, sizeof(FunctionStmt *) * new_capacity);
+                if (grown == NULL) {
+                    return false;
+                }
+                *functions = grown;
+                *capacity = new_capacity;
+            }
+            (*functions)[(*count)++] = stmt;
+            *token_total += stmt->body_token_count;
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+/**
+ * 分析线程：依次领取函数完整地分析函数体（内部的函数声明也立即分析）
+ */
+static void* parse_bodies_worker(void *arg) {
+    BodyParseJobs *jobs = (BodyParseJobs *)arg;
+    
+    while (true) {
+        pthread_mutex_lock(&jobs->lock);
+        size_t index = jobs->next++;
+        // 已经有更早的函数出错时，后面的函数不影响报告的错误
+        bool done = index >= jobs->count || index > jobs->first_error;
+        pthread_mutex_unlock(&jobs->lock);
+        if (done) {
+            break;
+        }
+        
+        FunctionStmt *stmt = jobs->functions[index];
+        parser_init(stmt->body_tokens, stmt->body_token_count);
+        parser.lazy = false;
+        parser.current = 1;
+        AstNode *body = parse_block();
+        if (body != NULL) {
+            stmt->body = body;
+            stmt->body_tokens = NULL;
+            stmt->body_token_count = 0;
+            continue;
+        }
+        
+        pthread_mutex_lock(&jobs->lock);
+        if (index < jobs->first_error) {
+            jobs->first_error = index;
+            jobs->error = parser.error;
+        }
+        pthread_mutex_unlock(&jobs->lock);
+    }
+    
+    return NULL;
+}
+
+/**
+ * 完整分析所有延迟分析的函数体，函数体足够多时在多个线程上并行分析。
+ * 每个函数体的节点由分析它的线程分配，分析完按源码顺序挂回各自的函数声明；
+ * 有多个函数出错时报告源码中最早的那个，与线程数无关
+ * @param program 程序节点
+ * @param threads 线程数，0表示使用所有处理器
+ * @return 成功返回true，失败时错误信息通过parser_get_error获取
+ */
+bool parser_parse_function_bodies(struct AstNode *program, int threads) {
+    FunctionStmt **functions = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t token_total = 0;
+    
+    if (!collect_lazy_functions(program, &functions, &count, &capacity, &token_total)) {
+        free(functions);
+        parser.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(parser.error.message, sizeof(parser.error.message), 
+                 "内存分配失败，无法收集函数声明");
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+    
+    BodyParseJobs jobs;
+    jobs.functions = functions;
+    jobs.count = count;
+    jobs.next = 0;
+    jobs.first_error = count;
+    pthread_mutex_init(&jobs.lock, NULL);
+    
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > PARSE_MAX_THREADS) {
+        threads = PARSE_MAX_THREADS;
+    }
+    if ((size_t)threads > count) {
+        threads = (int)count;
+    }
+    if (token_total < PARSE_PARALLEL_MIN_TOKENS) {
+        threads = 1;
+    }
+    
+    // 当前线程也参与分析，线程创建失败时由其余线程完成
+    pthread_t workers[PARSE_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, parse_bodies_worker, &jobs) == 0) {
+            started++;
+        }
+    }
+    
+    ParserContext saved = parser;
+    parse_bodies_worker(&jobs);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    parser = saved;
+    
+    bool success = jobs.first_error == count;
+    if (!success) {
+        parser.error = jobs.error;
+    }
+    
+    pthread_mutex_destroy(&jobs.lock);
+    free(functions);
+    return success;
+}
+
+/**
+ * 解析标记流，并记录每条顶层语句占用的标记范围，供增量分析使用
+ * @param spans 输出标记范围数组，第i条语句占用标记[spans[2i], spans[2i+1])，使用后需要释放
+ * @return AST根节点，失败返回NULL
+ */
+struct AstNode* parser_parse_spans(Token *tokens, size_t token_count, size_t **spans) {
+    *spans = NULL;
+    if (tokens == NULL || token_count == 0) {
+        return NULL;
+    }
+    
+    parser_init(tokens, token_count);
+    parser.span_capacity = 16;
+    parser.spans = (size_t *)malloc(sizeof(size_t) * 2 * parser.span_capacity);
+    if (parser.spans == NULL) {
+        parser.error.code = KUNYU_ERROR_MEMORY;
+        snprintf(parser.error.message, sizeof(parser.error.message), 
+                 "内存分配失败，无法记录语句的位置");
+        return NULL;
+    }
+    
+    AstNode *program = parse_program();
+    if (program == NULL) {
+        free(parser.spans);
+    } else {
+        *spans = parser.spans;
+    }
+    parser.spans = NULL;
+    parser.span_capacity = 0;
+    return program;
+}
+
 /**
  * 获取语法分析器错误信息
  */
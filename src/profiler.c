@@ -0,0 +1,447 @@
+/**
+ * 坤舆编程语言 - 采样性能分析器
+ * 通过SIGPROF定时采样当前执行的节点和坤舆调用栈，
+ * 输出按函数和按行统计的报告，以及火焰图工具可用的折叠栈文件
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define PROFILER_MAX_FRAMES 64        // 每个样本最多记录的帧数
+#define PROFILER_TABLE_SIZE 8192      // 不同调用栈的最大数量，必须是2的幂
+#define PROFILER_MAX_PROBES 64        // 哈希表冲突时的最大探测次数
+#define PROFILER_TOP_NAME "<主程序>"   // 顶层代码的帧名
+#define PROFILER_TRUNCATED_NAME "<已截断>"
+
+/**
+ * 一个不同的调用栈及其样本数
+ */
+typedef struct {
+    uint64_t hash;                            // 调用栈哈希值
+    long count;                               // 样本数，0表示空槽
+    int depth;                                // 帧数
+    const char *names[PROFILER_MAX_FRAMES];   // 函数名，下标0为最外层
+    int lines[PROFILER_MAX_FRAMES];           // 每一帧正在执行的行号
+} ProfileStack;
+
+/**
+ * 按函数统计
+ */
+typedef struct {
+    const char *name;        // 函数名
+    long self_count;         // 位于栈顶的样本数
+    long total_count;        // 出现在栈中的样本数
+} FunctionStat;
+
+/**
+ * 按行统计
+ */
+typedef struct {
+    const char *name;        // 所在函数
+    int line;                // 行号
+    long count;              // 样本数
+} LineStat;
+
+/**
+ * 分析器上下文
+ */
+typedef struct {
+    ProfileStack *stacks;            // 调用栈哈希表
+    volatile long sample_count;      // 总样本数
+    volatile long dropped_count;     // 因哈希表已满而丢弃的样本数
+    int interval_us;                 // 采样间隔（微秒）
+    bool running;                    // 是否正在采样
+#ifndef _WIN32
+    struct sigaction old_action;     // 原有的SIGPROF处理函数
+#endif
+} ProfilerContext;
+
+// 全局分析器上下文
+static ProfilerContext profiler;
+
+/**
+ * 计算调用栈哈希值（FNV-1a）
+ */
+static uint64_t hash_stack(const char **names, const int *lines, int depth) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < depth; i++) {
+        hash ^= (uint64_t)(uintptr_t)names[i];
+        hash *= 1099511628211ULL;
+        hash ^= (uint64_t)lines[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * 判断哈希表中的调用栈是否与样本相同
+ */
+static bool stack_equals(const ProfileStack *stack, const char **names, const int *lines, int depth) {
+    if (stack->depth != depth) {
+        return false;
+    }
+    for (int i = 0; i < depth; i++) {
+        if (stack->names[i] != names[i] || stack->lines[i] != lines[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 记录一个样本
+ * 在信号处理函数中调用，不能分配内存
+ */
+static void record_sample() {
+    const char *names[PROFILER_MAX_FRAMES];
+    int lines[PROFILER_MAX_FRAMES];
+
+    int call_depth = 0;
+    const CallFrame *frames = interpreter_get_call_stack(&call_depth);
+    const AstNode *node = interpreter_current_node();
+    int current_line = node != NULL ? node->line : 0;
+
+    // 顶层代码加上每一层调用，超过上限时保留最内层的帧
+    int total = call_depth + 1;
+    int first = 0;
+    int depth = 0;
+    if (total > PROFILER_MAX_FRAMES) {
+        first = total - (PROFILER_MAX_FRAMES - 1);
+        names[depth] = PROFILER_TRUNCATED_NAME;
+        lines[depth] = 0;
+        depth++;
+    }
+
+    for (int i = first; i < total; i++) {
+        // 第i帧正在执行的行：内层调用的调用位置，最内层为当前节点
+        int line = current_line;
+        if (i < call_depth) {
+            const AstNode *call_site = frames[i].call_site;
+            line = call_site != NULL ? call_site->line : 0;
+        }
+        names[depth] = i == 0 ? PROFILER_TOP_NAME : frames[i - 1].name;
+        lines[depth] = line;
+        depth++;
+    }
+
+    uint64_t hash = hash_stack(names, lines, depth);
+    size_t index = (size_t)hash & (PROFILER_TABLE_SIZE - 1);
+
+    for (int probe = 0; probe < PROFILER_MAX_PROBES; probe++) {
+        ProfileStack *stack = &profiler.stacks[index];
+
+        if (stack->count == 0) {
+            // 空槽，记录新的调用栈
+            stack->hash = hash;
+            stack->depth = depth;
+            memcpy(stack->names, names, sizeof(const char *) * depth);
+            memcpy(stack->lines, lines, sizeof(int) * depth);
+            stack->count = 1;
+            profiler.sample_count++;
+            return;
+        }
+
+        if (stack->hash == hash && stack_equals(stack, names, lines, depth)) {
+            stack->count++;
+            profiler.sample_count++;
+            return;
+        }
+
+        index = (index + 1) & (PROFILER_TABLE_SIZE - 1);
+    }
+
+    profiler.dropped_count++;
+}
+
+#ifndef _WIN32
+/**
+ * SIGPROF信号处理函数
+ */
+static void profiler_signal_handler(int sig) {
+    (void)sig;
+    if (profiler.stacks != NULL) {
+        record_sample();
+    }
+}
+#endif
+
+/**
+ * 开始采样
+ * @param interval_us 采样间隔（微秒）
+ * @return 成功返回true
+ */
+bool profiler_start(int interval_us) {
+#ifdef _WIN32
+    (void)interval_us;
+    fprintf(stderr, "警告: 当前平台不支持采样性能分析\n");
+    return false;
+#else
+    if (profiler.running) {
+        return true;
+    }
+
+    if (interval_us <= 0) {
+        interval_us = 1000;
+    }
+
+    free(profiler.stacks);
+    profiler.stacks = (ProfileStack *)calloc(PROFILER_TABLE_SIZE, sizeof(ProfileStack));
+    if (profiler.stacks == NULL) {
+        fprintf(stderr, "错误: 内存分配失败，无法启动性能分析\n");
+        return false;
+    }
+    profiler.sample_count = 0;
+    profiler.dropped_count = 0;
+    profiler.interval_us = interval_us;
+
+    // 安装信号处理函数
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = profiler_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &profiler.old_action) != 0) {
+        fprintf(stderr, "错误: 无法安装SIGPROF信号处理函数\n");
+        return false;
+    }
+
+    // 按进程CPU时间定时
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        sigaction(SIGPROF, &profiler.old_action, NULL);
+        fprintf(stderr, "错误: 无法设置采样定时器\n");
+        return false;
+    }
+
+    profiler.running = true;
+    return true;
+#endif
+}
+
+/**
+ * 停止采样
+ */
+void profiler_stop() {
+#ifndef _WIN32
+    if (!profiler.running) {
+        return;
+    }
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &profiler.old_action, NULL);
+
+    profiler.running = false;
+#endif
+}
+
+/**
+ * 查找或添加函数统计项
+ */
+static FunctionStat* find_function_stat(FunctionStat **stats, int *count, int *capacity, const char *name) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp((*stats)[i].name, name) == 0) {
+            return &(*stats)[i];
+        }
+    }
+
+    if (*count >= *capacity) {
+        int new_capacity = *capacity == 0 ? 32 : *capacity * 2;
+        FunctionStat *new_stats = (FunctionStat *)realloc(*stats, sizeof(FunctionStat) * new_capacity);
+        if (new_stats == NULL) {
+            return NULL;
+        }
+        *stats = new_stats;
+        *capacity = new_capacity;
+    }
+
+    FunctionStat *stat = &(*stats)[(*count)++];
+    stat->name = name;
+    stat->self_count = 0;
+    stat->total_count = 0;
+    return stat;
+}
+
+/**
+ * 查找或添加行统计项
+ */
+static LineStat* find_line_stat(LineStat **stats, int *count, int *capacity, const char *name, int line) {
+    for (int i = 0; i < *count; i++) {
+        if ((*stats)[i].line == line && strcmp((*stats)[i].name, name) == 0) {
+            return &(*stats)[i];
+        }
+    }
+
+    if (*count >= *capacity) {
+        int new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+        LineStat *new_stats = (LineStat *)realloc(*stats, sizeof(LineStat) * new_capacity);
+        if (new_stats == NULL) {
+            return NULL;
+        }
+        *stats = new_stats;
+        *capacity = new_capacity;
+    }
+
+    LineStat *stat = &(*stats)[(*count)++];
+    stat->name = name;
+    stat->line = line;
+    stat->count = 0;
+    return stat;
+}
+
+/**
+ * 比较函数：按自身样本数降序
+ */
+static int compare_function_stat(const void *a, const void *b) {
+    const FunctionStat *x = (const FunctionStat *)a;
+    const FunctionStat *y = (const FunctionStat *)b;
+    if (x->self_count != y->self_count) {
+        return x->self_count < y->self_count ? 1 : -1;
+    }
+    return x->total_count < y->total_count ? 1 : (x->total_count > y->total_count ? -1 : 0);
+}
+
+/**
+ * 比较函数：按样本数降序
+ */
+static int compare_line_stat(const void *a, const void *b) {
+    const LineStat *x = (const LineStat *)a;
+    const LineStat *y = (const LineStat *)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->line - y->line;
+}
+
+/**
+ * 计算百分比
+ */
+static double percent(long count, long total) {
+    return total > 0 ? count * 100.0 / total : 0;
+}
+
+/**
+ * 输出按函数和按行统计的报告
+ * @param out 输出流
+ */
+void profiler_report(FILE *out) {
+    if (profiler.stacks == NULL) {
+        return;
+    }
+
+    FunctionStat *functions = NULL;
+    int function_count = 0, function_capacity = 0;
+    LineStat *lines = NULL;
+    int line_count = 0, line_capacity = 0;
+
+    for (int i = 0; i < PROFILER_TABLE_SIZE; i++) {
+        ProfileStack *stack = &profiler.stacks[i];
+        if (stack->count == 0) {
+            continue;
+        }
+
+        // 栈顶函数和当前行计入自身样本
+        int top = stack->depth - 1;
+        FunctionStat *self = find_function_stat(&functions, &function_count, &function_capacity, stack->names[top]);
+        if (self != NULL) {
+            self->self_count += stack->count;
+        }
+        LineStat *line = find_line_stat(&lines, &line_count, &line_capacity, stack->names[top], stack->lines[top]);
+        if (line != NULL) {
+            line->count += stack->count;
+        }
+
+        // 栈中出现的每个函数计入总样本，递归调用只计一次
+        for (int j = 0; j < stack->depth; j++) {
+            bool seen = false;
+            for (int k = 0; k < j; k++) {
+                if (strcmp(stack->names[k], stack->names[j]) == 0) {
+                    seen = true;
+                    break;
+                }
+            }
+            if (seen) {
+                continue;
+            }
+            FunctionStat *stat = find_function_stat(&functions, &function_count, &function_capacity, stack->names[j]);
+            if (stat != NULL) {
+                stat->total_count += stack->count;
+            }
+        }
+    }
+
+    qsort(functions, function_count, sizeof(FunctionStat), compare_function_stat);
+    qsort(lines, line_count, sizeof(LineStat), compare_line_stat);
+
+    long total = profiler.sample_count;
+    fprintf(out, "\n=== 性能分析报告 ===\n");
+    fprintf(out, "采样间隔: %d 微秒，样本数: %ld", profiler.interval_us, total);
+    if (profiler.dropped_count > 0) {
+        fprintf(out, "，丢弃: %ld", profiler.dropped_count);
+    }
+    fprintf(out, "\n\n");
+
+    fprintf(out, "%-24s %10s %8s %10s %8s\n", "函数", "自身样本", "自身%", "总样本", "总%");
+    for (int i = 0; i < function_count; i++) {
+        fprintf(out, "%-24s %10ld %7.2f%% %10ld %7.2f%%\n",
+                functions[i].name,
+                functions[i].self_count, percent(functions[i].self_count, total),
+                functions[i].total_count, percent(functions[i].total_count, total));
+    }
+
+    fprintf(out, "\n%-24s %8s %10s %8s\n", "函数", "行", "样本", "%");
+    for (int i = 0; i < line_count; i++) {
+        fprintf(out, "%-24s %8d %10ld %7.2f%%\n",
+                lines[i].name, lines[i].line, lines[i].count, percent(lines[i].count, total));
+    }
+    fprintf(out, "\n");
+
+    free(functions);
+    free(lines);
+}
+
+/**
+ * 输出折叠栈文件
+ * 每行格式为"帧;帧;帧 样本数"，帧为"函数名:行号"，可直接交给flamegraph.pl等工具
+ * @param filename 输出文件名
+ * @return 成功返回true
+ */
+bool profiler_write_collapsed(const char *filename) {
+    if (profiler.stacks == NULL) {
+        return false;
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "错误: 无法写入文件 '%s'\n", filename);
+        return false;
+    }
+
+    for (int i = 0; i < PROFILER_TABLE_SIZE; i++) {
+        ProfileStack *stack = &profiler.stacks[i];
+        if (stack->count == 0) {
+            continue;
+        }
+
+        for (int j = 0; j < stack->depth; j++) {
+            fprintf(file, "%s%s:%d", j > 0 ? ";" : "", stack->names[j], stack->lines[j]);
+        }
+        fprintf(file, " %ld\n", stack->count);
+    }
+
+    fclose(file);
+    return true;
+}
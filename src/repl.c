@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -22,6 +23,13 @@
 // 存储上下文的全局状态
 static bool repl_initialized = false;
 
+// 会话中输入过的所有语句。函数声明和之后的调用都引用其中的语法树，
+// 每次输入追加到末尾，只有新追加的语句会被分析
+static KunyuDocument *session = NULL;
+
+// 已经执行过的顶层语句数
+static int executed_count = 0;
+
 /**
  * 设置控制台支持UTF-8输出
  */
@@ -75,6 +83,48 @@ static void print_object(PyObject *obj) {
     }
 }
 
+/**
+ * 把一条输入追加到会话文档末尾
+ */
+static bool append_to_session(const char *statement) {
+    if (session == NULL) {
+        session = document_new("");
+        if (session == NULL) {
+            fprintf(stderr, "错误: 内存分配失败\n");
+            return false;
+        }
+    }
+    
+    char *text = (char *)malloc(strlen(statement) + 2);
+    if (text == NULL) {
+        fprintf(stderr, "错误: 内存分配失败\n");
+        return false;
+    }
+    sprintf(text, "%s\n", statement);
+    
+    size_t length = strlen(document_source(session));
+    bool appended = document_edit(session, length, length, text);
+    free(text);
+    
+    int first;
+    document_changed(session, &first);
+    if (!appended || first < executed_count) {
+        // 输入已经单独检查过，正常情况下不会走到这里；之前的语句被重新分析后函数表中的声明已失效
+        if (!appended) {
+            KunyuError *error = document_error(session);
+            fprintf(stderr, "语法分析错误: %s (行 %d, 列 %d)\n", 
+                    error->message, error->line, error->column);
+        }
+        fprintf(stderr, "错误: 会话需要重新开始，之前定义的变量和函数已清空\n");
+        interpreter_cleanup();
+        document_free(session);
+        session = NULL;
+        executed_count = 0;
+        return false;
+    }
+    return true;
+}
+
 /**
  * 执行表达式并打印结果
  */
@@ -95,6 +145,7 @@ static bool execute_and_print(const char *source) {
         lexer_free();
         return false;
     }
+    tokens = lexer_get_tokens();
     
     // 判断输入是否为表达式或语句
     bool is_expression = false;
@@ -118,17 +169,24 @@ static bool execute_and_print(const char *source) {
             }
         }
         
-        // 如果没有分号结尾，认为是表达式（简化处理）
-        if (i == token_count - 1 && 
-            !(token->type == KUNYU_TOKEN_DELIMITER && strcmp(token->value, ";") == 0)) {
-            is_expression = true;
-        }
+    }
+    
+    // 如果不以分号或右大括号（函数、条件、循环）结尾，认为是表达式（简化处理）
+    int last = token_count - 1;
+    while (last >= 0 && (tokens[last].type == KUNYU_TOKEN_EOF || tokens[last].type == KUNYU_TOKEN_NEWLINE)) {
+        last--;
+    }
+    if (last >= 0 && !(tokens[last].type == KUNYU_TOKEN_DELIMITER &&
+                       (strcmp(tokens[last].value, ";") == 0 || strcmp(tokens[last].value, "}") == 0))) {
+        is_expression = true;
     }
     
     // 如果是表达式，添加输出语句
+    const char *statement = source;
+    char *new_source = NULL;
     if (is_expression) {
         // 创建新的源代码，添加输出语句
-        char *new_source = (char *)malloc(strlen(source) + 10);
+        new_source = (char *)malloc(strlen(source) + 10);
         if (new_source == NULL) {
             fprintf(stderr, "错误: 内存分配失败\n");
             lexer_free();
@@ -155,12 +213,19 @@ static bool execute_and_print(const char *source) {
             free(new_source);
             return false;
         }
+        tokens = lexer_get_tokens();
         
-        free(new_source);
+        statement = new_source;
     }
     
-    // 语法分析
+    // 先单独分析这次的输入（包括函数体），有错误时不加入会话
+    size_t detached_count;
+    tokens = lexer_detach_tokens(&detached_count);
     AstNode *ast = parser_parse(tokens, token_count);
+    if (ast != NULL && !parser_parse_function_bodies(ast, 1)) {
+        ast_free(ast);
+        ast = NULL;
+    }
     if (ast == NULL) {
         KunyuError *error = parser_get_error();
         if (error->code != KUNYU_OK) {
@@ -169,24 +234,31 @@ static bool execute_and_print(const char *source) {
         } else {
             fprintf(stderr, "错误: 语法分析失败，无法生成AST\n");
         }
-        lexer_free();
+        lexer_free_tokens(tokens, detached_count);
+        free(new_source);
+        return false;
+    }
+    ast_free(ast);
+    lexer_free_tokens(tokens, detached_count);
+    
+    bool appended = append_to_session(statement);
+    free(new_source);
+    if (!appended) {
         return false;
     }
     
-    // 执行程序
-    if (!interpreter_execute(ast)) {
+    // 在保留的全局状态中执行新追加的语句
+    AstNode *program = document_ast(session);
+    int total = ((Program *)program)->stmt_count;
+    int first = executed_count;
+    executed_count = total;
+    if (!interpreter_execute_statements(program, first, total - first)) {
         KunyuError *error = interpreter_get_error();
         fprintf(stderr, "运行时错误: %s (行 %d, 列 %d)\n", 
                 error->message, error->line, error->column);
-        ast_free(ast);
-        lexer_free();
         return false;
     }
     
-    // 释放资源
-    ast_free(ast);
-    lexer_free();
-    
     return true;
 }
 
@@ -272,4 +344,10 @@ void repl_start() {
         
         free(input);
     }
+    
+    // 函数表引用会话的语法树，先清理解释器再释放会话
+    interpreter_cleanup();
+    document_free(session);
+    session = NULL;
+    executed_count = 0;
 } 
\ No newline at end of file
@@ -0,0 +1,614 @@
+/**
+ * 坤舆编程语言 - 服务模式
+ * 常驻进程在Unix域套接字上接受请求，每行一个JSON对象：
+ *   {"script": "脚本路径", "function": "函数名", "args": [参数...]}
+ * 每个请求在全新的全局作用域中执行脚本的顶层语句，给出函数名时再调用该函数，
+ * 回复一行JSON：{"ok": true, "result": 返回值, "output": "输出"}，出错时为
+ * {"ok": false, "error": "错误信息", "output": "输出"}。
+ * 脚本和导入的模块只在第一次用到或源文件改变后分析一次，函数体只优化一次，
+ * 之后的请求不再经过词法分析和语法分析。请求按到达顺序逐个执行。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define SERVER_MAX_CLIENTS 64
+#define SERVER_MAX_REQUEST (16 * 1024 * 1024)
+#define SERVER_READ_CHUNK 65536
+
+/**
+ * 分析过的脚本
+ */
+typedef struct CachedScript {
+    char *path;                     // 规范化的绝对路径
+    AstNode *ast;                   // 优化过的语法树，函数体已全部分析
+    struct timespec mtime;          // 分析时源文件的修改时间
+    off_t size;                     // 分析时源文件的大小
+    struct CachedScript *next;
+} CachedScript;
+
+/**
+ * 客户端连接
+ */
+typedef struct {
+    int fd;                         // 套接字，-1表示空闲
+    char *buffer;                   // 尚未处理完的请求数据
+    size_t length;                  // 数据字节数
+    size_t capacity;                // 缓冲区容量
+} Client;
+
+// 分析过的脚本
+static CachedScript *scripts = NULL;
+
+// 收到SIGINT或SIGTERM后置位
+static volatile sig_atomic_t stopping = 0;
+
+// 收集脚本输出的临时文件
+static FILE *capture_file = NULL;
+
+/**
+ * 信号处理函数：停止服务
+ */
+static void handle_stop_signal(int signal_number) {
+    (void)signal_number;
+    stopping = 1;
+}
+
+/**
+ * 读取源文件
+ */
+static char* read_source(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *buffer = (char *)malloc(capacity);
+    while (buffer != NULL) {
+        length += fread(buffer + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = (char *)realloc(buffer, capacity);
+        if (grown == NULL) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+    fclose(file);
+
+    if (buffer != NULL) {
+        buffer[length] = '\0';
+    }
+    return buffer;
+}
+
+/**
+ * 分析脚本，函数体全部立即分析，语法树不再引用标记
+ */
+static AstNode* parse_script(const char *path, char *error, size_t error_size) {
+    char *source = read_source(path);
+    if (source == NULL) {
+        snprintf(error, error_size, "无法读取脚本'%s'", path);
+        return NULL;
+    }
+
+    size_t error_offset;
+    if (!utf8_validate(source, strlen(source), &error_offset)) {
+        snprintf(error, error_size, "脚本'%s'不是有效的UTF-8编码（第%zu字节）", path, error_offset + 1);
+        free(source);
+        return NULL;
+    }
+
+    AstNode *ast = NULL;
+    if (lexer_init(source) == NULL) {
+        snprintf(error, error_size, "内存分配失败，无法初始化词法分析器");
+    } else {
+        int token_count = lexer_tokenize();
+        if (token_count < 0) {
+            KunyuError *lexer_error = lexer_get_error();
+            snprintf(error, error_size, "词法分析错误: %s (行 %d, 列 %d)",
+                     lexer_error->message, lexer_error->line, lexer_error->column);
+        } else {
+            size_t detached_count;
+            Token *tokens = lexer_detach_tokens(&detached_count);
+            ast = parser_parse(tokens, token_count);
+            if (ast != NULL && !parser_parse_function_bodies(ast, 0)) {
+                ast_free(ast);
+                ast = NULL;
+            }
+            if (ast == NULL) {
+                KunyuError *parser_error = parser_get_error();
+                snprintf(error, error_size, "语法分析错误: %s (行 %d, 列 %d)",
+                         parser_error->message, parser_error->line, parser_error->column);
+            }
+            lexer_free_tokens(tokens, detached_count);
+        }
+    }
+    lexer_free();
+    free(source);
+
+    if (ast != NULL) {
+        optimizer_optimize(ast);
+    }
+    return ast;
+}
+
+/**
+ * 查找或分析脚本。源文件改变过时重新分析，解释器在请求之间已经清理，旧的语法树可以直接释放
+ * @return 脚本，出错返回NULL
+ */
+static CachedScript* load_script(const char *name, char *error, size_t error_size) {
+    char *path = realpath(name, NULL);
+    struct stat info;
+    if (path == NULL || stat(path, &info) != 0) {
+        snprintf(error, error_size, "找不到脚本'%s'", name);
+        free(path);
+        return NULL;
+    }
+
+    CachedScript *script = scripts;
+    while (script != NULL && strcmp(script->path, path) != 0) {
+        script = script->next;
+    }
+    if (script != NULL) {
+        free(path);
+        if (info.st_size == script->size &&
+            info.st_mtim.tv_sec == script->mtime.tv_sec && info.st_mtim.tv_nsec == script->mtime.tv_nsec) {
+            return script;
+        }
+        ast_free(script->ast);
+        script->ast = NULL;
+    } else {
+        script = (CachedScript *)calloc(1, sizeof(CachedScript));
+        if (script == NULL) {
+            snprintf(error, error_size, "内存分配失败，无法缓存脚本");
+            free(path);
+            return NULL;
+        }
+        script->path = path;
+        script->next = scripts;
+        scripts = script;
+    }
+
+    // 分析失败时不记录修改时间，下一次请求重新分析
+    script->ast = parse_script(script->path, error, error_size);
+    if (script->ast == NULL) {
+        script->size = -1;
+        return NULL;
+    }
+    script->mtime = info.st_mtim;
+    script->size = info.st_size;
+    return script;
+}
+
+/**
+ * 释放所有脚本
+ */
+static void free_scripts() {
+    while (scripts != NULL) {
+        CachedScript *next = scripts->next;
+        ast_free(scripts->ast);
+        free(scripts->path);
+        free(scripts);
+        scripts = next;
+    }
+}
+
+/**
+ * 开始把标准输出重定向到临时文件
+ * @return 原来的标准输出，失败返回-1（输出不被收集）
+ */
+static int begin_capture() {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    if (saved < 0) {
+        return -1;
+    }
+    if (dup2(fileno(capture_file), STDOUT_FILENO) < 0) {
+        close(saved);
+        return -1;
+    }
+    return saved;
+}
+
+/**
+ * 恢复标准输出，取出收集到的输出并清空临时文件
+ * @param length 输出字节数
+ * @return 输出内容，使用后需要释放
+ */
+static char* end_capture(int saved, size_t *length) {
+    *length = 0;
+    if (saved < 0) {
+        return NULL;
+    }
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    int fd = fileno(capture_file);
+    off_t size = lseek(fd, 0, SEEK_END);
+    char *output = size > 0 ? (char *)malloc((size_t)size) : NULL;
+    if (output != NULL) {
+        ssize_t got = pread(fd, output, (size_t)size, 0);
+        *length = got > 0 ? (size_t)got : 0;
+    }
+    if (ftruncate(fd, 0) == 0) {
+        lseek(fd, 0, SEEK_SET);
+    }
+    return output;
+}
+
+/**
+ * 读取请求中的字段
+ * @return 字段值的新引用，不存在时返回NULL
+ */
+static PyObject* request_field(PyObject *request, const char *name) {
+    PyObject *key = py_string_new(name);
+    PyObject *value = key != NULL ? py_dict_get(request, key) : NULL;
+    py_decref(key);
+    return value;
+}
+
+/**
+ * 执行一个请求
+ * @param result 输出返回值的新引用
+ * @param error 出错时写入错误信息
+ * @return 成功返回true
+ */
+static bool execute_request(PyObject *request, PyObject **result, char *error, size_t error_size) {
+    *result = NULL;
+    if (request->type != TYPE_DICT) {
+        snprintf(error, error_size, "请求必须是JSON对象");
+        return false;
+    }
+
+    PyObject *script_name = request_field(request, "script");
+    PyObject *function = request_field(request, "function");
+    PyObject *args = request_field(request, "args");
+    bool success = false;
+
+    if (script_name == NULL || script_name->type != TYPE_STRING) {
+        snprintf(error, error_size, "请求缺少字符串字段\"script\"");
+    } else if (function != NULL && function->type != TYPE_STRING) {
+        snprintf(error, error_size, "字段\"function\"必须是字符串");
+    } else if (args != NULL && args->type != TYPE_LIST) {
+        snprintf(error, error_size, "字段\"args\"必须是数组");
+    } else if (args != NULL && function == NULL) {
+        snprintf(error, error_size, "给出\"args\"时必须给出\"function\"");
+    } else {
+        CachedScript *script = load_script(((PyStringObject *)script_name)->value, error, error_size);
+        if (script != NULL) {
+            module_set_entry(script->path);
+            success = interpreter_execute(script->ast);
+            if (success && function != NULL) {
+                PyListObject *list = (PyListObject *)args;
+                *result = interpreter_call_named(((PyStringObject *)function)->value,
+                                                 list != NULL ? list->items : NULL,
+                                                 list != NULL ? (int)list->length : 0);
+                success = *result != NULL || interpreter_get_error()->code == KUNYU_OK;
+            }
+            if (!success) {
+                KunyuError *runtime_error = interpreter_get_error();
+                snprintf(error, error_size, "%s: %s (行 %d, 列 %d)",
+                         runtime_error->code == KUNYU_ERROR_PARSER ? "语法分析错误" : "运行时错误",
+                         runtime_error->message, runtime_error->line, runtime_error->column);
+            }
+        }
+    }
+
+    py_decref(script_name);
+    py_decref(function);
+    py_decref(args);
+    return success;
+}
+
+/**
+ * 把数据全部写到套接字
+ */
+static bool send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+/**
+ * 处理一行请求并回复
+ * @return 回复发送成功返回true
+ */
+static bool handle_request(int fd, const char *line, size_t length) {
+    char error[512] = "";
+    PyObject *result = NULL;
+    bool success = false;
+
+    int saved = begin_capture();
+    PyObject *request = json_parse(line, length, error, sizeof(error));
+    if (request == NULL) {
+        char detail[sizeof(error)];
+        snprintf(detail, sizeof(detail), "%s", error);
+        snprintf(error, sizeof(error), "请求不是有效的JSON: %.400s", detail);
+    } else {
+        success = execute_request(request, &result, error, sizeof(error));
+        py_decref(request);
+    }
+    size_t output_length;
+    char *output = end_capture(saved, &output_length);
+
+    char *response = NULL;
+    size_t response_length = 0;
+    FILE *out = open_memstream(&response, &response_length);
+    if (out == NULL) {
+        free(output);
+        py_decref(result);
+        interpreter_cleanup();
+        return false;
+    }
+    if (success) {
+        fputs("{\"ok\":true,\"result\":", out);
+        json_write(out, result);
+    } else {
+        fputs("{\"ok\":false,\"error\":", out);
+        json_write_string(out, error, strlen(error));
+    }
+    fputs(",\"output\":", out);
+    json_write_string(out, output != NULL ? output : "", output_length);
+    fputs("}\n", out);
+    fclose(out);
+
+    // 返回值和这次请求创建的全局变量、函数全部释放，下一个请求从全新的全局作用域开始
+    free(output);
+    py_decref(result);
+    interpreter_cleanup();
+
+    bool sent = response != NULL && send_all(fd, response, response_length);
+    free(response);
+    return sent;
+}
+
+/**
+ * 关闭客户端连接
+ */
+static void close_client(Client *client) {
+    close(client->fd);
+    free(client->buffer);
+    client->fd = -1;
+    client->buffer = NULL;
+    client->length = 0;
+    client->capacity = 0;
+}
+
+/**
+ * 读取客户端的数据，处理其中每一行完整的请求
+ * @return 连接仍然可用返回true
+ */
+static bool serve_client(Client *client) {
+    if (client->capacity - client->length < SERVER_READ_CHUNK) {
+        size_t capacity = client->capacity == 0 ? SERVER_READ_CHUNK * 2 : client->capacity * 2;
+        char *grown = (char *)realloc(client->buffer, capacity);
+        if (grown == NULL) {
+            return false;
+        }
+        client->buffer = grown;
+        client->capacity = capacity;
+    }
+
+    ssize_t received = recv(client->fd, client->buffer + client->length, SERVER_READ_CHUNK, 0);
+    if (received < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    bool closed = received == 0;
+    client->length += (size_t)received;
+
+    size_t start = 0;
+    while (start < client->length) {
+        char *newline = (char *)memchr(client->buffer + start, '\n', client->length - start);
+        if (newline == NULL) {
+            // 对方关闭了写方向时最后一行可以没有换行
+            if (!closed) {
+                break;
+            }
+            newline = client->buffer + client->length;
+        }
+
+        size_t length = (size_t)(newline - (client->buffer + start));
+        if (length > 0 && client->buffer[start + length - 1] == '\r') {
+            length--;
+        }
+        if (length > 0 && !handle_request(client->fd, client->buffer + start, length)) {
+            return false;
+        }
+        start = (size_t)(newline - client->buffer) + 1;
+    }
+
+    if (start > client->length) {
+        start = client->length;
+    }
+    memmove(client->buffer, client->buffer + start, client->length - start);
+    client->length -= start;
+
+    if (client->length > SERVER_MAX_REQUEST) {
+        const char *message = "{\"ok\":false,\"error\":\"请求太长\",\"output\":\"\"}\n";
+        send_all(client->fd, message, strlen(message));
+        return false;
+    }
+    return !closed;
+}
+
+/**
+ * 创建并监听Unix域套接字。路径上已有的套接字（上次没有正常退出时留下的）会被删除
+ * @return 套接字，失败返回-1
+ */
+static int open_listener(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "错误: 套接字路径太长 '%s'\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "错误: 无法创建套接字: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // 只删除没有进程在监听的旧套接字文件，不抢走正在运行的服务的路径
+    struct stat info;
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            fprintf(stderr, "错误: '%s' 已存在且不是套接字\n", path);
+            close(fd);
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            fprintf(stderr, "错误: 已经有服务在 '%s' 上运行\n", path);
+            close(fd);
+            return -1;
+        }
+        if (errno != ECONNREFUSED && errno != ENOENT) {
+            fprintf(stderr, "错误: 无法检查套接字 '%s': %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+
+        // 连接失败后套接字的状态不确定，重新创建
+        close(fd);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            fprintf(stderr, "错误: 无法创建套接字: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SERVER_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "错误: 无法监听 '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * 运行服务，直到收到SIGINT或SIGTERM
+ * @param path 套接字路径
+ * @return 进程退出码
+ */
+int server_run(const char *path) {
+    capture_file = tmpfile();
+    if (capture_file == NULL) {
+        fprintf(stderr, "错误: 无法创建收集输出的临时文件\n");
+        return 1;
+    }
+
+    int listener = open_listener(path);
+    if (listener < 0) {
+        fclose(capture_file);
+        return 1;
+    }
+
+    // 不设置SA_RESTART，poll被信号打断后检查是否需要停止
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    module_set_cache(true);
+    fprintf(stderr, "服务已启动，监听 %s\n", path);
+
+    Client clients[SERVER_MAX_CLIENTS];
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+        clients[i].buffer = NULL;
+        clients[i].length = 0;
+        clients[i].capacity = 0;
+    }
+
+    while (!stopping) {
+        struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+        int owners[SERVER_MAX_CLIENTS + 1];
+        int count = 0;
+        fds[count].fd = listener;
+        fds[count].events = POLLIN;
+        owners[count++] = -1;
+        for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0) {
+                fds[count].fd = clients[i].fd;
+                fds[count].events = POLLIN;
+                owners[count++] = i;
+            }
+        }
+
+        if (poll(fds, (nfds_t)count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "错误: poll失败: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 1; i < count; i++) {
+            if (fds[i].revents != 0 && !serve_client(&clients[owners[i]])) {
+                close_client(&clients[owners[i]]);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                int slot = 0;
+                while (slot < SERVER_MAX_CLIENTS && clients[slot].fd >= 0) {
+                    slot++;
+                }
+                if (slot < SERVER_MAX_CLIENTS) {
+                    clients[slot].fd = fd;
+                } else {
+                    const char *message = "{\"ok\":false,\"error\":\"连接数超过上限\",\"output\":\"\"}\n";
+                    send_all(fd, message, strlen(message));
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            close_client(&clients[i]);
+        }
+    }
+    close(listener);
+    unlink(path);
+    fprintf(stderr, "服务已停止\n");
+
+    interpreter_cleanup();
+    module_set_cache(false);
+    free_scripts();
+    fclose(capture_file);
+    return 0;
+}
@@ -0,0 +1,747 @@
+/**
+ * 坤舆编程语言 - 启动快照
+ * 脚本顶层的 快照点("标签"); 把初始化阶段和之后的工作分开。以 --snapshot-after=标签 运行时，
+ * 执行到这条语句就把全局变量和它们引用的所有对象写入快照文件；以 --from-snapshot 运行时，
+ * 只重新定义快照点之前的函数（包括导入的模块中的函数），从快照恢复全局变量，
+ * 然后从快照点之后的语句继续执行，跳过建立查找表之类的初始化工作。
+ *
+ * 对象在解释器中是各自分配、带引用计数的，不能把堆直接映射回来。快照把所有对象排成一张表，
+ * 对象之间的引用写成表中的下标，加载时先创建所有对象，再把下标重定位为指针，
+ * 共享的对象和循环引用都保持原样。
+ *
+ * 快照记录了脚本源码的散列值，脚本修改过时快照作废。导入的模块不参与校验。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "KUNYUSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BUILTIN "快照点"
+#define SNAPSHOT_NO_OBJECT UINT32_MAX
+
+/**
+ * 快照文件头，后面依次是标签、对象表和全局变量表
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t statement;             // 快照点语句在顶层语句中的下标
+    uint64_t source_hash;           // 脚本源码的散列值
+    uint32_t object_count;
+    uint32_t global_count;
+    uint32_t label_length;
+} SnapshotHeader;
+
+/**
+ * 对象到下标的映射，开放寻址
+ */
+typedef struct {
+    PyObject **keys;
+    uint32_t *values;
+    size_t capacity;
+} ObjectMap;
+
+/**
+ * 写快照时收集的对象
+ */
+typedef struct {
+    ObjectMap map;
+    PyObject **objects;             // 按下标排列，表持有引用
+    size_t count;
+    size_t capacity;
+    uint32_t *keys;                 // 字典的键的下标，按字典的下标顺序排列
+    size_t key_count;
+    size_t key_capacity;
+    bool failed;
+    char error[256];
+} ObjectTable;
+
+/**
+ * 读快照的位置
+ */
+typedef struct {
+    const char *data;
+    size_t length;
+    size_t offset;
+    bool failed;
+} Reader;
+
+// 以 --snapshot-after 运行时要生成快照的位置
+static struct {
+    const AstNode *call;            // 快照点语句中的调用
+    int statement;
+    char *label;
+    char *path;
+    uint64_t source_hash;
+    bool written;
+} target = { NULL, 0, NULL, NULL, 0, false };
+
+/**
+ * 计算源码的散列值（FNV-1a）
+ */
+static uint64_t hash_source(const char *source) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)source; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * 查找 快照点("标签"); 语句
+ * @return 语句下标，找不到返回-1
+ */
+static int find_snapshot_point(AstNode *ast, const char *label, const AstNode **call_out) {
+    if (ast == NULL || ast->type != NODE_PROGRAM) {
+        return -1;
+    }
+    Program *program = (Program *)ast;
+    for (int i = 0; i < program->stmt_count; i++) {
+        AstNode *stmt = program->statements[i];
+        if (!ast_is_expression_stmt(stmt)) {
+            continue;
+        }
+        AstNode *expr = ((ExpressionStmt *)stmt)->expr;
+        if (expr == NULL || expr->type != NODE_CALL) {
+            continue;
+        }
+        CallExpr *call = (CallExpr *)expr;
+        if (strcmp(call->name, SNAPSHOT_BUILTIN) != 0 || call->arg_count != 1 ||
+            call->args[0]->type != NODE_LITERAL) {
+            continue;
+        }
+        LiteralExpr *literal = (LiteralExpr *)call->args[0];
+        if (literal->token_type == KUNYU_TOKEN_STRING && strcmp(literal->value, label) == 0) {
+            if (call_out != NULL) {
+                *call_out = expr;
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 查找对象的下标
+ * @return 不在表中时返回SNAPSHOT_NO_OBJECT
+ */
+static uint32_t map_get(const ObjectMap *map, const PyObject *object) {
+    if (map->capacity == 0) {
+        return SNAPSHOT_NO_OBJECT;
+    }
+    size_t mask = map->capacity - 1;
+    size_t slot = ((uintptr_t)object >> 4) & mask;
+    while (map->keys[slot] != NULL) {
+        if (map->keys[slot] == object) {
+            return map->values[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return SNAPSHOT_NO_OBJECT;
+}
+
+/**
+ * 记录对象的下标，负载超过一半时扩容
+ */
+static bool map_put(ObjectMap *map, PyObject *object, uint32_t index) {
+    if ((size_t)index * 2 >= map->capacity) {
+        size_t capacity = map->capacity > 0 ? map->capacity * 2 : 1024;
+        PyObject **keys = (PyObject **)calloc(capacity, sizeof(PyObject *));
+        uint32_t *values = (uint32_t *)malloc(sizeof(uint32_t) * capacity);
+        if (keys == NULL || values == NULL) {
+            free(keys);
+            free(values);
+            return false;
+        }
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->keys[i] != NULL) {
+                size_t slot = ((uintptr_t)map->keys[i] >> 4) & (capacity - 1);
+                while (keys[slot] != NULL) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                keys[slot] = map->keys[i];
+                values[slot] = map->values[i];
+            }
+        }
+        free(map->keys);
+        free(map->values);
+        map->keys = keys;
+        map->values = values;
+        map->capacity = capacity;
+    }
+
+    size_t mask = map->capacity - 1;
+    size_t slot = ((uintptr_t)object >> 4) & mask;
+    while (map->keys[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    map->keys[slot] = object;
+    map->values[slot] = index;
+    return true;
+}
+
+/**
+ * 把对象加入表中，已经在表中时什么也不做
+ */
+static void table_add(ObjectTable *table, PyObject *object) {
+    if (table->failed || object == NULL || map_get(&table->map, object) != SNAPSHOT_NO_OBJECT) {
+        return;
+    }
+    if (object->type == TYPE_FUNCTION) {
+        PyFunctionObject *func = (PyFunctionObject *)object;
+        if (func->name == NULL || func->upvalue_count > 0) {
+            table->failed = true;
+            snprintf(table->error, sizeof(table->error), "快照不能保存匿名函数");
+            return;
+        }
+    } else if (object->type == TYPE_NULL) {
+        table->failed = true;
+        snprintf(table->error, sizeof(table->error), "快照不能保存空值");
+        return;
+    }
+
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity > 0 ? table->capacity * 2 : 1024;
+        PyObject **objects = (PyObject **)realloc(table->objects, sizeof(PyObject *) * capacity);
+        if (objects == NULL) {
+            table->failed = true;
+            snprintf(table->error, sizeof(table->error), "内存分配失败，无法生成快照");
+            return;
+        }
+        table->objects = objects;
+        table->capacity = capacity;
+    }
+    if (table->count >= SNAPSHOT_NO_OBJECT || !map_put(&table->map, object, (uint32_t)table->count)) {
+        table->failed = true;
+        snprintf(table->error, sizeof(table->error), "内存分配失败，无法生成快照");
+        return;
+    }
+    py_incref(object);
+    table->objects[table->count++] = object;
+}
+
+/**
+ * 记录字典的键。布局模式的字典每次取键都会创建新的字符串，要在收集时记下下标
+ */
+static void table_add_key(ObjectTable *table, PyObject *key) {
+    table_add(table, key);
+    if (table->failed) {
+        return;
+    }
+    if (table->key_count == table->key_capacity) {
+        size_t capacity = table->key_capacity > 0 ? table->key_capacity * 2 : 1024;
+        uint32_t *keys = (uint32_t *)realloc(table->keys, sizeof(uint32_t) * capacity);
+        if (keys == NULL) {
+            table->failed = true;
+            snprintf(table->error, sizeof(table->error), "内存分配失败，无法生成快照");
+            return;
+        }
+        table->keys = keys;
+        table->key_capacity = capacity;
+    }
+    table->keys[table->key_count++] = map_get(&table->map, key);
+}
+
+/**
+ * 释放对象表
+ */
+static void table_free(ObjectTable *table) {
+    for (size_t i = 0; i < table->count; i++) {
+        py_decref(table->objects[i]);
+    }
+    free(table->objects);
+    free(table->keys);
+    free(table->map.keys);
+    free(table->map.values);
+}
+
+/**
+ * 收集全局变量的值
+ */
+static bool collect_global(const char *name, PyObject *value, bool is_constant, void *context) {
+    table_add((ObjectTable *)context, value);
+    return true;
+}
+
+/**
+ * 从全局变量出发收集所有可达的对象。按下标顺序处理，不需要递归
+ */
+static void collect_objects(ObjectTable *table) {
+    interpreter_visit_globals(collect_global, table);
+    for (size_t i = 0; i < table->count && !table->failed; i++) {
+        PyObject *object = table->objects[i];
+        if (object->type == TYPE_LIST) {
+            PyListObject *list = (PyListObject *)object;
+            for (size_t j = 0; j < list->length; j++) {
+                table_add(table, list->items[j]);
+            }
+        } else if (object->type == TYPE_DICT) {
+            size_t size = py_dict_size(object);
+            for (size_t j = 0; j < size; j++) {
+                PyObject *key = py_dict_key_at(object, j);
+                PyObject *value = py_dict_value_at(object, j);
+                table_add_key(table, key);
+                table_add(table, value);
+                py_decref(key);
+                py_decref(value);
+            }
+        }
+    }
+}
+
+/**
+ * 写入32位整数
+ */
+static void write_u32(FILE *file, uint32_t value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+/**
+ * 写入带长度的字节串
+ */
+static void write_bytes(FILE *file, const char *data, size_t length) {
+    write_u32(file, (uint32_t)length);
+    fwrite(data, 1, length, file);
+}
+
+/**
+ * 写入一个对象，引用的对象写成下标
+ */
+static void write_object(FILE *file, const ObjectTable *table, size_t *next_key, PyObject *object) {
+    uint8_t type = (uint8_t)object->type;
+    fwrite(&type, 1, 1, file);
+    switch (object->type) {
+        case TYPE_NUMBER: {
+            PyNumberObject *number = (PyNumberObject *)object;
+            uint8_t is_int = number->is_int ? 1 : 0;
+            fwrite(&is_int, 1, 1, file);
+            if (number->is_int) {
+                fwrite(&number->int_value, sizeof(number->int_value), 1, file);
+            } else {
+                fwrite(&number->value, sizeof(number->value), 1, file);
+            }
+            break;
+        }
+        case TYPE_BIGINT: {
+            char *text = py_bigint_to_string(object);
+            write_bytes(file, text != NULL ? text : "0", text != NULL ? strlen(text) : 1);
+            free(text);
+            break;
+        }
+        case TYPE_STRING: {
+            PyStringObject *str = (PyStringObject *)object;
+            write_bytes(file, str->value, str->length);
+            break;
+        }
+        case TYPE_LIST: {
+            PyListObject *list = (PyListObject *)object;
+            write_u32(file, (uint32_t)list->length);
+            for (size_t i = 0; i < list->length; i++) {
+                write_u32(file, map_get(&table->map, list->items[i]));
+            }
+            break;
+        }
+        case TYPE_DICT: {
+            size_t size = py_dict_size(object);
+            write_u32(file, (uint32_t)size);
+            for (size_t i = 0; i < size; i++) {
+                PyObject *value = py_dict_value_at(object, i);
+                write_u32(file, table->keys[(*next_key)++]);
+                write_u32(file, map_get(&table->map, value));
+                py_decref(value);
+            }
+            break;
+        }
+        case TYPE_FUNCTION: {
+            const char *name = ((PyFunctionObject *)object)->name;
+            write_bytes(file, name, strlen(name));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * 写入一个全局变量
+ */
+static bool write_global(const char *name, PyObject *value, bool is_constant, void *context) {
+    void **state = (void **)context;
+    FILE *file = (FILE *)state[0];
+    const ObjectTable *table = (const ObjectTable *)state[1];
+    uint8_t constant = is_constant ? 1 : 0;
+    write_bytes(file, name, strlen(name));
+    fwrite(&constant, 1, 1, file);
+    write_u32(file, value != NULL ? map_get(&table->map, value) : SNAPSHOT_NO_OBJECT);
+    return true;
+}
+
+/**
+ * 计算全局变量的个数
+ */
+static bool count_global(const char *name, PyObject *value, bool is_constant, void *context) {
+    (*(uint32_t *)context)++;
+    return true;
+}
+
+/**
+ * 把全局状态写入快照文件。先写临时文件再改名，中途出错不会留下不完整的快照
+ */
+static bool write_snapshot() {
+    ObjectTable table;
+    memset(&table, 0, sizeof(table));
+    collect_objects(&table);
+
+    KunyuError *error = interpreter_get_error();
+    bool success = !table.failed;
+    if (!success) {
+        error->code = KUNYU_ERROR_RUNTIME;
+        snprintf(error->message, sizeof(error->message), "%s", table.error);
+    }
+
+    size_t temp_length = strlen(target.path) + 8;
+    char *temp_path = success ? (char *)malloc(temp_length) : NULL;
+    FILE *file = NULL;
+    if (temp_path != NULL) {
+        snprintf(temp_path, temp_length, "%s.tmp", target.path);
+        file = fopen(temp_path, "wb");
+    }
+    if (success && file == NULL) {
+        error->code = KUNYU_ERROR_RUNTIME;
+        snprintf(error->message, sizeof(error->message), "无法写入快照文件'%.200s'", target.path);
+        success = false;
+    }
+
+    if (success) {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.statement = (uint32_t)target.statement;
+        header.source_hash = target.source_hash;
+        header.object_count = (uint32_t)table.count;
+        interpreter_visit_globals(count_global, &header.global_count);
+        header.label_length = (uint32_t)strlen(target.label);
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(target.label, 1, header.label_length, file);
+
+        size_t next_key = 0;
+        for (size_t i = 0; i < table.count; i++) {
+            write_object(file, &table, &next_key, table.objects[i]);
+        }
+        void *state[2] = { file, &table };
+        interpreter_visit_globals(write_global, state);
+
+        bool write_failed = ferror(file) != 0;
+        if (fclose(file) != 0 || write_failed || rename(temp_path, target.path) != 0) {
+            remove(temp_path);
+            error->code = KUNYU_ERROR_RUNTIME;
+            snprintf(error->message, sizeof(error->message), "无法写入快照文件'%.200s'", target.path);
+            success = false;
+        }
+    }
+
+    free(temp_path);
+    table_free(&table);
+    return success;
+}
+
+/**
+ * 设置执行到哪个快照点时生成快照
+ * @param label 快照点的标签
+ * @param path 快照文件
+ * @param source 脚本源码，用于校验快照
+ * @return 脚本顶层没有这个快照点时返回false
+ */
+bool snapshot_prepare(AstNode *ast, const char *label, const char *path, const char *source) {
+    const AstNode *call = NULL;
+    int statement = find_snapshot_point(ast, label, &call);
+    if (statement < 0) {
+        return false;
+    }
+
+    free(target.label);
+    free(target.path);
+    target.call = call;
+    target.statement = statement;
+    target.label = strdup(label);
+    target.path = strdup(path);
+    target.source_hash = hash_source(source);
+    target.written = false;
+    return target.label != NULL && target.path != NULL;
+}
+
+/**
+ * 执行到快照点时由内置函数调用，是要生成快照的那一条顶层语句时写入快照
+ * @return 写入失败或快照点不在顶层时返回false并设置解释器错误
+ */
+bool snapshot_reached(const char *label) {
+    if (target.label == NULL || strcmp(label, target.label) != 0) {
+        return true;
+    }
+    // 内置函数调用时，解释器的当前节点是最后评估的参数
+    const AstNode *node = interpreter_current_node();
+    if (node != target.call && node != ((const CallExpr *)target.call)->args[0]) {
+        KunyuError *error = interpreter_get_error();
+        error->code = KUNYU_ERROR_RUNTIME;
+        snprintf(error->message, sizeof(error->message), "快照点'%.200s'必须是脚本顶层的语句", label);
+        return false;
+    }
+    if (target.written) {
+        return true;
+    }
+    target.written = write_snapshot();
+    return target.written;
+}
+
+/**
+ * 是否已经生成了快照
+ */
+bool snapshot_written() {
+    return target.written;
+}
+
+/**
+ * 读取32位整数
+ */
+static uint32_t read_u32(Reader *reader) {
+    uint32_t value = 0;
+    if (reader->failed || reader->length - reader->offset < sizeof(value)) {
+        reader->failed = true;
+        return 0;
+    }
+    memcpy(&value, reader->data + reader->offset, sizeof(value));
+    reader->offset += sizeof(value);
+    return value;
+}
+
+/**
+ * 读取指定长度的字节，返回指向快照数据的指针
+ */
+static const char* read_raw(Reader *reader, size_t length) {
+    if (reader->failed || reader->length - reader->offset < length) {
+        reader->failed = true;
+        return NULL;
+    }
+    const char *data = reader->data + reader->offset;
+    reader->offset += length;
+    return data;
+}
+
+/**
+ * 读取带长度的字节串，复制为以\0结尾的字符串
+ */
+static char* read_string(Reader *reader) {
+    uint32_t length = read_u32(reader);
+    const char *data = read_raw(reader, length);
+    if (data == NULL) {
+        return NULL;
+    }
+    char *text = (char *)malloc((size_t)length + 1);
+    if (text == NULL) {
+        reader->failed = true;
+        return NULL;
+    }
+    memcpy(text, data, length);
+    text[length] = '\0';
+    return text;
+}
+
+/**
+ * 第一遍：创建对象。数字、字符串和函数直接创建，列表和字典先创建空对象，
+ * 记下内容的位置留到第二遍填充
+ */
+static PyObject* create_object(Reader *reader, size_t *content_offset) {
+    const char *type_byte = read_raw(reader, 1);
+    if (type_byte == NULL) {
+        return NULL;
+    }
+    ObjectType type = (ObjectType)(uint8_t)*type_byte;
+    switch (type) {
+        case TYPE_NUMBER: {
+            const char *is_int = read_raw(reader, 1);
+            const char *data = read_raw(reader, 8);
+            if (data == NULL) {
+                return NULL;
+            }
+            if (*is_int) {
+                int64_t value;
+                memcpy(&value, data, sizeof(value));
+                return py_int_new(value);
+            }
+            double value;
+            memcpy(&value, data, sizeof(value));
+            return py_number_new(value);
+        }
+        case TYPE_BIGINT:
+        case TYPE_STRING:
+        case TYPE_FUNCTION: {
+            char *text = read_string(reader);
+            if (text == NULL) {
+                return NULL;
+            }
+            PyObject *object = type == TYPE_BIGINT ? py_bigint_from_string(text) :
+                               type == TYPE_STRING ? py_string_new(text) : interpreter_function_value(text);
+            free(text);
+            return object;
+        }
+        case TYPE_LIST:
+        case TYPE_DICT: {
+            *content_offset = reader->offset;
+            uint32_t count = read_u32(reader);
+            size_t width = type == TYPE_LIST ? 4 : 8;
+            if (reader->failed || (reader->length - reader->offset) / width < count) {
+                reader->failed = true;
+                return NULL;
+            }
+            reader->offset += (size_t)count * width;
+            return type == TYPE_LIST ? py_list_new() : py_dict_new();
+        }
+        default:
+            reader->failed = true;
+            return NULL;
+    }
+}
+
+/**
+ * 第二遍：把列表和字典内容中的下标重定位为对象
+ */
+static bool fill_container(Reader *reader, PyObject *object, PyObject **objects, uint32_t object_count) {
+    uint32_t count = read_u32(reader);
+    for (uint32_t i = 0; i < count && !reader->failed; i++) {
+        if (object->type == TYPE_LIST) {
+            uint32_t item = read_u32(reader);
+            if (item >= object_count || !py_list_append(object, objects[item])) {
+                return false;
+            }
+        } else {
+            uint32_t key = read_u32(reader);
+            uint32_t value = read_u32(reader);
+            if (key >= object_count || value >= object_count || !py_dict_append(object, objects[key], objects[value])) {
+                return false;
+            }
+        }
+    }
+    return !reader->failed;
+}
+
+/**
+ * 读取快照文件
+ */
+static char* read_snapshot_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = size > 0 ? (char *)malloc((size_t)size) : NULL;
+    if (data != NULL && fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *length = data != NULL ? (size_t)size : 0;
+    return data;
+}
+
+/**
+ * 加载对象表和全局变量，出错时释放已经创建的对象
+ */
+static bool load_state(Reader *reader, const SnapshotHeader *header) {
+    PyObject **objects = (PyObject **)calloc(header->object_count > 0 ? header->object_count : 1, sizeof(PyObject *));
+    size_t *offsets = (size_t *)calloc(header->object_count > 0 ? header->object_count : 1, sizeof(size_t));
+    bool success = objects != NULL && offsets != NULL;
+
+    uint32_t created = 0;
+    for (; success && created < header->object_count; created++) {
+        objects[created] = create_object(reader, &offsets[created]);
+        success = objects[created] != NULL && !reader->failed;
+    }
+    size_t globals_offset = reader->offset;
+    for (uint32_t i = 0; success && i < header->object_count; i++) {
+        if (objects[i]->type == TYPE_LIST || objects[i]->type == TYPE_DICT) {
+            reader->offset = offsets[i];
+            success = fill_container(reader, objects[i], objects, header->object_count);
+        }
+    }
+    reader->offset = globals_offset;
+
+    for (uint32_t i = 0; success && i < header->global_count; i++) {
+        char *name = read_string(reader);
+        const char *constant = read_raw(reader, 1);
+        uint32_t index = read_u32(reader);
+        success = name != NULL && !reader->failed &&
+                  (index == SNAPSHOT_NO_OBJECT || index < header->object_count) &&
+                  interpreter_define_global(name, index == SNAPSHOT_NO_OBJECT ? NULL : objects[index], *constant != 0);
+        free(name);
+    }
+
+    // 变量持有自己的引用，对象表中的引用可以释放
+    for (uint32_t i = 0; objects != NULL && i < created; i++) {
+        if (objects[i] != NULL) {
+            py_decref(objects[i]);
+        }
+    }
+    free(objects);
+    free(offsets);
+    return success;
+}
+
+/**
+ * 从快照恢复全局状态：重新定义快照点之前的函数，恢复全局变量
+ * @param path 快照文件
+ * @param source 脚本源码，与生成快照时不同则快照作废
+ * @param next_statement 输出接下来要执行的第一条顶层语句；快照不存在或已经作废时为0，表示需要完整执行
+ * @return 快照文件损坏或恢复出错时返回false
+ */
+bool snapshot_restore(AstNode *ast, const char *path, const char *source, int *next_statement) {
+    *next_statement = 0;
+    size_t length;
+    char *data = read_snapshot_file(path, &length);
+    if (data == NULL) {
+        fprintf(stderr, "警告: 无法读取快照文件 '%s'，完整执行脚本\n", path);
+        return true;
+    }
+
+    Reader reader = { data, length, 0, false };
+    SnapshotHeader header;
+    const char *raw = read_raw(&reader, sizeof(header));
+    if (raw == NULL || memcmp(raw, SNAPSHOT_MAGIC, 8) != 0) {
+        fprintf(stderr, "错误: '%s' 不是有效的快照文件\n", path);
+        free(data);
+        return false;
+    }
+    memcpy(&header, raw, sizeof(header));
+    const char *label_data = read_raw(&reader, header.label_length);
+    char *label = label_data != NULL ? strndup(label_data, header.label_length) : NULL;
+
+    bool success = true;
+    int statement = label != NULL ? find_snapshot_point(ast, label, NULL) : -1;
+    if (header.version != SNAPSHOT_VERSION || header.source_hash != hash_source(source) ||
+        statement < 0 || (uint32_t)statement != header.statement) {
+        fprintf(stderr, "警告: 快照 '%s' 与脚本不匹配，完整执行脚本\n", path);
+    } else if (!interpreter_define_functions(ast, statement)) {
+        KunyuError *error = interpreter_get_error();
+        fprintf(stderr, "运行时错误: %s (行 %d, 列 %d)\n", error->message, error->line, error->column);
+        success = false;
+    } else if (!load_state(&reader, &header)) {
+        KunyuError *error = interpreter_get_error();
+        fprintf(stderr, "错误: 无法从快照 '%s' 恢复: %s\n", path,
+                error->code != KUNYU_OK ? error->message : "快照文件已损坏");
+        success = false;
+    } else {
+        *next_statement = statement + 1;
+    }
+
+    free(label);
+    free(data);
+    return success;
+}
@@ -0,0 +1,281 @@
+/**
+ * 坤舆编程语言 - 解释器内部统计
+ * 汇总计数器，记录每个函数的调用次数和耗时，并输出统计报告
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STATS_FUNCTION_BUCKETS 256
+
+/**
+ * 函数调用统计
+ */
+typedef struct FunctionStats {
+    const char *name;            // 函数名
+    bool is_builtin;             // 是否是内置函数
+    uint64_t calls;              // 调用次数
+    uint64_t self_ns;            // 自身耗时（不含子调用）
+    uint64_t total_ns;           // 总耗时（递归调用只计最外层）
+    int active;                  // 正在执行的层数
+    struct FunctionStats *next;  // 同一哈希桶的下一项
+} FunctionStats;
+
+/**
+ * 正在进行的调用
+ */
+typedef struct {
+    FunctionStats *function;     // 对应的函数统计
+    uint64_t start_ns;           // 开始时间
+    uint64_t child_ns;           // 子调用耗时
+} ActiveCall;
+
+#ifdef KUNYU_STATS_ENABLED
+
+// 计数器
+uint64_t stats_counters[STAT_COUNTER_COUNT];
+
+// 是否统计函数调用耗时
+bool stats_enabled = false;
+
+// 函数统计哈希表
+static FunctionStats *function_buckets[STATS_FUNCTION_BUCKETS];
+
+// 调用栈
+static ActiveCall active_calls[KUNYU_MAX_CALL_DEPTH];
+static int active_depth = 0;
+
+// 统计开始时间
+static uint64_t start_ns = 0;
+
+/**
+ * 获取单调时钟的纳秒数
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * 查找或创建函数统计
+ */
+static FunctionStats* find_function_stats(const char *name, bool is_builtin) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    size_t bucket = hash % STATS_FUNCTION_BUCKETS;
+
+    for (FunctionStats *entry = function_buckets[bucket]; entry != NULL; entry = entry->next) {
+        if (entry->is_builtin == is_builtin && strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+
+    FunctionStats *entry = (FunctionStats *)calloc(1, sizeof(FunctionStats));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->name = strdup(name);
+    if (entry->name == NULL) {
+        free(entry);
+        return NULL;
+    }
+    entry->is_builtin = is_builtin;
+    entry->next = function_buckets[bucket];
+    function_buckets[bucket] = entry;
+
+    return entry;
+}
+
+/**
+ * 记录函数调用开始
+ */
+void stats_call_begin(const char *name, bool is_builtin) {
+    if (active_depth >= KUNYU_MAX_CALL_DEPTH) {
+        return;
+    }
+
+    FunctionStats *function = find_function_stats(name, is_builtin);
+    ActiveCall *call = &active_calls[active_depth++];
+    call->function = function;
+    call->child_ns = 0;
+    call->start_ns = now_ns();
+
+    if (function != NULL) {
+        function->calls++;
+        function->active++;
+    }
+}
+
+/**
+ * 记录函数调用结束
+ */
+void stats_call_end() {
+    if (active_depth <= 0) {
+        return;
+    }
+
+    ActiveCall *call = &active_calls[--active_depth];
+    uint64_t elapsed = now_ns() - call->start_ns;
+
+    // 子调用耗时计入调用者
+    if (active_depth > 0) {
+        active_calls[active_depth - 1].child_ns += elapsed;
+    }
+
+    FunctionStats *function = call->function;
+    if (function == NULL) {
+        return;
+    }
+
+    function->self_ns += elapsed > call->child_ns ? elapsed - call->child_ns : 0;
+    function->active--;
+    if (function->active == 0) {
+        function->total_ns += elapsed;
+    }
+}
+
+/**
+ * 比较函数：按自身耗时降序
+ */
+static int compare_function_stats(const void *a, const void *b) {
+    const FunctionStats *x = *(const FunctionStats * const *)a;
+    const FunctionStats *y = *(const FunctionStats * const *)b;
+    if (x->self_ns != y->self_ns) {
+        return x->self_ns < y->self_ns ? 1 : -1;
+    }
+    return x->calls < y->calls ? 1 : (x->calls > y->calls ? -1 : 0);
+}
+
+#endif /* KUNYU_STATS_ENABLED */
+
+/**
+ * 开始统计
+ * @return 统计功能被编译进来时返回true
+ */
+bool stats_start() {
+#ifdef KUNYU_STATS_ENABLED
+    stats_enabled = true;
+    start_ns = now_ns();
+    return true;
+#else
+    fprintf(stderr, "警告: 发布构建未包含统计功能，--stats 无效\n");
+    return false;
+#endif
+}
+
+/**
+ * 输出统计报告
+ * @param out 输出流
+ */
+void stats_report(FILE *out) {
+#ifdef KUNYU_STATS_ENABLED
+    uint64_t *c = stats_counters;
+    double elapsed_ms = (now_ns() - start_ns) / 1e6;
+
+    fprintf(out, "\n=== 解释器统计 ===\n");
+    fprintf(out, "运行时间: %.3f 毫秒\n\n", elapsed_ms);
+
+    fprintf(out, "对象分配:\n");
+    fprintf(out, "  数字         %12llu\n", (unsigned long long)c[STAT_NUMBER_NEW]);
+    fprintf(out, "  字符串       %12llu\n", (unsigned long long)c[STAT_STRING_NEW]);
+    fprintf(out, "  列表         %12llu\n", (unsigned long long)c[STAT_LIST_NEW]);
+    fprintf(out, "  字典         %12llu\n", (unsigned long long)c[STAT_DICT_NEW]);
+    fprintf(out, "  大整数       %12llu\n", (unsigned long long)c[STAT_BIGINT_NEW]);
+    fprintf(out, "  函数         %12llu\n", (unsigned long long)c[STAT_FUNCTION_NEW]);
+    fprintf(out, "  释放         %12llu\n", (unsigned long long)c[STAT_OBJECT_FREE]);
+    fprintf(out, "  峰值存活     %12llu\n", (unsigned long long)c[STAT_PEAK_LIVE_OBJECTS]);
+    fprintf(out, "  当前存活     %12llu\n\n", (unsigned long long)c[STAT_LIVE_OBJECTS]);
+
+    fprintf(out, "引用计数:\n");
+    fprintf(out, "  增加         %12llu\n", (unsigned long long)c[STAT_INCREF]);
+    fprintf(out, "  减少         %12llu\n", (unsigned long long)c[STAT_DECREF]);
+    fprintf(out, "  峰值引用计数 %12llu\n\n", (unsigned long long)c[STAT_PEAK_REFCOUNT]);
+
+    double average_chain = c[STAT_VARIABLE_LOOKUP] > 0
+        ? (double)c[STAT_LOOKUP_SCOPES] / c[STAT_VARIABLE_LOOKUP] : 0;
+    fprintf(out, "作用域与查找:\n");
+    fprintf(out, "  创建作用域   %12llu\n", (unsigned long long)c[STAT_PUSH_SCOPE]);
+    fprintf(out, "  变量查找     %12llu (平均作用域链 %.2f，最长 %llu)\n",
+            (unsigned long long)c[STAT_VARIABLE_LOOKUP], average_chain,
+            (unsigned long long)c[STAT_LOOKUP_MAX_CHAIN]);
+    fprintf(out, "  函数查找     %12llu\n", (unsigned long long)c[STAT_FUNCTION_LOOKUP]);
+    fprintf(out, "  内置函数查找 %12llu\n", (unsigned long long)c[STAT_BUILTIN_LOOKUP]);
+    fprintf(out, "  字符串比较   %12llu\n\n", (unsigned long long)c[STAT_STRCMP]);
+
+    fprintf(out, "超级指令:\n");
+    fprintf(out, "  快速路径     %12llu\n", (unsigned long long)c[STAT_SUPER_FAST]);
+    fprintf(out, "  退回原始节点 %12llu\n\n", (unsigned long long)c[STAT_SUPER_FALLBACK]);
+
+    fprintf(out, "函数结果缓存:\n");
+    fprintf(out, "  命中         %12llu\n", (unsigned long long)c[STAT_MEMO_HIT]);
+    fprintf(out, "  未命中       %12llu\n", (unsigned long long)c[STAT_MEMO_MISS]);
+    fprintf(out, "  淘汰         %12llu\n\n", (unsigned long long)c[STAT_MEMO_EVICT]);
+
+    // 收集并排序函数统计
+    size_t count = 0;
+    for (int i = 0; i < STATS_FUNCTION_BUCKETS; i++) {
+        for (FunctionStats *entry = function_buckets[i]; entry != NULL; entry = entry->next) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+
+    FunctionStats **entries = (FunctionStats **)malloc(sizeof(FunctionStats *) * count);
+    if (entries == NULL) {
+        return;
+    }
+    size_t index = 0;
+    for (int i = 0; i < STATS_FUNCTION_BUCKETS; i++) {
+        for (FunctionStats *entry = function_buckets[i]; entry != NULL; entry = entry->next) {
+            entries[index++] = entry;
+        }
+    }
+    qsort(entries, count, sizeof(FunctionStats *), compare_function_stats);
+
+    fprintf(out, "函数调用:\n");
+    fprintf(out, "  %-24s %-6s %12s %12s %12s\n", "函数", "类型", "调用次数", "自身(毫秒)", "总计(毫秒)");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "  %-24s %-6s %12llu %12.3f %12.3f\n",
+                entries[i]->name,
+                entries[i]->is_builtin ? "内置" : "用户",
+                (unsigned long long)entries[i]->calls,
+                entries[i]->self_ns / 1e6,
+                entries[i]->total_ns / 1e6);
+    }
+    fprintf(out, "\n");
+
+    free(entries);
+#else
+    (void)out;
+#endif
+}
+
+/**
+ * 释放统计数据
+ */
+void stats_cleanup() {
+#ifdef KUNYU_STATS_ENABLED
+    for (int i = 0; i < STATS_FUNCTION_BUCKETS; i++) {
+        FunctionStats *entry = function_buckets[i];
+        while (entry != NULL) {
+            FunctionStats *next = entry->next;
+            free((void *)entry->name);
+            free(entry);
+            entry = next;
+        }
+        function_buckets[i] = NULL;
+    }
+    active_depth = 0;
+    stats_enabled = false;
+#endif
+}
@@ -0,0 +1,243 @@
+/**
+ * 坤舆编程语言 - 执行跟踪
+ * 以Chrome跟踪事件格式（chrome://tracing、Perfetto可直接打开）记录
+ * 词法分析、语法分析、执行等阶段以及每次函数调用的时间线
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define TRACE_MAX_PHASES 16      // 阶段最多嵌套层数
+
+/**
+ * 正在进行的阶段或调用
+ */
+typedef struct {
+    const char *name;        // 名称
+    bool is_builtin;         // 是否是内置函数调用
+    int line;                // 调用位置的行号
+    uint64_t start_ns;       // 开始时间
+} TraceSpan;
+
+/**
+ * 跟踪器上下文
+ */
+typedef struct {
+    FILE *out;                                   // 输出文件
+    uint64_t start_ns;                           // 跟踪开始时间
+    uint64_t threshold_ns;                       // 短于此时长的调用不记录
+    bool first_event;                            // 是否还没有写出事件
+    int pid;                                     // 进程号
+    TraceSpan phases[TRACE_MAX_PHASES];          // 阶段栈
+    int phase_depth;
+    TraceSpan calls[KUNYU_MAX_CALL_DEPTH];       // 调用栈
+    int call_depth;
+    long recorded_calls;                         // 已记录的调用数
+    long skipped_calls;                          // 因低于阈值而跳过的调用数
+} Tracer;
+
+// 是否正在跟踪，解释器的钩子会读取它
+bool trace_active = false;
+
+// 全局跟踪器上下文
+static Tracer tracer;
+
+/**
+ * 获取单调时钟的纳秒数
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * 写出JSON字符串，转义引号、反斜杠和控制字符
+ */
+static void write_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * 写出一个完整事件（ph为X，带开始时间和持续时间）
+ */
+static void write_complete_event(const char *name, const char *category,
+                                 uint64_t start_ns, uint64_t end_ns, int line) {
+    FILE *out = tracer.out;
+    fputs(tracer.first_event ? "\n" : ",\n", out);
+    tracer.first_event = false;
+
+    fputs("{\"name\":", out);
+    write_json_string(out, name);
+    fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":1",
+            category,
+            (start_ns - tracer.start_ns) / 1000.0,
+            (end_ns - start_ns) / 1000.0,
+            tracer.pid);
+    if (line > 0) {
+        fprintf(out, ",\"args\":{\"line\":%d}", line);
+    }
+    fputc('}', out);
+}
+
+/**
+ * 写出进程和线程名元数据事件
+ */
+static void write_metadata(const char *kind, const char *value) {
+    FILE *out = tracer.out;
+    fputs(tracer.first_event ? "\n" : ",\n", out);
+    tracer.first_event = false;
+
+    fprintf(out, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":", kind, tracer.pid);
+    write_json_string(out, value);
+    fputs("}}", out);
+}
+
+/**
+ * 开始跟踪，程序退出时会自动结束并关闭文件
+ * @param filename 输出文件名
+ * @param threshold_us 短于此时长（微秒）的函数调用不记录，0表示全部记录
+ * @return 成功返回true，失败返回false
+ */
+bool trace_start(const char *filename, int threshold_us) {
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        fprintf(stderr, "警告: 无法创建跟踪文件 '%s'，已禁用跟踪\n", filename);
+        return false;
+    }
+
+    memset(&tracer, 0, sizeof(tracer));
+    tracer.out = out;
+    tracer.start_ns = now_ns();
+    tracer.threshold_ns = threshold_us > 0 ? (uint64_t)threshold_us * 1000 : 0;
+    tracer.first_event = true;
+#ifndef _WIN32
+    tracer.pid = (int)getpid();
+#else
+    tracer.pid = 1;
+#endif
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+    write_metadata("process_name", KUNYU_NAME);
+    write_metadata("thread_name", "解释器");
+
+    static bool registered = false;
+    if (!registered) {
+        atexit(trace_stop);
+        registered = true;
+    }
+
+    trace_active = true;
+    return true;
+}
+
+/**
+ * 结束跟踪，补全尚未结束的阶段和调用，并关闭文件
+ */
+void trace_stop() {
+    if (tracer.out == NULL) {
+        return;
+    }
+
+    trace_active = false;
+    uint64_t end = now_ns();
+
+    // 出错退出时可能还有未结束的调用和阶段
+    while (tracer.call_depth > 0) {
+        TraceSpan *span = &tracer.calls[--tracer.call_depth];
+        write_complete_event(span->name, span->is_builtin ? "内置函数" : "函数",
+                             span->start_ns, end, span->line);
+    }
+    while (tracer.phase_depth > 0) {
+        TraceSpan *span = &tracer.phases[--tracer.phase_depth];
+        write_complete_event(span->name, "阶段", span->start_ns, end, 0);
+    }
+
+    fprintf(tracer.out, "\n],\"otherData\":{\"recorded_calls\":%ld,\"skipped_calls\":%ld}}\n",
+            tracer.recorded_calls, tracer.skipped_calls);
+    fclose(tracer.out);
+    tracer.out = NULL;
+}
+
+/**
+ * 开始一个阶段
+ * @param name 阶段名，必须在阶段结束前保持有效
+ */
+void trace_phase_begin(const char *name) {
+    if (!trace_active || tracer.phase_depth >= TRACE_MAX_PHASES) {
+        return;
+    }
+
+    TraceSpan *span = &tracer.phases[tracer.phase_depth++];
+    span->name = name;
+    span->is_builtin = false;
+    span->line = 0;
+    span->start_ns = now_ns();
+}
+
+/**
+ * 结束最近开始的阶段
+ */
+void trace_phase_end() {
+    if (!trace_active || tracer.phase_depth <= 0) {
+        return;
+    }
+
+    TraceSpan *span = &tracer.phases[--tracer.phase_depth];
+    write_complete_event(span->name, "阶段", span->start_ns, now_ns(), 0);
+}
+
+/**
+ * 记录函数调用开始
+ */
+void trace_call_begin(const char *name, bool is_builtin, int line) {
+    if (tracer.call_depth >= KUNYU_MAX_CALL_DEPTH) {
+        return;
+    }
+
+    TraceSpan *span = &tracer.calls[tracer.call_depth++];
+    span->name = name;
+    span->is_builtin = is_builtin;
+    span->line = line;
+    span->start_ns = now_ns();
+}
+
+/**
+ * 记录函数调用结束，短于阈值的调用不写出
+ */
+void trace_call_end() {
+    if (tracer.call_depth <= 0) {
+        return;
+    }
+
+    TraceSpan *span = &tracer.calls[--tracer.call_depth];
+    uint64_t end = now_ns();
+    if (end - span->start_ns < tracer.threshold_ns) {
+        tracer.skipped_calls++;
+        return;
+    }
+
+    write_complete_event(span->name, span->is_builtin ? "内置函数" : "函数",
+                         span->start_ns, end, span->line);
+    tracer.recorded_calls++;
+}
@@ -0,0 +1,288 @@
+/**
+ * 坤舆编程语言 - UTF-8校验和字符计数
+ * 源文件和从文件读入的字符串在进入解释器前校验一次。
+ * x86处理器支持SSSE3时使用查表法（Keiser和Lemire的算法）每次检查16个字节，
+ * 否则逐字节检查，连续的ASCII字节按8字节一组跳过。
+ */
+
+#include "../includes/kunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define UTF8_HAVE_SSSE3 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define UTF8_ASCII_MASK 0x8080808080808080ULL
+
+/**
+ * 读取8个字节
+ */
+static uint64_t load_word(const unsigned char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/**
+ * 逐字节校验，返回第一个非法字节的位置，全部合法时返回length
+ */
+static size_t validate_scalar(const unsigned char *s, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        // 跳过连续的ASCII字节
+        if (i + 8 <= length && (load_word(s + i) & UTF8_ASCII_MASK) == 0) {
+            i += 8;
+            continue;
+        }
+
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        // 后续字节数和第二个字节的范围（排除过长编码、代理项和超出U+10FFFF的码点）
+        size_t count;
+        unsigned char low = 0x80, high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            count = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            count = 2;
+            if (c == 0xE0) {
+                low = 0xA0;
+            } else if (c == 0xED) {
+                high = 0x9F;
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            count = 3;
+            if (c == 0xF0) {
+                low = 0x90;
+            } else if (c == 0xF4) {
+                high = 0x8F;
+            }
+        } else {
+            return i;
+        }
+
+        if (i + count >= length || s[i + 1] < low || s[i + 1] > high) {
+            return i;
+        }
+        for (size_t k = 2; k <= count; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) {
+                return i;
+            }
+        }
+        i += count + 1;
+    }
+    return length;
+}
+
+#ifdef UTF8_HAVE_SSSE3
+
+// 查表法中的错误类型，每种错误由前一个字节的高4位、低4位和当前字节的高4位共同确定
+#define TOO_SHORT   (1 << 0)    // 多字节序列的后续字节不足
+#define TOO_LONG    (1 << 1)    // ASCII后出现后续字节
+#define OVERLONG_3  (1 << 2)    // 三字节的过长编码
+#define TOO_LARGE   (1 << 3)    // 超出U+10FFFF
+#define SURROGATE   (1 << 4)    // 代理项U+D800到U+DFFF
+#define OVERLONG_2  (1 << 5)    // 两字节的过长编码
+#define TOO_LARGE_1000 (1 << 6) // 超出U+10FFFF（第二个字节是1000____）
+#define OVERLONG_4  (1 << 6)    // 四字节的过长编码
+#define TWO_CONTS   (1 << 7)    // 连续两个后续字节
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/**
+ * 每个字节右移4位
+ */
+__attribute__((target("ssse3")))
+static __m128i high_nibbles(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+/**
+ * 检查一个16字节的块，prev是前一个块
+ * @return 错误位，全0表示没有错误
+ */
+__attribute__((target("ssse3")))
+static __m128i check_block(__m128i input, __m128i prev) {
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    // 前1、2、3个字节（跨越块边界时取自前一个块）
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte_1_high_table, high_nibbles(prev1)),
+                      _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+        _mm_shuffle_epi8(byte_2_high_table, high_nibbles(input)));
+
+    // 三字节和四字节序列的第三、四个字节必须是后续字节，这正是查表中标记为TWO_CONTS的位置
+    __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+
+    return _mm_xor_si128(must23, special);
+}
+
+/**
+ * 块的末尾是否有未结束的多字节序列
+ */
+__attribute__((target("ssse3")))
+static __m128i incomplete_tail(__m128i input) {
+    const __m128i max_value = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm_subs_epu8(input, max_value);
+}
+
+/**
+ * 使用SSSE3校验
+ */
+__attribute__((target("ssse3")))
+static bool validate_ssse3(const unsigned char *s, size_t length) {
+    __m128i error = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+
+    size_t i = 0;
+    unsigned char tail[16];
+    while (i < length) {
+        __m128i input;
+        if (i + 16 <= length) {
+            input = _mm_loadu_si128((const __m128i *)(s + i));
+        } else {
+            // 最后不足16字节的部分补0（0是ASCII，不影响结果）
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, s + i, length - i);
+            input = _mm_loadu_si128((const __m128i *)tail);
+        }
+        i += 16;
+
+        if (_mm_movemask_epi8(input) == 0) {
+            // 全是ASCII时只需确认前一个块没有未结束的序列
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            error = _mm_or_si128(error, check_block(input, prev));
+            prev_incomplete = incomplete_tail(input);
+        }
+        prev = input;
+    }
+
+    error = _mm_or_si128(error, prev_incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+/**
+ * 处理器是否支持SSSE3
+ */
+static bool cpu_has_ssse3() {
+    static int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return supported == 1;
+}
+
+#endif /* UTF8_HAVE_SSSE3 */
+
+/**
+ * 校验UTF-8编码
+ * @param data 数据
+ * @param length 字节数
+ * @param error_offset 不合法时设置为第一个非法字节的位置，可以为NULL
+ * @return 合法返回true
+ */
+bool utf8_validate(const char *data, size_t length, size_t *error_offset) {
+    const unsigned char *s = (const unsigned char *)data;
+
+#ifdef UTF8_HAVE_SSSE3
+    // 向量化校验只能判断是否合法，出错时再逐字节定位
+    if (cpu_has_ssse3() && validate_ssse3(s, length)) {
+        return true;
+    }
+#endif
+
+    size_t offset = validate_scalar(s, length);
+    if (offset == length) {
+        return true;
+    }
+    if (error_offset != NULL) {
+        *error_offset = offset;
+    }
+    return false;
+}
+
+/**
+ * 统计UTF-8字符（码点）数，即不是后续字节（10xxxxxx）的字节数
+ */
+size_t utf8_count_chars(const char *data, size_t length) {
+    const unsigned char *s = (const unsigned char *)data;
+    size_t continuations = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // 后续字节作为有符号数小于-64
+    const __m128i threshold = _mm_set1_epi8(-64);
+    for (; i + 16 <= length; i += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(s + i));
+        int mask = _mm_movemask_epi8(_mm_cmplt_epi8(input, threshold));
+        continuations += (size_t)__builtin_popcount((unsigned int)mask);
+    }
+#else
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word = load_word(s + i);
+        // 最高两位是10的字节在对应位置得到1，再把8个字节的结果相加
+        uint64_t marks = ((word & UTF8_ASCII_MASK) >> 7) & ((~word & 0x4040404040404040ULL) >> 6);
+        continuations += (size_t)((marks * 0x0101010101010101ULL) >> 56);
+    }
+#endif
+
+    for (; i < length; i++) {
+        if ((s[i] & 0xC0) == 0x80) {
+            continuations++;
+        }
+    }
+    return length - continuations;
+}
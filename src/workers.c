@@ -0,0 +1,570 @@
+/**
+ * 坤舆编程语言 - 批处理
+ * kunyu --workers N --each 输入文件 脚本：对输入文件的每一行执行一次脚本。
+ * 父进程分析并优化脚本（包括所有函数体）之后创建N个工作进程，工作进程通过写时复制共享语法树和
+ * 内置函数表，解释器本身不需要支持多线程。父进程通过管道把输入逐个分给空闲的工作进程，
+ * 收到的结果按输入的顺序输出。
+ *
+ * 每次执行都在全新的全局作用域中进行，当前这一行的内容是全局常量"输入"，
+ * 脚本输出的内容被收集起来，和其他输入的输出不会交错。
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#define WORKERS_MAX 256
+#define WORKERS_INPUT_NAME "输入"
+#define WORKERS_ERROR_SIZE 320
+
+/**
+ * 父进程发给工作进程的任务，后面跟着输入内容
+ */
+typedef struct {
+    uint32_t index;                 // 输入的下标
+    uint32_t length;                // 输入的字节数
+} TaskHeader;
+
+/**
+ * 工作进程发回的结果，后面跟着输出和错误信息
+ */
+typedef struct {
+    uint32_t index;                 // 输入的下标
+    uint32_t success;               // 执行是否成功
+    uint32_t output_length;         // 输出的字节数
+    uint32_t error_length;          // 错误信息的字节数，成功时为0
+} ResultHeader;
+
+/**
+ * 工作进程
+ */
+typedef struct {
+    pid_t pid;
+    int task_fd;                    // 写任务，-1表示已经关闭
+    int result_fd;                  // 读结果，-1表示工作进程已经退出
+    long current;                   // 正在执行的输入下标，-1表示空闲
+    char *buffer;                   // 尚未读完的结果
+    size_t length;
+    size_t capacity;
+} Worker;
+
+/**
+ * 一个输入的执行结果
+ */
+typedef struct {
+    char *output;
+    size_t output_length;
+    char *error;                    // 出错时的错误信息
+    bool done;
+} TaskResult;
+
+/**
+ * 读取输入文件
+ */
+static char* read_inputs(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    *length = 0;
+    char *buffer = (char *)malloc(capacity);
+    while (buffer != NULL) {
+        *length += fread(buffer + *length, 1, capacity - *length - 1, file);
+        if (*length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = (char *)realloc(buffer, capacity);
+        if (grown == NULL) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+    fclose(file);
+
+    if (buffer != NULL) {
+        buffer[*length] = '\0';
+    }
+    return buffer;
+}
+
+/**
+ * 把输入按行切开，行尾的\r一并去掉，文件末尾换行之后的空行不算输入
+ * @return 每行的起始位置，行尾已经改为\0
+ */
+static char** split_lines(char *text, size_t length, long *count) {
+    long lines = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '\n') {
+            lines++;
+        }
+    }
+    if (length > 0 && text[length - 1] != '\n') {
+        lines++;
+    }
+
+    char **result = (char **)malloc(sizeof(char *) * (lines > 0 ? lines : 1));
+    if (result == NULL) {
+        return NULL;
+    }
+    char *line = text;
+    for (long i = 0; i < lines; i++) {
+        char *end = strchr(line, '\n');
+        if (end == NULL) {
+            end = text + length;
+        }
+        if (end > line && end[-1] == '\r') {
+            end[-1] = '\0';
+        }
+        *end = '\0';
+        result[i] = line;
+        line = end + 1;
+    }
+    *count = lines;
+    return result;
+}
+
+/**
+ * 读满指定的字节数
+ * @return 读到末尾或出错返回false
+ */
+static bool read_full(int fd, void *data, size_t length) {
+    char *p = (char *)data;
+    while (length > 0) {
+        ssize_t got = read(fd, p, length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        p += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * 写出全部数据
+ */
+static bool write_full(int fd, const void *data, size_t length) {
+    const char *p = (const char *)data;
+    while (length > 0) {
+        ssize_t written = write(fd, p, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        p += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * 执行一个输入
+ * @param error 出错时写入错误信息
+ * @return 成功返回true
+ */
+static bool execute_input(AstNode *ast, const char *input, char *error, size_t error_size) {
+    PyObject *value = py_string_new(input);
+    if (value == NULL) {
+        snprintf(error, error_size, "内存分配失败，无法创建输入");
+        return false;
+    }
+    bool success = interpreter_execute_with_constant(ast, WORKERS_INPUT_NAME, value);
+    py_decref(value);
+
+    if (!success) {
+        KunyuError *runtime_error = interpreter_get_error();
+        snprintf(error, error_size, "%s: %s (行 %d, 列 %d)",
+                 runtime_error->code == KUNYU_ERROR_PARSER ? "语法分析错误" : "运行时错误",
+                 runtime_error->message, runtime_error->line, runtime_error->column);
+    }
+    return success;
+}
+
+/**
+ * 工作进程：逐个读取任务并执行，标准输出重定向到临时文件，执行完一个输入后把输出发回父进程。
+ * 任务管道关闭时退出
+ */
+static void worker_main(AstNode *ast, int task_fd, int result_fd) {
+    FILE *capture = tmpfile();
+    if (capture == NULL || dup2(fileno(capture), STDOUT_FILENO) < 0) {
+        _exit(1);
+    }
+    int capture_fd = fileno(capture);
+
+    // 导入的模块在工作进程中只分析一次
+    module_set_cache(true);
+
+    char *input = NULL;
+    size_t input_capacity = 0;
+    char *output = NULL;
+    size_t output_capacity = 0;
+    TaskHeader task;
+    while (read_full(task_fd, &task, sizeof(task))) {
+        if (task.length + 1 > input_capacity) {
+            free(input);
+            input_capacity = task.length + 1;
+            input = (char *)malloc(input_capacity);
+            if (input == NULL) {
+                _exit(1);
+            }
+        }
+        if (!read_full(task_fd, input, task.length)) {
+            break;
+        }
+        input[task.length] = '\0';
+
+        char error[WORKERS_ERROR_SIZE] = "";
+        bool success = execute_input(ast, input, error, sizeof(error));
+
+        // 取出这次的输出并清空临时文件
+        fflush(stdout);
+        off_t size = lseek(capture_fd, 0, SEEK_END);
+        size_t output_length = size > 0 ? (size_t)size : 0;
+        if (output_length > output_capacity) {
+            free(output);
+            output_capacity = output_length;
+            output = (char *)malloc(output_capacity);
+            if (output == NULL) {
+                _exit(1);
+            }
+        }
+        if (output_length > 0 && pread(capture_fd, output, output_length, 0) != (ssize_t)output_length) {
+            output_length = 0;
+        }
+        if (ftruncate(capture_fd, 0) == 0) {
+            lseek(capture_fd, 0, SEEK_SET);
+        }
+
+        ResultHeader result;
+        result.index = task.index;
+        result.success = success ? 1 : 0;
+        result.output_length = (uint32_t)output_length;
+        result.error_length = success ? 0 : (uint32_t)strlen(error);
+        if (!write_full(result_fd, &result, sizeof(result)) ||
+            !write_full(result_fd, output, output_length) ||
+            !write_full(result_fd, error, result.error_length)) {
+            break;
+        }
+    }
+    _exit(0);
+}
+
+/**
+ * 在workers[index]创建工作进程。子进程关闭其他工作进程的管道，否则这些管道的写端不会随父进程关闭
+ * @param count 已经创建过的工作进程数
+ * @return 成功返回true
+ */
+static bool spawn_worker(AstNode *ast, Worker *workers, int count, int index) {
+    int task_pipe[2];
+    int result_pipe[2];
+    if (pipe(task_pipe) != 0) {
+        return false;
+    }
+    if (pipe(result_pipe) != 0) {
+        close(task_pipe[0]);
+        close(task_pipe[1]);
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(task_pipe[0]);
+        close(task_pipe[1]);
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return false;
+    }
+    if (pid == 0) {
+        for (int i = 0; i < count; i++) {
+            if (i == index) {
+                continue;
+            }
+            if (workers[i].task_fd >= 0) {
+                close(workers[i].task_fd);
+            }
+            if (workers[i].result_fd >= 0) {
+                close(workers[i].result_fd);
+            }
+        }
+        close(task_pipe[1]);
+        close(result_pipe[0]);
+        worker_main(ast, task_pipe[0], result_pipe[1]);
+    }
+
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+    Worker *worker = &workers[index];
+    free(worker->buffer);
+    memset(worker, 0, sizeof(Worker));
+    worker->pid = pid;
+    worker->task_fd = task_pipe[1];
+    worker->result_fd = result_pipe[0];
+    worker->current = -1;
+    return true;
+}
+
+/**
+ * 把下一个输入分给空闲的工作进程，没有剩下的输入时关闭任务管道让它退出
+ * @return 工作进程已经退出时返回false
+ */
+static bool dispatch(Worker *worker, char **inputs, long input_count, long *next_input) {
+    if (*next_input >= input_count) {
+        if (worker->task_fd >= 0) {
+            close(worker->task_fd);
+            worker->task_fd = -1;
+        }
+        return true;
+    }
+
+    long index = (*next_input)++;
+    TaskHeader task;
+    task.index = (uint32_t)index;
+    task.length = (uint32_t)strlen(inputs[index]);
+    worker->current = index;
+    return write_full(worker->task_fd, &task, sizeof(task)) &&
+           write_full(worker->task_fd, inputs[index], task.length);
+}
+
+/**
+ * 记录一个输入的结果
+ */
+static void store_result(TaskResult *result, const char *output, size_t output_length, const char *error) {
+    result->done = true;
+    if (output_length > 0) {
+        result->output = (char *)malloc(output_length);
+        if (result->output != NULL) {
+            memcpy(result->output, output, output_length);
+            result->output_length = output_length;
+        }
+    }
+    if (error != NULL) {
+        result->error = strdup(error);
+    }
+}
+
+/**
+ * 从工作进程读取结果，收到完整的结果后把它记下并分配下一个输入
+ * @return 工作进程仍然可用时返回true
+ */
+static bool receive(Worker *worker, TaskResult *results, char **inputs, long input_count, long *next_input) {
+    if (worker->capacity - worker->length < 65536) {
+        size_t capacity = worker->capacity > 0 ? worker->capacity * 2 : 65536 * 2;
+        char *grown = (char *)realloc(worker->buffer, capacity);
+        if (grown == NULL) {
+            return false;
+        }
+        worker->buffer = grown;
+        worker->capacity = capacity;
+    }
+    ssize_t got = read(worker->result_fd, worker->buffer + worker->length, worker->capacity - worker->length);
+    if (got < 0 && errno == EINTR) {
+        return true;
+    }
+    if (got <= 0) {
+        return false;
+    }
+    worker->length += (size_t)got;
+
+    ResultHeader header;
+    if (worker->length < sizeof(header)) {
+        return true;
+    }
+    memcpy(&header, worker->buffer, sizeof(header));
+    size_t total = sizeof(header) + header.output_length + header.error_length;
+    if (worker->length < total) {
+        return true;
+    }
+
+    // 工作进程一次只执行一个输入，完整的结果之后不会再有数据
+    char error[WORKERS_ERROR_SIZE];
+    const char *payload = worker->buffer + sizeof(header);
+    size_t error_length = header.error_length < sizeof(error) ? header.error_length : sizeof(error) - 1;
+    memcpy(error, payload + header.output_length, error_length);
+    error[error_length] = '\0';
+    if (header.index < (uint32_t)input_count) {
+        store_result(&results[header.index], payload, header.output_length, header.success ? NULL : error);
+    }
+    worker->length = 0;
+    worker->current = -1;
+    return dispatch(worker, inputs, input_count, next_input);
+}
+
+/**
+ * 工作进程意外退出：正在执行的输入记为失败，回收进程
+ */
+static void retire(Worker *worker, TaskResult *results) {
+    if (worker->current >= 0) {
+        store_result(&results[worker->current], NULL, 0, "工作进程意外退出");
+        worker->current = -1;
+    }
+    if (worker->task_fd >= 0) {
+        close(worker->task_fd);
+        worker->task_fd = -1;
+    }
+    close(worker->result_fd);
+    worker->result_fd = -1;
+    waitpid(worker->pid, NULL, 0);
+}
+
+/**
+ * 按输入的顺序输出已经完成的结果
+ * @return 输出结果中失败的个数
+ */
+static long flush_results(TaskResult *results, long input_count, long *next_output) {
+    long failed = 0;
+    while (*next_output < input_count && results[*next_output].done) {
+        TaskResult *result = &results[*next_output];
+        if (result->output_length > 0) {
+            fwrite(result->output, 1, result->output_length, stdout);
+        }
+        if (result->error != NULL) {
+            fflush(stdout);
+            fprintf(stderr, "第%ld行: %s\n", *next_output + 1, result->error);
+            failed++;
+        }
+        free(result->output);
+        free(result->error);
+        result->output = NULL;
+        result->error = NULL;
+        (*next_output)++;
+    }
+    return failed;
+}
+
+/**
+ * 对输入文件的每一行执行一次脚本
+ * @param ast 已经完整分析和优化的语法树
+ * @param inputs_path 输入文件，每行一个输入
+ * @param worker_count 工作进程数
+ * @return 进程退出码，有输入执行失败时为1
+ */
+int workers_run(AstNode *ast, const char *inputs_path, int worker_count) {
+    size_t text_length;
+    char *text = read_inputs(inputs_path, &text_length);
+    if (text == NULL) {
+        fprintf(stderr, "错误: 无法读取输入文件 '%s'\n", inputs_path);
+        return 1;
+    }
+    size_t error_offset;
+    if (memchr(text, '\0', text_length) != NULL || !utf8_validate(text, text_length, &error_offset)) {
+        fprintf(stderr, "错误: 输入文件 '%s' 不是有效的UTF-8文本\n", inputs_path);
+        free(text);
+        return 1;
+    }
+
+    long input_count = 0;
+    char **inputs = split_lines(text, text_length, &input_count);
+    TaskResult *results = inputs != NULL ? (TaskResult *)calloc(input_count > 0 ? input_count : 1, sizeof(TaskResult)) : NULL;
+    if (results == NULL) {
+        fprintf(stderr, "错误: 内存分配失败\n");
+        free(inputs);
+        free(text);
+        return 1;
+    }
+
+    if (worker_count > input_count) {
+        worker_count = (int)input_count;
+    }
+    if (worker_count > WORKERS_MAX) {
+        worker_count = WORKERS_MAX;
+    }
+
+    // 工作进程退出后父进程写任务得到EPIPE错误，而不是被SIGPIPE结束
+    signal(SIGPIPE, SIG_IGN);
+
+    // 内置函数表在创建工作进程之前建好，由所有工作进程共享
+    builtins_init();
+
+    Worker workers[WORKERS_MAX];
+    int spawned = 0;
+    long next_input = 0;
+    long next_output = 0;
+    long failed = 0;
+    memset(workers, 0, sizeof(Worker) * (worker_count > 0 ? worker_count : 1));
+    while (spawned < worker_count && spawn_worker(ast, workers, spawned, spawned)) {
+        if (!dispatch(&workers[spawned], inputs, input_count, &next_input)) {
+            retire(&workers[spawned], results);
+        }
+        spawned++;
+    }
+    if (spawned < worker_count) {
+        fprintf(stderr, "警告: 只创建了%d个工作进程\n", spawned);
+    }
+
+    struct pollfd fds[WORKERS_MAX];
+    int owners[WORKERS_MAX];
+    while (next_output < input_count) {
+        int count = 0;
+        for (int i = 0; i < spawned; i++) {
+            if (workers[i].result_fd >= 0 && workers[i].current >= 0) {
+                fds[count].fd = workers[i].result_fd;
+                fds[count].events = POLLIN;
+                fds[count].revents = 0;
+                owners[count++] = i;
+            }
+        }
+        if (count == 0) {
+            // 所有工作进程都已退出，剩下的输入无法执行
+            for (long i = next_input; i < input_count; i++) {
+                store_result(&results[i], NULL, 0, "没有可用的工作进程");
+            }
+            next_input = input_count;
+            failed += flush_results(results, input_count, &next_output);
+            break;
+        }
+
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "错误: 等待工作进程失败\n");
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            Worker *worker = &workers[owners[i]];
+            if (fds[i].revents == 0 || receive(worker, results, inputs, input_count, &next_input)) {
+                continue;
+            }
+            // 工作进程意外退出时换一个新的继续执行剩下的输入，每次退出至少消耗一个输入，不会无限重建
+            retire(worker, results);
+            if (next_input < input_count && spawn_worker(ast, workers, spawned, owners[i]) &&
+                !dispatch(worker, inputs, input_count, &next_input)) {
+                retire(worker, results);
+            }
+        }
+        failed += flush_results(results, input_count, &next_output);
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < spawned; i++) {
+        if (workers[i].result_fd >= 0) {
+            retire(&workers[i], results);
+        }
+        free(workers[i].buffer);
+    }
+    for (long i = next_output; i < input_count; i++) {
+        free(results[i].output);
+        free(results[i].error);
+    }
+    free(results);
+    free(inputs);
+    free(text);
+    return failed > 0 || next_output < input_count ? 1 : 0;
+}
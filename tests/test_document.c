@@ -0,0 +1,394 @@
+/**
+ * 坤舆编程语言 - 增量语法分析测试
+ * 在同一个文档上依次进行插入、删除和替换编辑，每次编辑后都用编辑后的源码新建一个文档完整分析，
+ * 两者的语法树（包括每个节点的行号和列号）和顶层语句的范围必须完全相同。
+ * 编辑是连续进行的，前一次编辑后移动的行号和字节偏移如果有误，会在之后的编辑中暴露出来
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+/**
+ * 编辑后预期的分析方式
+ */
+typedef enum {
+    EXPECT_LOCAL,        // 只重新分析部分语句
+    EXPECT_FULL,         // 退回到完整分析
+    EXPECT_ANY,          // 不限定分析方式
+    EXPECT_ERROR         // 编辑后的源码有错误
+} Expectation;
+
+/**
+ * 一次编辑：在anchor第一次出现的位置之后skip个字节处删除remove个字节，再插入text
+ */
+typedef struct {
+    const char *name;
+    const char *anchor;
+    size_t skip;
+    size_t remove;
+    const char *text;
+    Expectation expect;
+} Edit;
+
+static const char *BASE =
+    "# 增量分析测试\n"
+    "变量 甲 = 1;\n"
+    "常量 乙 = \"文本\";\n"
+    "函数 加(a, b) {\n"
+    "    返回 a + b;\n"
+    "}\n"
+    "函数 计数(n) {\n"
+    "    变量 i = 0;\n"
+    "    循环 (i < n) {\n"
+    "        i = i + 1;\n"
+    "    }\n"
+    "    返回 i;\n"
+    "}\n"
+    "变量 标题 = \"甲\";\n"
+    "输出 标题;\n"
+    "# 结束引号\";\n"
+    "变量 丙 = 加(甲, 2);\n"
+    "如果 (丙 > 2) {\n"
+    "    输出 \"大\";\n"
+    "} 否则 {\n"
+    "    输出 \"小\";\n"
+    "}\n"
+    "变量 丁 = 函数 (x) {\n"
+    "    返回 x * 丙;\n"
+    "};\n"
+    "输出 丁(3);\n"
+    "输出 计数(5);\n";
+
+#define INSERT(name, anchor, text, expect) { name, anchor, 0, 0, text, expect }
+#define DELETE(name, anchor, expect) { name, anchor, 0, sizeof(anchor) - 1, "", expect }
+#define REPLACE(name, anchor, text, expect) { name, anchor, 0, sizeof(anchor) - 1, text, expect }
+
+static const Edit EDITS[] = {
+    INSERT("在中间插入一条语句", "变量 丙", "变量 新 = 甲 + 1;\n", EXPECT_LOCAL),
+    INSERT("在函数体中插入一行", "    }\n    返回 i;", "        输出 i;\n", EXPECT_LOCAL),
+    DELETE("删除一条语句", "常量 乙 = \"文本\";\n", EXPECT_LOCAL),
+    REPLACE("替换同一行中的表达式", "x * 丙", "(x + 1) * 丙 - 甲", EXPECT_LOCAL),
+    REPLACE("替换后行数减少", "如果 (丙 > 2) {\n    输出 \"大\";\n} 否则 {\n    输出 \"小\";\n}",
+            "如果 (丙 > 2) { 输出 \"大\"; }", EXPECT_LOCAL),
+    INSERT("在开头插入", "# 增量分析测试", "变量 首 = 0;\n", EXPECT_LOCAL),
+    INSERT("在末尾追加", "输出 计数(5);\n", "输出 首;\n输出 新;\n", EXPECT_LOCAL),
+    REPLACE("替换一行中间的标识符", "加(甲, 2)", "加(新, 甲)", EXPECT_LOCAL),
+    DELETE("删除后函数合并", "}\n函数 计数(n) {\n", EXPECT_ANY),
+    INSERT("插入的行有语法错误", "输出 丁(3);", "变量 错 = ;\n", EXPECT_ERROR),
+    DELETE("修正语法错误", "变量 错 = ;\n", EXPECT_FULL),
+    // 字符串延伸到下一条语句，一直到注释中的引号才结束，下一条语句的第一个标记不在原来的位置上
+    REPLACE("未闭合的字符串吞掉后面的语句", "\"甲\";", "\"甲", EXPECT_FULL),
+    // 闭合后原来的一条语句重新分成两条，后面的语句不受影响
+    REPLACE("重新闭合字符串", "\"甲\n", "\"甲\";\n", EXPECT_LOCAL),
+    REPLACE("替换多行", "变量 新 = 甲 + 1;\n变量 丙", "变量 新 = 2;\n\n\n变量 丙", EXPECT_LOCAL),
+    { "删除空行", "\n\n\n变量 丙", 1, 2, "", EXPECT_LOCAL },
+};
+
+/**
+ * 可增长的文本缓冲区
+ */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static void append(Buffer *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int needed = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (needed < 0) {
+        va_end(args);
+        return;
+    }
+    if (buffer->length + (size_t)needed + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+        while (buffer->length + (size_t)needed + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *data = (char *)realloc(buffer->data, capacity);
+        if (data == NULL) {
+            va_end(args);
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    vsnprintf(buffer->data + buffer->length, buffer->capacity - buffer->length, format, args);
+    buffer->length += (size_t)needed;
+    va_end(args);
+}
+
+static void dump_node(Buffer *out, const AstNode *node);
+
+static void dump_operand(Buffer *out, const SuperOperand *operand) {
+    if (operand->name != NULL) {
+        append(out, " %s", operand->name);
+    } else if (operand->is_int) {
+        append(out, " %lld", (long long)operand->int_constant);
+    } else {
+        append(out, " %.17g", operand->constant);
+    }
+}
+
+/**
+ * 把语法树写成文本：节点类型、行号、列号、名字和值，子节点写在括号中
+ */
+static void dump_node(Buffer *out, const AstNode *node) {
+    if (node == NULL) {
+        append(out, "()");
+        return;
+    }
+
+    append(out, "(%d@%d:%d", (int)node->type, node->line, node->column);
+    switch (node->type) {
+        case NODE_PROGRAM: {
+            if (ast_is_expression_stmt(node)) {
+                append(out, " 表达式");
+                dump_node(out, ((const ExpressionStmt *)node)->expr);
+            } else {
+                const Program *program = (const Program *)node;
+                for (int i = 0; i < program->stmt_count; i++) {
+                    dump_node(out, program->statements[i]);
+                }
+            }
+            break;
+        }
+        case NODE_BLOCK: {
+            const BlockStmt *block = (const BlockStmt *)node;
+            for (int i = 0; i < block->stmt_count; i++) {
+                dump_node(out, block->statements[i]);
+            }
+            break;
+        }
+        case NODE_VARDECL: {
+            const VarDeclStmt *stmt = (const VarDeclStmt *)node;
+            append(out, " %s %d", stmt->name, (int)stmt->is_constant);
+            dump_node(out, stmt->initializer);
+            break;
+        }
+        case NODE_FUNCDECL: {
+            const FunctionStmt *stmt = (const FunctionStmt *)node;
+            append(out, " %s %zu %d", stmt->name, stmt->memo_capacity, (int)stmt->assume_pure);
+            for (int i = 0; i < stmt->param_count; i++) {
+                append(out, " %s", stmt->params[i]);
+            }
+            dump_node(out, stmt->body);
+            break;
+        }
+        case NODE_IF: {
+            const IfStmt *stmt = (const IfStmt *)node;
+            dump_node(out, stmt->condition);
+            dump_node(out, stmt->then_branch);
+            dump_node(out, stmt->else_branch);
+            break;
+        }
+        case NODE_LOOP: {
+            const LoopStmt *stmt = (const LoopStmt *)node;
+            dump_node(out, stmt->condition);
+            dump_node(out, stmt->body);
+            break;
+        }
+        case NODE_CALL: {
+            const CallExpr *expr = (const CallExpr *)node;
+            append(out, " %s", expr->name);
+            for (int i = 0; i < expr->arg_count; i++) {
+                dump_node(out, expr->args[i]);
+            }
+            break;
+        }
+        case NODE_RETURN:
+            dump_node(out, ((const ReturnStmt *)node)->value);
+            break;
+        case NODE_PRINT:
+            dump_node(out, ((const PrintStmt *)node)->value);
+            break;
+        case NODE_BINARY: {
+            const BinaryExpr *expr = (const BinaryExpr *)node;
+            append(out, " %d", (int)expr->op);
+            dump_node(out, expr->left);
+            dump_node(out, expr->right);
+            break;
+        }
+        case NODE_UNARY: {
+            const UnaryExpr *expr = (const UnaryExpr *)node;
+            append(out, " %d", (int)expr->op);
+            dump_node(out, expr->operand);
+            break;
+        }
+        case NODE_LITERAL: {
+            const LiteralExpr *expr = (const LiteralExpr *)node;
+            append(out, " %d \"%s\"", (int)expr->token_type, expr->value);
+            break;
+        }
+        case NODE_IDENTIFIER:
+            append(out, " %s", ((const VariableExpr *)node)->name);
+            break;
+        case NODE_GROUPING:
+            dump_node(out, ((const GroupingExpr *)node)->expr);
+            break;
+        case NODE_ASSIGN: {
+            const AssignExpr *expr = (const AssignExpr *)node;
+            append(out, " %s", expr->name);
+            dump_node(out, expr->value);
+            break;
+        }
+        case NODE_SUPER: {
+            const SuperInstr *instr = (const SuperInstr *)node;
+            append(out, " %d %d %s %d", (int)instr->op, (int)instr->binary_op,
+                   instr->target != NULL ? instr->target : "-", (int)instr->is_constant);
+            dump_operand(out, &instr->left);
+            dump_operand(out, &instr->right);
+            dump_node(out, instr->original);
+            break;
+        }
+        case NODE_LAMBDA: {
+            const LambdaExpr *expr = (const LambdaExpr *)node;
+            for (int i = 0; i < expr->param_count; i++) {
+                append(out, " %s", expr->params[i]);
+            }
+            append(out, " |");
+            for (int i = 0; i < expr->upvalue_count; i++) {
+                append(out, " %s", expr->upvalues[i]);
+            }
+            dump_node(out, expr->body);
+            break;
+        }
+        case NODE_IMPORT:
+            append(out, " %s", ((const ImportStmt *)node)->path);
+            break;
+    }
+    append(out, ")");
+}
+
+/**
+ * 比较文档与完整分析同一份源码的结果
+ * @return 相同时返回true
+ */
+static bool compare_with_fresh(const char *name, KunyuDocument *doc) {
+    KunyuDocument *fresh = document_new(document_source(doc));
+    if (fresh == NULL) {
+        printf("失败: %s: 内存分配失败\n", name);
+        return false;
+    }
+
+    bool same = true;
+    AstNode *ast = document_ast(doc);
+    AstNode *fresh_ast = document_ast(fresh);
+    if ((ast == NULL) != (fresh_ast == NULL)) {
+        printf("失败: %s: 增量分析%s，完整分析%s\n", name,
+               ast == NULL ? "有错误" : "没有错误", fresh_ast == NULL ? "有错误" : "没有错误");
+        same = false;
+    } else if (ast == NULL) {
+        KunyuError *error = document_error(doc);
+        KunyuError *fresh_error = document_error(fresh);
+        if (strcmp(error->message, fresh_error->message) != 0 || error->line != fresh_error->line ||
+            error->column != fresh_error->column) {
+            printf("失败: %s: 增量分析报告 %s (行 %d, 列 %d)，完整分析报告 %s (行 %d, 列 %d)\n", name,
+                   error->message, error->line, error->column,
+                   fresh_error->message, fresh_error->line, fresh_error->column);
+            same = false;
+        }
+    } else {
+        Program *program = (Program *)ast;
+        Program *fresh_program = (Program *)fresh_ast;
+        if (program->stmt_count != fresh_program->stmt_count) {
+            printf("失败: %s: 增量分析有%d条语句，完整分析有%d条\n", name,
+                   program->stmt_count, fresh_program->stmt_count);
+            same = false;
+        }
+        for (int i = 0; same && i < program->stmt_count; i++) {
+            size_t start, end, fresh_start, fresh_end;
+            int line, fresh_line;
+            document_statement_span(doc, i, &start, &end, &line);
+            document_statement_span(fresh, i, &fresh_start, &fresh_end, &fresh_line);
+            if (start != fresh_start || end != fresh_end || line != fresh_line) {
+                printf("失败: %s: 第%d条语句的范围是[%zu, %zu)第%d行，完整分析是[%zu, %zu)第%d行\n",
+                       name, i + 1, start, end, line, fresh_start, fresh_end, fresh_line);
+                same = false;
+                break;
+            }
+
+            Buffer dump = { NULL, 0, 0 };
+            Buffer fresh_dump = { NULL, 0, 0 };
+            dump_node(&dump, program->statements[i]);
+            dump_node(&fresh_dump, fresh_program->statements[i]);
+            if (dump.data == NULL || fresh_dump.data == NULL || strcmp(dump.data, fresh_dump.data) != 0) {
+                printf("失败: %s: 第%d条语句的语法树不同\n  增量分析: %s\n  完整分析: %s\n", name, i + 1,
+                       dump.data != NULL ? dump.data : "", fresh_dump.data != NULL ? fresh_dump.data : "");
+                same = false;
+            }
+            free(dump.data);
+            free(fresh_dump.data);
+        }
+    }
+
+    document_free(fresh);
+    return same;
+}
+
+/**
+ * 进行一次编辑并检查结果
+ * @return 失败的次数
+ */
+static int apply_edit(KunyuDocument *doc, const Edit *edit) {
+    const char *source = document_source(doc);
+    const char *found = strstr(source, edit->anchor);
+    if (found == NULL) {
+        printf("失败: %s: 源码中没有找到编辑位置\n", edit->name);
+        return 1;
+    }
+    size_t start = (size_t)(found - source) + edit->skip;
+    bool ok = document_edit(doc, start, start + edit->remove, edit->text);
+
+    int failures = 0;
+    if (ok != (edit->expect != EXPECT_ERROR)) {
+        KunyuError *error = document_error(doc);
+        printf("失败: %s: %s\n", edit->name, ok ? "预期有错误" : error->message);
+        failures++;
+    }
+    if (ok && edit->expect != EXPECT_ANY) {
+        int first;
+        int changed = document_changed(doc, &first);
+        int total = ((Program *)document_ast(doc))->stmt_count;
+        bool full = first == 0 && changed == total;
+        if (full != (edit->expect == EXPECT_FULL)) {
+            printf("失败: %s: 重新分析了%d条语句中从第%d条开始的%d条，预期%s\n", edit->name,
+                   total, first + 1, changed, edit->expect == EXPECT_FULL ? "完整分析" : "局部分析");
+            failures++;
+        }
+    }
+    if (!compare_with_fresh(edit->name, doc)) {
+        failures++;
+    }
+
+    if (failures == 0) {
+        printf("通过: %s\n", edit->name);
+    }
+    return failures;
+}
+
+int main(void) {
+    KunyuDocument *doc = document_new(BASE);
+    if (doc == NULL || document_ast(doc) == NULL) {
+        printf("失败: 初始源码: %s\n", doc != NULL ? document_error(doc)->message : "内存分配失败");
+        document_free(doc);
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(EDITS) / sizeof(EDITS[0]); i++) {
+        failures += apply_edit(doc, &EDITS[i]);
+    }
+
+    document_free(doc);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * 坤舆编程语言 - @缓存 纯度检查测试
+ * 解释器状态在多次编译之间保留，一次被拒绝的 @缓存 声明不能让之后的检查得出错误的结论：
+ * 检查中递归调用正在检查的函数时假设它是纯的，这个假设不成立时，依赖它的结论必须作废
+ */
+
+#include "libkunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/**
+ * 互相递归的两个函数，甲在调用乙之后才输出，检查乙时甲还在检查中
+ */
+static const char *MUTUAL =
+    "函数 甲(n) {\n"
+    "    变量 r = 乙(n);\n"
+    "    输出 \"甲\";\n"
+    "    返回 r;\n"
+    "}\n"
+    "\n"
+    "函数 乙(n) {\n"
+    "    如果 (n <= 0) {\n"
+    "        返回 0;\n"
+    "    }\n"
+    "    返回 甲(n - 1);\n"
+    "}\n";
+
+/**
+ * 互相递归的纯函数，可以缓存。检查在声明时进行，被调用的函数要先声明
+ */
+static const char *PURE_MUTUAL =
+    "函数 是奇数(n) {\n"
+    "    如果 (n <= 0) {\n"
+    "        返回 0;\n"
+    "    }\n"
+    "    返回 是偶数(n - 1);\n"
+    "}\n"
+    "\n"
+    "@缓存\n"
+    "函数 是偶数(n) {\n"
+    "    如果 (n <= 0) {\n"
+    "        返回 1;\n"
+    "    }\n"
+    "    返回 是奇数(n - 1);\n"
+    "}\n";
+
+static int failures = 0;
+
+/**
+ * 编译脚本，检查是否成功与预期相符；预期失败时检查错误信息包含expected_error
+ */
+static void expect_compile(KunyuState *state, const char *name, const char *source,
+                           const char *expected_error) {
+    KunyuScript *script = kunyu_compile(state, source);
+    if (expected_error == NULL && script == NULL) {
+        printf("失败: %s: 编译出错: %s\n", name, kunyu_last_error(state));
+        failures++;
+    } else if (expected_error != NULL && script != NULL) {
+        printf("失败: %s: 预期编译失败（%s），实际成功\n", name, expected_error);
+        failures++;
+    } else if (expected_error != NULL && strstr(kunyu_last_error(state), expected_error) == NULL) {
+        printf("失败: %s: 错误信息 '%s' 中没有 '%s'\n", name, kunyu_last_error(state), expected_error);
+        failures++;
+    } else {
+        printf("通过: %s\n", name);
+    }
+}
+
+int main(void) {
+    KunyuState *state = kunyu_state_new();
+    if (state == NULL) {
+        fprintf(stderr, "错误: 无法创建解释器状态\n");
+        return 1;
+    }
+
+    expect_compile(state, "定义互相递归的函数", MUTUAL, NULL);
+    expect_compile(state, "拒绝缓存调用了有副作用函数的函数",
+                   "@缓存\n函数 丙(n) {\n    返回 甲(n);\n}\n", "不能使用@缓存");
+    // 检查丙时乙在甲的检查过程中被判定为纯，甲有副作用，这个结论不能保留
+    expect_compile(state, "上一次检查失败后仍然拒绝",
+                   "@缓存\n函数 丁(n) {\n    返回 乙(n);\n}\n", "不能使用@缓存");
+    expect_compile(state, "接受互相递归的纯函数", PURE_MUTUAL, NULL);
+
+    KunyuScript *script = kunyu_compile(state, "");
+    KunyuValue *arg = kunyu_integer_new(10);
+    KunyuValue *result = script != NULL ? kunyu_call(script, "是偶数", &arg, 1) : NULL;
+    int64_t value = -1;
+    if (result == NULL || !kunyu_to_integer(result, &value) || value != 1) {
+        printf("失败: 调用缓存的纯函数: %s\n", result == NULL ? kunyu_last_error(state) : "结果不是1");
+        failures++;
+    } else {
+        printf("通过: 调用缓存的纯函数\n");
+    }
+    if (result != NULL) {
+        kunyu_release(result);
+    }
+    kunyu_release(arg);
+
+    kunyu_state_free(state);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * 坤舆编程语言 - 并行分析函数体测试
+ * 和 kunyu -c 一样先分析顶层语句，再在多个线程上分析所有函数体。
+ * 不论使用多少线程、线程以什么顺序完成，报告的都必须是源文件中最早的错误，行号和列号与单线程相同
+ */
+
+#include "../includes/kunyu.h"
+#include "../includes/ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define FUNCTION_COUNT 400          // 函数体的标记总数要超过并行分析的下限
+#define REPEAT 20                   // 每种线程数重复的次数，线程完成的顺序每次不同
+
+static const int THREAD_COUNTS[] = { 1, 2, 3, 4, 8, 16 };
+
+/**
+ * 生成测试源码，bad中列出的函数的函数体有语法错误
+ * @param first_error_line 设置为最早的错误所在的行，没有错误时为0
+ */
+static char* generate_source(const int *bad, int bad_count, int *first_error_line) {
+    size_t capacity = FUNCTION_COUNT * 256;
+    char *source = (char *)malloc(capacity);
+    if (source == NULL) {
+        return NULL;
+    }
+
+    size_t length = 0;
+    int line = 1;
+    *first_error_line = 0;
+    for (int i = 0; i < FUNCTION_COUNT; i++) {
+        bool is_bad = false;
+        for (int j = 0; j < bad_count; j++) {
+            is_bad = is_bad || bad[j] == i;
+        }
+        if (is_bad && *first_error_line == 0) {
+            *first_error_line = line + 2;
+        }
+        length += snprintf(source + length, capacity - length,
+                           "函数 计算%d(n) {\n"
+                           "    变量 a = n + %d;\n"
+                           "    变量 b = %s;\n"
+                           "    如果 (a > b) {\n"
+                           "        返回 a;\n"
+                           "    }\n"
+                           "    返回 b;\n"
+                           "}\n",
+                           i, i, is_bad ? "" : "a * 2");
+        line += 8;
+    }
+    return source;
+}
+
+/**
+ * 按 kunyu -c 的方式分析源码
+ * @param error 分析失败时设置为错误信息
+ * @return 没有语法错误时返回true
+ */
+static bool check_source(const char *source, int threads, KunyuError *error) {
+    if (lexer_init(source) == NULL || lexer_tokenize() < 0) {
+        *error = *lexer_get_error();
+        lexer_free();
+        return false;
+    }
+
+    size_t token_count;
+    Token *tokens = lexer_detach_tokens(&token_count);
+    AstNode *ast = parser_parse(tokens, token_count);
+    bool success = ast != NULL && parser_parse_function_bodies(ast, threads);
+    if (!success) {
+        *error = *parser_get_error();
+    }
+    if (ast != NULL) {
+        ast_free(ast);
+    }
+    lexer_free_tokens(tokens, token_count);
+    return success;
+}
+
+/**
+ * 用各种线程数反复分析，检查结果都与单线程相同
+ * @return 失败的次数
+ */
+static int run_case(const char *name, const int *bad, int bad_count) {
+    int expected_line;
+    char *source = generate_source(bad, bad_count, &expected_line);
+    if (source == NULL) {
+        printf("失败: %s: 内存分配失败\n", name);
+        return 1;
+    }
+
+    KunyuError reference;
+    memset(&reference, 0, sizeof(reference));
+    bool reference_ok = check_source(source, 1, &reference);
+    int failures = 0;
+    if (reference_ok != (bad_count == 0) || (!reference_ok && reference.line != expected_line)) {
+        printf("失败: %s: 单线程结果不对: %s (行 %d, 列 %d)，预期错误在第%d行\n",
+               name, reference_ok ? "没有错误" : reference.message, reference.line, reference.column,
+               expected_line);
+        failures++;
+    }
+
+    for (size_t t = 0; t < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]) && failures == 0; t++) {
+        for (int r = 0; r < REPEAT && failures == 0; r++) {
+            KunyuError error;
+            memset(&error, 0, sizeof(error));
+            bool ok = check_source(source, THREAD_COUNTS[t], &error);
+            if (ok != reference_ok ||
+                (!ok && (error.line != reference.line || error.column != reference.column ||
+                         strcmp(error.message, reference.message) != 0))) {
+                printf("失败: %s: %d个线程报告 %s (行 %d, 列 %d)，单线程报告 %s (行 %d, 列 %d)\n",
+                       name, THREAD_COUNTS[t], ok ? "没有错误" : error.message, error.line, error.column,
+                       reference_ok ? "没有错误" : reference.message, reference.line, reference.column);
+                failures++;
+            }
+        }
+    }
+
+    if (failures == 0) {
+        if (reference_ok) {
+            printf("通过: %s\n", name);
+        } else {
+            printf("通过: %s: %s (行 %d, 列 %d)\n", name, reference.message, reference.line, reference.column);
+        }
+    }
+    free(source);
+    return failures;
+}
+
+int main(void) {
+    static const int middle[] = { 150, 151, 300, 390 };
+    static const int ends[] = { 0, FUNCTION_COUNT - 1 };
+    static const int last[] = { FUNCTION_COUNT - 1 };
+
+    int failures = 0;
+    failures += run_case("没有错误", NULL, 0);
+    failures += run_case("多个函数体有错误", middle, 4);
+    failures += run_case("第一个和最后一个函数体有错误", ends, 2);
+    failures += run_case("只有最后一个函数体有错误", last, 1);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * 坤舆编程语言 - 服务模式测试
+ * 在子进程中运行服务，通过Unix域套接字发送请求，检查回复与预期的JSON完全相同：
+ * 同一个连接上连续发送的请求按顺序回复，每个请求从全新的全局作用域开始，
+ * 脚本修改后下一个请求使用新的内容，有语法错误的脚本修正后恢复正常
+ */
+
+#include "../includes/kunyu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define CONNECT_ATTEMPTS 500        // 等待服务启动时尝试连接的次数，每次间隔10毫秒
+
+static const char *SCRIPT_V1 =
+    "变量 倍数 = 2;\n"
+    "变量 次数 = 0;\n"
+    "函数 计算(x) {\n"
+    "    次数 = 次数 + 1;\n"
+    "    输出 \"计算 \" + x;\n"
+    "    返回 x * 倍数;\n"
+    "}\n"
+    "函数 第几次() {\n"
+    "    返回 次数;\n"
+    "}\n";
+
+static const char *SCRIPT_V2 =
+    "变量 倍数 = 3;\n"
+    "函数 计算(x) {\n"
+    "    输出 \"新版本 \" + x;\n"
+    "    变量 结果 = 创建列表();\n"
+    "    列表添加(结果, x);\n"
+    "    列表添加(结果, x * 倍数);\n"
+    "    返回 结果;\n"
+    "}\n";
+
+static const char *SCRIPT_BROKEN =
+    "函数 计算(x) {\n"
+    "    返回 x * ;\n"
+    "}\n";
+
+static int failures = 0;
+
+// 收到的数据中尚未作为回复返回的部分
+static char pending[65536];
+static size_t pending_length = 0;
+
+static bool write_file(const char *path, const char *content) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fputs(content, file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * 连接服务，服务尚未开始监听时重试
+ * @return 套接字，失败返回-1
+ */
+static int connect_server(const char *path) {
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+/**
+ * 读取一行回复（不含换行符）
+ * @return 连接关闭或出错时返回false
+ */
+static bool read_response(int fd, char *line, size_t size) {
+    for (;;) {
+        char *newline = memchr(pending, '\n', pending_length);
+        if (newline != NULL) {
+            size_t length = (size_t)(newline - pending);
+            snprintf(line, size, "%.*s", (int)length, pending);
+            pending_length -= length + 1;
+            memmove(pending, newline + 1, pending_length);
+            return true;
+        }
+        if (pending_length == sizeof(pending)) {
+            return false;
+        }
+        ssize_t received = recv(fd, pending + pending_length, sizeof(pending) - pending_length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        pending_length += (size_t)received;
+    }
+}
+
+/**
+ * 发送请求（可以是多行），然后依次检查每一行回复
+ */
+static void expect_responses(int fd, const char *name, const char *requests, const char **expected, int count) {
+    size_t length = strlen(requests);
+    if (send(fd, requests, length, 0) != (ssize_t)length) {
+        printf("失败: %s: 发送请求失败\n", name);
+        failures++;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        char line[4096];
+        if (!read_response(fd, line, sizeof(line))) {
+            printf("失败: %s: 没有收到第%d个回复\n", name, i + 1);
+            failures++;
+            return;
+        }
+        if (strcmp(line, expected[i]) != 0) {
+            printf("失败: %s: 第%d个回复\n  收到: %s\n  预期: %s\n", name, i + 1, line, expected[i]);
+            failures++;
+            return;
+        }
+    }
+    printf("通过: %s\n", name);
+}
+
+/**
+ * 按脚本路径生成请求
+ */
+static void format_request(char *buffer, size_t size, const char *script, const char *tail) {
+    snprintf(buffer, size, "{\"script\": \"%s\"%s}\n", script, tail);
+}
+
+int main(void) {
+    char directory[] = "/tmp/kunyu_serve_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        printf("失败: 无法创建临时目录\n");
+        return 1;
+    }
+    char socket_path[128], script[128];
+    snprintf(socket_path, sizeof(socket_path), "%s/服务.sock", directory);
+    snprintf(script, sizeof(script), "%s/脚本.kunyu", directory);
+    if (!write_file(script, SCRIPT_V1)) {
+        printf("失败: 无法写入脚本\n");
+        return 1;
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        printf("失败: fork失败\n");
+        return 1;
+    }
+    if (child == 0) {
+        // 服务的启动和停止信息不混入测试输出
+        if (freopen("/dev/null", "w", stderr) == NULL) {
+            _exit(1);
+        }
+        _exit(server_run(socket_path));
+    }
+
+    int fd = connect_server(socket_path);
+    if (fd < 0) {
+        printf("失败: 无法连接服务\n");
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+        return 1;
+    }
+
+    char request[1024], requests[2048];
+
+    // 两个请求一次发出，回复按顺序到达；全局变量次数在请求之间不保留
+    format_request(request, sizeof(request), script, ", \"function\": \"计算\", \"args\": [21]");
+    snprintf(requests, sizeof(requests), "%s%s", request, request);
+    const char *first[] = {
+        "{\"ok\":true,\"result\":42,\"output\":\"计算 21\\n\"}",
+        "{\"ok\":true,\"result\":42,\"output\":\"计算 21\\n\"}",
+    };
+    expect_responses(fd, "连续请求按顺序回复", requests, first, 2);
+
+    format_request(request, sizeof(request), script, ", \"function\": \"第几次\"");
+    const char *fresh[] = { "{\"ok\":true,\"result\":0,\"output\":\"\"}" };
+    expect_responses(fd, "每个请求从全新的全局作用域开始", request, fresh, 1);
+
+    format_request(request, sizeof(request), script, ", \"function\": \"不存在\"");
+    snprintf(requests, sizeof(requests), "%s{\"script\": 1}\n", request);
+    const char *errors[] = {
+        "{\"ok\":false,\"error\":\"运行时错误: 未定义的函数: 不存在 (行 0, 列 0)\",\"output\":\"\"}",
+        "{\"ok\":false,\"error\":\"请求缺少字符串字段\\\"script\\\"\",\"output\":\"\"}",
+    };
+    expect_responses(fd, "出错的请求不影响连接", requests, errors, 2);
+
+    // 修改脚本后下一个请求重新分析
+    if (!write_file(script, SCRIPT_V2)) {
+        printf("失败: 无法修改脚本\n");
+        failures++;
+    }
+    format_request(request, sizeof(request), script, ", \"function\": \"计算\", \"args\": [5]");
+    const char *reloaded[] = { "{\"ok\":true,\"result\":[5,15],\"output\":\"新版本 5\\n\"}" };
+    expect_responses(fd, "脚本修改后重新加载", request, reloaded, 1);
+
+    // 分析失败不缓存，修正后的下一个请求重新分析
+    if (!write_file(script, SCRIPT_BROKEN)) {
+        printf("失败: 无法修改脚本\n");
+        failures++;
+    }
+    const char *broken[] = {
+        "{\"ok\":false,\"error\":\"语法分析错误: 预期表达式但遇到了: ; (行 2, 列 16)\",\"output\":\"\"}",
+    };
+    expect_responses(fd, "脚本有语法错误", request, broken, 1);
+    if (!write_file(script, SCRIPT_V1)) {
+        printf("失败: 无法修改脚本\n");
+        failures++;
+    }
+    const char *fixed[] = { "{\"ok\":true,\"result\":10,\"output\":\"计算 5\\n\"}" };
+    expect_responses(fd, "修正语法错误后恢复", request, fixed, 1);
+
+    close(fd);
+    kill(child, SIGTERM);
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("失败: 服务没有正常退出\n");
+        failures++;
+    } else if (access(socket_path, F_OK) == 0) {
+        printf("失败: 服务退出后套接字文件仍然存在\n");
+        failures++;
+    } else {
+        printf("通过: 收到SIGTERM后正常退出\n");
+    }
+
+    unlink(script);
+    rmdir(directory);
+    return failures > 0 ? 1 : 0;
+}